@@ -5,8 +5,20 @@
  *         compatible = "st,mygpio";
  *         status = "okay";
  *         greenled-gpios = <&gpioa 14 0>;
+ *         bus-gpios = <&gpioa 0 0>, <&gpioa 1 0>, ...;	(optional)
  *     };
  *
+ * Waveform generator on GPIO bank A: MYGPIO_IOC_WAVE_START on /dev/mygpio
+ * loads a pattern (see mygpio_wave.h) played from an hrtimer, each edge is
+ * a single BSRR write. MYGPIO_IOC_WAVE_STATS returns the lateness of the
+ * edges and the number of missed deadlines (later than miss_ns, or in a
+ * whole period skipped because the timer came too late).
+ *
+ * MYGPIO_IOC_BUS_WRITE applies a stream of BSRR words, given by pointer or
+ * written in the buffer mapped by mmap(), all the pins of a word in one
+ * write. The bus pins must be on GPIOA. Patterns and words only drive the
+ * pins claimed here (greenled and bus), the other bits are dropped.
+ *
  *******************************************************************/
 
 #include <asm/io.h>
@@ -17,10 +29,34 @@
 #include <linux/delay.h>
 #include <linux/gpio/consumer.h>
 #include <linux/platform_device.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/gpio/driver.h>
+#include <linux/sched/signal.h>
+
+#include "mygpio_wave.h"
+
+/* gpiod_set_value()/gpiod_set_array_value() instead of BSRR writes */
+//#define USING_API
 
-#define USING_API
+#define GREENLED_PIN	14
+#define MYGPIO_BANK_LABEL	"GPIOA"	/* gpio_chip label of the bank mapped */
+#define MYGPIO_WAVE_START_NS	(100 * NSEC_PER_USEC)	/* first edge after START */
+
+static unsigned int miss_ns = 5000;
+module_param(miss_ns, uint, 0644);
+MODULE_PARM_DESC(miss_ns, "edges later than this are counted as missed");
 
 struct gpio_desc *red, *green;
+struct gpio_descs *bus;
+static u8 bus_pins[MYGPIO_BUS_MAX_PINS];	/* GPIOA pin of each bus gpio */
+static u32 out_mask;				/* pins claimed: greenled and bus */
 
 void __iomem * gpio_banka_base;
 #define GPIO_BANKA_BASE		0X50002000
@@ -40,21 +76,58 @@ void __iomem * rcc_base;
 #define RCC_MP_AHB4ENSETR	0xA28
 #define RCC_MP_AHB4ENCLRR	0xA2C
 
-static void mygpio_init(void)
+/* Pattern being played, steps and sched are protected by wave_lock */
+static struct hrtimer wave_timer;
+static DEFINE_SPINLOCK(wave_lock);
+static DEFINE_MUTEX(wave_mutex);	/* serializes START/STOP */
+static struct mygpio_wave_step *wave_steps;
+static struct mygpio_wave_sched wave_sched;
+
+/* MYGPIO_IOC_BUS_WRITE, serialized by bus_mutex */
+static DEFINE_MUTEX(bus_mutex);
+static u32 *bus_buf;		/* mmap() buffer */
+static u32 *bus_chunk;		/* words copied from a user pointer */
+#define MYGPIO_BUS_CHUNK_WORDS	(PAGE_SIZE / sizeof(u32))
+
+#ifdef USING_API
+static u32 out_state;		/* pin levels, protected by wave_lock */
+#endif
+
+static int mygpio_init(void)
 {
+	u32 val;
+
 	gpio_banka_base = ioremap(GPIO_BANKA_BASE, 0x3ff);
 	rcc_base = ioremap(RCC_BASE, 0xfff);
+	if (!gpio_banka_base || !rcc_base)
+		return -ENOMEM;
 
 	//Enable GPIOA clk
 	writel_relaxed(1 << 0, rcc_base + RCC_MP_AHB4ENSETR);
 
-	printk("RCC_MP_AHB4ENSETR: 0x%x\n", readl_relaxed(rcc_base + GPIO_MODER_OFFSET));
+	printk("RCC_MP_AHB4ENSETR: 0x%x\n", readl_relaxed(rcc_base + RCC_MP_AHB4ENSETR));
 
-	writel_relaxed(1 << 28, gpio_banka_base + GPIO_MODER_OFFSET); //PA14 Output
-	writel_relaxed(1 << 28, gpio_banka_base + GPIO_SPEEDR_OFFSET); //PA14 Medium speed
+	//PA14 Output, Medium speed, other pins untouched
+	val = readl_relaxed(gpio_banka_base + GPIO_MODER_OFFSET);
+	val = (val & ~(3 << 28)) | 1 << 28;
+	writel_relaxed(val, gpio_banka_base + GPIO_MODER_OFFSET);
+	val = readl_relaxed(gpio_banka_base + GPIO_SPEEDR_OFFSET);
+	val = (val & ~(3 << 28)) | 1 << 28;
+	writel_relaxed(val, gpio_banka_base + GPIO_SPEEDR_OFFSET);
 
 	printk("GPIOA MODER: 0x%x\n", readl_relaxed(gpio_banka_base + GPIO_MODER_OFFSET));
 	printk("GPIOA SPPEEDR: 0x%x\n", readl_relaxed(gpio_banka_base + GPIO_SPEEDR_OFFSET));
+	return 0;
+}
+
+static void mygpio_exit(void)
+{
+	if (gpio_banka_base)
+		iounmap(gpio_banka_base);
+	if (rcc_base)
+		iounmap(rcc_base);
+	gpio_banka_base = NULL;
+	rcc_base = NULL;
 }
 
 static void mygpio_set_value(int value)
@@ -67,45 +140,324 @@ static void mygpio_set_value(int value)
 	//writel_relaxed(value << 14, gpio_banka_base + GPIO_ODR_OFFSET); //PA14 output value
 }
 
-static int gpio_init_probe(struct platform_device *pdev)
+/* Called with wave_lock held in USING_API mode */
+static void mygpio_write_bsrr(void *ctx, u32 bsrr)
 {
-	int i = 0;
+#ifdef USING_API //using gpio consumer interface
+	unsigned long values;
 
-	printk("GPIO example init\n");
+	out_state = mygpio_bus_apply(out_state, bsrr);
+	if (bsrr & (0x10001 << GREENLED_PIN))
+		gpiod_set_value(green, !!(out_state & 1 << GREENLED_PIN));
+	if (bus && (bsrr & (out_mask | out_mask << 16) & ~(0x10001 << GREENLED_PIN))) {
+		values = mygpio_bus_to_array(out_state, bus_pins, bus->ndescs);
+		gpiod_set_array_value(bus->ndescs, bus->desc, bus->info, &values);
+	}
+#else
+	writel_relaxed(bsrr, gpio_banka_base + GPIO_BSRR_OFFSET);
+#endif
+}
 
+static void mygpio_bus_write_words(const u32 *words, u32 nb_words)
+{
+	u32 i, mask = out_mask;
 #ifdef USING_API
-	green = devm_gpiod_get(&pdev->dev, "greenled", GPIOD_OUT_LOW);
+	unsigned long flags;
+
+	for (i = 0; i < nb_words; i++) {
+		spin_lock_irqsave(&wave_lock, flags);
+		mygpio_write_bsrr(NULL, mygpio_bus_filter(words[i], mask));
+		spin_unlock_irqrestore(&wave_lock, flags);
+	}
 #else
-	mygpio_init();
+	/* BSRR writes are atomic, no lock against the waveform timer */
+	for (i = 0; i < nb_words; i++)
+		writel_relaxed(mygpio_bus_filter(READ_ONCE(words[i]), mask),
+			       gpio_banka_base + GPIO_BSRR_OFFSET);
 #endif
+}
+
+/* Called with bus_mutex held */
+static int mygpio_bus_write(const struct mygpio_bus *req)
+{
+	const u32 __user *uwords = u64_to_user_ptr(req->words);
+	u32 done, n;
+
+	if (!req->words) {
+		if (req->offset > MYGPIO_BUS_BUF_WORDS ||
+		    req->nb_words > MYGPIO_BUS_BUF_WORDS - req->offset)
+			return -EINVAL;
+		mygpio_bus_write_words(bus_buf + req->offset, req->nb_words);
+		return 0;
+	}
+
+	for (done = 0; done < req->nb_words; done += n) {
+		n = min_t(u32, req->nb_words - done, MYGPIO_BUS_CHUNK_WORDS);
+		if (copy_from_user(bus_chunk, uwords + done, n * sizeof(u32)))
+			return -EFAULT;
+		mygpio_bus_write_words(bus_chunk, n);
+		if (fatal_signal_pending(current))
+			return -EINTR;
+	}
+	return 0;
+}
+
+static enum hrtimer_restart mygpio_wave_timer(struct hrtimer *timer)
+{
+	unsigned long flags;
+	u64 next;
+
+	spin_lock_irqsave(&wave_lock, flags);
+	next = mygpio_wave_sched_run(&wave_sched, ktime_get_ns(), mygpio_write_bsrr, NULL);
+	spin_unlock_irqrestore(&wave_lock, flags);
+
+	if (!next)
+		return HRTIMER_NORESTART;
+
+	hrtimer_set_expires(timer, ns_to_ktime(next));
+	return HRTIMER_RESTART;
+}
+
+/* Called with wave_mutex held */
+static void mygpio_wave_stop(void)
+{
+	unsigned long flags;
+
+	hrtimer_cancel(&wave_timer);
+
+	spin_lock_irqsave(&wave_lock, flags);
+	wave_sched.stats.running = 0;
+	spin_unlock_irqrestore(&wave_lock, flags);
+}
+
+/* Called with wave_mutex held */
+static int mygpio_wave_start(const struct mygpio_wave *wave)
+{
+	struct mygpio_edge *edges;
+	struct mygpio_wave_step *steps;
+	unsigned long flags;
+	u64 start;
+	int n;
+
+	if (!wave->nb_edges || wave->nb_edges > MYGPIO_WAVE_MAX_EDGES)
+		return -EINVAL;
+	if (wave->mask & ~out_mask)
+		return -EPERM;
+
+	edges = vmemdup_user(u64_to_user_ptr(wave->edges),
+			     wave->nb_edges * sizeof(*edges));
+	if (IS_ERR(edges))
+		return PTR_ERR(edges);
+
+	steps = kvmalloc_array(wave->nb_edges, sizeof(*steps), GFP_KERNEL);
+	if (!steps) {
+		kvfree(edges);
+		return -ENOMEM;
+	}
 
-	while(i < 100)
-	{
-	#ifdef USING_API //using gpio consumer interface
-		udelay(1);
-		gpiod_set_value(green, 1);
+	n = mygpio_wave_compile(edges, wave->nb_edges, wave->mask,
+				wave->period_ns, wave->repeat, steps);
+	kvfree(edges);
+	if (n < 0) {
+		kvfree(steps);
+		return n;
+	}
+
+	mygpio_wave_stop();
+	kvfree(wave_steps);
+	wave_steps = steps;
+
+	start = ktime_get_ns() + MYGPIO_WAVE_START_NS;
+	spin_lock_irqsave(&wave_lock, flags);
+	mygpio_wave_sched_init(&wave_sched, steps, n, wave->period_ns,
+			       wave->repeat, READ_ONCE(miss_ns), start);
+	spin_unlock_irqrestore(&wave_lock, flags);
+
+	hrtimer_start(&wave_timer, ns_to_ktime(mygpio_wave_sched_deadline(&wave_sched)),
+		      HRTIMER_MODE_ABS);
+	return 0;
+}
+
+static long mygpio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	void __user *uarg = (void __user *)arg;
+	struct mygpio_wave_stats stats;
+	struct mygpio_wave wave;
+	struct mygpio_bus req;
+	unsigned long flags;
+	int ret = 0;
+
+	switch (cmd) {
+	case MYGPIO_IOC_WAVE_START:
+		if (copy_from_user(&wave, uarg, sizeof(wave)))
+			return -EFAULT;
+		mutex_lock(&wave_mutex);
+		ret = mygpio_wave_start(&wave);
+		mutex_unlock(&wave_mutex);
+		break;
+
+	case MYGPIO_IOC_WAVE_STOP:
+		mutex_lock(&wave_mutex);
+		mygpio_wave_stop();
+		mutex_unlock(&wave_mutex);
+		break;
+
+	case MYGPIO_IOC_WAVE_STATS:
+		spin_lock_irqsave(&wave_lock, flags);
+		stats = wave_sched.stats;
+		spin_unlock_irqrestore(&wave_lock, flags);
+		if (copy_to_user(uarg, &stats, sizeof(stats)))
+			return -EFAULT;
+		break;
+
+	case MYGPIO_IOC_BUS_WRITE:
+		if (copy_from_user(&req, uarg, sizeof(req)))
+			return -EFAULT;
+		if (mutex_lock_interruptible(&bus_mutex))
+			return -ERESTARTSYS;
+		ret = mygpio_bus_write(&req);
+		mutex_unlock(&bus_mutex);
+		break;
+
+	case MYGPIO_IOC_BUS_MASK:
+		if (put_user(out_mask, (u32 __user *)uarg))
+			return -EFAULT;
+		break;
 
-		udelay(1);
-		gpiod_set_value(green, 0);
-	#else
-		udelay(1);
-		mygpio_set_value(1);
+	default:
+		ret = -ENOTTY;
+	}
+
+	return ret;
+}
 
-		udelay(1);
-		mygpio_set_value(0);
+static int mygpio_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_ALIGN(MYGPIO_BUS_BUF_WORDS * sizeof(u32)))
+		return -EINVAL;
 
-	#endif
+	return remap_vmalloc_range(vma, bus_buf, 0);
+}
+
+static const struct file_operations mygpio_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = mygpio_ioctl,
+	.mmap = mygpio_mmap,
+	.llseek = noop_llseek,
+};
 
-		i = 0;
+static struct miscdevice mygpio_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "mygpio",
+	.fops = &mygpio_fops,
+};
+
+/*
+ * GPIOA pin of a descriptor, -EINVAL if it is on another bank: the words
+ * are written to the GPIOA BSRR, the offset alone would drive the pin of
+ * the same number on GPIOA instead.
+ */
+static int mygpio_bank_pin(struct gpio_desc *desc)
+{
+	struct gpio_chip *chip = gpiod_to_chip(desc);
+
+	if (!chip || !chip->label || strcmp(chip->label, MYGPIO_BANK_LABEL)) {
+		printk("GPIO %d is not on %s\n", desc_to_gpio(desc), MYGPIO_BANK_LABEL);
+		return -EINVAL;
 	}
+	return desc_to_gpio(desc) - chip->base;
+}
 
+static int mygpio_bus_init(struct device *dev)
+{
+	unsigned int i;
+	int pin;
+
+	bus = devm_gpiod_get_array_optional(dev, "bus", GPIOD_OUT_LOW);
+	if (IS_ERR(bus))
+		return PTR_ERR(bus);
+
+	for (i = 0; bus && i < bus->ndescs; i++) {
+		pin = mygpio_bank_pin(bus->desc[i]);
+		if (pin < 0)
+			return pin;
+		if (i >= MYGPIO_BUS_MAX_PINS || pin > 15 || pin == GREENLED_PIN)
+			return -EINVAL;
+		bus_pins[i] = pin;
+		out_mask |= 1 << pin;
+	}
+	printk("GPIO bus: %u pins, mask 0x%04x\n", bus ? bus->ndescs : 0, out_mask);
+
+	bus_buf = vmalloc_user(MYGPIO_BUS_BUF_WORDS * sizeof(u32));
+	bus_chunk = devm_kmalloc(dev, PAGE_SIZE, GFP_KERNEL);
+	if (!bus_buf || !bus_chunk) {
+		vfree(bus_buf);
+		bus_buf = NULL;
+		return -ENOMEM;
+	}
 	return 0;
 }
 
+static int gpio_init_probe(struct platform_device *pdev)
+{
+	int ret;
+
+	printk("GPIO example init\n");
+
+	/* claims PA14 and drives it low */
+	green = devm_gpiod_get(&pdev->dev, "greenled", GPIOD_OUT_LOW);
+	if (IS_ERR(green)) {
+		printk("Could not get greenled gpio!\n");
+		return PTR_ERR(green);
+	}
+	out_mask = 1 << GREENLED_PIN;
+
+	ret = mygpio_bus_init(&pdev->dev);
+	if (ret) {
+		printk("Could not get bus gpios!\n");
+		return ret;
+	}
+
+	ret = mygpio_init();
+	if (ret) {
+		printk("Could not map GPIOA!\n");
+		goto err;
+	}
+	mygpio_set_value(0);
+
+	hrtimer_init(&wave_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	wave_timer.function = mygpio_wave_timer;
+
+	mygpio_misc.parent = &pdev->dev;
+	ret = misc_register(&mygpio_misc);
+	if (ret) {
+		printk("Could not register /dev/mygpio!\n");
+		goto err;
+	}
+
+	return 0;
+
+err:
+	mygpio_exit();
+	vfree(bus_buf);
+	bus_buf = NULL;
+	return ret;
+}
+
 static int gpio_exit_remove(struct platform_device * pdev)
 {
 	printk("GPIO example exit\n");
 
+	misc_deregister(&mygpio_misc);
+	mutex_lock(&wave_mutex);
+	mygpio_wave_stop();
+	kvfree(wave_steps);
+	wave_steps = NULL;
+	mutex_unlock(&wave_mutex);
+	mygpio_exit();
+	vfree(bus_buf);
+	bus_buf = NULL;
+
 	return 0;
 }
 
@@ -0,0 +1,344 @@
+/*******************************************************************
+ *
+ * Waveform engine of mygpio: pattern compiler and scheduler, and the
+ * bus words of MYGPIO_IOC_BUS_WRITE.
+ *
+ * A pattern is a list of edges (time from the start of the pattern,
+ * level of the pins) compiled into BSRR words: one register write
+ * updates all the pins of an edge. The scheduler plays the steps whose
+ * deadline has passed and returns the next deadline; the driver calls
+ * it from an hrtimer. It only depends on the clock given by the caller
+ * so it can be built and run on a host with a fake clock.
+ *
+ *******************************************************************/
+
+#ifndef MYGPIO_WAVE_H
+#define MYGPIO_WAVE_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/ioctl.h>
+#include <linux/math64.h>
+#else
+#include <stdint.h>
+#include <errno.h>
+#include <linux/types.h>
+#include <sys/ioctl.h>
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+#endif
+
+/* ioctl interface, also used by 1_userland_app/mygpio_app */
+struct mygpio_edge {
+	__u32 t_ns;		/* from the start of the pattern */
+	__u32 value;		/* pin levels, bit n = pin n of the bank */
+};
+
+struct mygpio_wave {
+	__u64 edges;		/* user pointer to struct mygpio_edge[] */
+	__u32 nb_edges;
+	__u32 mask;		/* pins driven by the pattern */
+	__u32 period_ns;	/* pattern length, needed to repeat it */
+	__u32 repeat;		/* number of periods, 0: until stopped */
+};
+
+#define MYGPIO_JITTER_BINS	16	/* bin 0: < 1us, bin n: [2^(n-1), 2^n) us */
+
+struct mygpio_wave_stats {
+	__u64 steps;		/* BSRR writes done */
+	__u64 missed;		/* steps later than the miss_ns limit or skipped */
+	__u64 late_sum_ns;
+	__u32 late_min_ns;
+	__u32 late_max_ns;
+	__u32 loops;		/* periods completed */
+	__u32 running;
+	__u32 hist[MYGPIO_JITTER_BINS];
+};
+
+#define MYGPIO_IOC_WAVE_START	_IOW('G', 0x00, struct mygpio_wave)
+#define MYGPIO_IOC_WAVE_STOP	_IO('G', 0x01)
+#define MYGPIO_IOC_WAVE_STATS	_IOR('G', 0x02, struct mygpio_wave_stats)
+
+/*
+ * Stream of BSRR words (bits 0-15 set, 16-31 reset the pins), each one
+ * applied in a single write. With words = 0 they are read from the
+ * buffer mapped by mmap() on /dev/mygpio, starting at word offset.
+ */
+struct mygpio_bus {
+	__u64 words;		/* user pointer to __u32[], or 0: mmap buffer */
+	__u32 nb_words;
+	__u32 offset;
+};
+
+#define MYGPIO_IOC_BUS_WRITE	_IOW('G', 0x03, struct mygpio_bus)
+#define MYGPIO_IOC_BUS_MASK	_IOR('G', 0x04, __u32)	/* pins words may drive */
+
+#define MYGPIO_BUS_BUF_WORDS	16384	/* size of the mmap buffer */
+#define MYGPIO_BUS_MAX_PINS	16
+
+#define MYGPIO_WAVE_MAX_EDGES	4096
+#define MYGPIO_WAVE_MIN_NS	5000	/* shortest period and step spacing */
+
+struct mygpio_wave_step {
+	u32 t_ns;
+	u32 bsrr;
+};
+
+struct mygpio_wave_sched {
+	const struct mygpio_wave_step *steps;
+	u32 nb_steps;
+	u32 period_ns;
+	u32 repeat;
+	u32 miss_ns;
+	u32 idx;
+	u64 base_ns;		/* start of the current period */
+	struct mygpio_wave_stats stats;
+};
+
+static inline u32 mygpio_wave_bsrr(u32 value, u32 mask)
+{
+	return (value & mask) | (~value & mask) << 16;
+}
+
+/*
+ * Compile edges into steps (steps must hold nb_edges entries). Edges at
+ * the same time are merged, the last one wins; edges that do not change
+ * the pins are dropped. The steps, and the last and first ones across
+ * the period, must be at least MYGPIO_WAVE_MIN_NS apart: each one costs
+ * a timer IRQ.
+ * Returns the number of steps or -EINVAL.
+ */
+static inline int mygpio_wave_compile(const struct mygpio_edge *edges, u32 nb_edges,
+				      u32 mask, u32 period_ns, u32 repeat,
+				      struct mygpio_wave_step *steps)
+{
+	u32 i, bsrr;
+	int n = 0;
+
+	if (!nb_edges || !mask || (mask & 0xffff0000))
+		return -EINVAL;
+	if (repeat != 1 && !period_ns)
+		return -EINVAL;
+	if (period_ns && period_ns < MYGPIO_WAVE_MIN_NS)
+		return -EINVAL;
+
+	for (i = 0; i < nb_edges; i++) {
+		if (i && edges[i].t_ns < edges[i - 1].t_ns)
+			return -EINVAL;
+		if (period_ns && edges[i].t_ns >= period_ns)
+			return -EINVAL;
+
+		bsrr = mygpio_wave_bsrr(edges[i].value, mask);
+		if (n && steps[n - 1].t_ns == edges[i].t_ns) {
+			steps[n - 1].bsrr = bsrr;
+			continue;
+		}
+		if (n && steps[n - 1].bsrr == bsrr)
+			continue;
+		if (n && edges[i].t_ns - steps[n - 1].t_ns < MYGPIO_WAVE_MIN_NS)
+			return -EINVAL;
+		steps[n].t_ns = edges[i].t_ns;
+		steps[n].bsrr = bsrr;
+		n++;
+	}
+	if (repeat != 1 && n > 1 &&
+	    period_ns - steps[n - 1].t_ns + steps[0].t_ns < MYGPIO_WAVE_MIN_NS)
+		return -EINVAL;
+	return n;
+}
+
+static inline void mygpio_wave_sched_init(struct mygpio_wave_sched *s,
+					  const struct mygpio_wave_step *steps, u32 nb_steps,
+					  u32 period_ns, u32 repeat, u32 miss_ns, u64 start_ns)
+{
+	u32 i;
+
+	s->steps = steps;
+	s->nb_steps = nb_steps;
+	s->period_ns = period_ns;
+	s->repeat = repeat;
+	s->miss_ns = miss_ns;
+	s->idx = 0;
+	s->base_ns = start_ns;
+
+	s->stats.steps = 0;
+	s->stats.missed = 0;
+	s->stats.late_sum_ns = 0;
+	s->stats.late_min_ns = ~0u;
+	s->stats.late_max_ns = 0;
+	s->stats.loops = 0;
+	s->stats.running = nb_steps != 0;
+	for (i = 0; i < MYGPIO_JITTER_BINS; i++)
+		s->stats.hist[i] = 0;
+}
+
+static inline u64 mygpio_wave_sched_deadline(const struct mygpio_wave_sched *s)
+{
+	return s->base_ns + s->steps[s->idx].t_ns;
+}
+
+static inline void mygpio_wave_account(struct mygpio_wave_stats *st, u64 late, u32 miss_ns)
+{
+	u32 us = div_u64(late, 1000), bin = 0;
+
+	while (us && bin < MYGPIO_JITTER_BINS - 1) {
+		us >>= 1;
+		bin++;
+	}
+	st->hist[bin]++;
+	st->steps++;
+	st->late_sum_ns += late;
+	if (late < st->late_min_ns)
+		st->late_min_ns = late;
+	if (late > st->late_max_ns)
+		st->late_max_ns = late > ~0u ? ~0u : late;
+	if (late > miss_ns)
+		st->missed++;
+}
+
+/*
+ * At the start of a period already over at "now": the whole periods
+ * before the one of "now" are counted as missed instead of being played,
+ * the pins take the level of the last step and the pattern goes on in
+ * the period of "now", or stops if the repeat count is reached.
+ * Returns 0 once the pattern is over.
+ */
+static inline u32 mygpio_wave_sched_skip(struct mygpio_wave_sched *s, u64 now,
+					 void (*write)(void *ctx, u32 bsrr), void *ctx)
+{
+	u64 periods = div_u64(now - s->base_ns, s->period_ns);
+
+	if (s->repeat && s->stats.loops + periods >= s->repeat)
+		periods = s->repeat - s->stats.loops;
+
+	write(ctx, s->steps[s->nb_steps - 1].bsrr);
+	s->stats.missed += periods * s->nb_steps;
+	s->stats.loops += periods;
+	s->base_ns += periods * s->period_ns;
+	if (s->repeat && s->stats.loops >= s->repeat)
+		s->stats.running = 0;
+
+	return s->stats.running;
+}
+
+/*
+ * Play the steps due at "now" with write(ctx, bsrr). Late steps are
+ * played back to back and counted as missed beyond miss_ns, but whole
+ * periods late are skipped: one call plays at most the end of the
+ * current period and the start of the period of "now", however late the
+ * timer.
+ * Returns the deadline of the next step, 0 once the pattern is over.
+ */
+static inline u64 mygpio_wave_sched_run(struct mygpio_wave_sched *s, u64 now,
+					void (*write)(void *ctx, u32 bsrr), void *ctx)
+{
+	u64 deadline;
+
+	if (!s->stats.running)
+		return 0;
+
+	while ((deadline = mygpio_wave_sched_deadline(s)) <= now) {
+		if (!s->idx && s->period_ns && now - s->base_ns >= s->period_ns) {
+			if (!mygpio_wave_sched_skip(s, now, write, ctx))
+				return 0;
+			continue;
+		}
+
+		write(ctx, s->steps[s->idx].bsrr);
+		mygpio_wave_account(&s->stats, now - deadline, s->miss_ns);
+
+		if (++s->idx < s->nb_steps)
+			continue;
+
+		s->idx = 0;
+		s->base_ns += s->period_ns;
+		s->stats.loops++;
+		if (s->repeat && s->stats.loops >= s->repeat) {
+			s->stats.running = 0;
+			return 0;
+		}
+	}
+	return deadline;
+}
+
+/*
+ * Bus words. pins[i] is the pin driven by bit i of a bus value; the
+ * lookup table turns a value into a word with two loads instead of one
+ * test per pin.
+ */
+struct mygpio_bus_lut {
+	u32 mask;		/* all the pins of the bus */
+	u32 set[2][256];	/* pins set by the low and high byte */
+};
+
+static inline u32 mygpio_bus_word(u32 value, const u8 *pins, u32 nb_pins)
+{
+	u32 i, set = 0, clr = 0;
+
+	for (i = 0; i < nb_pins; i++) {
+		if (value >> i & 1)
+			set |= 1 << pins[i];
+		else
+			clr |= 1 << pins[i];
+	}
+	return set | clr << 16;
+}
+
+static inline void mygpio_bus_lut_init(struct mygpio_bus_lut *lut, const u8 *pins, u32 nb_pins)
+{
+	u32 v, i;
+
+	lut->mask = 0;
+	for (i = 0; i < nb_pins; i++)
+		lut->mask |= 1 << pins[i];
+
+	for (v = 0; v < 256; v++) {
+		lut->set[0][v] = 0;
+		lut->set[1][v] = 0;
+		for (i = 0; i < nb_pins; i++) {
+			if (i < 8 && (v >> i & 1))
+				lut->set[0][v] |= 1 << pins[i];
+			if (i >= 8 && (v >> (i - 8) & 1))
+				lut->set[1][v] |= 1 << pins[i];
+		}
+	}
+}
+
+static inline u32 mygpio_bus_lut_word(const struct mygpio_bus_lut *lut, u32 value)
+{
+	u32 set = lut->set[0][value & 0xff] | lut->set[1][value >> 8 & 0xff];
+
+	return set | (lut->mask & ~set) << 16;
+}
+
+/* Drop the bits of the pins outside mask */
+static inline u32 mygpio_bus_filter(u32 word, u32 mask)
+{
+	return word & (mask | mask << 16);
+}
+
+/* Pin levels after writing word to BSRR, set wins over reset */
+static inline u32 mygpio_bus_apply(u32 state, u32 word)
+{
+	return ((state & ~(word >> 16)) | word) & 0xffff;
+}
+
+/* Levels of pins[] as the bitmap of gpiod_set_array_value() */
+static inline unsigned long mygpio_bus_to_array(u32 state, const u8 *pins, u32 nb_pins)
+{
+	unsigned long bitmap = 0;
+	u32 i;
+
+	for (i = 0; i < nb_pins; i++)
+		bitmap |= (unsigned long)(state >> pins[i] & 1) << i;
+	return bitmap;
+}
+
+#endif /* MYGPIO_WAVE_H */
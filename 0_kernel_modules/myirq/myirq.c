@@ -8,6 +8,18 @@
  *         interrupts = <14 IRQ_TYPE_LEVEL_LOW>;
  *     };
  *
+ * The hard IRQ handler only timestamps the IRQ into a kfifo, the IRQ
+ * thread moves the timestamps to the event fifo read through /dev/myirq:
+ * read() returns as many struct myirq_event as fit in the buffer, poll()
+ * reports POLLIN when events are pending.
+ *
+ * IRQs less than coalesce_us after the first one of an event are merged in
+ * it (count > 1), see myirq_coalesce.h. The counters are in
+ * /sys/class/misc/myirq/.
+ *
+ * The device is freed with its last reference: an open file keeps it
+ * after the unbind, read() and poll() then fail with ENODEV / POLLERR.
+ *
  *******************************************************************/
 
 #include <asm/io.h>
@@ -19,20 +31,220 @@
 #include <linux/gpio/consumer.h>
 #include <linux/platform_device.h>
 #include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/hrtimer.h>
+#include <linux/kref.h>
+#include <linux/slab.h>
 
-static int myirq_irq;
-static irqreturn_t myirq_handler(int irq, void *dev);
+#include "myirq_coalesce.h"
 
+#define MYIRQ_RAW_FIFO_SIZE	64	/* hard IRQ -> thread, power of 2 */
+#define MYIRQ_EVT_FIFO_SIZE	1024	/* thread -> read(), power of 2 */
 
-static irqreturn_t myirq_handler(int irq, void *dev)
+static unsigned int coalesce_us;
+module_param(coalesce_us, uint, 0644);
+MODULE_PARM_DESC(coalesce_us, "merge the IRQs of this window in one event (0: off)");
+
+struct myirq_dev {
+	struct miscdevice misc;
+	int irq;
+	struct kref ref;	/* probe and each open file */
+	bool gone;		/* removed, the readers fail */
+
+	/* written by the hard IRQ handler only */
+	DECLARE_KFIFO(raw, struct myirq_event, MYIRQ_RAW_FIFO_SIZE);
+	u32 nb_irq;
+	u32 raw_dropped;
+
+	/*
+	 * producers (IRQ thread, coalescing timer) serialized by lock, the
+	 * timer is a softirq one so spin_lock_bh() in the thread is enough
+	 */
+	spinlock_t lock;
+	DECLARE_KFIFO(evt, struct myirq_event, MYIRQ_EVT_FIFO_SIZE);
+	struct myirq_coal_t coal;
+	struct hrtimer timer;
+	u32 nb_evt;
+	u32 evt_dropped;
+
+	/* consumer */
+	struct mutex read_lock;
+	wait_queue_head_t wq;
+};
+
+static irqreturn_t myirq_handler(int irq, void *data)
+{
+	struct myirq_dev *dev = data;
+	struct myirq_event raw = {
+		.ts_ns = ktime_get_ns(),
+		.seq = dev->nb_irq++,
+		.count = 1,
+	};
+
+	if (!kfifo_put(&dev->raw, raw))
+		dev->raw_dropped++;
+
+	return IRQ_WAKE_THREAD;
+}
+
+/* Called with dev->lock held */
+static void myirq_push_event(struct myirq_dev *dev, const struct myirq_event *evt)
 {
-	printk("myirq handler!\n");
+	if (kfifo_put(&dev->evt, *evt))
+		dev->nb_evt++;
+	else
+		dev->evt_dropped += evt->count;
+}
+
+static irqreturn_t myirq_thread(int irq, void *data)
+{
+	struct myirq_dev *dev = data;
+	struct myirq_event raw, evt;
+
+	spin_lock_bh(&dev->lock);
+	dev->coal.window_ns = (u64)READ_ONCE(coalesce_us) * NSEC_PER_USEC;
+	while (kfifo_get(&dev->raw, &raw)) {
+		if (myirq_coal_add(&dev->coal, &raw, &evt))
+			myirq_push_event(dev, &evt);
+	}
+
+	/* keep the event open until the end of its window */
+	if (dev->coal.window_ns && dev->coal.has_pending)
+		hrtimer_start(&dev->timer, ns_to_ktime(myirq_coal_deadline(&dev->coal)),
+			      HRTIMER_MODE_ABS_SOFT);
+	else if (myirq_coal_flush(&dev->coal, &evt))
+		myirq_push_event(dev, &evt);
+	spin_unlock_bh(&dev->lock);
+
+	if (!kfifo_is_empty(&dev->evt))
+		wake_up_interruptible(&dev->wq);
+
 	return IRQ_HANDLED;
 }
 
+static enum hrtimer_restart myirq_timer(struct hrtimer *timer)
+{
+	struct myirq_dev *dev = container_of(timer, struct myirq_dev, timer);
+	struct myirq_event evt;
+
+	/* softirq context, the thread holds the lock with BHs off */
+	spin_lock(&dev->lock);
+	if (myirq_coal_flush(&dev->coal, &evt))
+		myirq_push_event(dev, &evt);
+	spin_unlock(&dev->lock);
+
+	wake_up_interruptible(&dev->wq);
+	return HRTIMER_NORESTART;
+}
+
+static void myirq_free(struct kref *ref)
+{
+	kfree(container_of(ref, struct myirq_dev, ref));
+}
+
+static int myirq_open(struct inode *inode, struct file *file)
+{
+	/* misc_open() runs under misc_mtx: the device is not deregistered yet */
+	struct myirq_dev *dev = container_of(file->private_data, struct myirq_dev, misc);
+
+	kref_get(&dev->ref);
+	return 0;
+}
+
+static int myirq_release(struct inode *inode, struct file *file)
+{
+	struct myirq_dev *dev = container_of(file->private_data, struct myirq_dev, misc);
+
+	kref_put(&dev->ref, myirq_free);
+	return 0;
+}
+
+static ssize_t myirq_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct myirq_dev *dev = container_of(file->private_data, struct myirq_dev, misc);
+	unsigned int copied;
+	int ret;
+
+	count = rounddown(count, sizeof(struct myirq_event));
+	if (!count)
+		return -EINVAL;
+
+	do {
+		if (READ_ONCE(dev->gone))
+			return -ENODEV;
+		if (kfifo_is_empty(&dev->evt)) {
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			ret = wait_event_interruptible(dev->wq, !kfifo_is_empty(&dev->evt) ||
+						       READ_ONCE(dev->gone));
+			if (ret)
+				return ret;
+			if (READ_ONCE(dev->gone))
+				return -ENODEV;
+		}
+
+		if (mutex_lock_interruptible(&dev->read_lock))
+			return -ERESTARTSYS;
+		ret = kfifo_to_user(&dev->evt, buf, count, &copied);
+		mutex_unlock(&dev->read_lock);
+		if (ret)
+			return ret;
+	} while (!copied);
+
+	return copied;
+}
+
+static __poll_t myirq_poll(struct file *file, poll_table *wait)
+{
+	struct myirq_dev *dev = container_of(file->private_data, struct myirq_dev, misc);
+
+	poll_wait(file, &dev->wq, wait);
+	if (READ_ONCE(dev->gone))
+		return EPOLLERR | EPOLLHUP;
+	return kfifo_is_empty(&dev->evt) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+static const struct file_operations myirq_fops = {
+	.owner = THIS_MODULE,
+	.open = myirq_open,
+	.release = myirq_release,
+	.read = myirq_read,
+	.poll = myirq_poll,
+	.llseek = noop_llseek,
+};
+
+#define MYIRQ_COUNTER_ATTR(_name, _field) \
+static ssize_t _name##_show(struct device *d, struct device_attribute *attr, char *buf) \
+{ \
+	struct miscdevice *misc = dev_get_drvdata(d); \
+	struct myirq_dev *dev = container_of(misc, struct myirq_dev, misc); \
+	return sprintf(buf, "%u\n", READ_ONCE(dev->_field)); \
+} \
+static DEVICE_ATTR_RO(_name)
+
+MYIRQ_COUNTER_ATTR(irq_count, nb_irq);
+MYIRQ_COUNTER_ATTR(event_count, nb_evt);
+MYIRQ_COUNTER_ATTR(coalesced, coal.coalesced);
+MYIRQ_COUNTER_ATTR(irq_dropped, raw_dropped);
+MYIRQ_COUNTER_ATTR(event_dropped, evt_dropped);
+
+static struct attribute *myirq_attrs[] = {
+	&dev_attr_irq_count.attr,
+	&dev_attr_event_count.attr,
+	&dev_attr_coalesced.attr,
+	&dev_attr_irq_dropped.attr,
+	&dev_attr_event_dropped.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(myirq);
+
 static int myirq_init_probe(struct platform_device *pdev)
 {
-	int i = 0, ret;
+	struct myirq_dev *dev;
+	int ret;
 	int irq;
 
 	printk("GPIO IRQ init\n");
@@ -43,17 +255,62 @@ static int myirq_init_probe(struct platform_device *pdev)
 		return irq;
 	}
 
+	/* not devm: an open file may outlive the unbind */
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (!dev)
+		return -ENOMEM;
+	kref_init(&dev->ref);
+
+	INIT_KFIFO(dev->raw);
+	INIT_KFIFO(dev->evt);
+	spin_lock_init(&dev->lock);
+	mutex_init(&dev->read_lock);
+	init_waitqueue_head(&dev->wq);
+	myirq_coal_reset(&dev->coal);
+	hrtimer_init(&dev->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+	dev->timer.function = myirq_timer;
+	dev->irq = irq;
+
+	dev->misc.minor = MISC_DYNAMIC_MINOR;
+	dev->misc.name = "myirq";
+	dev->misc.fops = &myirq_fops;
+	dev->misc.groups = myirq_groups;
+	dev->misc.parent = &pdev->dev;
+	ret = misc_register(&dev->misc);
+	if (ret) {
+		printk("Could not register /dev/myirq!\n");
+		kref_put(&dev->ref, myirq_free);
+		return ret;
+	}
+
 	printk("GPIO IRQ: %d\n", irq);
-	myirq_irq = irq;
-	ret = request_irq(irq, myirq_handler, IRQF_TRIGGER_LOW | IRQF_ONESHOT, "myirq", NULL);
+	/* ONESHOT keeps the level IRQ masked until the thread has run */
+	ret = request_threaded_irq(irq, myirq_handler, myirq_thread,
+				   IRQF_TRIGGER_LOW | IRQF_ONESHOT, "myirq", dev);
+	if (ret) {
+		printk("Could not request irq %d!\n", irq);
+		misc_deregister(&dev->misc);
+		kref_put(&dev->ref, myirq_free);
+		return ret;
+	}
 
+	platform_set_drvdata(pdev, dev);
 	return 0;
 }
 
 static int myirq_exit_remove(struct platform_device * pdev)
 {
+	struct myirq_dev *dev = platform_get_drvdata(pdev);
+
 	printk("GPIO IRQ exit\n");
-	free_irq(myirq_irq, NULL);
+	free_irq(dev->irq, dev);
+	hrtimer_cancel(&dev->timer);
+
+	/* the readers still waiting fail, the open files keep dev */
+	WRITE_ONCE(dev->gone, true);
+	wake_up_interruptible_all(&dev->wq);
+	misc_deregister(&dev->misc);
+	kref_put(&dev->ref, myirq_free);
 
 	return 0;
 }
@@ -79,4 +336,3 @@ MODULE_AUTHOR("Simon Chen");
 MODULE_DESCRIPTION("GPIO IRQ example");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS("platform:myirq_driver");
-
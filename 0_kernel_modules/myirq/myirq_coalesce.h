@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Coalescing of the myirq events.
+ *
+ * The IRQ thread feeds the timestamps of the hard IRQ handler, in order,
+ * to myirq_coal_add(): an IRQ less than window_ns after the first one of
+ * the open event is merged in it (count + 1), otherwise the open event is
+ * closed and a new one opened. After each batch the caller arms a timer
+ * at myirq_coal_deadline() and closes the open event with
+ * myirq_coal_flush() when it expires; with a window of 0 it closes it at
+ * once. An event is thus delivered at most window_ns after its first IRQ,
+ * however dense the IRQs: measured from the last IRQ instead, a steady
+ * stream faster than the window would never close its event.
+ *
+ * The policy only depends on the timestamps given by the caller so it is
+ * shared with the userland simulation 1_userland_app/myirq_sim.
+ */
+
+#ifndef MYIRQ_COALESCE_H
+#define MYIRQ_COALESCE_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#include <stdbool.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+#endif
+
+/* Record returned by read() */
+struct myirq_event {
+	__u64 ts_ns;	/* ktime_get_ns() of the first IRQ of the event */
+	__u32 seq;	/* number of this IRQ, a gap with the previous seq + count means drops */
+	__u32 count;	/* IRQs merged in this event */
+};
+
+struct myirq_coal_t {
+	u64 window_ns;		/* 0: no coalescing */
+
+	struct myirq_event pending;
+	bool has_pending;
+
+	u32 coalesced;		/* IRQs merged in an open event */
+};
+
+static inline void myirq_coal_reset(struct myirq_coal_t *c)
+{
+	c->has_pending = false;
+	c->coalesced = 0;
+}
+
+/* End of the window of the open event */
+static inline u64 myirq_coal_deadline(const struct myirq_coal_t *c)
+{
+	return c->pending.ts_ns + c->window_ns;
+}
+
+/* Closes the open event in *closed, returns false if there is none */
+static inline bool myirq_coal_flush(struct myirq_coal_t *c, struct myirq_event *closed)
+{
+	if (!c->has_pending)
+		return false;
+
+	*closed = c->pending;
+	c->has_pending = false;
+	return true;
+}
+
+/* An IRQ of the hard handler, returns true if an event was closed in *closed */
+static inline bool myirq_coal_add(struct myirq_coal_t *c, const struct myirq_event *raw,
+				  struct myirq_event *closed)
+{
+	bool ret = false;
+
+	if (c->has_pending && raw->ts_ns - c->pending.ts_ns <= c->window_ns) {
+		c->pending.count += raw->count;
+		c->coalesced += raw->count;
+	} else {
+		ret = myirq_coal_flush(c, closed);
+		c->pending = *raw;
+		c->has_pending = true;
+	}
+
+	return ret;
+}
+
+#endif /* MYIRQ_COALESCE_H */
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Correlation of the CM4 clock with CLOCK_MONOTONIC.
+ *
+ * The CM4 time is its DWT cycle counter in us since boot, as carried by
+ * the completion messages. The driver pings the CM4 periodically; a
+ * ping gives 4 timestamps, as in NTP: t1 send and t4 receive of the
+ * local clock, t2 receive and t3 send of the CM4. The offset local - CM4
+ * is within [t1 - t2, t4 - t3] whatever the delays of both ways, so the
+ * middle of the interval is off by at most half the round trip without
+ * the CM4 processing, plus the 1us resolution of the CM4 time.
+ *
+ * The last RPMSG_SDB_CLOCK_SAMPLES pings are kept. The drift is the slope
+ * between the shortest round trips of the older and the newer half of
+ * the samples; it is taken as 0 +/- RPMSG_SDB_CLOCK_MAX_PPM until the
+ * samples are far enough apart to do better. The conversions start
+ * from the sample of the smallest error at the latest ping, given the
+ * error of the drift. Each conversion returns a bound of its error: the
+ * error of the anchor plus the error of the drift over the distance to
+ * the anchor.
+ *
+ * The estimator only depends on the timestamps given by the caller so it
+ * is shared with the userland simulation 1_userland_app/rpmsg_sdb_sim.
+ */
+
+#ifndef RPMSG_SDB_CLOCK_H
+#define RPMSG_SDB_CLOCK_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/math64.h>
+#else
+#include <stdint.h>
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+typedef int64_t s64;
+
+static inline s64 div64_s64(s64 dividend, s64 divisor)
+{
+	return dividend / divisor;
+}
+#endif
+
+#define RPMSG_SDB_CLOCK_SAMPLES	32	/* window of pings, even */
+#define RPMSG_SDB_CLOCK_MAX_PPM	200	/* drift of both crystals at most */
+#define RPMSG_SDB_CLOCK_RES_NS	1000	/* resolution of the CM4 time */
+
+struct rpmsg_sdb_clock_sample_t {
+	u64 remote_ns;	/* CM4 time of the ping, middle of t2 and t3 */
+	s64 offset_ns;	/* local - CM4 */
+	u64 err_ns;	/* bound of the error of offset_ns */
+};
+
+struct rpmsg_sdb_clock_t {
+	struct rpmsg_sdb_clock_sample_t s[RPMSG_SDB_CLOCK_SAMPLES];
+	u32 nb;		/* samples in the window */
+	u32 next;	/* oldest sample once the window is full */
+	u64 remote_us;	/* latest CM4 time seen, extended to 64 bits */
+	u64 samples;
+	u64 rejected;
+
+	/* estimate, valid once a sample has been taken */
+	u32 anchor;	/* index of the sample the conversions start from */
+	s64 skew_ppb;	/* offset change per s of CM4 time: - drift of the CM4 */
+	u64 skew_err_ppb;
+};
+
+static inline void rpmsg_sdb_clock_reset(struct rpmsg_sdb_clock_t *c)
+{
+	c->nb = 0;
+	c->next = 0;
+	c->remote_us = 0;
+	c->samples = 0;
+	c->rejected = 0;
+	c->anchor = 0;
+	c->skew_ppb = 0;
+	c->skew_err_ppb = (u64)RPMSG_SDB_CLOCK_MAX_PPM * 1000;
+}
+
+/* CM4 time in ns of a 32-bit timestamp, within 35 min of the latest one */
+static inline u64 rpmsg_sdb_clock_remote_ns(struct rpmsg_sdb_clock_t *c, u32 us)
+{
+	u64 remote_us;
+
+	if (!c->samples && !c->remote_us)
+		c->remote_us = us;
+	remote_us = c->remote_us + (s32)(us - (u32)c->remote_us);
+	if (remote_us > c->remote_us)
+		c->remote_us = remote_us;
+
+	return remote_us * 1000;
+}
+
+/* Error of a sample at the CM4 time at, drift included */
+static inline u64 rpmsg_sdb_clock_err_at(const struct rpmsg_sdb_clock_t *c,
+					 const struct rpmsg_sdb_clock_sample_t *s, u64 at)
+{
+	s64 dist_us = div64_s64((s64)(at - s->remote_ns), 1000);
+
+	if (dist_us < 0)
+		dist_us = -dist_us;
+	return s->err_ns + div64_s64((s64)c->skew_err_ppb * dist_us, 1000000);
+}
+
+/*
+ * Index of the smallest error at the CM4 time at among n samples from
+ * the first one, at 0: the shortest round trip
+ */
+static inline u32 rpmsg_sdb_clock_best(const struct rpmsg_sdb_clock_t *c, u32 first, u32 n,
+				       u64 at)
+{
+	u32 i, idx, best = first % RPMSG_SDB_CLOCK_SAMPLES;
+	u64 err, best_err = at ? rpmsg_sdb_clock_err_at(c, &c->s[best], at) : c->s[best].err_ns;
+
+	for (i = 1; i < n; i++) {
+		idx = (first + i) % RPMSG_SDB_CLOCK_SAMPLES;
+		err = at ? rpmsg_sdb_clock_err_at(c, &c->s[idx], at) : c->s[idx].err_ns;
+		/* the newer one on a tie */
+		if (err <= best_err) {
+			best = idx;
+			best_err = err;
+		}
+	}
+	return best;
+}
+
+static inline void rpmsg_sdb_clock_update(struct rpmsg_sdb_clock_t *c)
+{
+	u32 first = c->nb < RPMSG_SDB_CLOCK_SAMPLES ? 0 : c->next;
+	u32 half = c->nb / 2;
+	u64 latest = c->s[(c->next + RPMSG_SDB_CLOCK_SAMPLES - 1) % RPMSG_SDB_CLOCK_SAMPLES].remote_ns;
+	const struct rpmsg_sdb_clock_sample_t *o, *n;
+	s64 span_us, err_ppb;
+
+	c->skew_ppb = 0;
+	c->skew_err_ppb = (u64)RPMSG_SDB_CLOCK_MAX_PPM * 1000;
+	if (half >= 2) {
+		o = &c->s[rpmsg_sdb_clock_best(c, first, half, 0)];
+		n = &c->s[rpmsg_sdb_clock_best(c, first + half, c->nb - half, 0)];
+		span_us = div64_s64((s64)(n->remote_ns - o->remote_ns), 1000);
+		/* ppb: ns of offset per s, the error rounded up */
+		err_ppb = span_us > 0 ?
+			  div64_s64((s64)(o->err_ns + n->err_ns) * 1000000, span_us) + 1 : 0;
+		if (span_us > 0 && err_ppb < (s64)c->skew_err_ppb) {
+			c->skew_ppb = div64_s64((n->offset_ns - o->offset_ns) * 1000000, span_us);
+			c->skew_err_ppb = err_ppb;
+		}
+	}
+	c->anchor = rpmsg_sdb_clock_best(c, first, c->nb, latest);
+}
+
+/*
+ * A ping: t1 and t4 local ns, t2 and t3 CM4 us. Returns 0, or -1 if the
+ * timestamps are not consistent and the sample was dropped.
+ */
+static inline int rpmsg_sdb_clock_add(struct rpmsg_sdb_clock_t *c, u64 t1, u32 t2_us,
+				      u32 t3_us, u64 t4)
+{
+	struct rpmsg_sdb_clock_sample_t *s;
+	u64 t2 = rpmsg_sdb_clock_remote_ns(c, t2_us);
+	u64 t3 = rpmsg_sdb_clock_remote_ns(c, t3_us);
+
+	if (t4 < t1 || t3 < t2 || t3 - t2 > t4 - t1) {
+		c->rejected++;
+		return -1;
+	}
+
+	s = &c->s[c->next];
+	s->remote_ns = t2 + (t3 - t2) / 2;
+	/* the CM4 times are truncated: the interval is [t1 - t2 - res, t4 - t3] */
+	s->offset_ns = ((s64)(t1 - t2) + (s64)(t4 - t3)) / 2 - RPMSG_SDB_CLOCK_RES_NS / 2;
+	s->err_ns = ((t4 - t1) - (t3 - t2)) / 2 + RPMSG_SDB_CLOCK_RES_NS / 2;
+
+	c->next = (c->next + 1) % RPMSG_SDB_CLOCK_SAMPLES;
+	if (c->nb < RPMSG_SDB_CLOCK_SAMPLES)
+		c->nb++;
+	c->samples++;
+	rpmsg_sdb_clock_update(c);
+
+	return 0;
+}
+
+/*
+ * Local time of a CM4 timestamp in us and the bound of its error.
+ * Returns 0, or -1 before the first ping.
+ */
+static inline int rpmsg_sdb_clock_to_local(struct rpmsg_sdb_clock_t *c, u32 us,
+					   u64 *local_ns, u64 *err_ns)
+{
+	const struct rpmsg_sdb_clock_sample_t *a = &c->s[c->anchor];
+	u64 remote_ns = rpmsg_sdb_clock_remote_ns(c, us);
+	s64 dist_us;
+
+	if (!c->nb)
+		return -1;
+
+	dist_us = div64_s64((s64)(remote_ns - a->remote_ns), 1000);
+	/* the timestamp was truncated, the event is in [us, us + res) */
+	*local_ns = remote_ns + RPMSG_SDB_CLOCK_RES_NS / 2 + a->offset_ns +
+		    div64_s64(c->skew_ppb * dist_us, 1000000);
+	*err_ns = rpmsg_sdb_clock_err_at(c, a, remote_ns) + RPMSG_SDB_CLOCK_RES_NS / 2 +
+		  2; /* roundings */
+
+	return 0;
+}
+
+#endif /* RPMSG_SDB_CLOCK_H */
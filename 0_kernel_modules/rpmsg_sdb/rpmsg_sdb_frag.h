@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Reassembly of the copro messages longer than one rpmsg buffer.
+ *
+ * The copro (RPMSG_HDR_Transmit() of exchange_large_buf) sends such a
+ * message in fragments, each one starting with struct rpmsg_sdb_frag_hdr:
+ * the id of the message, the index of the fragment and the total length.
+ * The other messages are sent as they are, their first byte is text and
+ * never RPMSG_SDB_FRAG_MAGIC. A fragment missing or out of order drops the
+ * message in progress, the next index 0 starts a new one.
+ *
+ * The reassembly only depends on the fragments given by the caller so it
+ * is shared with the userland checks 1_userland_app/cm4_sim.
+ */
+
+#ifndef RPMSG_SDB_FRAG_H
+#define RPMSG_SDB_FRAG_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+#endif
+
+#define RPMSG_SDB_FRAG_MAGIC	0xa5
+#define RPMSG_SDB_FRAG_LAST	0x01	/* flags of the last fragment */
+
+/* Same layout as RPMSG_HDR_FragTypeDef of the copro, little endian */
+struct rpmsg_sdb_frag_hdr {
+	u8 magic;
+	u8 id;		/* of the message, the same in all its fragments */
+	u8 index;	/* of the fragment in the message, from 0 */
+	u8 flags;
+	u16 total;	/* length of the whole message */
+	u16 reserved;
+};
+
+struct rpmsg_sdb_frag_t {
+	u8 *buf;		/* reassembly buffer of size bytes */
+	u32 size;
+
+	bool active;		/* a message is in progress */
+	u8 id;
+	u8 next;		/* index of the next fragment */
+	u16 total;
+	u32 len;		/* bytes received */
+
+	u32 messages;		/* reassembled */
+	u32 dropped;		/* messages with a fragment missing, out of order or too long */
+};
+
+static inline void rpmsg_sdb_frag_init(struct rpmsg_sdb_frag_t *f, u8 *buf, u32 size)
+{
+	f->buf = buf;
+	f->size = size;
+	f->active = false;
+	f->id = 0;
+	f->messages = 0;
+	f->dropped = 0;
+}
+
+static inline bool rpmsg_sdb_frag_is_frag(const void *data, u32 len)
+{
+	return len >= sizeof(struct rpmsg_sdb_frag_hdr) &&
+	       *(const u8 *)data == RPMSG_SDB_FRAG_MAGIC;
+}
+
+static inline void rpmsg_sdb_frag_drop(struct rpmsg_sdb_frag_t *f)
+{
+	if (f->active)
+		f->dropped++;
+	f->active = false;
+}
+
+/*
+ * Add a fragment. Returns the length of the message reassembled in buf
+ * after its last fragment, 0 while fragments are awaited, -EINVAL if the
+ * fragment is dropped, and the message in progress with it.
+ */
+static inline int rpmsg_sdb_frag_add(struct rpmsg_sdb_frag_t *f, const void *data, u32 len)
+{
+	struct rpmsg_sdb_frag_hdr h;
+	u32 n = len - sizeof(h);
+
+	memcpy(&h, data, sizeof(h));
+
+	if (h.index == 0) {
+		rpmsg_sdb_frag_drop(f);
+		f->active = true;
+		f->id = h.id;
+		f->next = 0;
+		f->total = h.total;
+		f->len = 0;
+		if (h.total > f->size) {
+			rpmsg_sdb_frag_drop(f);
+			return -EINVAL;
+		}
+	} else if (!f->active || h.id != f->id || h.index != f->next) {
+		/*
+		 * The message in progress is lost, and this one too if its
+		 * first fragment is missing: counted once, its next fragments
+		 * come with the same id.
+		 */
+		f->dropped += f->active + (h.id != f->id);
+		f->active = false;
+		f->id = h.id;
+		return -EINVAL;
+	}
+
+	if (n > (u32)f->total - f->len) {
+		rpmsg_sdb_frag_drop(f);
+		return -EINVAL;
+	}
+	memcpy(f->buf + f->len, (const u8 *)data + sizeof(h), n);
+	f->len += n;
+	f->next++;
+
+	if (!(h.flags & RPMSG_SDB_FRAG_LAST))
+		return 0;
+	if (f->len != f->total) {
+		rpmsg_sdb_frag_drop(f);
+		return -EINVAL;
+	}
+	f->active = false;
+	f->messages++;
+	return f->len;
+}
+
+#endif /* RPMSG_SDB_FRAG_H */
@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Latency histograms of rpmsg_sdb.
+ *
+ * Count, sum, min and max of the samples and a log2 histogram: bin 0
+ * counts the samples < 1us, bin n the ones in [2^(n-1), 2^n) us, the
+ * last bin everything above. Percentiles are estimated as the upper
+ * bound of the bin they fall in, never below the real value.
+ *
+ * It does not depend on the kernel so it is shared with the userland
+ * simulation 1_userland_app/rpmsg_sdb_sim.
+ */
+
+#ifndef RPMSG_SDB_HIST_H
+#define RPMSG_SDB_HIST_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/math64.h>
+#else
+#include <stdint.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+#endif
+
+#define RPMSG_SDB_HIST_BINS 24	/* last bin: >= 4.2s */
+
+struct rpmsg_sdb_hist_t {
+	u64 count;
+	u64 sum_ns;
+	u64 min_ns;
+	u64 max_ns;
+	u32 bin[RPMSG_SDB_HIST_BINS];
+};
+
+static inline void rpmsg_sdb_hist_reset(struct rpmsg_sdb_hist_t *h)
+{
+	unsigned int i;
+
+	h->count = 0;
+	h->sum_ns = 0;
+	h->min_ns = ~0ull;
+	h->max_ns = 0;
+	for (i = 0; i < RPMSG_SDB_HIST_BINS; i++)
+		h->bin[i] = 0;
+}
+
+static inline unsigned int rpmsg_sdb_hist_bin(u64 ns)
+{
+	u64 us64 = div64_u64(ns, 1000);
+	u32 us = us64 > 0xffffffffull ? 0xffffffff : (u32)us64;
+	unsigned int bin = us ? 32 - __builtin_clz(us) : 0;
+
+	return bin < RPMSG_SDB_HIST_BINS ? bin : RPMSG_SDB_HIST_BINS - 1;
+}
+
+/* Lowest value of the next bin, in us, ~0 for the last one */
+static inline u64 rpmsg_sdb_hist_bin_limit_us(unsigned int bin)
+{
+	return bin < RPMSG_SDB_HIST_BINS - 1 ? 1ull << bin : ~0ull;
+}
+
+static inline void rpmsg_sdb_hist_add(struct rpmsg_sdb_hist_t *h, u64 ns)
+{
+	h->count++;
+	h->sum_ns += ns;
+	if (ns < h->min_ns)
+		h->min_ns = ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	h->bin[rpmsg_sdb_hist_bin(ns)]++;
+}
+
+/* Accumulate src into dst, e.g. the buffers into the device */
+static inline void rpmsg_sdb_hist_merge(struct rpmsg_sdb_hist_t *dst, const struct rpmsg_sdb_hist_t *src)
+{
+	unsigned int i;
+
+	dst->count += src->count;
+	dst->sum_ns += src->sum_ns;
+	if (src->min_ns < dst->min_ns)
+		dst->min_ns = src->min_ns;
+	if (src->max_ns > dst->max_ns)
+		dst->max_ns = src->max_ns;
+	for (i = 0; i < RPMSG_SDB_HIST_BINS; i++)
+		dst->bin[i] += src->bin[i];
+}
+
+/* per_mille percentile in ns, bounded by the max, 0 without samples */
+static inline u64 rpmsg_sdb_hist_percentile(const struct rpmsg_sdb_hist_t *h, u32 per_mille)
+{
+	u64 rank = div64_u64(h->count * per_mille + 999, 1000), seen = 0, limit;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < RPMSG_SDB_HIST_BINS; i++) {
+		seen += h->bin[i];
+		if (seen >= rank)
+			break;
+	}
+	limit = rpmsg_sdb_hist_bin_limit_us(i);
+	if (limit == ~0ull || limit * 1000 > h->max_ns)
+		return h->max_ns;
+	return limit * 1000;
+}
+
+static inline u64 rpmsg_sdb_hist_avg(const struct rpmsg_sdb_hist_t *h)
+{
+	return h->count ? div64_u64(h->sum_ns, h->count) : 0;
+}
+
+#endif /* RPMSG_SDB_HIST_H */
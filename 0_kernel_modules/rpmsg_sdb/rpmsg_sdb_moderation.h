@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Eventfd moderation of the rpmsg_sdb completions.
+ *
+ * A completion is signaled at once when the driver is idle: no signal
+ * in the last usecs. Otherwise the signal is deferred until count
+ * completions are pending or usecs have elapsed since the last signal,
+ * so userland is woken at most once per count completions or usecs; the
+ * driver arms a timer at rpmsg_sdb_mod_deadline() for the latter.
+ * Completions read by userland before their signal are not signaled.
+ *
+ * The policy only depends on the clock given by the caller so it is
+ * shared with the userland simulation 1_userland_app/rpmsg_sdb_sim.
+ */
+
+#ifndef RPMSG_SDB_MODERATION_H
+#define RPMSG_SDB_MODERATION_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+#endif
+
+enum rpmsg_sdb_mod_action {
+	RPMSG_SDB_MOD_NONE,	/* nothing to signal */
+	RPMSG_SDB_MOD_SIGNAL,	/* signal the pending completions now */
+	RPMSG_SDB_MOD_DEFER,	/* signal at rpmsg_sdb_mod_deadline() at the latest */
+};
+
+struct rpmsg_sdb_mod_t {
+	/* policy, count <= 1 disables the moderation */
+	u32 count;
+	u32 usecs;
+
+	u32 outstanding;	/* completions not consumed by userland */
+	u32 deferred;		/* completions not signaled yet */
+	u64 last_signal_ns;
+
+	u64 completions;
+	u64 signals;
+};
+
+static inline void rpmsg_sdb_mod_reset(struct rpmsg_sdb_mod_t *m)
+{
+	m->outstanding = 0;
+	m->deferred = 0;
+	m->last_signal_ns = 0;
+	m->completions = 0;
+	m->signals = 0;
+}
+
+static inline u64 rpmsg_sdb_mod_deadline(const struct rpmsg_sdb_mod_t *m)
+{
+	return m->last_signal_ns + (u64)m->usecs * 1000;
+}
+
+static inline enum rpmsg_sdb_mod_action rpmsg_sdb_mod_signal(struct rpmsg_sdb_mod_t *m, u64 now)
+{
+	m->deferred = 0;
+	m->last_signal_ns = now;
+	m->signals++;
+	return RPMSG_SDB_MOD_SIGNAL;
+}
+
+/* A buffer has been completed by the copro */
+static inline enum rpmsg_sdb_mod_action rpmsg_sdb_mod_complete(struct rpmsg_sdb_mod_t *m, u64 now)
+{
+	m->completions++;
+	m->outstanding++;
+	m->deferred++;
+
+	if (m->count <= 1 || m->deferred >= m->count ||
+	    now >= rpmsg_sdb_mod_deadline(m))
+		return rpmsg_sdb_mod_signal(m, now);
+
+	return RPMSG_SDB_MOD_DEFER;
+}
+
+/* The timer armed at rpmsg_sdb_mod_deadline() expired */
+static inline enum rpmsg_sdb_mod_action rpmsg_sdb_mod_timeout(struct rpmsg_sdb_mod_t *m, u64 now)
+{
+	if (!m->deferred)
+		return RPMSG_SDB_MOD_NONE;
+	if (now < rpmsg_sdb_mod_deadline(m))
+		return RPMSG_SDB_MOD_DEFER;
+
+	return rpmsg_sdb_mod_signal(m, now);
+}
+
+/* Userland consumed nb completions */
+static inline void rpmsg_sdb_mod_consumed(struct rpmsg_sdb_mod_t *m, u32 nb)
+{
+	m->outstanding -= nb < m->outstanding ? nb : m->outstanding;
+	/* the deferred completions have been read without their signal */
+	if (!m->outstanding)
+		m->deferred = 0;
+}
+
+#endif /* RPMSG_SDB_MODERATION_H */
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Pool of SDB buffers kept across the sessions of rpmsg_sdb.
+ *
+ * Buffers are rounded up to a power of 2 pages (the order) and the freed
+ * ones are kept in one list per order, up to max_cached bytes, so the
+ * next session gets them back in O(1) instead of a new contiguous
+ * allocation. The pool does not allocate: on a miss the caller
+ * allocates the chunk and gives it to rpmsg_sdb_pool_alloced(), and
+ * frees the chunks rpmsg_sdb_pool_put() does not keep. The caller
+ * serializes the calls.
+ *
+ * It does not depend on the kernel so it is shared with the userland
+ * model 1_userland_app/rpmsg_sdb_sim.
+ */
+
+#ifndef RPMSG_SDB_POOL_H
+#define RPMSG_SDB_POOL_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#define RPMSG_SDB_POOL_PAGE_SHIFT PAGE_SHIFT
+#else
+#include <stddef.h>
+#include <stdint.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+#define RPMSG_SDB_POOL_PAGE_SHIFT 12
+#endif
+
+#define RPMSG_SDB_POOL_ORDERS 13	/* up to 4096 pages (16MB) */
+
+struct rpmsg_sdb_chunk_t {
+	struct rpmsg_sdb_chunk_t *next;	/* in the free list of its order */
+	unsigned int order;
+	u64 paddr;
+	void *vaddr;
+};
+
+struct rpmsg_sdb_pool_t {
+	struct rpmsg_sdb_chunk_t *free[RPMSG_SDB_POOL_ORDERS];
+	u32 nb_free[RPMSG_SDB_POOL_ORDERS];
+	size_t max_cached;		/* bytes kept in the free lists at most */
+	size_t cached;
+	size_t in_use;
+	size_t high_water;		/* highest in_use + cached */
+
+	u64 hits;
+	u64 misses;
+	u64 released;			/* chunks given back to the caller to free */
+};
+
+static inline size_t rpmsg_sdb_chunk_size(unsigned int order)
+{
+	return (size_t)1 << (order + RPMSG_SDB_POOL_PAGE_SHIFT);
+}
+
+/* Order of a buffer of size bytes, -1 if too big for the pool */
+static inline int rpmsg_sdb_pool_order(size_t size)
+{
+	unsigned int order = 0;
+
+	while (rpmsg_sdb_chunk_size(order) < size) {
+		if (++order >= RPMSG_SDB_POOL_ORDERS)
+			return -1;
+	}
+	return order;
+}
+
+static inline void rpmsg_sdb_pool_update_hw(struct rpmsg_sdb_pool_t *pool)
+{
+	if (pool->in_use + pool->cached > pool->high_water)
+		pool->high_water = pool->in_use + pool->cached;
+}
+
+/* Chunk of the order from the free lists, NULL on a miss */
+static inline struct rpmsg_sdb_chunk_t *rpmsg_sdb_pool_get(struct rpmsg_sdb_pool_t *pool,
+							   unsigned int order)
+{
+	struct rpmsg_sdb_chunk_t *chunk = pool->free[order];
+
+	if (!chunk) {
+		pool->misses++;
+		return NULL;
+	}
+
+	pool->free[order] = chunk->next;
+	pool->nb_free[order]--;
+	pool->cached -= rpmsg_sdb_chunk_size(order);
+	pool->in_use += rpmsg_sdb_chunk_size(order);
+	pool->hits++;
+	return chunk;
+}
+
+/* A chunk allocated by the caller after a miss is now in use */
+static inline void rpmsg_sdb_pool_alloced(struct rpmsg_sdb_pool_t *pool,
+					  struct rpmsg_sdb_chunk_t *chunk)
+{
+	pool->in_use += rpmsg_sdb_chunk_size(chunk->order);
+	rpmsg_sdb_pool_update_hw(pool);
+}
+
+/* Give a chunk to the pool (preallocated or in use), returns it if the caller must free it */
+static inline struct rpmsg_sdb_chunk_t *rpmsg_sdb_pool_add(struct rpmsg_sdb_pool_t *pool,
+							   struct rpmsg_sdb_chunk_t *chunk)
+{
+	size_t size = rpmsg_sdb_chunk_size(chunk->order);
+
+	if (pool->cached + size > pool->max_cached) {
+		pool->released++;
+		return chunk;
+	}
+
+	chunk->next = pool->free[chunk->order];
+	pool->free[chunk->order] = chunk;
+	pool->nb_free[chunk->order]++;
+	pool->cached += size;
+	rpmsg_sdb_pool_update_hw(pool);
+	return NULL;
+}
+
+static inline struct rpmsg_sdb_chunk_t *rpmsg_sdb_pool_put(struct rpmsg_sdb_pool_t *pool,
+							   struct rpmsg_sdb_chunk_t *chunk)
+{
+	pool->in_use -= rpmsg_sdb_chunk_size(chunk->order);
+	return rpmsg_sdb_pool_add(pool, chunk);
+}
+
+/* Remove a cached chunk to free it, any order, NULL when the pool is empty */
+static inline struct rpmsg_sdb_chunk_t *rpmsg_sdb_pool_drain(struct rpmsg_sdb_pool_t *pool)
+{
+	struct rpmsg_sdb_chunk_t *chunk;
+	unsigned int order;
+
+	for (order = 0; order < RPMSG_SDB_POOL_ORDERS; order++) {
+		chunk = pool->free[order];
+		if (!chunk)
+			continue;
+		pool->free[order] = chunk->next;
+		pool->nb_free[order]--;
+		pool->cached -= rpmsg_sdb_chunk_size(order);
+		return chunk;
+	}
+	return NULL;
+}
+
+#endif /* RPMSG_SDB_POOL_H */
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Page allocator of the rpmsg_sdb reserved-memory region.
+ *
+ * One bit per page. A block of 2^order pages is aligned on its size, as
+ * in a buddy allocator, so a block never straddles a bitmap word unless
+ * it covers whole words: the search tests a masked word, or whole words
+ * for orders >= 5. The allocation time only depends on the region size,
+ * not on the memory pressure of the rest of the system.
+ *
+ * It does not depend on the kernel so it is shared with the userland
+ * model 1_userland_app/rpmsg_sdb_sim.
+ */
+
+#ifndef RPMSG_SDB_REGION_H
+#define RPMSG_SDB_REGION_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+#endif
+
+#define RPMSG_SDB_REGION_WORD_BITS 32
+
+struct rpmsg_sdb_region_t {
+	u32 *bitmap;		/* (nb_pages + 31) / 32 words, set bit: page used */
+	u32 nb_pages;
+	u32 free_pages;
+
+	u64 allocs;
+	u64 failures;
+};
+
+static inline u32 rpmsg_sdb_region_words(u32 nb_pages)
+{
+	return (nb_pages + RPMSG_SDB_REGION_WORD_BITS - 1) / RPMSG_SDB_REGION_WORD_BITS;
+}
+
+/* bitmap must hold rpmsg_sdb_region_words(nb_pages) words */
+static inline void rpmsg_sdb_region_init(struct rpmsg_sdb_region_t *r, u32 *bitmap, u32 nb_pages)
+{
+	u32 i, nb_words = rpmsg_sdb_region_words(nb_pages);
+
+	r->bitmap = bitmap;
+	r->nb_pages = nb_pages;
+	r->free_pages = nb_pages;
+	r->allocs = 0;
+	r->failures = 0;
+
+	for (i = 0; i < nb_words; i++)
+		bitmap[i] = 0;
+	/* pages past the end of the region are never free */
+	if (nb_pages % RPMSG_SDB_REGION_WORD_BITS)
+		bitmap[nb_words - 1] = ~0u << (nb_pages % RPMSG_SDB_REGION_WORD_BITS);
+}
+
+static inline void rpmsg_sdb_region_mark(struct rpmsg_sdb_region_t *r, u32 first,
+					 unsigned int order, int used)
+{
+	u32 nb = 1u << order, w = first / RPMSG_SDB_REGION_WORD_BITS, i, mask;
+
+	if (nb < RPMSG_SDB_REGION_WORD_BITS) {
+		mask = ((1u << nb) - 1) << (first % RPMSG_SDB_REGION_WORD_BITS);
+		if (used)
+			r->bitmap[w] |= mask;
+		else
+			r->bitmap[w] &= ~mask;
+	} else {
+		for (i = 0; i < nb / RPMSG_SDB_REGION_WORD_BITS; i++)
+			r->bitmap[w + i] = used ? ~0u : 0;
+	}
+}
+
+/* First page of a free block of 2^order pages, -1 if there is none */
+static inline int rpmsg_sdb_region_alloc(struct rpmsg_sdb_region_t *r, unsigned int order)
+{
+	u32 nb = 1u << order, nb_words = rpmsg_sdb_region_words(r->nb_pages);
+	u32 w, i, off, mask, span;
+
+	if (nb > r->free_pages || order >= 31)
+		goto fail;
+
+	if (nb < RPMSG_SDB_REGION_WORD_BITS) {
+		mask = (1u << nb) - 1;
+		for (w = 0; w < nb_words; w++) {
+			if (r->bitmap[w] == ~0u)
+				continue;
+			for (off = 0; off < RPMSG_SDB_REGION_WORD_BITS; off += nb) {
+				if (!(r->bitmap[w] & mask << off))
+					goto found_small;
+			}
+		}
+		goto fail;
+found_small:
+		r->bitmap[w] |= mask << off;
+		r->free_pages -= nb;
+		r->allocs++;
+		return w * RPMSG_SDB_REGION_WORD_BITS + off;
+	}
+
+	span = nb / RPMSG_SDB_REGION_WORD_BITS;
+	for (w = 0; w + span <= nb_words; w += span) {
+		for (i = 0; i < span; i++)
+			if (r->bitmap[w + i])
+				break;
+		if (i == span) {
+			rpmsg_sdb_region_mark(r, w * RPMSG_SDB_REGION_WORD_BITS, order, 1);
+			r->free_pages -= nb;
+			r->allocs++;
+			return w * RPMSG_SDB_REGION_WORD_BITS;
+		}
+	}
+
+fail:
+	r->failures++;
+	return -1;
+}
+
+static inline void rpmsg_sdb_region_free(struct rpmsg_sdb_region_t *r, u32 first, unsigned int order)
+{
+	rpmsg_sdb_region_mark(r, first, order, 0);
+	r->free_pages += 1u << order;
+}
+
+#endif /* RPMSG_SDB_REGION_H */
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Tracepoints of rpmsg_sdb, in /sys/kernel/debug/tracing/events/rpmsg_sdb/.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rpmsg_sdb
+
+#if !defined(_RPMSG_SDB_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _RPMSG_SDB_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* cm4_lat_ns: CM4 timestamp to callback, -1 without timestamp */
+TRACE_EVENT(rpmsg_sdb_complete,
+	TP_PROTO(int id, u32 size, s64 cm4_lat_ns),
+	TP_ARGS(id, size, cm4_lat_ns),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(u32, size)
+		__field(s64, cm4_lat_ns)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->size = size;
+		__entry->cm4_lat_ns = cm4_lat_ns;
+	),
+	TP_printk("buffer=%d size=%u cm4_lat_ns=%lld",
+		  __entry->id, __entry->size, __entry->cm4_lat_ns)
+);
+
+/* The copro completed a buffer userland has not consumed yet */
+TRACE_EVENT(rpmsg_sdb_overrun,
+	TP_PROTO(int id),
+	TP_ARGS(id),
+	TP_STRUCT__entry(
+		__field(int, id)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+	),
+	TP_printk("buffer=%d", __entry->id)
+);
+
+/* eventfds of nb buffers signaled at once */
+TRACE_EVENT(rpmsg_sdb_signal,
+	TP_PROTO(u32 nb),
+	TP_ARGS(nb),
+	TP_STRUCT__entry(
+		__field(u32, nb)
+	),
+	TP_fast_assign(
+		__entry->nb = nb;
+	),
+	TP_printk("buffers=%u", __entry->nb)
+);
+
+/* lat_ns: callback to read() or RPMSG_SDB_IOCTL_GET_DATA_SIZE */
+TRACE_EVENT(rpmsg_sdb_consume,
+	TP_PROTO(int id, u64 lat_ns),
+	TP_ARGS(id, lat_ns),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(u64, lat_ns)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->lat_ns = lat_ns;
+	),
+	TP_printk("buffer=%d lat_ns=%llu", __entry->id, __entry->lat_ns)
+);
+
+#endif /* _RPMSG_SDB_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE rpmsg_sdb_trace
+#include <trace/define_trace.h>
@@ -15,9 +15,61 @@
 #include <linux/eventfd.h>
 #include <linux/of_platform.h>
 #include <linux/list.h>
+#include <linux/kfifo.h>
+#include <linux/hrtimer.h>
+#include <linux/poll.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/of.h>
+#include <linux/of_address.h>
+#include <linux/io.h>
+#include <linux/workqueue.h>
+
+#include "rpmsg_sdb_moderation.h"
+#include "rpmsg_sdb_pool.h"
+#include "rpmsg_sdb_region.h"
+#include "rpmsg_sdb_hist.h"
+#include "rpmsg_sdb_clock.h"
+#include "rpmsg_sdb_frag.h"
+
+#define CREATE_TRACE_POINTS
+#include "rpmsg_sdb_trace.h"
 
 #define RPMSG_SDB_DRIVER_VERSION "1.0"
 
+#define RPMSG_SDB_COMP_FIFO_SIZE 256 /* completions readable by read(), power of 2 */
+#define RPMSG_SDB_FRAG_MAX_LEN 4096 /* longest copro message sent in fragments */
+
+/*
+ * Eventfd moderation defaults, see rpmsg_sdb_moderation.h. Per device
+ * values are in /sys/class/misc/rpmsg-sdb/moderation_{count,usecs}.
+ */
+static unsigned int moderation_count = 4;
+module_param(moderation_count, uint, 0444);
+MODULE_PARM_DESC(moderation_count, "signal at most once per N completions unless idle (<= 1: off)");
+
+static unsigned int moderation_usecs = 500;
+module_param(moderation_usecs, uint, 0444);
+MODULE_PARM_DESC(moderation_usecs, "idle time before an immediate signal, longest delay of a deferred one");
+
+/* Buffer pool, see rpmsg_sdb_pool.h. Statistics in debugfs rpmsg_sdb/pool */
+static unsigned int pool_max_kb = 16384;
+module_param(pool_max_kb, uint, 0444);
+MODULE_PARM_DESC(pool_max_kb, "buffers kept across sessions at most (KB)");
+
+static unsigned int pool_prealloc = 0;
+module_param(pool_prealloc, uint, 0444);
+MODULE_PARM_DESC(pool_prealloc, "number of buffers allocated at probe");
+
+static unsigned int pool_prealloc_kb = 1024;
+module_param(pool_prealloc_kb, uint, 0444);
+MODULE_PARM_DESC(pool_prealloc_kb, "size of the buffers allocated at probe (KB)");
+
+/* Correlation of the CM4 clock, see rpmsg_sdb_clock.h. State in debugfs rpmsg_sdb/clock */
+static unsigned int clock_sync_ms = 1000;
+module_param(clock_sync_ms, uint, 0444);
+MODULE_PARM_DESC(clock_sync_ms, "period of the clock pings of the CM4 (0: off)");
+
 /*
  * Static global variables
  */
@@ -41,6 +93,35 @@ struct rpmsg_sdb_ioctl_get_data_size {
 #define RPMSG_SDB_IOCTL_SET_EFD _IOW('R', 0x00, struct rpmsg_sdb_ioctl_set_efd *)
 #define RPMSG_SDB_IOCTL_GET_DATA_SIZE _IOWR('R', 0x01, struct rpmsg_sdb_ioctl_get_data_size *)
 
+/*
+ * Record returned by read() on /dev/rpmsg-sdb, one per buffer completed by
+ * the copro. Reading the completions acknowledges them like
+ * RPMSG_SDB_IOCTL_GET_DATA_SIZE does. cm4_ns is the end of the transfer
+ * stamped by the copro in CLOCK_MONOTONIC, within cm4_err_ns; 0 while
+ * the clocks are not correlated.
+ */
+struct rpmsg_sdb_completion {
+	int bufferId;
+	uint32_t size;
+	uint64_t ts_ns;
+	uint64_t cm4_ns;
+	uint64_t cm4_err_ns;
+};
+
+/*
+ * Telemetry of a session, per device and per buffer, in debugfs
+ * rpmsg_sdb/stats. The copro stamps the completion with its own clock
+ * in us. Once the clocks are correlated cm4_lat is the one-way latency,
+ * before it is the latency above the fastest completion of the session.
+ */
+struct rpmsg_sdb_stats_t {
+	u64 completions;
+	u64 bytes;
+	u64 overruns; /* completed again before being consumed */
+	struct rpmsg_sdb_hist_t cm4_lat; /* CM4 timestamp to callback */
+	struct rpmsg_sdb_hist_t consume_lat; /* callback to read()/GET_DATA_SIZE */
+};
+
 struct sdb_buf_t {
 	int index; /* index of buffer */
 	size_t size; /* buffer size */
@@ -49,6 +130,10 @@ struct sdb_buf_t {
 	void *vaddr; /* virtual address */
 	void *uaddr; /* mapped address for userland */
 	struct eventfd_ctx *efd_ctx; /* eventfd context */
+	struct rpmsg_sdb_chunk_t *chunk; /* pool chunk backing the buffer */
+	bool signal_pending; /* completed, eventfd not signaled yet */
+	u64 complete_ns; /* completed, not consumed yet, 0 otherwise */
+	struct rpmsg_sdb_stats_t stats;
 	struct list_head buflist; /* reference in the buffers list */
 };
 
@@ -57,27 +142,69 @@ struct rpmsg_sdb_t {
 	struct miscdevice mdev; /* misc device ref */
 	struct rpmsg_device	*rpdev;	/* handle rpmsg device */
 	struct list_head buffer_list; /* buffer instances list */
+
+	/* completions and eventfd moderation, protected by lock */
+	spinlock_t lock;
+	struct rpmsg_sdb_mod_t mod;
+	struct hrtimer mod_timer;
+	DECLARE_KFIFO(comp, struct rpmsg_sdb_completion, RPMSG_SDB_COMP_FIFO_SIZE);
+	u32 comp_dropped;
+	u32 deferred_signals;
+	struct rpmsg_sdb_stats_t stats;
+	u64 first_ns, last_ns; /* first and last completion of the session */
+	u32 cm4_offset_us; /* smallest callback - CM4 timestamp */
+	bool cm4_offset_valid;
+
+	/* pings of the CM4 clock, protected by lock */
+	struct rpmsg_sdb_clock_t clock;
+	struct delayed_work clock_work;
+	u32 clock_seq; /* of the ping in flight */
+	u64 clock_t1_ns; /* send time of the ping in flight, 0 if none */
+	u64 clock_lost;
+	struct mutex read_lock;
+	wait_queue_head_t wq;
+
+	/* copro messages in fragments, only used by the rpmsg callback */
+	struct rpmsg_sdb_frag_t frag;
+
+	struct mutex pool_lock; /* mutex to protect the pool and the region */
+	struct rpmsg_sdb_pool_t pool;
+
+	/* memory-region of the "st,rpmsg-sdb" DT node, default CMA if none */
+	struct rpmsg_sdb_region_t region;
+	phys_addr_t region_paddr;
+	void *region_vaddr;
+	struct dentry *debugfs;
 };
 
 struct device *rpmsg_sdb_dev;
 
+static void rpmsg_sdb_stats_reset(struct rpmsg_sdb_stats_t *stats)
+{
+	stats->completions = 0;
+	stats->bytes = 0;
+	stats->overruns = 0;
+	rpmsg_sdb_hist_reset(&stats->cm4_lat);
+	rpmsg_sdb_hist_reset(&stats->consume_lat);
+}
+
 static int rpmsg_sdb_format_txbuf_string(struct sdb_buf_t *buffer, char *bufinfo_str, size_t bufinfo_str_size)
 {
 	return snprintf(bufinfo_str, bufinfo_str_size, "B%dA%08xL%08x", buffer->index, buffer->paddr, buffer->size);
 }
 
-static long rpmsg_sdb_decode_rxbuf_string(char *rxbuf_str, int *buffer_id, size_t *size)
+static long rpmsg_sdb_decode_rxbuf_string(char *rxbuf_str, int *buffer_id, size_t *size,
+					  u32 *cm4_us, bool *has_ts)
 {
 	int ret = 0;
 	char *sub_str;
 	long bsize;
 	long bufid;
-	const char delimiter[1] = {'L'};
 
 	//pr_err("%s: rxbuf_str:%s\n", __func__, rxbuf_str);
 
 	/* Get first part containing the buffer id */
-	sub_str = strsep(&rxbuf_str, delimiter);
+	sub_str = strsep(&rxbuf_str, "L");
 
 	//pr_err("%s: sub_str:%s\n", __func__, sub_str);
 
@@ -88,7 +215,16 @@ static long rpmsg_sdb_decode_rxbuf_string(char *rxbuf_str, int *buffer_id, size_
 		goto out;
 	}
 
-	ret = kstrtol(&rxbuf_str[2], 16, &bsize);
+	if (!rxbuf_str) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* Optional CM4 timestamp in us: template BxLyyyyyyyyTzzzzzzzz */
+	sub_str = strsep(&rxbuf_str, "T");
+	*has_ts = rxbuf_str && !kstrtou32(rxbuf_str, 16, cm4_us);
+
+	ret = kstrtol(&sub_str[2], 16, &bsize);
 	if (ret < 0) {
 		pr_err("%s: extract of buffer size failed(%d)", __func__, ret);
 		goto out;
@@ -138,25 +274,381 @@ static int rpmsg_sdb_send_buf_info(struct rpmsg_sdb_t *rpmsg_sdb, struct sdb_buf
 	return count;
 }
 
+/* Called with drv->pool_lock held, or at probe */
+static struct rpmsg_sdb_chunk_t *rpmsg_sdb_chunk_alloc(struct rpmsg_sdb_t *drv, unsigned int order)
+{
+	struct rpmsg_sdb_chunk_t *chunk;
+	dma_addr_t paddr;
+	int page;
+
+	chunk = kzalloc(sizeof(*chunk), GFP_KERNEL);
+	if (!chunk)
+		return NULL;
+
+	chunk->order = order;
+	if (drv->region_vaddr) {
+		page = rpmsg_sdb_region_alloc(&drv->region, order);
+		if (page < 0) {
+			kfree(chunk);
+			return NULL;
+		}
+		chunk->paddr = drv->region_paddr + ((phys_addr_t)page << PAGE_SHIFT);
+		chunk->vaddr = drv->region_vaddr + ((size_t)page << PAGE_SHIFT);
+		return chunk;
+	}
+
+	chunk->vaddr = dma_alloc_wc(rpmsg_sdb_dev, rpmsg_sdb_chunk_size(order),
+				    &paddr, GFP_KERNEL);
+	if (!chunk->vaddr) {
+		kfree(chunk);
+		return NULL;
+	}
+	chunk->paddr = paddr;
+
+	printk("%s - dma_alloc_wc done - paddr:%llx - vaddr:%p - size:%zu\n", __func__,
+	       chunk->paddr, chunk->vaddr, rpmsg_sdb_chunk_size(order));
+	return chunk;
+}
+
+/* Called with drv->pool_lock held, or at probe */
+static void rpmsg_sdb_chunk_free(struct rpmsg_sdb_t *drv, struct rpmsg_sdb_chunk_t *chunk)
+{
+	if (drv->region_vaddr)
+		rpmsg_sdb_region_free(&drv->region,
+				      (chunk->paddr - drv->region_paddr) >> PAGE_SHIFT,
+				      chunk->order);
+	else
+		dma_free_wc(rpmsg_sdb_dev, rpmsg_sdb_chunk_size(chunk->order), chunk->vaddr,
+			    chunk->paddr);
+	kfree(chunk);
+}
+
+/* Chunk of at least size bytes, from the pool if possible */
+static struct rpmsg_sdb_chunk_t *rpmsg_sdb_buf_get(struct rpmsg_sdb_t *drv, size_t size)
+{
+	struct rpmsg_sdb_chunk_t *chunk, *cached;
+	int order = rpmsg_sdb_pool_order(size);
+
+	if (order < 0)
+		return NULL;
+
+	mutex_lock(&drv->pool_lock);
+	chunk = rpmsg_sdb_pool_get(&drv->pool, order);
+	if (!chunk) {
+		chunk = rpmsg_sdb_chunk_alloc(drv, order);
+		if (!chunk && drv->pool.cached) {
+			/* cached buffers of other sizes may fragment the memory */
+			while ((cached = rpmsg_sdb_pool_drain(&drv->pool)))
+				rpmsg_sdb_chunk_free(drv, cached);
+			chunk = rpmsg_sdb_chunk_alloc(drv, order);
+		}
+		if (chunk)
+			rpmsg_sdb_pool_alloced(&drv->pool, chunk);
+	}
+	mutex_unlock(&drv->pool_lock);
+
+	return chunk;
+}
+
+static void rpmsg_sdb_buf_put(struct rpmsg_sdb_t *drv, struct rpmsg_sdb_chunk_t *chunk)
+{
+	mutex_lock(&drv->pool_lock);
+	chunk = rpmsg_sdb_pool_put(&drv->pool, chunk);
+	if (chunk)
+		rpmsg_sdb_chunk_free(drv, chunk);
+	mutex_unlock(&drv->pool_lock);
+}
+
+static void rpmsg_sdb_pool_init(struct rpmsg_sdb_t *drv)
+{
+	struct rpmsg_sdb_chunk_t *chunk;
+	int order = rpmsg_sdb_pool_order((size_t)pool_prealloc_kb << 10);
+	unsigned int i;
+
+	drv->pool.max_cached = (size_t)pool_max_kb << 10;
+	if (order < 0)
+		return;
+
+	for (i = 0; i < pool_prealloc; i++) {
+		chunk = rpmsg_sdb_chunk_alloc(drv, order);
+		if (!chunk) {
+			dev_warn(rpmsg_sdb_dev, "%u of %u pool buffers allocated\n", i, pool_prealloc);
+			break;
+		}
+		chunk = rpmsg_sdb_pool_add(&drv->pool, chunk);
+		if (chunk) {
+			rpmsg_sdb_chunk_free(drv, chunk);
+			break;
+		}
+	}
+}
+
+static void rpmsg_sdb_pool_release(struct rpmsg_sdb_t *drv)
+{
+	struct rpmsg_sdb_chunk_t *chunk;
+
+	mutex_lock(&drv->pool_lock);
+	while ((chunk = rpmsg_sdb_pool_drain(&drv->pool)))
+		rpmsg_sdb_chunk_free(drv, chunk);
+	mutex_unlock(&drv->pool_lock);
+}
+
+/*
+ * DT binding, the region must be reachable by the copro DMA:
+ *     rpmsg-sdb {
+ *         compatible = "st,rpmsg-sdb";
+ *         memory-region = <&sdb_pool>;
+ *     };
+ */
+static int rpmsg_sdb_region_setup(struct device *dev, struct rpmsg_sdb_t *drv)
+{
+	struct device_node *np, *mem_np;
+	struct resource res;
+	u32 *bitmap;
+	u32 nb_pages;
+	void *vaddr;
+	int ret;
+
+	np = of_find_compatible_node(NULL, NULL, "st,rpmsg-sdb");
+	if (!np)
+		return 0;
+	mem_np = of_parse_phandle(np, "memory-region", 0);
+	of_node_put(np);
+	if (!mem_np)
+		return 0;
+
+	ret = of_address_to_resource(mem_np, 0, &res);
+	of_node_put(mem_np);
+	if (ret)
+		return ret;
+
+	nb_pages = resource_size(&res) >> PAGE_SHIFT;
+	bitmap = devm_kcalloc(dev, rpmsg_sdb_region_words(nb_pages), sizeof(u32), GFP_KERNEL);
+	if (!bitmap)
+		return -ENOMEM;
+
+	/* no-map region: not in the linear mapping, no cacheable alias */
+	vaddr = devm_memremap(dev, res.start, resource_size(&res), MEMREMAP_WC);
+	if (IS_ERR(vaddr))
+		return PTR_ERR(vaddr);
+
+	rpmsg_sdb_region_init(&drv->region, bitmap, nb_pages);
+	drv->region_paddr = res.start;
+	drv->region_vaddr = vaddr;
+
+	dev_info(dev, "SDB buffers from %pR\n", &res);
+	return 0;
+}
+
+static int rpmsg_sdb_pool_show(struct seq_file *s, void *unused)
+{
+	struct rpmsg_sdb_t *drv = s->private;
+	struct rpmsg_sdb_pool_t *pool = &drv->pool;
+	unsigned int order;
+
+	mutex_lock(&drv->pool_lock);
+	seq_printf(s, "hits: %llu\nmisses: %llu\nreleased: %llu\n",
+		   pool->hits, pool->misses, pool->released);
+	seq_printf(s, "in use: %zu\ncached: %zu\nmax cached: %zu\nhigh water: %zu\n",
+		   pool->in_use, pool->cached, pool->max_cached, pool->high_water);
+	for (order = 0; order < RPMSG_SDB_POOL_ORDERS; order++)
+		if (pool->nb_free[order])
+			seq_printf(s, "free %zuK: %u\n", rpmsg_sdb_chunk_size(order) >> 10,
+				   pool->nb_free[order]);
+	if (drv->region_vaddr)
+		seq_printf(s, "region: %pa, %u pages, %u free, allocs: %llu, failures: %llu\n",
+			   &drv->region_paddr, drv->region.nb_pages, drv->region.free_pages,
+			   drv->region.allocs, drv->region.failures);
+	mutex_unlock(&drv->pool_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rpmsg_sdb_pool);
+
+static void rpmsg_sdb_hist_show(struct seq_file *s, const char *name,
+				const struct rpmsg_sdb_hist_t *h)
+{
+	if (!h->count) {
+		seq_printf(s, "%s: -\n", name);
+		return;
+	}
+	seq_printf(s, "%s: %llu samples, us min %llu avg %llu p50 %llu p99 %llu max %llu\n", name,
+		   h->count, div_u64(h->min_ns, NSEC_PER_USEC),
+		   div_u64(rpmsg_sdb_hist_avg(h), NSEC_PER_USEC),
+		   div_u64(rpmsg_sdb_hist_percentile(h, 500), NSEC_PER_USEC),
+		   div_u64(rpmsg_sdb_hist_percentile(h, 990), NSEC_PER_USEC),
+		   div_u64(h->max_ns, NSEC_PER_USEC));
+}
+
+static void rpmsg_sdb_bins_show(struct seq_file *s, const struct rpmsg_sdb_hist_t *cm4,
+				const struct rpmsg_sdb_hist_t *consume)
+{
+	unsigned int i;
+
+	seq_puts(s, "     < us        cm4    consume\n");
+	for (i = 0; i < RPMSG_SDB_HIST_BINS; i++) {
+		if (!cm4->bin[i] && !consume->bin[i])
+			continue;
+		if (i == RPMSG_SDB_HIST_BINS - 1)
+			seq_printf(s, "%9s %10u %10u\n", "-", cm4->bin[i], consume->bin[i]);
+		else
+			seq_printf(s, "%9llu %10u %10u\n", rpmsg_sdb_hist_bin_limit_us(i),
+				   cm4->bin[i], consume->bin[i]);
+	}
+}
+
+/* Statistics of a buffer, copied for rpmsg_sdb_stats_show() */
+struct rpmsg_sdb_buf_stats_t {
+	int index;
+	struct rpmsg_sdb_stats_t stats;
+};
+
+/*
+ * The statistics are copied under drv->lock and printed after it is
+ * released: the rpmsg callback is not held off by seq_printf().
+ */
+static int rpmsg_sdb_stats_show(struct seq_file *s, void *unused)
+{
+	struct rpmsg_sdb_t *drv = s->private;
+	struct rpmsg_sdb_stats_t stats;
+	struct rpmsg_sdb_buf_stats_t *bufs = NULL;
+	struct sdb_buf_t *pos;
+	unsigned int nb, max = 0, i;
+	u32 outstanding;
+	u64 elapsed;
+
+	/* the array is allocated without the lock, again if buffers were added meanwhile */
+	for (;;) {
+		spin_lock_irq(&drv->lock);
+		nb = 0;
+		list_for_each_entry(pos, &drv->buffer_list, buflist) {
+			if (nb < max) {
+				bufs[nb].index = pos->index;
+				bufs[nb].stats = pos->stats;
+			}
+			nb++;
+		}
+		if (nb <= max)
+			break;
+		spin_unlock_irq(&drv->lock);
+
+		kfree(bufs);
+		max = nb;
+		bufs = kmalloc_array(max, sizeof(*bufs), GFP_KERNEL);
+		if (!bufs)
+			return -ENOMEM;
+	}
+	stats = drv->stats;
+	outstanding = drv->mod.outstanding;
+	elapsed = drv->last_ns - drv->first_ns;
+	spin_unlock_irq(&drv->lock);
+
+	seq_printf(s, "completions: %llu\nbytes: %llu\noverruns: %llu\noutstanding: %u\n",
+		   stats.completions, stats.bytes, stats.overruns, outstanding);
+	/* 976562 = NSEC_PER_SEC / 1024 */
+	seq_printf(s, "rate: %llu KB/s over %llu ms\n",
+		   elapsed ? div64_u64(stats.bytes * 976562, elapsed) : 0,
+		   div_u64(elapsed, NSEC_PER_MSEC));
+	rpmsg_sdb_hist_show(s, "cm4 latency", &stats.cm4_lat);
+	rpmsg_sdb_hist_show(s, "consume latency", &stats.consume_lat);
+	rpmsg_sdb_bins_show(s, &stats.cm4_lat, &stats.consume_lat);
+
+	for (i = 0; i < nb; i++) {
+		seq_printf(s, "buffer %d: completions %llu bytes %llu overruns %llu\n", bufs[i].index,
+			   bufs[i].stats.completions, bufs[i].stats.bytes, bufs[i].stats.overruns);
+		rpmsg_sdb_hist_show(s, "  cm4 latency", &bufs[i].stats.cm4_lat);
+		rpmsg_sdb_hist_show(s, "  consume latency", &bufs[i].stats.consume_lat);
+	}
+	kfree(bufs);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rpmsg_sdb_stats);
+
+/* Same as rpmsg_sdb_stats_show(): the estimate is copied under drv->lock */
+static int rpmsg_sdb_clock_show(struct seq_file *s, void *unused)
+{
+	struct rpmsg_sdb_t *drv = s->private;
+	struct rpmsg_sdb_clock_t *c = &drv->clock;
+	struct rpmsg_sdb_clock_sample_t a;
+	u64 samples, rejected, lost, skew_err, bound = 0;
+	s64 skew;
+	u32 window;
+
+	spin_lock_irq(&drv->lock);
+	samples = c->samples;
+	rejected = c->rejected;
+	lost = drv->clock_lost;
+	window = c->nb;
+	skew = c->skew_ppb;
+	skew_err = c->skew_err_ppb;
+	a = c->s[c->anchor];
+	if (window)
+		bound = rpmsg_sdb_clock_err_at(c, &a, c->remote_us * NSEC_PER_USEC) +
+			RPMSG_SDB_CLOCK_RES_NS / 2;
+	spin_unlock_irq(&drv->lock);
+
+	seq_printf(s, "pings: %llu\nrejected: %llu\nlost: %llu\nwindow: %u\n",
+		   samples, rejected, lost, window);
+	if (window) {
+		seq_printf(s, "offset: %lld ns +/- %llu ns at cm4 %llu us\n", a.offset_ns,
+			   a.err_ns, div_u64(a.remote_ns, NSEC_PER_USEC));
+		seq_printf(s, "cm4 drift: %lld ppb +/- %llu ppb\n", -skew, skew_err);
+		seq_printf(s, "error bound: %llu ns at the last cm4 time\n", bound);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rpmsg_sdb_clock);
+
+/* Userland consumed the completion of buffer. Called with drv->lock held */
+static void rpmsg_sdb_consumed(struct rpmsg_sdb_t *drv, struct sdb_buf_t *buffer, u64 now)
+{
+	u64 lat;
+
+	if (!buffer->complete_ns)
+		return;
+
+	lat = now - buffer->complete_ns;
+	buffer->complete_ns = 0;
+	rpmsg_sdb_hist_add(&buffer->stats.consume_lat, lat);
+	rpmsg_sdb_hist_add(&drv->stats.consume_lat, lat);
+	trace_rpmsg_sdb_consume(buffer->index, lat);
+}
+
+/* Account the completions returned by read() */
+static void rpmsg_sdb_consume_records(struct rpmsg_sdb_t *drv,
+				      const struct rpmsg_sdb_completion *comp, unsigned int nb)
+{
+	u64 now = ktime_get_ns();
+	struct sdb_buf_t *pos;
+	unsigned int i;
+
+	spin_lock_irq(&drv->lock);
+	for (i = 0; i < nb; i++) {
+		list_for_each_entry(pos, &drv->buffer_list, buflist) {
+			if (pos->index == comp[i].bufferId) {
+				rpmsg_sdb_consumed(drv, pos, now);
+				break;
+			}
+		}
+	}
+	rpmsg_sdb_mod_consumed(&drv->mod, nb);
+	spin_unlock_irq(&drv->lock);
+}
+
 static int rpmsg_sdb_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	unsigned long vsize = vma->vm_end - vma->vm_start;
 	unsigned long size = PAGE_ALIGN(vsize);
 	unsigned long NumPages = size >> PAGE_SHIFT;
-	unsigned long align = get_order(size);
 	pgprot_t prot = vma->vm_page_prot;
 	struct rpmsg_sdb_t *_rpmsg_sdb;
 	struct sdb_buf_t *_buffer;
 
-	if (align > CONFIG_CMA_ALIGNMENT)
-		align = CONFIG_CMA_ALIGNMENT;
-
 	if (rpmsg_sdb_dev == NULL)
 		return -ENOMEM;
 
-	rpmsg_sdb_dev->coherent_dma_mask = DMA_BIT_MASK(32);
-	rpmsg_sdb_dev->dma_mask = &rpmsg_sdb_dev->coherent_dma_mask;
-
 	_rpmsg_sdb = container_of(file->private_data, struct rpmsg_sdb_t,
 								mdev);
 
@@ -168,17 +660,21 @@ static int rpmsg_sdb_mmap(struct file *file, struct vm_area_struct *vma)
 		_buffer->uaddr = NULL;
 		_buffer->size = NumPages * PAGE_SIZE;
 		_buffer->writing_size = -1;
-		_buffer->vaddr = dma_alloc_wc(rpmsg_sdb_dev,
-												_buffer->size,
-												&_buffer->paddr,
-												GFP_KERNEL);
+		/* buffers are reused across sessions, the content is not cleared */
+		_buffer->chunk = rpmsg_sdb_buf_get(_rpmsg_sdb, _buffer->size);
 
-		if (!_buffer->vaddr) {
+		if (!_buffer->chunk) {
 			pr_err("%s: Memory allocation issue\n", __func__);
 			return -ENOMEM;
 		}
+		_buffer->vaddr = _buffer->chunk->vaddr;
+		_buffer->paddr = _buffer->chunk->paddr;
+
+		/* same attributes as the kernel mapping of the region */
+		if (_rpmsg_sdb->region_vaddr)
+			prot = pgprot_writecombine(prot);
 
-		printk("%s - dma_alloc_wc done - paddr[%d]:%x - vaddr[%d]:%p\n", __func__, _buffer->index, _buffer->paddr, _buffer->index, _buffer->vaddr);
+		printk("%s - buffer ready - paddr[%d]:%x - vaddr[%d]:%p\n", __func__, _buffer->index, _buffer->paddr, _buffer->index, _buffer->vaddr);
 
 		/* Get address for userland */
 		if (remap_pfn_range(vma, vma->vm_start,
@@ -218,10 +714,20 @@ static int rpmsg_sdb_open(struct inode *inode, struct file *file)
 	_rpmsg_sdb = container_of(file->private_data, struct rpmsg_sdb_t,
 								mdev);
 
+	mutex_init(&_rpmsg_sdb->mutex);
+
+	spin_lock_irq(&_rpmsg_sdb->lock);
 	/* Initialize the buffer list*/
 	INIT_LIST_HEAD(&_rpmsg_sdb->buffer_list);
-
-	mutex_init(&_rpmsg_sdb->mutex);
+	kfifo_reset(&_rpmsg_sdb->comp);
+	rpmsg_sdb_mod_reset(&_rpmsg_sdb->mod);
+	_rpmsg_sdb->comp_dropped = 0;
+	_rpmsg_sdb->deferred_signals = 0;
+	rpmsg_sdb_stats_reset(&_rpmsg_sdb->stats);
+	_rpmsg_sdb->first_ns = 0;
+	_rpmsg_sdb->last_ns = 0;
+	_rpmsg_sdb->cm4_offset_valid = false;
+	spin_unlock_irq(&_rpmsg_sdb->lock);
 
 	return 0;
 }
@@ -244,12 +750,17 @@ static int rpmsg_sdb_close(struct inode *inode, struct file *file)
 	_rpmsg_sdb = container_of(file->private_data, struct rpmsg_sdb_t,
 												mdev);
 
+	hrtimer_cancel(&_rpmsg_sdb->mod_timer);
+
 	list_for_each_entry_safe(pos, next, &_rpmsg_sdb->buffer_list, buflist) {
-		/* Free the CMA allocation */
-		dma_free_wc(rpmsg_sdb_dev, pos->size, pos->vaddr,
-					pos->paddr);
 		/* Remove the buffer from the list */
+		spin_lock_irq(&_rpmsg_sdb->lock);
 		list_del(&pos->buflist);
+		spin_unlock_irq(&_rpmsg_sdb->lock);
+		/* Give the CMA allocation back to the pool */
+		if (pos->chunk)
+			rpmsg_sdb_buf_put(_rpmsg_sdb, pos->chunk);
+		eventfd_ctx_put(pos->efd_ctx);
 		/* Free the buffer */
 		kfree(pos);
 	}
@@ -309,11 +820,24 @@ static long rpmsg_sdb_ioctl(struct file *file, unsigned int cmd, unsigned long a
 		}
 
 		/* create a new buffer which will be added in the buffer list */
-		buffer = kmalloc(sizeof(struct sdb_buf_t), GFP_KERNEL);
+		buffer = kzalloc(sizeof(struct sdb_buf_t), GFP_KERNEL);
+		if (!buffer) {
+			mutex_unlock(&_rpmsg_sdb->mutex);
+			return -ENOMEM;
+		}
 
 		buffer->index = idx;
+		rpmsg_sdb_stats_reset(&buffer->stats);
 		buffer->efd_ctx = eventfd_ctx_fdget(q_set_efd.eventfd);
+		if (IS_ERR(buffer->efd_ctx)) {
+			mutex_unlock(&_rpmsg_sdb->mutex);
+			idx = PTR_ERR(buffer->efd_ctx);
+			kfree(buffer);
+			return idx;
+		}
+		spin_lock_irq(&_rpmsg_sdb->lock);
 		list_add_tail(&buffer->buflist, &_rpmsg_sdb->buffer_list);
+		spin_unlock_irq(&_rpmsg_sdb->lock);
 
 		mutex_unlock(&_rpmsg_sdb->mutex);
 		break;
@@ -350,6 +874,11 @@ static long rpmsg_sdb_ioctl(struct file *file, unsigned int cmd, unsigned long a
 		/* Reset the writing size*/
 		datastructureptr->writing_size = -1;
 
+		spin_lock_irq(&_rpmsg_sdb->lock);
+		rpmsg_sdb_consumed(_rpmsg_sdb, datastructureptr, ktime_get_ns());
+		rpmsg_sdb_mod_consumed(&_rpmsg_sdb->mod, 1);
+		spin_unlock_irq(&_rpmsg_sdb->lock);
+
 		break;
 	default:
 		return -EINVAL;
@@ -358,38 +887,329 @@ static long rpmsg_sdb_ioctl(struct file *file, unsigned int cmd, unsigned long a
 	return 0;
 }
 
+/**
+ * rpmsg_sdb_read - Read the completions
+ *
+ * @file:	file struct
+ * @buf:	user buffer, filled with struct rpmsg_sdb_completion
+ * @count:	size of buf
+ * @ppos:	unused
+ *
+ * Return:
+ *	Number of bytes read, as many completions as fit in buf
+ *	Negative - Failure
+ */
+static ssize_t rpmsg_sdb_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct rpmsg_sdb_completion comp[16];
+	struct rpmsg_sdb_t *_rpmsg_sdb;
+	size_t copied = 0;
+	unsigned int nb;
+	int ret = 0;
+
+	_rpmsg_sdb = container_of(file->private_data, struct rpmsg_sdb_t,
+								mdev);
+
+	count = rounddown(count, sizeof(struct rpmsg_sdb_completion));
+	if (!count)
+		return -EINVAL;
+
+	do {
+		if (kfifo_is_empty(&_rpmsg_sdb->comp)) {
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			ret = wait_event_interruptible(_rpmsg_sdb->wq,
+						       !kfifo_is_empty(&_rpmsg_sdb->comp));
+			if (ret)
+				return ret;
+		}
+
+		if (mutex_lock_interruptible(&_rpmsg_sdb->read_lock))
+			return -ERESTARTSYS;
+		/* through a bounce buffer to account the consume latency of each record */
+		while (copied < count) {
+			nb = kfifo_out(&_rpmsg_sdb->comp, comp,
+				       min_t(size_t, (count - copied) / sizeof(comp[0]), ARRAY_SIZE(comp)));
+			if (!nb)
+				break;
+			if (copy_to_user(buf + copied, comp, nb * sizeof(comp[0])))
+				ret = -EFAULT;
+			rpmsg_sdb_consume_records(_rpmsg_sdb, comp, nb);
+			if (ret)
+				break;
+			copied += nb * sizeof(comp[0]);
+		}
+		mutex_unlock(&_rpmsg_sdb->read_lock);
+		if (ret)
+			return ret;
+	} while (!copied);
+
+	return copied;
+}
+
+static __poll_t rpmsg_sdb_poll(struct file *file, poll_table *wait)
+{
+	struct rpmsg_sdb_t *_rpmsg_sdb;
+
+	_rpmsg_sdb = container_of(file->private_data, struct rpmsg_sdb_t,
+								mdev);
+
+	poll_wait(file, &_rpmsg_sdb->wq, wait);
+	return kfifo_is_empty(&_rpmsg_sdb->comp) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
 static const struct file_operations rpmsg_sdb_fops = {
 	.owner			= THIS_MODULE,
 	.unlocked_ioctl	= rpmsg_sdb_ioctl,
 	.mmap			= rpmsg_sdb_mmap,
 	.open           = rpmsg_sdb_open,
 	.release        = rpmsg_sdb_close,
+	.read			= rpmsg_sdb_read,
+	.poll			= rpmsg_sdb_poll,
 };
 
-static int rpmsg_sdb_drv_cb(struct rpmsg_device *rpdev, void *data, int len,
-			void *priv, u32 src)
+/* Called with drv->lock held */
+static void rpmsg_sdb_signal_pending(struct rpmsg_sdb_t *drv)
 {
-	int ret = 0;
-	int buffer_id = 0;
-	size_t buffer_size;
-	char rpmsg_RxBuf[len+1];
-	struct list_head *pos;
-	struct sdb_buf_t *datastructureptr = NULL;
+	struct sdb_buf_t *pos;
+	u32 nb = 0;
+
+	list_for_each_entry(pos, &drv->buffer_list, buflist) {
+		if (pos->signal_pending) {
+			eventfd_signal(pos->efd_ctx, 1);
+			pos->signal_pending = false;
+			nb++;
+		}
+	}
+	trace_rpmsg_sdb_signal(nb);
+	wake_up_interruptible(&drv->wq);
+}
 
-	struct rpmsg_sdb_t *drv = dev_get_drvdata(&rpdev->dev);
+static enum hrtimer_restart rpmsg_sdb_mod_timer(struct hrtimer *timer)
+{
+	struct rpmsg_sdb_t *drv = container_of(timer, struct rpmsg_sdb_t, mod_timer);
+	enum hrtimer_restart restart = HRTIMER_NORESTART;
+	unsigned long flags;
+
+	spin_lock_irqsave(&drv->lock, flags);
+	switch (rpmsg_sdb_mod_timeout(&drv->mod, ktime_get_ns())) {
+	case RPMSG_SDB_MOD_SIGNAL:
+		rpmsg_sdb_signal_pending(drv);
+		break;
+	case RPMSG_SDB_MOD_DEFER:
+		hrtimer_set_expires(timer, ns_to_ktime(rpmsg_sdb_mod_deadline(&drv->mod)));
+		restart = HRTIMER_RESTART;
+		break;
+	default:
+		break;
+	}
+	spin_unlock_irqrestore(&drv->lock, flags);
 
-	if (len == 0) {
-		dev_err(rpmsg_sdb_dev, "(%s) Empty lenght requested\n", __func__);
+	return restart;
+}
+
+/*
+ * Latency from the CM4 timestamp, relative to the smallest offset between
+ * both clocks seen in the session. Called with drv->lock held.
+ */
+static u64 rpmsg_sdb_cm4_latency(struct rpmsg_sdb_t *drv, u64 now, u32 cm4_us)
+{
+	u32 offset = (u32)div_u64(now, NSEC_PER_USEC) - cm4_us;
+
+	if (!drv->cm4_offset_valid || (s32)(offset - drv->cm4_offset_us) < 0) {
+		drv->cm4_offset_us = offset;
+		drv->cm4_offset_valid = true;
+	}
+	return (u64)(offset - drv->cm4_offset_us) * NSEC_PER_USEC;
+}
+
+/* Called with drv->lock held */
+static void rpmsg_sdb_complete(struct rpmsg_sdb_t *drv, struct sdb_buf_t *buffer,
+			       u32 cm4_us, bool has_ts)
+{
+	struct rpmsg_sdb_completion comp = {
+		.bufferId = buffer->index,
+		.size = buffer->writing_size,
+		.ts_ns = ktime_get_ns(),
+	};
+	s64 cm4_lat = -1;
+
+	if (buffer->complete_ns) {
+		buffer->stats.overruns++;
+		drv->stats.overruns++;
+		trace_rpmsg_sdb_overrun(buffer->index);
+	}
+	buffer->complete_ns = comp.ts_ns;
+	if (!drv->first_ns)
+		drv->first_ns = comp.ts_ns;
+	drv->last_ns = comp.ts_ns;
+
+	buffer->stats.completions++;
+	buffer->stats.bytes += comp.size;
+	drv->stats.completions++;
+	drv->stats.bytes += comp.size;
+	if (has_ts) {
+		if (!rpmsg_sdb_clock_to_local(&drv->clock, cm4_us, &comp.cm4_ns, &comp.cm4_err_ns))
+			cm4_lat = comp.ts_ns > comp.cm4_ns ? comp.ts_ns - comp.cm4_ns : 0;
+		else
+			cm4_lat = rpmsg_sdb_cm4_latency(drv, comp.ts_ns, cm4_us);
+		rpmsg_sdb_hist_add(&buffer->stats.cm4_lat, cm4_lat);
+		rpmsg_sdb_hist_add(&drv->stats.cm4_lat, cm4_lat);
+	}
+	trace_rpmsg_sdb_complete(buffer->index, comp.size, cm4_lat);
+
+	if (!kfifo_put(&drv->comp, comp))
+		drv->comp_dropped++;
+
+	buffer->signal_pending = true;
+	switch (rpmsg_sdb_mod_complete(&drv->mod, comp.ts_ns)) {
+	case RPMSG_SDB_MOD_SIGNAL:
+		rpmsg_sdb_signal_pending(drv);
+		break;
+	case RPMSG_SDB_MOD_DEFER:
+		drv->deferred_signals++;
+		if (!hrtimer_active(&drv->mod_timer))
+			hrtimer_start(&drv->mod_timer, ns_to_ktime(rpmsg_sdb_mod_deadline(&drv->mod)),
+				      HRTIMER_MODE_ABS);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Ping of the CM4 clock, "Pxxxxxxxx" with a sequence number, answered with
+ * "PxxxxxxxxRyyyyyyyyTzzzzzzzz": the CM4 times in us of the receive and of
+ * the answer. A ping still unanswered at the next one is lost. The window
+ * is filled 8 times faster so that the drift is estimated early.
+ */
+static void rpmsg_sdb_clock_ping(struct work_struct *work)
+{
+	struct rpmsg_sdb_t *drv = container_of(to_delayed_work(work), struct rpmsg_sdb_t,
+					       clock_work);
+	unsigned int period = clock_sync_ms;
+	char msg[16];
+	int len, ret;
+
+	spin_lock_irq(&drv->lock);
+	if (drv->clock_t1_ns)
+		drv->clock_lost++;
+	if (drv->clock.nb < RPMSG_SDB_CLOCK_SAMPLES)
+		period = DIV_ROUND_UP(period, 8);
+	len = snprintf(msg, sizeof(msg), "P%08x", ++drv->clock_seq);
+	drv->clock_t1_ns = ktime_get_ns();
+	spin_unlock_irq(&drv->lock);
+
+	/* no wait for a free buffer: the round trip would include it */
+	ret = rpmsg_trysend(drv->rpdev->ept, msg, len);
+	if (ret) {
+		spin_lock_irq(&drv->lock);
+		drv->clock_t1_ns = 0;
+		spin_unlock_irq(&drv->lock);
+	}
+
+	schedule_delayed_work(&drv->clock_work, msecs_to_jiffies(period));
+}
+
+/* Answer of the CM4 to a ping, received at t4 */
+static int rpmsg_sdb_clock_answer(struct rpmsg_sdb_t *drv, const char *msg, u64 t4)
+{
+	unsigned long flags;
+	u32 seq, t2, t3;
+
+	if (sscanf(msg, "P%8xR%8xT%8x", &seq, &t2, &t3) != 3)
 		return -EINVAL;
+
+	spin_lock_irqsave(&drv->lock, flags);
+	if (drv->clock_t1_ns && seq == drv->clock_seq) {
+		rpmsg_sdb_clock_add(&drv->clock, drv->clock_t1_ns, t2, t3, t4);
+		drv->clock_t1_ns = 0;
 	}
+	spin_unlock_irqrestore(&drv->lock, flags);
 
-    //dev_err(rpmsg_sdb_dev, "(%s) lenght: %d\n", __func__,len);
+	return 0;
+}
 
-	memcpy(rpmsg_RxBuf, data, len);
+#define RPMSG_SDB_COUNTER_ATTR(_name, _expr) \
+static ssize_t _name##_show(struct device *d, struct device_attribute *attr, char *buf) \
+{ \
+	struct miscdevice *misc = dev_get_drvdata(d); \
+	struct rpmsg_sdb_t *drv = container_of(misc, struct rpmsg_sdb_t, mdev); \
+	return sprintf(buf, "%llu\n", (unsigned long long)READ_ONCE(_expr)); \
+} \
+static DEVICE_ATTR_RO(_name)
+
+RPMSG_SDB_COUNTER_ATTR(completions, drv->mod.completions);
+RPMSG_SDB_COUNTER_ATTR(signals, drv->mod.signals);
+RPMSG_SDB_COUNTER_ATTR(deferred, drv->deferred_signals);
+RPMSG_SDB_COUNTER_ATTR(outstanding, drv->mod.outstanding);
+RPMSG_SDB_COUNTER_ATTR(completions_dropped, drv->comp_dropped);
+RPMSG_SDB_COUNTER_ATTR(bytes, drv->stats.bytes);
+RPMSG_SDB_COUNTER_ATTR(overruns, drv->stats.overruns);
+RPMSG_SDB_COUNTER_ATTR(frag_messages, drv->frag.messages);
+RPMSG_SDB_COUNTER_ATTR(frag_dropped, drv->frag.dropped);
+
+#define RPMSG_SDB_MODERATION_ATTR(_name, _min) \
+static ssize_t moderation_##_name##_show(struct device *d, struct device_attribute *attr, char *buf) \
+{ \
+	struct miscdevice *misc = dev_get_drvdata(d); \
+	struct rpmsg_sdb_t *drv = container_of(misc, struct rpmsg_sdb_t, mdev); \
+	return sprintf(buf, "%u\n", READ_ONCE(drv->mod._name)); \
+} \
+static ssize_t moderation_##_name##_store(struct device *d, struct device_attribute *attr, \
+			     const char *buf, size_t count) \
+{ \
+	struct miscdevice *misc = dev_get_drvdata(d); \
+	struct rpmsg_sdb_t *drv = container_of(misc, struct rpmsg_sdb_t, mdev); \
+	unsigned int val; \
+	int ret = kstrtouint(buf, 0, &val); \
+	if (ret) \
+		return ret; \
+	if (val < _min) \
+		return -EINVAL; \
+	spin_lock_irq(&drv->lock); \
+	drv->mod._name = val; \
+	spin_unlock_irq(&drv->lock); \
+	return count; \
+} \
+static DEVICE_ATTR_RW(moderation_##_name)
+
+/* a deferred signal needs a timeout: usecs >= 1 */
+RPMSG_SDB_MODERATION_ATTR(count, 0);
+RPMSG_SDB_MODERATION_ATTR(usecs, 1);
+
+static struct attribute *rpmsg_sdb_attrs[] = {
+	&dev_attr_moderation_count.attr,
+	&dev_attr_moderation_usecs.attr,
+	&dev_attr_completions.attr,
+	&dev_attr_signals.attr,
+	&dev_attr_deferred.attr,
+	&dev_attr_outstanding.attr,
+	&dev_attr_completions_dropped.attr,
+	&dev_attr_bytes.attr,
+	&dev_attr_overruns.attr,
+	&dev_attr_frag_messages.attr,
+	&dev_attr_frag_dropped.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(rpmsg_sdb);
 
-    rpmsg_RxBuf[len] = 0;
+/* Whole message of the copro received at rx_ns, NUL terminated, modified by the decoding */
+static int rpmsg_sdb_drv_msg(struct rpmsg_sdb_t *drv, char *rpmsg_RxBuf, u64 rx_ns)
+{
+	int ret = 0;
+	int buffer_id = 0;
+	size_t buffer_size;
+	u32 cm4_us = 0;
+	bool has_ts = false;
+	struct list_head *pos;
+	struct sdb_buf_t *datastructureptr = NULL;
+	unsigned long flags;
 
-	ret = rpmsg_sdb_decode_rxbuf_string(rpmsg_RxBuf, &buffer_id, &buffer_size);
+	if (rpmsg_RxBuf[0] == 'P')
+		return rpmsg_sdb_clock_answer(drv, rpmsg_RxBuf, rx_ns);
+
+	ret = rpmsg_sdb_decode_rxbuf_string(rpmsg_RxBuf, &buffer_id, &buffer_size, &cm4_us, &has_ts);
 	if (ret < 0)
 		goto out;
 
@@ -399,6 +1219,7 @@ static int rpmsg_sdb_drv_cb(struct rpmsg_device *rpdev, void *data, int len,
 	}
 
 	/* Signal to User space application */
+	spin_lock_irqsave(&drv->lock, flags);
 	list_for_each(pos, &drv->buffer_list)
 	{
 		datastructureptr = list_entry(pos, struct sdb_buf_t, buflist);
@@ -408,36 +1229,89 @@ static int rpmsg_sdb_drv_cb(struct rpmsg_device *rpdev, void *data, int len,
 			if (datastructureptr->writing_size > datastructureptr->size) {
 				dev_err(rpmsg_sdb_dev, "(%s) Writing size is bigger than buffer size\n", __func__);
 				ret = -EINVAL;
-				goto out;
+				break;
 			}
 
-			eventfd_signal(datastructureptr->efd_ctx, 1);
+			rpmsg_sdb_complete(drv, datastructureptr, cm4_us, has_ts);
 			break;
 		}
 		/* TODO: quid if nothing find during the loop ? */
 	}
+	spin_unlock_irqrestore(&drv->lock, flags);
 
 out:
 	return ret;
 }
 
+static int rpmsg_sdb_drv_cb(struct rpmsg_device *rpdev, void *data, int len,
+			void *priv, u32 src)
+{
+	u64 rx_ns = ktime_get_ns();
+	struct rpmsg_sdb_t *drv = dev_get_drvdata(&rpdev->dev);
+	char rpmsg_RxBuf[len+1];
+	int ret;
+
+	if (len == 0) {
+		dev_err(rpmsg_sdb_dev, "(%s) Empty lenght requested\n", __func__);
+		return -EINVAL;
+	}
+
+	/* fragment of a message longer than an rpmsg buffer, see rpmsg_sdb_frag.h */
+	if (rpmsg_sdb_frag_is_frag(data, len)) {
+		ret = rpmsg_sdb_frag_add(&drv->frag, data, len);
+		if (ret <= 0)
+			return ret;
+		drv->frag.buf[ret] = 0;
+		return rpmsg_sdb_drv_msg(drv, (char *)drv->frag.buf, rx_ns);
+	}
+
+	memcpy(rpmsg_RxBuf, data, len);
+	rpmsg_RxBuf[len] = 0;
+
+	return rpmsg_sdb_drv_msg(drv, rpmsg_RxBuf, rx_ns);
+}
+
 static int rpmsg_sdb_drv_probe(struct rpmsg_device *rpdev)
 {
 	int ret = 0;
 	struct device *dev = &rpdev->dev;
 	struct rpmsg_sdb_t *rpmsg_sdb;
+	u8 *frag_buf;
 
 	rpmsg_sdb = devm_kzalloc(dev, sizeof(*rpmsg_sdb), GFP_KERNEL);
-	if (!rpmsg_sdb)
+	/* + 1: the messages are NUL terminated for the decoding */
+	frag_buf = devm_kmalloc(dev, RPMSG_SDB_FRAG_MAX_LEN + 1, GFP_KERNEL);
+	if (!rpmsg_sdb || !frag_buf)
 		return -ENOMEM;
 
 	mutex_init(&rpmsg_sdb->mutex);
+	INIT_LIST_HEAD(&rpmsg_sdb->buffer_list);
+
+	spin_lock_init(&rpmsg_sdb->lock);
+	INIT_KFIFO(rpmsg_sdb->comp);
+	mutex_init(&rpmsg_sdb->read_lock);
+	init_waitqueue_head(&rpmsg_sdb->wq);
+	rpmsg_sdb->mod.count = moderation_count;
+	rpmsg_sdb->mod.usecs = moderation_usecs ? moderation_usecs : 1;
+	hrtimer_init(&rpmsg_sdb->mod_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	rpmsg_sdb->mod_timer.function = rpmsg_sdb_mod_timer;
+	mutex_init(&rpmsg_sdb->pool_lock);
+	rpmsg_sdb_clock_reset(&rpmsg_sdb->clock);
+	INIT_DELAYED_WORK(&rpmsg_sdb->clock_work, rpmsg_sdb_clock_ping);
+	rpmsg_sdb_frag_init(&rpmsg_sdb->frag, frag_buf, RPMSG_SDB_FRAG_MAX_LEN);
 
 	rpmsg_sdb->rpdev = rpdev;
 
 	rpmsg_sdb->mdev.name = "rpmsg-sdb";
 	rpmsg_sdb->mdev.minor = MISC_DYNAMIC_MINOR;
 	rpmsg_sdb->mdev.fops = &rpmsg_sdb_fops;
+	rpmsg_sdb->mdev.groups = rpmsg_sdb_groups;
+
+	ret = rpmsg_sdb_region_setup(dev, rpmsg_sdb);
+	if (ret) {
+		dev_err(dev, "Failed to map the memory-region\n");
+		goto err_out;
+	}
 
 	dev_set_drvdata(&rpdev->dev, rpmsg_sdb);
 
@@ -451,6 +1325,22 @@ static int rpmsg_sdb_drv_probe(struct rpmsg_device *rpdev)
 
 	rpmsg_sdb_dev = rpmsg_sdb->mdev.this_device;
 
+	rpmsg_sdb_dev->coherent_dma_mask = DMA_BIT_MASK(32);
+	rpmsg_sdb_dev->dma_mask = &rpmsg_sdb_dev->coherent_dma_mask;
+
+	rpmsg_sdb_pool_init(rpmsg_sdb);
+
+	rpmsg_sdb->debugfs = debugfs_create_dir("rpmsg_sdb", NULL);
+	debugfs_create_file("pool", 0444, rpmsg_sdb->debugfs, rpmsg_sdb,
+			    &rpmsg_sdb_pool_fops);
+	debugfs_create_file("stats", 0444, rpmsg_sdb->debugfs, rpmsg_sdb,
+			    &rpmsg_sdb_stats_fops);
+	debugfs_create_file("clock", 0444, rpmsg_sdb->debugfs, rpmsg_sdb,
+			    &rpmsg_sdb_clock_fops);
+
+	if (clock_sync_ms)
+		schedule_delayed_work(&rpmsg_sdb->clock_work, 0);
+
 	dev_info(dev, "%s probed\n", rpmsg_sdb_driver_name);
 
 err_out:
@@ -461,7 +1351,11 @@ static void rpmsg_sdb_drv_remove(struct rpmsg_device *rpmsgdev)
 {
 	struct rpmsg_sdb_t *drv = dev_get_drvdata(&rpmsgdev->dev);
 
+	cancel_delayed_work_sync(&drv->clock_work);
+	debugfs_remove_recursive(drv->debugfs);
 	misc_deregister(&drv->mdev);
+	hrtimer_cancel(&drv->mod_timer);
+	rpmsg_sdb_pool_release(drv);
 }
 
 static struct rpmsg_device_id rpmsg_driver_sdb_id_table[] = {
@@ -0,0 +1,96 @@
+/*
+ * cm4_sim.c
+ * Host harness of the CM4 firmware code that does not need the hardware:
+ * the sources of the exchange projects are built here as they are, the
+ * HAL is replaced by stub/stm32mp1xx_hal.h.
+ *
+ * "cm4_sim log" checks the binary event ring of openamp_log.c and
+ * compares the cost of an event with the printf of the text log, see
+ * log_check.c. "cm4_sim prof" checks the aggregation of the cycle probes
+ * of cm4_prof.c over the fake DWT counter, see prof_check.c. "cm4_sim
+ * status" checks the status event queue of status_evt.c, see
+ * status_check.c. "cm4_sim frag" checks the fragments of the long
+ * messages of rpmsg_hdr.c against the reassembly of the rpmsg_sdb driver,
+ * see frag_check.c.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stm32mp1xx_hal.h"
+#include "cm4_sim.h"
+
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+volatile uint32_t *sim_excl_addr;
+uint32_t sim_primask;
+
+static void (*irq_fn)(void);
+static int irq_pct;
+static int in_irq;
+static uint32_t seed = 1;
+
+uint32_t sim_rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+double sim_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void sim_set_irq(void (*fn)(void), int pct)
+{
+    irq_fn = fn;
+    irq_pct = pct;
+}
+
+void sim_strex_hook(void)
+{
+    if (!irq_fn || in_irq || sim_primask || (int)(sim_rnd() % 100) >= irq_pct)
+        return;
+
+    /* The exception entry and return clear the local monitor */
+    in_irq = 1;
+    sim_excl_addr = NULL;
+    irq_fn();
+    sim_excl_addr = NULL;
+    in_irq = 0;
+}
+
+uint32_t HAL_GetTick(void)
+{
+    return sim_dwt.CYCCNT / 209000;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage : \n");
+    printf("%s log [-n <events>]\n", prog);
+    printf("%s prof [-n <snapshots>]\n", prog);
+    printf("%s status [-n <steps>]\n", prog);
+    printf("%s frag [-n <messages>]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "log"))
+        return log_check_main(argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "prof"))
+        return prof_check_main(argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "status"))
+        return status_check_main(argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "frag"))
+        return frag_check_main(argc - 1, argv + 1);
+
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,30 @@
+/*
+ * cm4_sim.h
+ * Host harness of the CM4 firmware code that does not need the hardware,
+ * see cm4_sim.c.
+ */
+
+#ifndef CM4_SIM_H
+#define CM4_SIM_H
+
+#include <stdint.h>
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("check failed line %d: %s\n", __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+/* Interrupt run between a LDREX and its STREX in pct % of them, NULL: none */
+void sim_set_irq(void (*fn)(void), int pct);
+
+uint32_t sim_rnd(void);
+double sim_now_ns(void);
+
+int log_check_main(int argc, char **argv);
+int prof_check_main(int argc, char **argv);
+int status_check_main(int argc, char **argv);
+int frag_check_main(int argc, char **argv);
+
+#endif /* CM4_SIM_H */
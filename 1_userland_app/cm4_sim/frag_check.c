@@ -0,0 +1,233 @@
+/*
+ * frag_check.c
+ * Checks of the fragments of RPMSG_HDR_Transmit() (rpmsg_hdr.c of
+ * exchange_large_buf) against the reassembly of the rpmsg_sdb driver,
+ * rpmsg_sdb_frag.h.
+ *
+ * OPENAMP_send() of the stub keeps the rpmsg sent, each one is then given
+ * to the reassembly like the rpmsg callback of the driver does. The
+ * checks cover:
+ *   - the messages that fit one buffer sent as they are, the ones
+ *     starting with the magic byte of a fragment framed anyway;
+ *   - every length up to the reassembly buffer, every rpmsg within the
+ *     buffer size and the message rebuilt as it was sent;
+ *   - the messages with too many fragments refused, nothing sent;
+ *   - a fragment lost or out of order: the message dropped, counted once,
+ *     and the next one reassembled.
+ * Then random messages, with fragments lost now and then, are compared
+ * with the ones delivered by the reassembly. The checks stop at the first
+ * failure.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rpmsg_hdr.h"
+#include "rpmsg_sdb_frag.h"
+#include "cm4_sim.h"
+
+#define PAYLOAD     (RPMSG_BUFFER_SIZE - 16)    /* OPENAMP_get_buffer_size() */
+#define MAX_LEN     4096                        /* RPMSG_SDB_FRAG_MAX_LEN of the driver */
+#define MAX_SENT    (MAX_LEN / 8 + 2)
+
+/* rpmsg sent by RPMSG_HDR_Transmit() */
+typedef struct
+{
+    uint8_t data[RPMSG_BUFFER_SIZE];
+    uint32_t len;
+} sent_t;
+
+static sent_t sent[MAX_SENT];
+static uint32_t nb_sent;
+static int buffer_size = PAYLOAD;
+
+int OPENAMP_create_endpoint(struct rpmsg_endpoint *ept, const char *name,
+                            uint32_t dest, rpmsg_ept_cb cb, void *unbind_cb)
+{
+    ept->cb = cb;
+    return 0;
+}
+
+void OPENAMP_destroy_ept(struct rpmsg_endpoint *ept)
+{
+    ept->cb = NULL;
+}
+
+int OPENAMP_get_buffer_size(void)
+{
+    return buffer_size;
+}
+
+int OPENAMP_send(struct rpmsg_endpoint *ept, const void *data, int len)
+{
+    if (nb_sent == MAX_SENT || len > buffer_size)
+        return -1;
+    memcpy(sent[nb_sent].data, data, len);
+    sent[nb_sent++].len = len;
+    return len;
+}
+
+/*
+ * Give the rpmsg sent, but the one at index lost, to the
+ * reassembly as rpmsg_sdb_drv_cb() does. Returns the length of the last
+ * message delivered, -1 if none.
+ */
+static int receive(struct rpmsg_sdb_frag_t *f, uint32_t lost, uint8_t *msg)
+{
+    int ret, len = -1;
+    uint32_t i;
+
+    for (i = 0; i < nb_sent; i++) {
+        if (i == lost)
+            continue;
+        if (!rpmsg_sdb_frag_is_frag(sent[i].data, sent[i].len)) {
+            memcpy(msg, sent[i].data, sent[i].len);
+            len = sent[i].len;
+            continue;
+        }
+        ret = rpmsg_sdb_frag_add(f, sent[i].data, sent[i].len);
+        if (ret > 0) {
+            memcpy(msg, f->buf, ret);
+            len = ret;
+        }
+    }
+    return len;
+}
+
+static void fill(uint8_t *data, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+        data[i] = sim_rnd();
+}
+
+static int run_checks(uint32_t steps)
+{
+    static uint8_t data[MAX_LEN + 1], msg[MAX_LEN + 1], reasm[MAX_LEN];
+    RPMSG_HDR_HandleTypeDef hdr;
+    struct rpmsg_sdb_frag_t f;
+    uint32_t i, len, chunk, messages, lost = 0, delivered = 0, framed = 0;
+    uint32_t dropped;
+
+    CHECK(sizeof(RPMSG_HDR_FragTypeDef) == sizeof(struct rpmsg_sdb_frag_hdr));
+    CHECK(RPMSG_HDR_FRAG_MAGIC == RPMSG_SDB_FRAG_MAGIC &&
+          RPMSG_HDR_FRAG_LAST == RPMSG_SDB_FRAG_LAST);
+    CHECK(RPMSG_HDR_Init(&hdr) == RPMSG_HDR_OK);
+    rpmsg_sdb_frag_init(&f, reasm, MAX_LEN);
+    chunk = PAYLOAD - sizeof(RPMSG_HDR_FragTypeDef);
+
+    /* One buffer: as it is, unless it starts like a fragment */
+    nb_sent = 0;
+    CHECK(RPMSG_HDR_Transmit(&hdr, (uint8_t *)"B3L1024T123", 11) == RPMSG_HDR_OK);
+    CHECK(nb_sent == 1 && sent[0].len == 11 && !memcmp(sent[0].data, "B3L1024T123", 11));
+    memset(data, 'x', PAYLOAD);
+    nb_sent = 0;
+    CHECK(RPMSG_HDR_Transmit(&hdr, data, PAYLOAD) == RPMSG_HDR_OK);
+    CHECK(nb_sent == 1 && sent[0].len == PAYLOAD);
+    data[0] = RPMSG_HDR_FRAG_MAGIC;
+    nb_sent = 0;
+    CHECK(RPMSG_HDR_Transmit(&hdr, data, 20) == RPMSG_HDR_OK);
+    CHECK(nb_sent == 1 && rpmsg_sdb_frag_is_frag(sent[0].data, sent[0].len));
+    CHECK(receive(&f, ~0U, msg) == 20 && !memcmp(msg, data, 20));
+
+    /* Every length up to the reassembly buffer */
+    for (len = 1; len <= MAX_LEN; len++) {
+        fill(data, len);
+        nb_sent = 0;
+        CHECK(RPMSG_HDR_Transmit(&hdr, data, len) == RPMSG_HDR_OK);
+        if (len <= PAYLOAD && data[0] != RPMSG_HDR_FRAG_MAGIC)
+            CHECK(nb_sent == 1);
+        else
+            CHECK(nb_sent == (len + chunk - 1) / chunk);
+        for (i = 0; i < nb_sent; i++)
+            CHECK(sent[i].len <= PAYLOAD);
+        CHECK(receive(&f, ~0U, msg) == (int)len && !memcmp(msg, data, len));
+    }
+    CHECK(f.dropped == 0 && !f.active);
+
+    /* Longer than the reassembly buffer: dropped by the driver */
+    nb_sent = 0;
+    CHECK(RPMSG_HDR_Transmit(&hdr, data, MAX_LEN + 1) == RPMSG_HDR_OK);
+    CHECK(receive(&f, ~0U, msg) == -1 && f.dropped == 1);
+
+    /* Too many fragments: refused, the index of the fragment is 8 bits */
+    buffer_size = 64;
+    nb_sent = 0;
+    CHECK(RPMSG_HDR_Transmit(&hdr, data, RPMSG_HDR_FRAG_MAX * (64 - 8) + 1) == RPMSG_HDR_ERROR);
+    CHECK(nb_sent == 0);
+    CHECK(RPMSG_HDR_Transmit(&hdr, data, RPMSG_HDR_FRAG_MAX * (64 - 8)) == RPMSG_HDR_OK);
+    CHECK(nb_sent == RPMSG_HDR_FRAG_MAX && sent[nb_sent - 1].data[2] == RPMSG_HDR_FRAG_MAX - 1);
+    buffer_size = PAYLOAD;
+
+    /* Lost: the first, a middle and the last fragment, then out of order */
+    for (i = 0; i < 3; i++) {
+        messages = f.messages;
+        dropped = f.dropped;
+        nb_sent = 0;
+        fill(data, 3 * chunk);
+        CHECK(RPMSG_HDR_Transmit(&hdr, data, 3 * chunk) == RPMSG_HDR_OK && nb_sent == 3);
+        fill(data, 2 * chunk);
+        CHECK(RPMSG_HDR_Transmit(&hdr, data, 2 * chunk) == RPMSG_HDR_OK && nb_sent == 5);
+        CHECK(receive(&f, i, msg) == 2 * (int)chunk && !memcmp(msg, data, 2 * chunk));
+        CHECK(f.messages == messages + 1 && f.dropped == dropped + 1);
+    }
+    nb_sent = 0;
+    CHECK(RPMSG_HDR_Transmit(&hdr, data, 3 * chunk) == RPMSG_HDR_OK);
+    memcpy(&sent[nb_sent], &sent[1], sizeof(sent[0]));
+    memcpy(&sent[1], &sent[2], sizeof(sent[0]));
+    memcpy(&sent[2], &sent[nb_sent], sizeof(sent[0]));
+    dropped = f.dropped;
+    CHECK(receive(&f, ~0U, msg) == -1 && f.dropped == dropped + 1);
+
+    /* Random messages, with fragments lost */
+    messages = f.messages;
+    dropped = f.dropped;
+    for (i = 0; i < steps; i++) {
+        uint32_t loss = ~0U;
+
+        len = 1 + sim_rnd() % (sim_rnd() % 4 ? PAYLOAD : MAX_LEN);
+        fill(data, len);
+        nb_sent = 0;
+        CHECK(RPMSG_HDR_Transmit(&hdr, data, len) == RPMSG_HDR_OK);
+        /* only the fragments lost, a lost rpmsg is not the business of the reassembly */
+        if (nb_sent > 1 && !(sim_rnd() % 8))
+            loss = sim_rnd() % nb_sent;
+        if (loss == ~0U) {
+            CHECK(receive(&f, loss, msg) == (int)len && !memcmp(msg, data, len));
+            delivered++;
+            framed += rpmsg_sdb_frag_is_frag(sent[0].data, sent[0].len);
+        } else {
+            CHECK(receive(&f, loss, msg) == -1);
+            lost++;
+        }
+    }
+    /* a message without its last fragment is dropped by the next one */
+    CHECK(f.messages - messages == framed && f.dropped - dropped + f.active == lost);
+
+    printf("checks passed, %u messages: %u delivered, %u lost, %u dropped\n",
+           steps, delivered, lost, f.dropped);
+    return 0;
+}
+
+int frag_check_main(int argc, char **argv)
+{
+    uint32_t steps = 100000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            steps = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            printf("Usage : %s [-n <messages>]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    return run_checks(steps) ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * log_check.c
+ * Checks and cost of the binary event ring of openamp_log.c.
+ *
+ * The events are read back as cm4_trace reads them on Linux: from the
+ * last record read up to head, a record whose sequence is not the
+ * expected one is dropped (being written or overwritten), a gap larger
+ * than the ring is reported as lost events. The checks cover the records
+ * in order, the wrap of the ring, the overflow accounting, a torn record,
+ * and interrupts that log between the LDREX and the STREX of the thread:
+ * every event must be stored once. They stop at the first failure.
+ *
+ * The cost of a log_evt4() is then compared with the one of the text log
+ * it replaced: the log_info() line formatted, then stored a character at
+ * a time by log_buff(), as __io_putchar() does.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "openamp_log.h"
+#include "cm4_sim.h"
+
+#define NB_REC      SYSTEM_EVT_NB_REC
+#define EVT_THREAD  1
+#define EVT_IRQ     2
+
+void log_buff(int ch);
+
+static uint32_t irq_count;
+
+/* Records from *next to head, as dump_events() of cm4_trace */
+static uint32_t read_events(uint32_t *next, log_evt_rec_t *out, uint32_t *lost)
+{
+    uint32_t head = system_evt_ring.head, n = 0, seq;
+
+    *lost = 0;
+    if (head - *next > NB_REC) {
+        *lost = head - NB_REC - *next;
+        *next = head - NB_REC;
+    }
+
+    for (; *next != head; (*next)++) {
+        volatile log_evt_rec_t *src = &system_evt_ring.rec[*next & (NB_REC - 1)];
+
+        seq = src->seq;
+        memcpy(&out[n], (const void *)src, sizeof(out[n]));
+        if (seq != *next || src->seq != *next)
+            continue;
+        n++;
+    }
+
+    return n;
+}
+
+static void ring_reset(void)
+{
+    memset(system_evt_ring.rec, 0, sizeof(system_evt_ring.rec));
+    system_evt_ring.head = 0;
+}
+
+static void irq_log(void)
+{
+    sim_dwt.CYCCNT += 7;
+    log_evt2(EVT_IRQ, irq_count, system_evt_ring.head);
+    irq_count++;
+}
+
+static int run_checks(uint32_t events)
+{
+    static log_evt_rec_t rec[NB_REC];
+    static uint8_t seen[1 << 20];
+    uint32_t next, lost, n, i, total, thread;
+
+    CHECK(system_evt_ring.magic == SYSTEM_EVT_MAGIC);
+    CHECK(system_evt_ring.rec_size == sizeof(log_evt_rec_t) && sizeof(log_evt_rec_t) == 28);
+    CHECK(system_evt_ring.nb_rec == NB_REC && !(NB_REC & (NB_REC - 1)));
+
+    /* In order, with their timestamp and args */
+    ring_reset();
+    next = 0;
+    for (i = 0; i < NB_REC / 2; i++) {
+        sim_dwt.CYCCNT = 1000 + i;
+        log_evt4(EVT_THREAD, i, i + 1, i + 2, i + 3);
+    }
+    log_evt0(EVT_THREAD);
+    n = read_events(&next, rec, &lost);
+    CHECK(n == NB_REC / 2 + 1 && lost == 0 && next == system_evt_ring.head);
+    for (i = 0; i < NB_REC / 2; i++)
+        CHECK(rec[i].seq == i && rec[i].ts == 1000 + i && rec[i].id == EVT_THREAD &&
+              rec[i].nargs == 4 && rec[i].args[0] == i && rec[i].args[3] == i + 3);
+    CHECK(rec[i].nargs == 0);
+    CHECK(read_events(&next, rec, &lost) == 0 && lost == 0);
+
+    /* Wrap: exactly the ring */
+    for (i = 0; i < NB_REC; i++)
+        log_evt1(EVT_THREAD, i);
+    n = read_events(&next, rec, &lost);
+    CHECK(n == NB_REC && lost == 0);
+    for (i = 0; i < NB_REC; i++)
+        CHECK(rec[i].args[0] == i && rec[i].seq == NB_REC / 2 + 1 + i);
+
+    /* Overflow: the oldest are lost and counted, the last ones kept */
+    for (i = 0; i < 3 * NB_REC + 5; i++)
+        log_evt1(EVT_THREAD, i);
+    n = read_events(&next, rec, &lost);
+    CHECK(n == NB_REC && lost == 2 * NB_REC + 5);
+    for (i = 0; i < NB_REC; i++)
+        CHECK(rec[i].args[0] == 2 * NB_REC + 5 + i);
+
+    /* A record being written is dropped, the next ones are read */
+    log_evt1(EVT_THREAD, 1);
+    log_evt1(EVT_THREAD, 2);
+    system_evt_ring.rec[next & (NB_REC - 1)].seq = ~next;
+    n = read_events(&next, rec, &lost);
+    CHECK(n == 1 && lost == 0 && rec[0].args[0] == 2);
+
+    /* Interrupts between LDREX and STREX: every event stored once */
+    if (events > sizeof(seen) / 2)
+        events = sizeof(seen) / 2;
+    ring_reset();
+    memset(seen, 0, sizeof(seen));
+    next = 0;
+    irq_count = 0;
+    thread = 0;
+    sim_set_irq(irq_log, 30);
+    for (i = 0; i < events; i++) {
+        log_evt1(EVT_THREAD, thread++);
+        if (system_evt_ring.head - next >= NB_REC / 2) {
+            n = read_events(&next, rec, &lost);
+            CHECK(lost == 0);
+            while (n--) {
+                CHECK(rec[n].seq < sizeof(seen) && !seen[rec[n].seq]);
+                seen[rec[n].seq] = 1;
+            }
+        }
+    }
+    sim_set_irq(NULL, 0);
+    n = read_events(&next, rec, &lost);
+    while (n--) {
+        CHECK(rec[n].seq < sizeof(seen) && !seen[rec[n].seq]);
+        seen[rec[n].seq] = 1;
+    }
+    total = system_evt_ring.head;
+    CHECK(irq_count > 0 && total == thread + irq_count);
+    for (i = 0; i < total; i++)
+        CHECK(seen[i]);
+
+    printf("checks passed, %u events, %u of them from interrupts between LDREX and STREX\n",
+           total, irq_count);
+    return 0;
+}
+
+static void bench(uint32_t loops)
+{
+    char line[128];
+    uint32_t i;
+    int n, c;
+    double t, t_evt, t_txt;
+
+    ring_reset();
+    t = sim_now_ns();
+    for (i = 0; i < loops; i++) {
+        sim_dwt.CYCCNT += 100;
+        log_evt2(EVT_THREAD, i, 0);
+    }
+    t_evt = (sim_now_ns() - t) / loops;
+
+    t = sim_now_ns();
+    for (i = 0; i < loops; i++) {
+        uint32_t tick = HAL_GetTick();
+
+        sim_dwt.CYCCNT += 100;
+        n = snprintf(line, sizeof(line), "[%05ld.%03ld][INFO ]" "UART0 rx %u bytes\n",
+                     (long)tick / 1000, (long)tick % 1000, (unsigned int)i);
+        for (c = 0; c < n; c++)
+            log_buff(line[c]);
+    }
+    t_txt = (sim_now_ns() - t) / loops;
+
+    printf("log_evt2: %.1f ns, log_info text line: %.1f ns (%d bytes), %.1fx\n",
+           t_evt, t_txt, n, t_txt / t_evt);
+}
+
+int log_check_main(int argc, char **argv)
+{
+    uint32_t events = 100000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            events = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            printf("Usage : %s [-n <events>]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!events)
+        return 1;
+
+    if (run_checks(events))
+        return 1;
+    bench(1000000);
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * prof_check.c
+ * Checks and cost of the cycle probes of cm4_prof.c.
+ *
+ * The DWT counter is the fake one of the stub: each measure of the checks
+ * moves it by a known number of cycles between PROF_START() and
+ * PROF_STOP(), around the wrap of the counter too, and the statistics of
+ * the probe are compared with the ones computed here: count, min, max,
+ * sum and the log2 histogram, its last bin taking the longer ones.
+ *
+ * A thread then updates a probe while another one reads it as cm4_trace
+ * does, retrying on an odd or changed sequence: every snapshot must be
+ * consistent. The checks stop at the first failure.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "stm32mp1xx_hal.h"
+#include "cm4_prof.h"
+#include "cm4_sim.h"
+
+#define CPU_FREQ    209000000
+#define READ_DELTA  5
+
+static volatile int writer_stop;
+
+static uint32_t bin_of(uint32_t cycles)
+{
+    uint32_t bin = 0;
+
+    while (cycles) {
+        bin++;
+        cycles >>= 1;
+    }
+    return bin < PROF_NB_BINS ? bin : PROF_NB_BINS - 1;
+}
+
+static void measure(uint32_t start, uint32_t cycles)
+{
+    sim_dwt.CYCCNT = start;
+    PROF_START(PROF_SDB_EVENT);
+    sim_dwt.CYCCNT += cycles;
+    PROF_STOP(PROF_SDB_EVENT);
+}
+
+static void *writer(void *arg)
+{
+    PROF_ProbeTypeDef *p = arg;
+
+    while (!writer_stop)
+        PROF_Update(p, READ_DELTA);
+
+    return NULL;
+}
+
+/* Snapshot of a probe, as dump_prof() of cm4_trace */
+static void read_probe(volatile PROF_ProbeTypeDef *src, PROF_ProbeTypeDef *dst)
+{
+    uint32_t seq;
+
+    do {
+        seq = src->seq;
+        __sync_synchronize();
+        memcpy(dst, (const void *)src, sizeof(*dst));
+        __sync_synchronize();
+    } while ((seq & 1) || seq != src->seq);
+}
+
+static int run_checks(uint32_t reads)
+{
+    static const uint32_t cycles[] = {
+        0, 1, 2, 3, 4, 7, 8, 100, 1000, 65535, 65536,
+        (1u << 22) - 1, 1u << 22, 1u << 23, 1u << 30, 0xffffffff,
+    };
+    PROF_ProbeTypeDef *p = &prof_stats.probe[PROF_SDB_EVENT];
+    PROF_ProbeTypeDef snap;
+    uint32_t hist[PROF_NB_BINS] = { 0 };
+    uint32_t i, b, n, min = UINT32_MAX, max = 0, total;
+    uint64_t sum = 0;
+    pthread_t th;
+
+    PROF_Init(CPU_FREQ);
+    CHECK(prof_stats.magic == PROF_MAGIC && prof_stats.cpu_freq == CPU_FREQ);
+    CHECK(prof_stats.probe_size == sizeof(PROF_ProbeTypeDef) &&
+          prof_stats.nb_probes == PROF_NB && prof_stats.nb_bins == PROF_NB_BINS);
+    for (i = 0; i < PROF_NB; i++)
+        CHECK(prof_stats.probe[i].name[0] && prof_stats.probe[i].count == 0 &&
+              prof_stats.probe[i].min == UINT32_MAX && prof_stats.probe[i].seq == 0);
+    CHECK(!strcmp(p->name, "sdb_event"));
+    CHECK(!strcmp(prof_stats.probe[PROF_SDB_FORMAT].name, "sdb_format"));
+
+    /* Known durations, from anywhere in the counter range */
+    n = sizeof(cycles) / sizeof(cycles[0]);
+    for (i = 0; i < 4 * n; i++) {
+        uint32_t c = cycles[i % n];
+        uint32_t start = i < n ? 0 : i < 2 * n ? 0xffffffff - c / 2 : sim_rnd() << 17;
+
+        measure(start, c);
+        hist[bin_of(c)]++;
+        sum += c;
+        if (c < min)
+            min = c;
+        if (c > max)
+            max = c;
+    }
+    CHECK(p->count == 4 * n && p->seq == 2 * p->count);
+    CHECK(p->min == min && p->max == max && p->sum == sum);
+    for (b = 0, total = 0; b < PROF_NB_BINS; b++) {
+        CHECK(p->hist[b] == hist[b]);
+        total += p->hist[b];
+    }
+    CHECK(total == p->count);
+    CHECK(p->hist[0] == 4 && p->hist[1] == 4 && p->hist[2] == 8);
+    CHECK(p->hist[PROF_NB_BINS - 1] == 4 * 4);
+    for (i = 0; i < PROF_NB; i++)
+        CHECK(i == PROF_SDB_EVENT || prof_stats.probe[i].count == 0);
+
+    /* Consistent snapshots while the probe is updated */
+    p = &prof_stats.probe[PROF_MAILBOX_POLL];
+    writer_stop = 0;
+    if (pthread_create(&th, NULL, writer, p))
+        return -1;
+    while (!*(volatile uint32_t *)&p->count)
+        ;
+    for (i = 0; i < reads; i++) {
+        read_probe(p, &snap);
+        for (b = 0, total = 0; b < PROF_NB_BINS; b++)
+            total += snap.hist[b];
+        if (!(total == snap.count && snap.sum == (uint64_t)READ_DELTA * snap.count &&
+              snap.hist[bin_of(READ_DELTA)] == snap.count &&
+              (!snap.count || (snap.min == READ_DELTA && snap.max == READ_DELTA)))) {
+            writer_stop = 1;
+            pthread_join(th, NULL);
+            CHECK(0);
+        }
+    }
+    writer_stop = 1;
+    pthread_join(th, NULL);
+
+    printf("checks passed, %u snapshots during %u updates\n", reads, p->count);
+    return 0;
+}
+
+static void bench(uint32_t loops)
+{
+    uint32_t i;
+    double t;
+
+    PROF_Init(CPU_FREQ);
+    t = sim_now_ns();
+    for (i = 0; i < loops; i++)
+        measure(i, i & 0xfff);
+    t = (sim_now_ns() - t) / loops;
+
+    printf("PROF_START + PROF_STOP: %.1f ns\n", t);
+}
+
+int prof_check_main(int argc, char **argv)
+{
+    uint32_t reads = 100000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            reads = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            printf("Usage : %s [-n <snapshots>]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (run_checks(reads))
+        return 1;
+    bench(10000000);
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * status_check.c
+ * Checks of the status event queue of status_evt.c.
+ *
+ * The queue runs with its PRIMASK lock over the PRIMASK of the stub,
+ * which must be restored after each call. The checks cover:
+ *   - the order of the events, across the wrap of the indexes, with
+ *     partial peeks and peeks not consumed (no free rpmsg buffer);
+ *   - the filtering by level, STS_LVL_NONE never queued, STS_FORCE
+ *     queued whatever the verbosity with the level of the record;
+ *   - the overflow: the events posted to a full queue are counted and
+ *     reported first by a STS_EVT_DROPPED record, the drops that happen
+ *     between a peek and its consume are kept for the next one.
+ * Then random posts, level changes, peeks and consumes are compared with
+ * a model of the queue. The checks stop at the first failure.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stm32mp1xx.h"
+#include "status_evt.h"
+#include "cm4_sim.h"
+
+#define QSIZE       STS_QUEUE_SIZE
+#define BATCH       8
+
+/* Model of the queue */
+typedef struct
+{
+    STS_EventTypeDef q[QSIZE];
+    uint32_t head, tail;
+    uint32_t dropped;
+    uint8_t level;
+} model_t;
+
+static int post(uint8_t level, uint16_t code, uint32_t arg0)
+{
+    int ret;
+
+    sim_primask = 0;
+    ret = STS_Post(level, code, arg0, ~arg0, arg0 ^ code);
+    return sim_primask ? -2 : ret;
+}
+
+static int model_post(model_t *m, uint8_t level, uint16_t code, uint32_t arg0)
+{
+    STS_EventTypeDef *e;
+    uint8_t force = level & STS_FORCE;
+
+    level &= ~STS_FORCE;
+    if (level == STS_LVL_NONE || (!force && level > m->level))
+        return 0;
+    if (m->head - m->tail >= QSIZE) {
+        m->dropped++;
+        return -1;
+    }
+    e = &m->q[m->head++ % QSIZE];
+    e->sync = STS_SYNC;
+    e->level = level;
+    e->code = code;
+    e->arg[0] = arg0;
+    e->arg[1] = ~arg0;
+    e->arg[2] = arg0 ^ code;
+    return 1;
+}
+
+static int model_peek(const model_t *m, STS_EventTypeDef *evt, int max)
+{
+    uint32_t tail = m->tail;
+    int nb = 0;
+
+    if (max > 0 && m->dropped) {
+        memset(&evt[0], 0, sizeof(evt[0]));
+        evt[0].sync = STS_SYNC;
+        evt[0].level = STS_LVL_WARN;
+        evt[0].code = STS_EVT_DROPPED;
+        evt[0].arg[0] = m->dropped;
+        nb++;
+    }
+    for (; nb < max && tail != m->head; nb++, tail++)
+        evt[nb] = m->q[tail % QSIZE];
+
+    return nb;
+}
+
+static void model_consume(model_t *m, const STS_EventTypeDef *evt, int nb)
+{
+    if (nb > 0 && evt[0].code == STS_EVT_DROPPED) {
+        m->dropped -= evt[0].arg[0];
+        nb--;
+    }
+    m->tail += nb;
+}
+
+static int same(const STS_EventTypeDef *a, const STS_EventTypeDef *b, int nb)
+{
+    int i;
+
+    for (i = 0; i < nb; i++)
+        if (a[i].sync != b[i].sync || a[i].level != b[i].level || a[i].code != b[i].code ||
+            a[i].arg[0] != b[i].arg[0] || a[i].arg[1] != b[i].arg[1] ||
+            a[i].arg[2] != b[i].arg[2])
+            return 0;
+    return 1;
+}
+
+static int run_checks(uint32_t steps)
+{
+    STS_EventTypeDef evt[QSIZE + 1], ref[QSIZE + 1];
+    model_t m;
+    uint32_t i, seq = 0, posted = 0, peeks = 0, drops = 0;
+    int nb, lvl, l, ret;
+
+    CHECK(sizeof(STS_EventTypeDef) == 16 && !(QSIZE & (QSIZE - 1)));
+
+    /* Order, across the wrap of the indexes */
+    STS_Init(STS_LVL_DEBUG);
+    CHECK(STS_Peek(evt, BATCH) == 0);
+    for (i = 0; i < 10 * QSIZE; i++) {
+        CHECK(post(STS_LVL_INFO, STS_EVT_SDB_RX, i) == 1);
+        if (i % 3 == 2) {
+            /* partial, then not sent: the same events again */
+            nb = STS_Peek(evt, 2);
+            CHECK(nb == 2 && evt[0].arg[0] == seq && evt[1].arg[0] == seq + 1);
+            nb = STS_Peek(evt, BATCH);
+            CHECK(nb == 3 && evt[0].arg[0] == seq && evt[2].arg[0] == seq + 2);
+            CHECK(evt[0].sync == STS_SYNC && evt[0].code == STS_EVT_SDB_RX &&
+                  evt[0].level == STS_LVL_INFO && evt[0].arg[1] == ~seq);
+            STS_Consume(nb);
+            seq += nb;
+        }
+    }
+    while ((nb = STS_Peek(evt, BATCH)) > 0) {
+        for (l = 0; l < nb; l++)
+            CHECK(evt[l].arg[0] == seq + l);
+        STS_Consume(nb);
+        seq += nb;
+    }
+    CHECK(seq == 10 * QSIZE && sim_primask == 0);
+
+    /* Levels */
+    for (lvl = STS_LVL_NONE; lvl <= STS_LVL_DEBUG; lvl++) {
+        STS_Init(STS_LVL_ERROR);
+        STS_SetLevel(lvl);
+        CHECK(STS_GetLevel() == lvl);
+        for (l = STS_LVL_NONE; l <= STS_LVL_DEBUG; l++)
+            CHECK(post(l, STS_EVT_BOOT, l) == (l != STS_LVL_NONE && l <= lvl));
+        nb = STS_Peek(evt, QSIZE);
+        CHECK(nb == lvl);
+        for (l = 0; l < nb; l++)
+            CHECK(evt[l].level == l + 1 && evt[l].arg[0] == (uint32_t)l + 1);
+        STS_Consume(nb);
+        /* forced: all but STS_LVL_NONE, recorded with their level */
+        for (l = STS_LVL_NONE; l <= STS_LVL_DEBUG; l++)
+            CHECK(post(l | STS_FORCE, STS_EVT_VERBOSITY, l) == (l != STS_LVL_NONE));
+        nb = STS_Peek(evt, QSIZE);
+        CHECK(nb == STS_LVL_DEBUG && STS_GetLevel() == lvl);
+        for (l = 0; l < nb; l++)
+            CHECK(evt[l].level == l + 1 && evt[l].arg[0] == (uint32_t)l + 1);
+        STS_Consume(nb);
+    }
+
+    /* Overflow: the oldest kept, the drops reported first */
+    STS_Init(STS_LVL_WARN);
+    for (i = 0; i < QSIZE; i++)
+        CHECK(post(STS_LVL_ERROR, STS_EVT_DMA_XFER_ERROR, i) == 1);
+    for (i = 0; i < 5; i++)
+        CHECK(post(STS_LVL_WARN, STS_EVT_DMA_XFER_ERROR, 100 + i) == -1);
+    CHECK(post(STS_LVL_DEBUG, STS_EVT_DMA_XFER_ERROR, 0) == 0);
+    nb = STS_Peek(evt, BATCH);
+    CHECK(nb == BATCH && evt[0].code == STS_EVT_DROPPED && evt[0].arg[0] == 5 &&
+          evt[0].level == STS_LVL_WARN && evt[1].arg[0] == 0);
+    /* 2 more lost between the peek and the consume */
+    CHECK(post(STS_LVL_ERROR, STS_EVT_DMA_XFER_ERROR, 200) == -1);
+    CHECK(post(STS_LVL_ERROR, STS_EVT_DMA_XFER_ERROR, 201) == -1);
+    STS_Consume(nb);
+    nb = STS_Peek(evt, BATCH);
+    CHECK(nb == BATCH && evt[0].code == STS_EVT_DROPPED && evt[0].arg[0] == 2 &&
+          evt[1].arg[0] == BATCH - 1);
+    STS_Consume(nb);
+    nb = STS_Peek(evt, BATCH);
+    CHECK(evt[0].code == STS_EVT_DMA_XFER_ERROR && evt[0].arg[0] == 2 * (BATCH - 1));
+    /* a peek of 0 events consumes nothing */
+    CHECK(STS_Peek(evt, 0) == 0);
+    STS_Consume(0);
+    nb = STS_Peek(evt, 1);
+    CHECK(nb == 1 && evt[0].arg[0] == 2 * (BATCH - 1));
+    CHECK(sim_primask == 0);
+
+    /* Random operations against the model */
+    memset(&m, 0, sizeof(m));
+    m.level = STS_LVL_INFO;
+    STS_Init(m.level);
+    for (i = 0; i < steps; i++) {
+        uint32_t r = sim_rnd() % 100;
+
+        if (r < 60) {
+            /* not STS_EVT_DROPPED, the model tells its record by the code */
+            uint16_t code = STS_EVT_BOOT + sim_rnd() % (STS_EVT_DMA_XFER_ERROR - 1);
+
+            l = sim_rnd() % (STS_LVL_DEBUG + 1) | (sim_rnd() % 8 ? 0 : STS_FORCE);
+            ret = post(l, code, i);
+            CHECK(ret == model_post(&m, l, code, i));
+            posted += ret == 1;
+            drops += ret == -1;
+        } else if (r < 62) {
+            m.level = sim_rnd() % (STS_LVL_DEBUG + 1);
+            STS_SetLevel(m.level);
+        } else {
+            /* phases of small batches: the queue fills and overflows */
+            int max = sim_rnd() % (i & 0x1000 ? 2 : QSIZE + 2);
+
+            nb = STS_Peek(evt, max);
+            CHECK(nb == model_peek(&m, ref, max) && same(evt, ref, nb));
+            peeks++;
+            /* sent, or no free rpmsg buffer */
+            if (sim_rnd() % 4) {
+                STS_Consume(nb);
+                model_consume(&m, ref, nb);
+            }
+        }
+        CHECK(sim_primask == 0);
+    }
+
+    printf("checks passed, %u steps: %u posted, %u dropped, %u peeks\n",
+           steps, posted, drops, peeks);
+    return 0;
+}
+
+int status_check_main(int argc, char **argv)
+{
+    uint32_t steps = 1000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            steps = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            printf("Usage : %s [-n <steps>]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    return run_checks(steps) ? 1 : 0;
+}
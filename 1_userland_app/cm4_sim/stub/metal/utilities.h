@@ -0,0 +1,15 @@
+/*
+ * utilities.h
+ * Host stand-in of libmetal's metal/utilities.h for rpmsg_hdr.c.
+ */
+
+#ifndef __METAL_UTILITIES_H
+#define __METAL_UTILITIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define metal_container_of(ptr, structure, member) \
+    (void *)((uintptr_t)(ptr) - offsetof(structure, member))
+
+#endif /* __METAL_UTILITIES_H */
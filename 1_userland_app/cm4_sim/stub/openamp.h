@@ -0,0 +1,35 @@
+/*
+ * openamp.h
+ * Host stand-in of the OPENAMP layer of the CM4 projects for rpmsg_hdr.c:
+ * the endpoint is a plain structure, OPENAMP_send() and the buffer size
+ * are provided by frag_check.c.
+ */
+
+#ifndef __OPENAMP_H
+#define __OPENAMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RPMSG_BUFFER_SIZE       512
+#define RPMSG_ADDR_ANY          0xFFFFFFFF
+
+struct rpmsg_endpoint;
+struct rpmsg_virtio_device;
+
+typedef int (*rpmsg_ept_cb)(struct rpmsg_endpoint *ept, void *data,
+                            size_t len, uint32_t src, void *priv);
+
+struct rpmsg_endpoint
+{
+    rpmsg_ept_cb cb;
+};
+
+int OPENAMP_create_endpoint(struct rpmsg_endpoint *ept, const char *name,
+                            uint32_t dest, rpmsg_ept_cb cb, void *unbind_cb);
+void OPENAMP_destroy_ept(struct rpmsg_endpoint *ept);
+int OPENAMP_get_buffer_size(void);
+int OPENAMP_send(struct rpmsg_endpoint *ept, const void *data, int len);
+
+#endif /* __OPENAMP_H */
@@ -0,0 +1,72 @@
+/*
+ * stm32mp1xx.h
+ * Host stand-in of the CM4 core registers for the firmware sources
+ * cm4_sim builds.
+ *
+ * Only what those use: the DWT cycle counter and the debug block as plain
+ * variables, PRIMASK, and the exclusive access helpers over a model of
+ * the local monitor. __STREXW() gives cm4_sim a chance to run an
+ * interrupt between the LDREX and the STREX; taking the exception clears
+ * the monitor, as on the Cortex-M4, so the STREX fails and the firmware
+ * retries.
+ */
+
+#ifndef __STM32MP1XX_H
+#define __STM32MP1XX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+
+#define DWT                             (&sim_dwt)
+#define CoreDebug                       (&sim_core_debug)
+#define CoreDebug_DEMCR_TRCENA_Msk      (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk          (1UL << 0)
+
+/* Local monitor: the address LDREX tagged, NULL when open */
+extern volatile uint32_t *sim_excl_addr;
+
+/* Called by __STREXW(), may run an interrupt (see cm4_sim.c) */
+void sim_strex_hook(void);
+
+static inline uint32_t __LDREXW(volatile uint32_t *addr)
+{
+    sim_excl_addr = addr;
+    return *addr;
+}
+
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+    sim_strex_hook();
+    if (sim_excl_addr != addr)
+        return 1;
+    sim_excl_addr = NULL;
+    *addr = value;
+    return 0;
+}
+
+#define __CLREX()               (sim_excl_addr = NULL)
+#define __DMB()                 __sync_synchronize()
+
+/* PRIMASK: 1 while the interrupts are masked */
+extern uint32_t sim_primask;
+
+#define __get_PRIMASK()         (sim_primask)
+#define __set_PRIMASK(v)        (sim_primask = (v))
+#define __disable_irq()         (sim_primask = 1)
+#define __enable_irq()          (sim_primask = 0)
+
+#endif /* __STM32MP1XX_H */
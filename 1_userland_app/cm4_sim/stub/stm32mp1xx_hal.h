@@ -0,0 +1,19 @@
+/*
+ * stm32mp1xx_hal.h
+ * Host stand-in of the CM4 HAL for the firmware sources cm4_sim builds:
+ * the core registers are in stm32mp1xx.h.
+ */
+
+#ifndef __STM32MP1XX_HAL_H
+#define __STM32MP1XX_HAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "stm32mp1xx.h"
+
+#define __weak                  __attribute__((weak))
+
+uint32_t HAL_GetTick(void);
+
+#endif /* __STM32MP1XX_HAL_H */
@@ -0,0 +1,326 @@
+/*
+ * cm4_trace.c
+ * Decodes the binary events logged by the CM4 firmware with log_evt(),
+ * or prints the cycle probes statistics of cm4_prof (-p).
+ *
+ * The firmware publishes its event ring in the resource table as the
+ * "cm4_evt" trace entry, and the probes as "cm4_prof". The debugfs trace
+ * file stops at the first NUL byte, so both are read through /dev/mem at
+ * the address given by the resource table and formatted here.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#define RSC_TABLE_PATH "/sys/kernel/debug/remoteproc/remoteproc0/resource_table"
+#define EVT_TRACE_NAME "cm4_evt"
+#define EVT_MAGIC 0x45564d34
+#define PROF_TRACE_NAME "cm4_prof"
+#define PROF_MAGIC 0x464f5250
+#define PROF_NAME_LEN 16
+
+#define CM4_FREQ_HZ 209000000 /* MCU clock set by SystemClock_Config() */
+
+/* Must match log_evt_rec_t / log_evt_ring_t in openamp_log.h */
+typedef struct
+{
+    uint32_t seq;
+    uint32_t ts;
+    uint16_t id;
+    uint16_t nargs;
+    uint32_t args[4];
+} evt_rec_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t rec_size;
+    uint32_t nb_rec;
+    uint32_t head;
+    evt_rec_t rec[];
+} evt_ring_t;
+
+/* Must match PROF_ProbeTypeDef / PROF_StatsTypeDef in cm4_prof.h */
+typedef struct
+{
+    uint32_t seq;
+    char name[PROF_NAME_LEN];
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[];
+} prof_probe_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t probe_size;
+    uint32_t nb_probes;
+    uint32_t nb_bins;
+    uint32_t cpu_freq;
+    uint32_t reserved;
+    uint8_t probe[];
+} prof_stats_t;
+
+typedef struct
+{
+    uint16_t id;
+    const char *fmt;
+} evt_desc_t;
+
+/* Event ids of the exchange_buf firmware, see enum in CM4 main.c */
+static const evt_desc_t mEvtDesc[] = {
+    { 1, "UART0 rx %u bytes" },
+    { 2, "UART1 rx %u bytes" },
+    { 3, "SPI DMA start" },
+    { 4, "SPI DMA complete, buffer %u" },
+    { 5, "UART0 tx %u bytes, status %u" },
+    { 6, "SPI DMA start error" },
+};
+
+static volatile int mExitRequested = 0;
+
+static void exit_fct(int signum)
+{
+    mExitRequested = 1;
+}
+
+static const char *evt_get_fmt(uint16_t id)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(mEvtDesc) / sizeof(mEvtDesc[0]); i++) {
+        if (mEvtDesc[i].id == id)
+            return mEvtDesc[i].fmt;
+    }
+    return NULL;
+}
+
+/* Look for a trace entry in the remoteproc resource table dump */
+static int find_trace_addr(const char *name, uint32_t *addr, uint32_t *len)
+{
+    FILE *f;
+    char line[128], tname[32];
+    uint32_t da = 0, size = 0;
+    int found = 0;
+
+    f = fopen(RSC_TABLE_PATH, "r");
+    if (f == NULL) {
+        printf("Error opening %s, err=-%d\n", RSC_TABLE_PATH, errno);
+        return -errno;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, " Device Address 0x%x", &da);
+        sscanf(line, " Length 0x%x", &size);
+        if (sscanf(line, " Name %31s", tname) == 1 && !strcmp(tname, name)) {
+            *addr = da;
+            *len = size;
+            found = 1;
+            break;
+        }
+    }
+    fclose(f);
+
+    return found ? 0 : -ENOENT;
+}
+
+static void print_rec(const evt_rec_t *rec, uint32_t freq)
+{
+    const char *fmt = evt_get_fmt(rec->id);
+    double ts_us = (double)rec->ts * 1000000.0 / freq;
+
+    printf("[%10u][%12.3f us] ", rec->seq, ts_us);
+    if (fmt) {
+        printf(fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+    } else {
+        int i;
+        printf("evt %u:", rec->id);
+        for (i = 0; i < rec->nargs && i < 4; i++)
+            printf(" 0x%x", rec->args[i]);
+    }
+    printf("\n");
+}
+
+static int dump_events(volatile evt_ring_t *ring, uint32_t len, int follow, uint32_t freq)
+{
+    uint32_t next, head, seq;
+    evt_rec_t rec;
+
+    if (ring->magic != EVT_MAGIC || ring->rec_size != sizeof(evt_rec_t) ||
+        (ring->nb_rec & (ring->nb_rec - 1)) ||
+        len < sizeof(evt_ring_t) + ring->nb_rec * sizeof(evt_rec_t)) {
+        printf("no valid event ring\n");
+        return -EINVAL;
+    }
+
+    head = ring->head;
+    next = head > ring->nb_rec ? head - ring->nb_rec : 0;
+
+    do {
+        head = ring->head;
+        if (head - next > ring->nb_rec) {
+            printf("%u events lost\n", head - ring->nb_rec - next);
+            next = head - ring->nb_rec;
+        }
+
+        for (; next != head; next++) {
+            volatile evt_rec_t *src = &ring->rec[next & (ring->nb_rec - 1)];
+
+            /* drop records being written or already overwritten */
+            seq = src->seq;
+            memcpy(&rec, (const void *)src, sizeof(rec));
+            if (seq != next || src->seq != next)
+                continue;
+            print_rec(&rec, freq);
+        }
+
+        if (follow)
+            usleep(10000);
+    } while (follow && !mExitRequested);
+
+    return 0;
+}
+
+static int dump_prof(volatile prof_stats_t *stats, uint32_t len, int follow)
+{
+    uint8_t *buf;
+    prof_probe_t *probe;
+    uint32_t i, b, seq, freq;
+
+    if (stats->magic != PROF_MAGIC ||
+        stats->probe_size != sizeof(prof_probe_t) + stats->nb_bins * sizeof(uint32_t) ||
+        len < sizeof(prof_stats_t) + stats->nb_probes * stats->probe_size) {
+        printf("no valid probes block (firmware built without __PROF_CYCLES_?)\n");
+        return -EINVAL;
+    }
+    freq = stats->cpu_freq ? stats->cpu_freq : CM4_FREQ_HZ;
+
+    buf = malloc(stats->probe_size);
+    if (buf == NULL)
+        return -ENOMEM;
+    probe = (prof_probe_t *)buf;
+
+    do {
+        printf("%-16s %10s %10s %10s %10s %10s  log2 histogram (cycles)\n",
+               "probe", "count", "min", "avg", "max", "max us");
+        for (i = 0; i < stats->nb_probes; i++) {
+            volatile uint8_t *src = stats->probe + i * stats->probe_size;
+
+            /* retry while the CM4 is updating the probe */
+            do {
+                seq = *(volatile uint32_t *)src;
+                memcpy(buf, (const void *)src, stats->probe_size);
+            } while ((seq & 1) || seq != *(volatile uint32_t *)src);
+
+            probe->name[PROF_NAME_LEN - 1] = 0;
+            if (!probe->count) {
+                printf("%-16s %10u\n", probe->name, 0);
+                continue;
+            }
+            printf("%-16s %10u %10u %10llu %10u %10.2f ", probe->name, probe->count,
+                   probe->min, (unsigned long long)(probe->sum / probe->count),
+                   probe->max, (double)probe->max * 1000000.0 / freq);
+            for (b = 0; b < stats->nb_bins; b++) {
+                if (probe->hist[b])
+                    printf(" <2^%u:%u", b, probe->hist[b]);
+            }
+            printf("\n");
+        }
+
+        if (follow) {
+            printf("\n");
+            sleep(1);
+        }
+    } while (follow && !mExitRequested);
+
+    free(buf);
+    return 0;
+}
+
+static void usage(char *prog)
+{
+    printf("Usage : \n");
+    printf("%s [-a <addr>] [-f] [-p] [-c <cm4 freq Hz>]\n", prog);
+    printf("  -a: address of the event ring or probes (default: read from %s)\n", RSC_TABLE_PATH);
+    printf("  -f: follow, keep printing new events (polled every 10 ms) or the probes (every second)\n");
+    printf("  -p: print the cycle probes statistics instead of the events\n");
+    printf("  -c: CM4 clock of the event timestamps (default %d)\n", CM4_FREQ_HZ);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t addr = 0, len = 0, freq = CM4_FREQ_HZ;
+    int follow = 0, prof = 0, opt, fd, ret;
+    long page_size = sysconf(_SC_PAGESIZE);
+    const char *name;
+    off_t map_base;
+    size_t map_len;
+    uint8_t *map;
+
+    while ((opt = getopt(argc, argv, "a:fpc:h")) != -1) {
+        switch (opt) {
+        case 'a':
+            addr = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            follow = 1;
+            break;
+        case 'p':
+            prof = 1;
+            break;
+        case 'c':
+            freq = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+
+    name = prof ? PROF_TRACE_NAME : EVT_TRACE_NAME;
+    if (!addr) {
+        ret = find_trace_addr(name, &addr, &len);
+        if (ret) {
+            printf("fails to find the %s trace, is the firmware running?\n", name);
+            return ret;
+        }
+    }
+    if (!len)
+        len = page_size;
+
+    fd = open("/dev/mem", O_RDONLY | O_SYNC);
+    if (fd < 0) {
+        printf("Error opening /dev/mem, err=-%d\n", errno);
+        return -errno;
+    }
+
+    map_base = addr & ~(page_size - 1);
+    map_len = (addr - map_base) + len;
+    map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, map_base);
+    if (map == MAP_FAILED) {
+        printf("fails to map 0x%x, err=-%d\n", addr, errno);
+        close(fd);
+        return -errno;
+    }
+
+    signal(SIGINT, exit_fct);
+    signal(SIGTERM, exit_fct);
+
+    if (prof)
+        ret = dump_prof((volatile prof_stats_t *)(map + (addr - map_base)), len, follow);
+    else
+        ret = dump_events((volatile evt_ring_t *)(map + (addr - map_base)), len, follow, freq);
+
+    munmap(map, map_len);
+    close(fd);
+    return ret;
+}
@@ -0,0 +1,483 @@
+/*
+ * copro.c
+ * Control of the co-processor and of its virtual TTY over RPMSG, see
+ * copro.h.
+ *
+ * remoteproc does not notify its state: after a write, the state is read
+ * again until it is "running" or "offline". With the kernel the write
+ * returns once the firmware runs or is stopped, so the first read sees
+ * the new state.
+ *
+ * The devices of the channels are created in /dev when the firmware
+ * announces them. copro_waitDev() watches /dev with inotify and checks
+ * the device again on each event, until it exists and can be opened: udev
+ * may still be setting its permissions after the creation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+
+#include "copro.h"
+
+#define TTY_NAME        "ttyRPMSG0"
+#define STATE_POLL_US   1000
+
+enum {
+    SYS_STATE = 0,
+    SYS_FW_NAME,
+    SYS_FW_PATH,
+    SYS_NB
+};
+
+static const char *const mSysPath[SYS_NB] = {
+    "/sys/class/remoteproc/remoteproc0/state",
+    "/sys/class/remoteproc/remoteproc0/firmware",
+    "/sys/module/firmware_class/parameters/path",
+};
+static const char *const mSysName[SYS_NB] = {
+    "remoteproc0/state",
+    "remoteproc0/firmware",
+    "firmware_class/parameters/path",
+};
+static int mSysFd[SYS_NB] = { -1, -1, -1 };
+static char mRoot[PATH_MAX / 2] = "";
+
+/* The file descriptor used to manage our TTY over RPMSG */
+static int mFdRpmsg = -1;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int left_ms(double end)
+{
+    double left = end - now_ms();
+
+    return left > 0 ? (int)left + 1 : 0;
+}
+
+static int sys_fd(int idx)
+{
+    char path[PATH_MAX];
+    int err;
+
+    if (mSysFd[idx] >= 0)
+        return mSysFd[idx];
+
+    snprintf(path, sizeof(path), "%s%s", mRoot, mSysPath[idx]);
+    mSysFd[idx] = open(path, O_RDWR | O_CLOEXEC);
+    if (mSysFd[idx] < 0) {
+        err = errno;
+        printf("Error opening %s, err=-%d\n", mSysName[idx], err);
+        return -err;
+    }
+    return mSysFd[idx];
+}
+
+/* The value without its newline, returns its length */
+static int sys_read(int idx, char *str, int len)
+{
+    int fd = sys_fd(idx);
+    ssize_t n;
+
+    if (fd < 0)
+        return fd;
+    n = pread(fd, str, len - 1, 0);
+    if (n < 0) {
+        n = -errno;
+        printf("Error reading %s, err=-%d\n", mSysName[idx], (int)-n);
+        return n;
+    }
+    str[n] = 0;
+    str[strcspn(str, "\n")] = 0;
+    return strlen(str);
+}
+
+/* The value and a newline, which sysfs ignores, returns the bytes written */
+static int sys_write(int idx, const char *str)
+{
+    char buf[COPRO_MAX_NAME + 1];
+    int fd = sys_fd(idx), len;
+    ssize_t n;
+
+    if (fd < 0)
+        return fd;
+    len = snprintf(buf, sizeof(buf), "%s\n", str);
+    if (len >= (int)sizeof(buf))
+        return -ENAMETOOLONG;
+    n = pwrite(fd, buf, len, 0);
+    if (n < 0) {
+        n = -errno;
+        printf("Error writing %s, err=-%d\n", mSysName[idx], (int)-n);
+        return n;
+    }
+    return n;
+}
+
+int copro_setRoot(const char *root)
+{
+    copro_close();
+    if (strlen(root) >= sizeof(mRoot))
+        return -ENAMETOOLONG;
+    strcpy(mRoot, root);
+    return 0;
+}
+
+void copro_close(void)
+{
+    int i;
+
+    for (i = 0; i < SYS_NB; i++) {
+        if (mSysFd[i] >= 0)
+            close(mSysFd[i]);
+        mSysFd[i] = -1;
+    }
+    copro_closeTtyRpmsg();
+}
+
+int copro_isFwRunning(void)
+{
+    char state[COPRO_MAX_NAME];
+    int ret = sys_read(SYS_STATE, state, sizeof(state));
+
+    if (ret < 0)
+        return ret;
+    return strcmp(state, "running") == 0;
+}
+
+int copro_stopFw(void)
+{
+    int ret = sys_write(SYS_STATE, "stop");
+
+    return ret < 0 ? ret : 0;
+}
+
+int copro_startFw(void)
+{
+    int ret = sys_write(SYS_STATE, "start");
+
+    return ret < 0 ? ret : 0;
+}
+
+int copro_getFwPath(char *pathStr, int len)
+{
+    return sys_read(SYS_FW_PATH, pathStr, len);
+}
+
+int copro_setFwPath(const char *pathStr)
+{
+    return sys_write(SYS_FW_PATH, pathStr);
+}
+
+int copro_getFwName(char *nameStr, int len)
+{
+    return sys_read(SYS_FW_NAME, nameStr, len);
+}
+
+int copro_setFwName(const char *nameStr)
+{
+    return sys_write(SYS_FW_NAME, nameStr);
+}
+
+int copro_openTtyRpmsg(int modeRaw)
+{
+    struct termios tiorpmsg;
+    char path[PATH_MAX];
+    int err;
+
+    snprintf(path, sizeof(path), "%s/dev/" TTY_NAME, mRoot);
+    mFdRpmsg = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (mFdRpmsg < 0) {
+        err = errno;
+        printf("Error opening " TTY_NAME ", err=-%d\n", err);
+        return -err;
+    }
+    /* get current port settings */
+    tcgetattr(mFdRpmsg, &tiorpmsg);
+    if (modeRaw) {
+        tiorpmsg.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
+                      | INLCR | IGNCR | ICRNL | IXON);
+        tiorpmsg.c_oflag &= ~OPOST;
+        tiorpmsg.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+        tiorpmsg.c_cflag &= ~(CSIZE | PARENB);
+        tiorpmsg.c_cflag |= CS8;
+    } else {
+        /* ECHO off, other bits unchanged */
+        tiorpmsg.c_lflag &= ~ECHO;
+        /*do not convert LF to CR LF */
+        tiorpmsg.c_oflag &= ~ONLCR;
+    }
+    tcsetattr(mFdRpmsg, TCSANOW, &tiorpmsg);
+    return 0;
+}
+
+int copro_closeTtyRpmsg(void)
+{
+    if (mFdRpmsg >= 0)
+        close(mFdRpmsg);
+    mFdRpmsg = -1;
+    return 0;
+}
+
+int copro_writeTtyRpmsg(int len, const char *pData)
+{
+    if (mFdRpmsg < 0) {
+        printf("Error writing " TTY_NAME ", fileDescriptor is not set\n");
+        return mFdRpmsg;
+    }
+
+    return write(mFdRpmsg, pData, len);
+}
+
+int copro_readTtyRpmsg(int len, char *pData)
+{
+    int byte_avail;
+
+    if (mFdRpmsg < 0) {
+        printf("Error reading " TTY_NAME ", fileDescriptor is not set\n");
+        return mFdRpmsg;
+    }
+    ioctl(mFdRpmsg, FIONREAD, &byte_avail);
+    if (byte_avail <= 0)
+        return 0;
+    return read(mFdRpmsg, pData, byte_avail < len ? byte_avail : len);
+}
+
+/*
+ * Waits for /dev/<name> with the inotify of *ifd, created at the first
+ * device missing and kept for the next ones: the close of an inotify
+ * waits for a grace period of the kernel, milliseconds.
+ */
+static int wait_dev(int *ifd, const char *name, double end)
+{
+    char dir[sizeof(mRoot) + 8], path[PATH_MAX];
+    char ev[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd;
+    int ret, left;
+
+    snprintf(dir, sizeof(dir), "%s/dev", mRoot);
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (!access(path, R_OK | W_OK))
+        return 0;
+
+    if (*ifd < 0) {
+        *ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (*ifd < 0) {
+            ret = -errno;
+            printf("Error creating inotify, err=-%d\n", -ret);
+            return ret;
+        }
+        if (inotify_add_watch(*ifd, dir, IN_CREATE | IN_MOVED_TO | IN_ATTRIB) < 0) {
+            ret = -errno;
+            printf("Error watching %s, err=-%d\n", dir, -ret);
+            return ret;
+        }
+    }
+
+    /* Checked again once watched: a creation in between is not missed */
+    pfd.fd = *ifd;
+    pfd.events = POLLIN;
+    while (access(path, R_OK | W_OK)) {
+        left = left_ms(end);
+        if (!left)
+            return -ETIMEDOUT;
+        if (poll(&pfd, 1, left) < 0 && errno != EINTR)
+            return -errno;
+        /* Any event of /dev: the check of the loop covers them all */
+        while (read(*ifd, ev, sizeof(ev)) > 0)
+            ;
+    }
+    return 0;
+}
+
+int copro_waitDev(const char *name, int timeout_ms)
+{
+    int ifd = -1, ret;
+
+    ret = wait_dev(&ifd, name, now_ms() + timeout_ms);
+    if (ifd >= 0)
+        close(ifd);
+    return ret;
+}
+
+static int send_probe(const char *probe)
+{
+    int ret;
+
+    if (mFdRpmsg < 0) {
+        printf("Error waiting " TTY_NAME ", fileDescriptor is not set\n");
+        return -EBADF;
+    }
+    if (probe && copro_writeTtyRpmsg(strlen(probe), probe) < 0) {
+        ret = -errno;
+        printf("Error writing " TTY_NAME ", err=-%d\n", -ret);
+        return ret;
+    }
+    return 0;
+}
+
+static int wait_answer(double end)
+{
+    struct pollfd pfd;
+    int n;
+
+    pfd.fd = mFdRpmsg;
+    pfd.events = POLLIN;
+    do {
+        n = poll(&pfd, 1, left_ms(end));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return -errno;
+    if (!n)
+        return -ETIMEDOUT;
+    if (!(pfd.revents & POLLIN))
+        return -EIO;
+    return 0;
+}
+
+int copro_waitReady(const char *probe, int timeout_ms)
+{
+    int ret = send_probe(probe);
+
+    return ret ? ret : wait_answer(now_ms() + timeout_ms);
+}
+
+static int wait_state(const char *target, double end)
+{
+    char state[COPRO_MAX_NAME];
+    int ret;
+
+    while ((ret = sys_read(SYS_STATE, state, sizeof(state))) >= 0 && strcmp(state, target)) {
+        if (!left_ms(end))
+            return -ETIMEDOUT;
+        usleep(STATE_POLL_US);
+    }
+    return ret < 0 ? ret : 0;
+}
+
+int copro_boot(const char *fwName, const char *const *devs, const char *probe,
+               int timeout_ms, copro_boot_times_t *times)
+{
+    copro_boot_times_t t;
+    char name[COPRO_MAX_NAME];
+    double t0 = now_ms(), t1 = t0, end = t0 + timeout_ms;
+    int ret, i, ifd = -1;
+
+    memset(&t, 0, sizeof(t));
+    t.started = 1;
+
+    /* check if copro is already running */
+    ret = copro_isFwRunning();
+    if (ret < 0)
+        goto out;
+    if (ret) {
+        ret = copro_getFwName(name, sizeof(name));
+        if (ret < 0)
+            goto out;
+        if (strcmp(name, fwName) == 0) {
+            printf("%s is already running.\n", fwName);
+            t.started = 0;
+        } else {
+            printf("wrong FW running. Try to stop it... \n");
+            ret = copro_stopFw();
+            if (!ret)
+                ret = wait_state("offline", end);
+            if (ret) {
+                printf("fails to stop firmware\n");
+                goto out;
+            }
+        }
+    }
+    t.stop_ms = now_ms() - t1;
+    t1 = now_ms();
+
+    if (t.started) {
+        /* set the firmware name to load */
+        ret = copro_setFwName(fwName);
+        if (ret <= 0) {
+            printf("fails to change the firmware name\n");
+            ret = ret ? ret : -EIO;
+            goto out;
+        }
+        /* start the firmware */
+        ret = copro_startFw();
+        if (!ret)
+            ret = wait_state("running", end);
+        if (ret) {
+            printf("fails to start firmware\n");
+            goto out;
+        }
+    }
+    t.start_ms = now_ms() - t1;
+    t1 = now_ms();
+
+    /* the virtual ttyRPMSGx, then the other channels */
+    ret = wait_dev(&ifd, TTY_NAME, end);
+    if (ret) {
+        printf("no " TTY_NAME " within %d ms\n", timeout_ms);
+        goto out;
+    }
+    t.tty_ms = now_ms() - t1;
+    t1 = now_ms();
+
+    for (i = 0; devs && devs[i]; i++) {
+        ret = wait_dev(&ifd, devs[i], end);
+        if (ret) {
+            printf("no /dev/%s within %d ms\n", devs[i], timeout_ms);
+            goto out;
+        }
+    }
+    t.devs_ms = now_ms() - t1;
+    t1 = now_ms();
+
+    ret = copro_openTtyRpmsg(1);
+    if (ret) {
+        printf("fails to open the tty RPMSG\n");
+        goto out;
+    }
+    if (probe) {
+        /* the inotify is closed while the firmware answers */
+        ret = send_probe(probe);
+        if (ifd >= 0)
+            close(ifd);
+        ifd = -1;
+        if (!ret)
+            ret = wait_answer(end);
+        if (ret) {
+            printf("no answer of the firmware within %d ms\n", timeout_ms);
+            copro_closeTtyRpmsg();
+            goto out;
+        }
+    }
+    t.ready_ms = now_ms() - t1;
+
+out:
+    if (ifd >= 0)
+        close(ifd);
+    t.total_ms = now_ms() - t0;
+    if (times)
+        *times = t;
+    return ret;
+}
+
+void copro_printBootTimes(const copro_boot_times_t *times)
+{
+    printf("copro boot %.1f ms%s: stop %.1f, start %.1f, " TTY_NAME " %.1f, devices %.1f, ready %.1f\n",
+           times->total_ms, times->started ? "" : " (already running)",
+           times->stop_ms, times->start_ms, times->tty_ms, times->devs_ms, times->ready_ms);
+}
@@ -0,0 +1,69 @@
+/*
+ * copro.h
+ * Control of the co-processor through remoteproc, and its virtual TTY
+ * over RPMSG, shared by rpmsg_app and rpmsg_sdb_app.
+ *
+ * The sysfs files of remoteproc are opened once and kept open: each
+ * access is a pread/pwrite at offset 0, which sysfs answers with the
+ * current value.
+ *
+ * copro_boot() loads and starts the firmware, then waits for its
+ * channels instead of a fixed delay: the devices of the channels are
+ * watched in /dev with inotify, then a probe command is sent on the TTY
+ * and the first answer of the firmware marks it ready. Each phase is
+ * timed.
+ *
+ * All the paths are under a root, "" by default, so that the library
+ * runs on the host against a stand-in tree, see copro_sim.c.
+ */
+
+#ifndef COPRO_H
+#define COPRO_H
+
+#define COPRO_BOOT_TIMEOUT_MS   5000
+#define COPRO_MAX_NAME          80
+
+typedef struct
+{
+    int started;        /* 0: the firmware was already running */
+    double stop_ms;     /* stop of another firmware */
+    double start_ms;    /* name set, loaded and running */
+    double tty_ms;      /* ttyRPMSG0 created */
+    double devs_ms;     /* other devices of the channels created */
+    double ready_ms;    /* probe answered */
+    double total_ms;
+} copro_boot_times_t;
+
+/* Default "": the root of the sysfs and /dev paths, closes the cached files */
+int copro_setRoot(const char *root);
+void copro_close(void);
+
+int copro_isFwRunning(void);
+int copro_stopFw(void);
+int copro_startFw(void);
+int copro_getFwPath(char *pathStr, int len);
+int copro_setFwPath(const char *pathStr);
+int copro_getFwName(char *nameStr, int len);
+int copro_setFwName(const char *nameStr);
+
+int copro_openTtyRpmsg(int modeRaw);
+int copro_closeTtyRpmsg(void);
+int copro_writeTtyRpmsg(int len, const char *pData);
+int copro_readTtyRpmsg(int len, char *pData);
+
+/* Waits for /dev/<name> to be created and accessible, 0 or -ETIMEDOUT */
+int copro_waitDev(const char *name, int timeout_ms);
+/* Sends probe on the open TTY and waits for data to read, not consumed */
+int copro_waitReady(const char *probe, int timeout_ms);
+
+/*
+ * Runs fwName, stopping another firmware first, and waits for ttyRPMSG0,
+ * the devices of devs (NULL terminated, may be NULL) and the answer to
+ * probe (NULL: no probe). The TTY is left open in raw mode.
+ * Returns 0 or a negative errno, -ETIMEDOUT when timeout_ms expired.
+ */
+int copro_boot(const char *fwName, const char *const *devs, const char *probe,
+               int timeout_ms, copro_boot_times_t *times);
+void copro_printBootTimes(const copro_boot_times_t *times);
+
+#endif /* COPRO_H */
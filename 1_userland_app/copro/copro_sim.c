@@ -0,0 +1,489 @@
+/*
+ * copro_sim.c
+ * Runs the copro library on the host against a stand-in of remoteproc.
+ *
+ * The stand-in is a temporary tree with the sysfs files of remoteproc and
+ * a dev directory, served by a fake kernel thread. It watches the state
+ * file with inotify. On "start" it sets the state to running, then after
+ * the configured delays creates dev/ttyRPMSG0, a link to a pseudo
+ * terminal, and dev/rpmsg-sdb. The firmware end of the pseudo terminal
+ * answers each write after a delay. "stop" removes the devices.
+ *
+ * The checks boot the firmware, boot it again while it runs, boot another
+ * one, then time out on a device that comes too late and on a silent
+ * firmware. They stop at the first failure. Then the cached read of the
+ * state is timed against an open/read/close of the file.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "copro.h"
+
+#define NEVER           1e300
+#define STATE_FILE      "/sys/class/remoteproc/remoteproc0/state"
+#define FW_NAME_FILE    "/sys/class/remoteproc/remoteproc0/firmware"
+#define FW_PATH_FILE    "/sys/module/firmware_class/parameters/path"
+#define TTY_DEV         "/dev/ttyRPMSG0"
+#define SDB_DEV         "/dev/rpmsg-sdb"
+#define ANSWER          "BOOT"
+#define FW_SDB          "exchange_large_buf_CM4.elf"
+#define FW_TTY          "exchange_buf_CM4.elf"
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("check failed line %d: %s\n", __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+typedef struct
+{
+    int tty_ms;         /* ttyRPMSG0 after the start */
+    int sdb_ms;         /* rpmsg-sdb after ttyRPMSG0 */
+    int answer_ms;      /* answer after a write, -1: never */
+} fw_cfg_t;
+
+static struct
+{
+    char root[64];
+    pthread_t tid;
+    pthread_mutex_t lock;
+    int stop_pipe[2];
+    int inotify;                /* on the state file */
+    fw_cfg_t cfg;               /* under lock */
+    int starts, stops;          /* under lock */
+    char fw[COPRO_MAX_NAME];    /* under lock, name at the last start */
+} sim = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void sim_path(char *path, size_t len, const char *file)
+{
+    snprintf(path, len, "%s%s", sim.root, file);
+}
+
+/*
+ * Written over, not truncated: the library must not read an empty state.
+ * The states have the same length, a write of the library is shorter.
+ */
+static int write_file(const char *file, const char *str)
+{
+    char path[128];
+    int fd, ret;
+
+    sim_path(path, sizeof(path), file);
+    fd = open(path, O_WRONLY | O_CREAT, 0600);
+    if (fd < 0)
+        return -errno;
+    ret = write(fd, str, strlen(str)) < 0 ? -errno : 0;
+    close(fd);
+    return ret;
+}
+
+/* First line of the file, as the kernel takes a write to sysfs */
+static void read_line(const char *file, char *str, int len)
+{
+    char path[128];
+    ssize_t n = -1;
+    int fd;
+
+    sim_path(path, sizeof(path), file);
+    fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        n = read(fd, str, len - 1);
+        close(fd);
+    }
+    str[n > 0 ? n : 0] = 0;
+    str[strcspn(str, "\n")] = 0;
+}
+
+typedef struct
+{
+    int running;
+    int master, slave;          /* pseudo terminal of ttyRPMSG0 */
+    double tty_at, sdb_at, answer_at;
+} kernel_t;
+
+static void kernel_remove_devs(kernel_t *k)
+{
+    char path[128];
+
+    sim_path(path, sizeof(path), TTY_DEV);
+    unlink(path);
+    sim_path(path, sizeof(path), SDB_DEV);
+    unlink(path);
+    if (k->master >= 0) {
+        close(k->slave);
+        close(k->master);
+    }
+    k->master = k->slave = -1;
+    k->tty_at = k->sdb_at = k->answer_at = NEVER;
+}
+
+static void kernel_state(kernel_t *k)
+{
+    char state[COPRO_MAX_NAME];
+
+    read_line(STATE_FILE, state, sizeof(state));
+    pthread_mutex_lock(&sim.lock);
+    if (!strcmp(state, "start")) {
+        if (!k->running) {
+            k->running = 1;
+            sim.starts++;
+            read_line(FW_NAME_FILE, sim.fw, sizeof(sim.fw));
+            k->tty_at = now_ms() + sim.cfg.tty_ms;
+        }
+        write_file(STATE_FILE, "running\n");
+    } else if (!strcmp(state, "stop")) {
+        if (k->running) {
+            k->running = 0;
+            sim.stops++;
+            kernel_remove_devs(k);
+        }
+        write_file(STATE_FILE, "offline\n");
+    }
+    pthread_mutex_unlock(&sim.lock);
+}
+
+static void kernel_timers(kernel_t *k)
+{
+    char path[128];
+    double now = now_ms();
+    int fd;
+
+    pthread_mutex_lock(&sim.lock);
+    if (now >= k->tty_at) {
+        k->tty_at = NEVER;
+        k->master = posix_openpt(O_RDWR | O_NOCTTY);
+        grantpt(k->master);
+        unlockpt(k->master);
+        /* held open, or the master reports a hang up until the library opens it */
+        k->slave = open(ptsname(k->master), O_RDWR | O_NOCTTY);
+        sim_path(path, sizeof(path), TTY_DEV);
+        symlink(ptsname(k->master), path);
+        k->sdb_at = now + sim.cfg.sdb_ms;
+    }
+    if (now >= k->sdb_at) {
+        k->sdb_at = NEVER;
+        sim_path(path, sizeof(path), SDB_DEV);
+        fd = open(path, O_WRONLY | O_CREAT, 0600);
+        if (fd >= 0)
+            close(fd);
+    }
+    if (now >= k->answer_at) {
+        k->answer_at = NEVER;
+        if (write(k->master, ANSWER, strlen(ANSWER)) < 0)
+            printf("fake kernel: answer lost, err=-%d\n", errno);
+    }
+    pthread_mutex_unlock(&sim.lock);
+}
+
+static void *kernel_thread(void *arg)
+{
+    kernel_t k = { .master = -1, .slave = -1, .tty_at = NEVER, .sdb_at = NEVER, .answer_at = NEVER };
+    char buf[4096];
+    struct pollfd pfd[3];
+    double next;
+    int nfds, timeout;
+
+    (void)arg;
+    pfd[0].fd = sim.inotify;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = sim.stop_pipe[0];
+    pfd[1].events = POLLIN;
+
+    while (1) {
+        nfds = 2;
+        if (k.master >= 0) {
+            pfd[2].fd = k.master;
+            pfd[2].events = POLLIN;
+            nfds = 3;
+        }
+        next = k.tty_at < k.sdb_at ? k.tty_at : k.sdb_at;
+        if (k.answer_at < next)
+            next = k.answer_at;
+        timeout = next == NEVER ? -1 : next > now_ms() ? (int)(next - now_ms()) + 1 : 0;
+
+        if (poll(pfd, nfds, timeout) < 0 && errno != EINTR)
+            break;
+        if (pfd[1].revents)
+            break;
+        if (pfd[0].revents & POLLIN) {
+            while (read(pfd[0].fd, buf, sizeof(buf)) > 0)
+                ;
+            kernel_state(&k);
+        }
+        /* a write of the library: the firmware answers later */
+        if (nfds == 3 && (pfd[2].revents & POLLIN) && read(k.master, buf, sizeof(buf)) > 0) {
+            pthread_mutex_lock(&sim.lock);
+            if (sim.cfg.answer_ms >= 0)
+                k.answer_at = now_ms() + sim.cfg.answer_ms;
+            pthread_mutex_unlock(&sim.lock);
+        }
+        kernel_timers(&k);
+    }
+
+    kernel_remove_devs(&k);
+    return NULL;
+}
+
+static int sim_create(void)
+{
+    static const char *const dirs[] = {
+        "/sys", "/sys/class", "/sys/class/remoteproc", "/sys/class/remoteproc/remoteproc0",
+        "/sys/module", "/sys/module/firmware_class", "/sys/module/firmware_class/parameters",
+        "/dev",
+    };
+    char path[128];
+    unsigned int i;
+
+    strcpy(sim.root, "/tmp/copro_simXXXXXX");
+    if (!mkdtemp(sim.root)) {
+        printf("Error creating the stand-in tree, err=-%d\n", errno);
+        return -1;
+    }
+    for (i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        sim_path(path, sizeof(path), dirs[i]);
+        if (mkdir(path, 0700)) {
+            printf("Error creating %s, err=-%d\n", path, errno);
+            return -1;
+        }
+    }
+    if (write_file(STATE_FILE, "offline\n") || write_file(FW_NAME_FILE, "rproc-m4-fw\n") ||
+        write_file(FW_PATH_FILE, "\n"))
+        return -1;
+
+    /* watched before the first write of the library */
+    sim.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    sim_path(path, sizeof(path), STATE_FILE);
+    if (sim.inotify < 0 || inotify_add_watch(sim.inotify, path, IN_MODIFY) < 0 ||
+        pipe(sim.stop_pipe) || pthread_create(&sim.tid, NULL, kernel_thread, NULL)) {
+        printf("Error starting the fake kernel\n");
+        return -1;
+    }
+    return copro_setRoot(sim.root);
+}
+
+static void sim_destroy(void)
+{
+    static const char *const files[] = {
+        STATE_FILE, FW_NAME_FILE, FW_PATH_FILE, "/sys/module/firmware_class/parameters",
+        "/sys/module/firmware_class", "/sys/module", "/sys/class/remoteproc/remoteproc0",
+        "/sys/class/remoteproc", "/sys/class", "/sys", "/dev", "",
+    };
+    char path[128];
+    unsigned int i;
+
+    copro_close();
+    if (sim.tid && write(sim.stop_pipe[1], "", 1) == 1)
+        pthread_join(sim.tid, NULL);
+    if (sim.inotify > 0)
+        close(sim.inotify);
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        sim_path(path, sizeof(path), files[i]);
+        remove(path);
+    }
+}
+
+static void sim_config(int tty_ms, int sdb_ms, int answer_ms)
+{
+    pthread_mutex_lock(&sim.lock);
+    sim.cfg.tty_ms = tty_ms;
+    sim.cfg.sdb_ms = sdb_ms;
+    sim.cfg.answer_ms = answer_ms;
+    pthread_mutex_unlock(&sim.lock);
+}
+
+static void sim_counts(int *starts, int *stops, char *fw)
+{
+    pthread_mutex_lock(&sim.lock);
+    *starts = sim.starts;
+    *stops = sim.stops;
+    if (fw)
+        strcpy(fw, sim.fw);
+    pthread_mutex_unlock(&sim.lock);
+}
+
+static int sim_stop_fw(void)
+{
+    char state[COPRO_MAX_NAME];
+    double end = now_ms() + 1000;
+
+    copro_closeTtyRpmsg();
+    if (copro_stopFw())
+        return -1;
+    while (read_line(STATE_FILE, state, sizeof(state)), strcmp(state, "offline")) {
+        if (now_ms() > end)
+            return -1;
+        usleep(1000);
+    }
+    return 0;
+}
+
+static int open_fds(void)
+{
+    DIR *d = opendir("/proc/self/fd");
+    int n = 0;
+
+    if (!d)
+        return -1;
+    while (readdir(d))
+        n++;
+    closedir(d);
+    return n;
+}
+
+static int run_checks(const fw_cfg_t *cfg)
+{
+    static const char *const sdb_devs[] = { "rpmsg-sdb", NULL };
+    copro_boot_times_t t;
+    char fw[COPRO_MAX_NAME], buf[16];
+    int starts, stops, fds, i;
+    double min_ms = cfg->tty_ms + cfg->sdb_ms + cfg->answer_ms;
+
+    /* Started, as rpmsg_sdb_app does: after the devices, the answer to "R" */
+    sim_config(cfg->tty_ms, cfg->sdb_ms, cfg->answer_ms);
+    CHECK(copro_boot(FW_SDB, sdb_devs, "R", COPRO_BOOT_TIMEOUT_MS, &t) == 0);
+    copro_printBootTimes(&t);
+    sim_counts(&starts, &stops, fw);
+    CHECK(starts == 1 && stops == 0 && !strcmp(fw, FW_SDB) && t.started);
+    /* a phase that ends late shortens the next one */
+    CHECK(t.start_ms + t.tty_ms >= cfg->tty_ms - 1 &&
+          t.start_ms + t.tty_ms + t.devs_ms >= cfg->tty_ms + cfg->sdb_ms - 1);
+    CHECK(t.total_ms >= min_ms - 1 && t.total_ms < min_ms + 200);
+    /* the answer is left to the application */
+    CHECK(copro_readTtyRpmsg(sizeof(buf), buf) == (int)strlen(ANSWER));
+    CHECK(copro_getFwName(fw, sizeof(fw)) > 0 && !strcmp(fw, FW_SDB));
+
+    /* Already running: no restart, the probe still answered */
+    copro_closeTtyRpmsg();
+    CHECK(copro_boot(FW_SDB, sdb_devs, "R", COPRO_BOOT_TIMEOUT_MS, &t) == 0);
+    copro_printBootTimes(&t);
+    sim_counts(&starts, &stops, NULL);
+    CHECK(starts == 1 && stops == 0 && !t.started);
+
+    /* Another firmware running: stopped first, as rpmsg_app does */
+    copro_closeTtyRpmsg();
+    CHECK(copro_boot(FW_TTY, NULL, "ST", COPRO_BOOT_TIMEOUT_MS, &t) == 0);
+    copro_printBootTimes(&t);
+    sim_counts(&starts, &stops, fw);
+    CHECK(starts == 2 && stops == 1 && !strcmp(fw, FW_TTY) && t.started);
+
+    /* A device too late, then a silent firmware: the timeout is kept */
+    CHECK(sim_stop_fw() == 0);
+    sim_config(1000, cfg->sdb_ms, cfg->answer_ms);
+    CHECK(copro_boot(FW_SDB, sdb_devs, "R", 300, &t) == -ETIMEDOUT);
+    CHECK(t.total_ms >= 300 && t.total_ms < 400);
+    CHECK(sim_stop_fw() == 0);
+    sim_config(cfg->tty_ms, cfg->sdb_ms, -1);
+    CHECK(copro_boot(FW_SDB, sdb_devs, "R", 300, &t) == -ETIMEDOUT);
+    CHECK(t.total_ms >= 300 && t.total_ms < 400 && t.tty_ms >= cfg->tty_ms - 1);
+    CHECK(sim_stop_fw() == 0);
+
+    /* The sysfs files stay open across the calls */
+    fds = open_fds();
+    for (i = 0; i < 1000; i++)
+        CHECK(copro_isFwRunning() == 0);
+    CHECK(open_fds() == fds);
+
+    return 0;
+}
+
+static void bench(uint32_t loops)
+{
+    char path[128], state[COPRO_MAX_NAME];
+    double t, t_open;
+    uint32_t i;
+    int fd;
+
+    t = now_ms();
+    for (i = 0; i < loops; i++)
+        copro_isFwRunning();
+    t = (now_ms() - t) * 1e3 / loops;
+
+    sim_path(path, sizeof(path), STATE_FILE);
+    t_open = now_ms();
+    for (i = 0; i < loops; i++) {
+        fd = open(path, O_RDWR);
+        if (fd < 0 || read(fd, state, sizeof(state)) < 0)
+            break;
+        close(fd);
+    }
+    t_open = (now_ms() - t_open) * 1e3 / loops;
+
+    printf("state read: %.2f us cached, %.2f us open/read/close\n", t, t_open);
+}
+
+static void usage(char *prog)
+{
+    printf("Usage : \n");
+    printf("%s [-t <ms>] [-s <ms>] [-a <ms>] [-n <loops>]\n", prog);
+    printf("  -t: ttyRPMSG0 created after the start (default 150)\n");
+    printf("  -s: rpmsg-sdb created after ttyRPMSG0 (default 20)\n");
+    printf("  -a: answer of the firmware after a write (default 10)\n");
+    printf("  -n: state reads of the benchmark (default 100000)\n");
+}
+
+int main(int argc, char **argv)
+{
+    fw_cfg_t cfg = { 150, 20, 10 };
+    uint32_t loops = 100000;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "t:s:a:n:h")) != -1) {
+        switch (opt) {
+        case 't':
+            cfg.tty_ms = atoi(optarg);
+            break;
+        case 's':
+            cfg.sdb_ms = atoi(optarg);
+            break;
+        case 'a':
+            cfg.answer_ms = atoi(optarg);
+            break;
+        case 'n':
+            loops = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (cfg.tty_ms < 0 || cfg.sdb_ms < 0 || cfg.answer_ms < 0 || !loops ||
+        cfg.tty_ms + cfg.sdb_ms + cfg.answer_ms > COPRO_BOOT_TIMEOUT_MS / 2) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (sim_create()) {
+        sim_destroy();
+        return -1;
+    }
+    ret = run_checks(&cfg);
+    if (!ret) {
+        printf("checks passed\n");
+        bench(loops);
+    }
+    sim_destroy();
+
+    return ret;
+}
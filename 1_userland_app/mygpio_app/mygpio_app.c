@@ -0,0 +1,311 @@
+/*
+ * mygpio_app.c
+ * Loads a waveform in the mygpio driver and prints its timing statistics,
+ * or writes bus words (-w) and measures the words per second (-b).
+ * -c runs the checks of the pattern scheduler on a fake clock, see
+ * wave_check.c, without the driver.
+ *
+ * The pattern is a square wave (-s) or a text file (-f) with one edge
+ * per line: "<time ns> <pin levels>", times from the start of the
+ * pattern, levels as a bitmask of the GPIOA pins (0x4000 = PA14).
+ *
+ * The ioctl structures and the bus word compiler come from the driver
+ * header mygpio_wave.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "mygpio_wave.h"
+
+#define MYGPIO_DEV "/dev/mygpio"
+#define MAX_EDGES 4096
+
+#define BENCH_REPEAT 16
+
+int wave_check(void);
+
+static struct mygpio_edge mEdges[MAX_EDGES];
+
+static int load_pattern(const char *path, uint32_t *nb_edges)
+{
+    unsigned long t;
+    long v;
+    char line[128];
+    FILE *f;
+    int n = 0;
+
+    f = fopen(path, "r");
+    if (!f) {
+        printf("fails to open %s, err=-%d\n", path, errno);
+        return -errno;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%lu %li", &t, &v) != 2)
+            continue;
+        if (n == MAX_EDGES) {
+            printf("more than %d edges in %s\n", MAX_EDGES, path);
+            fclose(f);
+            return -E2BIG;
+        }
+        mEdges[n].t_ns = t;
+        mEdges[n].value = v;
+        n++;
+    }
+    fclose(f);
+    *nb_edges = n;
+    return 0;
+}
+
+static void print_stats(const struct mygpio_wave_stats *st)
+{
+    int i;
+
+    printf("running %u, %u periods, %llu edges, %llu missed\n", st->running, st->loops,
+           (unsigned long long)st->steps, (unsigned long long)st->missed);
+    if (!st->steps)
+        return;
+    printf("lateness ns: min %u, avg %llu, max %u\n", st->late_min_ns,
+           (unsigned long long)(st->late_sum_ns / st->steps), st->late_max_ns);
+    for (i = 0; i < MYGPIO_JITTER_BINS; i++) {
+        if (!st->hist[i])
+            continue;
+        if (i == 0)
+            printf("  < 1 us     : %u\n", st->hist[i]);
+        else
+            printf("  < %-6u us: %u\n", 1u << i, st->hist[i]);
+    }
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* bus pins in ascending order of the GPIOA pins of mask */
+static uint32_t mask_to_pins(uint32_t mask, uint8_t *pins)
+{
+    uint32_t pin, n = 0;
+
+    for (pin = 0; pin < 16; pin++)
+        if (mask & 1 << pin)
+            pins[n++] = pin;
+    return n;
+}
+
+static void print_rate(const char *what, uint32_t nb_words, double t)
+{
+    printf("%-24s: %10.0f words/s\n", what, nb_words / t);
+}
+
+/* Compiles a counter on the bus pins then writes it, by pointer and by mmap */
+static int bench_bus(int fd, uint32_t mask, uint32_t nb_words)
+{
+    struct mygpio_bus_lut lut;
+    struct mygpio_bus req;
+    uint8_t pins[MYGPIO_BUS_MAX_PINS];
+    uint32_t nb_pins, i, r, *words, *map;
+    double t;
+
+    nb_pins = mask_to_pins(mask, pins);
+    words = malloc(nb_words * sizeof(*words));
+    if (!nb_pins || !words) {
+        free(words);
+        return -EINVAL;
+    }
+    printf("%u pins (mask 0x%04x), %u words\n", nb_pins, mask, nb_words);
+
+    t = now_s();
+    for (r = 0; r < BENCH_REPEAT; r++)
+        for (i = 0; i < nb_words; i++)
+            words[i] = mygpio_bus_word(i + r, pins, nb_pins);
+    print_rate("compile, one test per pin", nb_words * BENCH_REPEAT, now_s() - t);
+
+    mygpio_bus_lut_init(&lut, pins, nb_pins);
+    t = now_s();
+    for (r = 0; r < BENCH_REPEAT; r++)
+        for (i = 0; i < nb_words; i++)
+            words[i] = mygpio_bus_lut_word(&lut, i + r);
+    print_rate("compile, lookup table", nb_words * BENCH_REPEAT, now_s() - t);
+
+    if (fd < 0) {
+        free(words);
+        return 0;
+    }
+
+    req.words = (uintptr_t)words;
+    req.nb_words = nb_words;
+    req.offset = 0;
+    t = now_s();
+    if (ioctl(fd, MYGPIO_IOC_BUS_WRITE, &req) < 0) {
+        printf("MYGPIO_IOC_BUS_WRITE fails, err=-%d\n", errno);
+        free(words);
+        return -errno;
+    }
+    print_rate("driver, user pointer", nb_words, now_s() - t);
+
+    map = mmap(NULL, MYGPIO_BUS_BUF_WORDS * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        printf("fails to map %s, err=-%d\n", MYGPIO_DEV, errno);
+        free(words);
+        return -errno;
+    }
+    req.words = 0;
+    req.nb_words = nb_words < MYGPIO_BUS_BUF_WORDS ? nb_words : MYGPIO_BUS_BUF_WORDS;
+    memcpy(map, words, req.nb_words * sizeof(uint32_t));
+    t = now_s();
+    if (ioctl(fd, MYGPIO_IOC_BUS_WRITE, &req) < 0)
+        printf("MYGPIO_IOC_BUS_WRITE fails, err=-%d\n", errno);
+    else
+        print_rate("driver, mmap buffer", req.nb_words, now_s() - t);
+
+    munmap(map, MYGPIO_BUS_BUF_WORDS * sizeof(uint32_t));
+    free(words);
+    return 0;
+}
+
+static void usage(char *prog)
+{
+    printf("Usage : \n");
+    printf("%s [-s <period ns> | -f <file> [-p <period ns>]] [-r <repeat>] [-m <mask>] [-x] [-t]\n", prog);
+    printf("%s [-w <word>]... [-b <nb words>] [-m <mask>]\n", prog);
+    printf("%s -c\n", prog);
+    printf("  -s: square wave on the pins of the mask\n");
+    printf("  -f: pattern file, one \"<time ns> <pin levels>\" per line\n");
+    printf("  -p: period of the pattern file, needed to repeat it\n");
+    printf("  -r: number of periods, 0: until stopped (default)\n");
+    printf("  -m: GPIOA pins driven (default 0x4000, PA14)\n");
+    printf("  -x: stop the waveform\n");
+    printf("  -t: print the timing statistics\n");
+    printf("  -w: write a BSRR word (bits 0-15 set, 16-31 reset the pins)\n");
+    printf("  -b: benchmark the bus words, mask defaults to the driver bus pins\n");
+    printf("  -c: check the pattern scheduler on a fake clock\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct mygpio_wave wave = { .mask = 1 << 14 };
+    struct mygpio_wave_stats st;
+    struct mygpio_bus req = { 0 };
+    uint32_t square_ns = 0, words[64], bench = 0, mask = 0;
+    const char *path = NULL;
+    int stop = 0, stats = 0, opt, fd, ret = 0;
+
+    while ((opt = getopt(argc, argv, "s:f:p:r:m:xtw:b:ch")) != -1) {
+        switch (opt) {
+        case 's':
+            square_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            path = optarg;
+            break;
+        case 'p':
+            wave.period_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            wave.repeat = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            wave.mask = mask = strtoul(optarg, NULL, 0);
+            break;
+        case 'x':
+            stop = 1;
+            break;
+        case 't':
+            stats = 1;
+            break;
+        case 'w':
+            if (req.nb_words < 64)
+                words[req.nb_words++] = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            bench = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            return wave_check() ? 1 : 0;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (square_ns) {
+        mEdges[0].t_ns = 0;
+        mEdges[0].value = wave.mask;
+        mEdges[1].t_ns = square_ns / 2;
+        mEdges[1].value = 0;
+        wave.nb_edges = 2;
+        wave.period_ns = square_ns;
+    } else if (path) {
+        ret = load_pattern(path, &wave.nb_edges);
+        if (ret)
+            return ret;
+    } else if (!stop && !stats && !req.nb_words && !bench) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    fd = open(MYGPIO_DEV, O_RDWR);
+    if (fd < 0 && bench) {
+        printf("%s not found, compile benchmark only\n", MYGPIO_DEV);
+        return bench_bus(fd, mask ? mask : 0xff, bench);
+    }
+    if (fd < 0) {
+        printf("Error opening %s, err=-%d\n", MYGPIO_DEV, errno);
+        return -errno;
+    }
+
+    if (req.nb_words) {
+        req.words = (uintptr_t)words;
+        if (ioctl(fd, MYGPIO_IOC_BUS_WRITE, &req) < 0) {
+            printf("MYGPIO_IOC_BUS_WRITE fails, err=-%d\n", errno);
+            ret = -errno;
+        }
+    }
+
+    if (bench) {
+        if (!mask && ioctl(fd, MYGPIO_IOC_BUS_MASK, &mask) < 0) {
+            printf("MYGPIO_IOC_BUS_MASK fails, err=-%d\n", errno);
+            ret = -errno;
+        } else {
+            ret = bench_bus(fd, mask, bench);
+        }
+    }
+
+    if (stop && ioctl(fd, MYGPIO_IOC_WAVE_STOP) < 0) {
+        printf("MYGPIO_IOC_WAVE_STOP fails, err=-%d\n", errno);
+        ret = -errno;
+    }
+
+    if (wave.nb_edges) {
+        wave.edges = (uintptr_t)mEdges;
+        if (ioctl(fd, MYGPIO_IOC_WAVE_START, &wave) < 0) {
+            printf("MYGPIO_IOC_WAVE_START fails, err=-%d\n", errno);
+            ret = -errno;
+        }
+    }
+
+    if (stats) {
+        if (ioctl(fd, MYGPIO_IOC_WAVE_STATS, &st) < 0) {
+            printf("MYGPIO_IOC_WAVE_STATS fails, err=-%d\n", errno);
+            ret = -errno;
+        } else {
+            print_stats(&st);
+        }
+    }
+
+    close(fd);
+    return ret;
+}
@@ -0,0 +1,224 @@
+/*
+ * wave_check.c
+ * Checks of the pattern compiler and scheduler of mygpio_wave.h on a
+ * fake clock, as the hrtimer of the driver calls them.
+ *
+ * The checks cover the minimum period and step spacing of the compiler,
+ * then the scheduler: steps on time, late ones and the missed limit, the
+ * rollover of the period, the whole periods skipped when the timer comes
+ * late and the end of the repeat count. Random call times then check
+ * that each call plays at most the end of a period and the start of the
+ * next one and leaves the pins at the level of the pattern at that time.
+ * The checks stop at the first failure.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mygpio_wave.h"
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("check failed line %d: %s\n", __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+#define PIN         (1 << 14)
+#define PERIOD      20000
+#define START       1000000
+#define MISS        5000
+#define NB_RANDOM   1000000
+
+/* Pins of the fake GPIO bank */
+typedef struct
+{
+    uint32_t state;
+    uint32_t writes;
+    uint32_t last;
+} bank_t;
+
+static void write_bsrr(void *ctx, u32 bsrr)
+{
+    bank_t *b = ctx;
+
+    b->state = mygpio_bus_apply(b->state, bsrr);
+    b->last = bsrr;
+    b->writes++;
+}
+
+static int compile(const struct mygpio_edge *edges, uint32_t nb, uint32_t period,
+                   uint32_t repeat, struct mygpio_wave_step *steps)
+{
+    return mygpio_wave_compile(edges, nb, PIN | 1, period, repeat, steps);
+}
+
+/* Level of the pins "now" for a pattern repeated from START */
+static uint32_t ref_state(const struct mygpio_wave_step *steps, uint32_t nb, uint64_t now)
+{
+    uint32_t pos = (now - START) % PERIOD, i, bsrr = steps[nb - 1].bsrr;
+
+    for (i = 0; i < nb && steps[i].t_ns <= pos; i++)
+        bsrr = steps[i].bsrr;
+    return mygpio_bus_apply(0, bsrr);
+}
+
+static int check_compile(void)
+{
+    struct mygpio_edge e[4] = {
+        { 0, PIN }, { 10000, 0 }, { 10000, 1 }, { 15000, 1 },
+    };
+    struct mygpio_wave_step steps[4];
+
+    /* same time merged, no change dropped */
+    CHECK(compile(e, 4, PERIOD, 0, steps) == 2);
+    CHECK(steps[1].t_ns == 10000 && steps[1].bsrr == (1 | PIN << 16));
+
+    CHECK(compile(e, 2, MYGPIO_WAVE_MIN_NS - 1, 0, steps) == -EINVAL);
+    CHECK(compile(e, 1, MYGPIO_WAVE_MIN_NS, 0, steps) == 1);
+    CHECK(compile(e, 2, 0, 0, steps) == -EINVAL);
+
+    /* spacing between the steps */
+    e[1].t_ns = MYGPIO_WAVE_MIN_NS - 1;
+    CHECK(compile(e, 2, PERIOD, 0, steps) == -EINVAL);
+    e[1].t_ns = MYGPIO_WAVE_MIN_NS;
+    CHECK(compile(e, 2, PERIOD, 0, steps) == 2);
+
+    /* and from the last step to the first one of the next period */
+    e[1].t_ns = PERIOD - MYGPIO_WAVE_MIN_NS + 1;
+    CHECK(compile(e, 2, PERIOD, 0, steps) == -EINVAL);
+    CHECK(compile(e, 2, PERIOD, 1, steps) == 2);
+    e[1].t_ns = PERIOD - MYGPIO_WAVE_MIN_NS;
+    CHECK(compile(e, 2, PERIOD, 0, steps) == 2);
+
+    /* single shot without period */
+    CHECK(compile(e, 2, 0, 1, steps) == 2);
+    return 0;
+}
+
+static int check_sched(void)
+{
+    struct mygpio_edge e[2] = { { 0, PIN }, { PERIOD / 2, 0 } };
+    struct mygpio_wave_step steps[2];
+    struct mygpio_wave_sched s;
+    bank_t b = { 0 };
+    uint64_t now, next;
+    uint32_t i;
+
+    CHECK(compile(e, 2, PERIOD, 0, steps) == 2);
+
+    /* On time */
+    mygpio_wave_sched_init(&s, steps, 2, PERIOD, 0, MISS, START);
+    CHECK(mygpio_wave_sched_run(&s, START - 1, write_bsrr, &b) == START && !b.writes);
+    for (i = 0, now = START; i < 10; i++) {
+        next = mygpio_wave_sched_run(&s, now, write_bsrr, &b);
+        CHECK(b.writes == i + 1 && b.state == (i & 1 ? 0 : PIN));
+        CHECK(next == now + PERIOD / 2);
+        now = next;
+    }
+    CHECK(s.stats.steps == 10 && s.stats.loops == 5 && !s.stats.missed);
+    CHECK(s.stats.late_max_ns == 0 && s.stats.hist[0] == 10);
+
+    /* Late, below and beyond the missed limit */
+    b.writes = 0;
+    CHECK(mygpio_wave_sched_run(&s, now + MISS, write_bsrr, &b) == now + PERIOD / 2);
+    CHECK(b.writes == 1 && !s.stats.missed && s.stats.late_max_ns == MISS);
+    now += PERIOD / 2;
+    CHECK(mygpio_wave_sched_run(&s, now + MISS + 1, write_bsrr, &b) == now + PERIOD / 2);
+    CHECK(b.writes == 2 && s.stats.missed == 1 && s.stats.late_max_ns == MISS + 1);
+    CHECK(s.stats.hist[3] == 2);
+    now += PERIOD / 2;
+
+    /* Late steps played back to back, across the rollover of the period */
+    b.writes = 0;
+    next = mygpio_wave_sched_run(&s, now + PERIOD / 2 + 100, write_bsrr, &b);
+    CHECK(next == now + PERIOD && b.writes == 2 && b.state == 0);
+    next = mygpio_wave_sched_run(&s, now + PERIOD + PERIOD / 2 - 1, write_bsrr, &b);
+    CHECK(next == now + PERIOD + PERIOD / 2 && b.writes == 3 && b.state == PIN);
+    CHECK(s.stats.loops == 7 && s.stats.steps == 15 && s.stats.missed == 3);
+    now += PERIOD + PERIOD / 2;
+
+    /* Whole periods late: skipped, not replayed */
+    b.writes = 0;
+    next = mygpio_wave_sched_run(&s, now + 999 * PERIOD + PERIOD / 2 + 100, write_bsrr, &b);
+    CHECK(next == now + 1000 * PERIOD && b.state == PIN);
+    /* end of the period, level of the skipped ones, start of the last one */
+    CHECK(b.writes == 3);
+    CHECK(s.stats.loops == 8 + 999 && s.stats.missed == 4 + 999 * 2);
+    CHECK(s.stats.steps == 17 && s.stats.running);
+
+    /* Repeat count reached on time, then by a late timer */
+    mygpio_wave_sched_init(&s, steps, 2, PERIOD, 3, MISS, START);
+    b.writes = 0;
+    for (now = START; (next = mygpio_wave_sched_run(&s, now, write_bsrr, &b)); now = next)
+        CHECK(b.writes < 6);
+    CHECK(b.writes == 6 && now == START + 2 * PERIOD + PERIOD / 2 && b.state == 0);
+    CHECK(s.stats.loops == 3 && !s.stats.running && !s.stats.missed);
+    CHECK(mygpio_wave_sched_run(&s, now + PERIOD, write_bsrr, &b) == 0 && b.writes == 6);
+
+    mygpio_wave_sched_init(&s, steps, 2, PERIOD, 3, MISS, START);
+    b.state = PIN;
+    b.writes = 0;
+    CHECK(mygpio_wave_sched_run(&s, START + PERIOD / 2, write_bsrr, &b) == START + PERIOD);
+    CHECK(mygpio_wave_sched_run(&s, START + 100 * PERIOD, write_bsrr, &b) == 0);
+    CHECK(b.writes == 3 && b.state == 0 && b.last == steps[1].bsrr);
+    CHECK(s.stats.loops == 3 && !s.stats.running && s.stats.missed == 1 + 2 * 2);
+    CHECK(s.stats.steps == 2);
+
+    /* Single shot late: its steps played once */
+    mygpio_wave_sched_init(&s, steps, 2, 0, 1, MISS, START);
+    b.writes = 0;
+    CHECK(mygpio_wave_sched_run(&s, START + 100 * PERIOD, write_bsrr, &b) == 0);
+    CHECK(b.writes == 2 && s.stats.steps == 2 && s.stats.missed == 2 && !s.stats.running);
+    return 0;
+}
+
+static int check_random(uint32_t nb_calls)
+{
+    static const uint32_t levels[4] = { PIN | 1, PIN, 1, 0 };
+    struct mygpio_edge e[4];
+    struct mygpio_wave_step steps[4];
+    struct mygpio_wave_sched s;
+    bank_t b = { 0 };
+    uint64_t now = START, next;
+    uint32_t i, before, nb, played = 0;
+
+    for (i = 0; i < 4; i++) {
+        e[i].t_ns = i * (PERIOD / 4);
+        e[i].value = levels[i];
+    }
+    nb = compile(e, 4, PERIOD, 0, steps);
+    CHECK(nb == 4);
+
+    srand(1);
+    mygpio_wave_sched_init(&s, steps, nb, PERIOD, 0, MISS, START);
+    next = mygpio_wave_sched_run(&s, now, write_bsrr, &b);
+    for (i = 0; i < nb_calls; i++) {
+        uint32_t r = rand() % 100;
+
+        /* on time, a bit late, or several periods late */
+        now = next + (r < 60 ? 0 : r < 95 ? rand() % PERIOD : rand() % (50 * PERIOD));
+        before = b.writes;
+        next = mygpio_wave_sched_run(&s, now, write_bsrr, &b);
+        CHECK(next > now && b.writes > before && b.writes - before <= 2 * nb + 1);
+        CHECK(b.state == ref_state(steps, nb, now));
+        played += b.writes - before;
+    }
+    CHECK(s.stats.steps + s.stats.missed >= (uint64_t)s.stats.loops * nb);
+    CHECK(s.stats.running && played >= s.stats.steps);
+
+    printf("%u calls: %u periods, %llu steps, %llu missed\n", nb_calls, s.stats.loops,
+           (unsigned long long)s.stats.steps, (unsigned long long)s.stats.missed);
+    return 0;
+}
+
+int wave_check(void)
+{
+    if (check_compile() || check_sched() || check_random(NB_RANDOM))
+        return -1;
+
+    printf("checks passed\n");
+    return 0;
+}
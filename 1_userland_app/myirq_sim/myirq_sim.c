@@ -0,0 +1,345 @@
+/*
+ * myirq_sim.c
+ * Simulates the event path of the myirq driver against a simulated IRQ
+ * source and a reader of /dev/myirq, with a fake clock.
+ *
+ * The source raises the line at a fixed rate (with optional jitter), in
+ * bursts of IRQs optionally. The driver is modeled as it runs:
+ *   - the hard handler timestamps the IRQ into the raw fifo (64);
+ *   - IRQF_ONESHOT keeps the line masked until the thread has run: an IRQ
+ *     raised meanwhile is latched and taken at the unmask, the next ones
+ *     are merged by the hardware;
+ *   - the thread, after its wakeup, coalesces the timestamps with the
+ *     policy of myirq_coalesce.h, the same code as the kernel module, into
+ *     the event fifo (1024) and arms the coalescing timer at the end of
+ *     the window of the open event;
+ *   - the reader sleeps in read(), pays a wakeup cost, then reads up to a
+ *     buffer of events at once and spends a fixed time per event.
+ * It prints the IRQs handled per second against the events and reads,
+ * the events per read, the IRQ to read latency and the losses.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "myirq_coalesce.h"
+
+#define NEVER UINT64_MAX
+#define RAW_FIFO_SIZE 64    /* MYIRQ_RAW_FIFO_SIZE */
+#define EVT_FIFO_SIZE 1024  /* MYIRQ_EVT_FIFO_SIZE */
+
+typedef struct
+{
+    double rate;        /* IRQs (or bursts) per second */
+    double jitter;      /* +/- fraction of the period */
+    uint32_t burst;     /* IRQs per burst */
+    uint32_t gap_ns;    /* between the IRQs of a burst */
+    uint32_t hard_ns;   /* hard handler */
+    uint32_t thread_wake_us;
+    uint32_t thread_ns; /* thread time per IRQ */
+    uint32_t read_wake_us;
+    uint32_t read_ns;   /* reader time per event */
+    uint32_t batch;     /* events per read() */
+    uint32_t duration_s;
+} sim_cfg_t;
+
+typedef struct
+{
+    uint64_t raised;
+    uint64_t irqs;      /* taken by the hard handler */
+    uint64_t hw_merged; /* raised while masked and latched */
+    uint64_t raw_dropped;
+    uint64_t events;
+    uint64_t evt_dropped;
+    uint64_t reads;
+    uint64_t wakeups;
+    uint64_t read_events;
+    uint64_t read_irqs; /* IRQs of the events read */
+    uint64_t lat_sum_ns;
+    uint64_t lat_max_ns;
+} sim_res_t;
+
+typedef struct
+{
+    struct myirq_coal_t coal;
+    struct myirq_event raw[RAW_FIFO_SIZE];
+    uint32_t raw_head, raw_tail;
+    struct myirq_event evt[EVT_FIFO_SIZE];
+    uint32_t evt_head, evt_tail;
+    int masked;         /* until the thread has run */
+    int latched;        /* IRQ raised while masked */
+    uint32_t seq;
+    int reader_sleeping;
+    uint64_t t_thread, t_timer, t_reader, t_unmask;
+    const sim_cfg_t *cfg;
+    sim_res_t *res;
+} sim_t;
+
+static void sim_push_event(sim_t *s, const struct myirq_event *evt)
+{
+    if (s->evt_head - s->evt_tail < EVT_FIFO_SIZE) {
+        s->evt[s->evt_head++ & (EVT_FIFO_SIZE - 1)] = *evt;
+        s->res->events++;
+    } else {
+        s->res->evt_dropped += evt->count;
+    }
+}
+
+static void sim_wake_reader(sim_t *s, uint64_t now)
+{
+    if (s->reader_sleeping && s->evt_head != s->evt_tail) {
+        s->reader_sleeping = 0;
+        s->res->wakeups++;
+        s->t_reader = now + s->cfg->read_wake_us * 1000ULL;
+    }
+}
+
+static void sim_hard_irq(sim_t *s, uint64_t now)
+{
+    struct myirq_event raw = { .ts_ns = now, .seq = s->seq++, .count = 1 };
+
+    s->res->irqs++;
+    if (s->raw_head - s->raw_tail < RAW_FIFO_SIZE)
+        s->raw[s->raw_head++ & (RAW_FIFO_SIZE - 1)] = raw;
+    else
+        s->res->raw_dropped++;
+
+    s->masked = 1;
+    s->t_thread = now + s->cfg->hard_ns + s->cfg->thread_wake_us * 1000ULL;
+}
+
+static void sim_raise(sim_t *s, uint64_t now)
+{
+    s->res->raised++;
+    if (!s->masked)
+        sim_hard_irq(s, now);
+    else if (!s->latched)
+        s->latched = 1;
+    else
+        s->res->hw_merged++;
+}
+
+/* myirq_thread(), the line is unmasked when it returns */
+static void sim_thread(sim_t *s, uint64_t now)
+{
+    struct myirq_event raw, evt;
+    uint32_t n = 0;
+
+    while (s->raw_tail != s->raw_head) {
+        raw = s->raw[s->raw_tail++ & (RAW_FIFO_SIZE - 1)];
+        if (myirq_coal_add(&s->coal, &raw, &evt))
+            sim_push_event(s, &evt);
+        n++;
+    }
+    now += n * s->cfg->thread_ns;
+
+    if (s->coal.window_ns && s->coal.has_pending)
+        s->t_timer = myirq_coal_deadline(&s->coal) > now ? myirq_coal_deadline(&s->coal) : now;
+    else if (myirq_coal_flush(&s->coal, &evt))
+        sim_push_event(s, &evt);
+    sim_wake_reader(s, now);
+
+    s->t_thread = NEVER;
+    s->t_unmask = now;
+}
+
+static void sim_unmask(sim_t *s, uint64_t now)
+{
+    s->t_unmask = NEVER;
+    s->masked = 0;
+    if (s->latched) {
+        s->latched = 0;
+        sim_hard_irq(s, now);
+    }
+}
+
+static void sim_timer(sim_t *s, uint64_t now)
+{
+    struct myirq_event evt;
+
+    s->t_timer = NEVER;
+    if (myirq_coal_flush(&s->coal, &evt))
+        sim_push_event(s, &evt);
+    sim_wake_reader(s, now);
+}
+
+/* reader back in read(): take a batch or sleep */
+static void sim_reader(sim_t *s, uint64_t now)
+{
+    uint32_t n = 0;
+    uint64_t lat;
+
+    if (s->evt_head == s->evt_tail) {
+        s->reader_sleeping = 1;
+        s->t_reader = NEVER;
+        return;
+    }
+
+    while (s->evt_tail != s->evt_head && n < s->cfg->batch) {
+        const struct myirq_event *e = &s->evt[s->evt_tail++ & (EVT_FIFO_SIZE - 1)];
+
+        lat = now - e->ts_ns;
+        s->res->lat_sum_ns += lat;
+        if (lat > s->res->lat_max_ns)
+            s->res->lat_max_ns = lat;
+        s->res->read_irqs += e->count;
+        s->res->read_events++;
+        n++;
+    }
+    s->res->reads++;
+    s->t_reader = now + n * (uint64_t)s->cfg->read_ns;
+}
+
+static void simulate(const sim_cfg_t *cfg, uint32_t coalesce_us, sim_res_t *res)
+{
+    uint64_t end = cfg->duration_s * 1000000000ULL, period = 1e9 / cfg->rate, t_arr = 0, t;
+    uint32_t in_burst = 0;
+    static sim_t s;
+
+    memset(&s, 0, sizeof(s));
+    memset(res, 0, sizeof(*res));
+    myirq_coal_reset(&s.coal);
+    s.coal.window_ns = coalesce_us * 1000ULL;
+    s.cfg = cfg;
+    s.res = res;
+    s.reader_sleeping = 1;
+    s.t_thread = s.t_timer = s.t_reader = s.t_unmask = NEVER;
+    srand(1);
+
+    for (;;) {
+        t = t_arr;
+        if (s.t_thread < t)
+            t = s.t_thread;
+        if (s.t_unmask < t)
+            t = s.t_unmask;
+        if (s.t_timer < t)
+            t = s.t_timer;
+        if (s.t_reader < t)
+            t = s.t_reader;
+        if (t > end)
+            break;
+
+        if (t == s.t_thread) {
+            sim_thread(&s, t);
+        } else if (t == s.t_unmask) {
+            sim_unmask(&s, t);
+        } else if (t == s.t_timer) {
+            sim_timer(&s, t);
+        } else if (t == s.t_reader) {
+            sim_reader(&s, t);
+        } else {
+            sim_raise(&s, t);
+            if (++in_burst < cfg->burst) {
+                t_arr += cfg->gap_ns;
+            } else {
+                in_burst = 0;
+                t_arr += period + (int64_t)(period * cfg->jitter * (2.0 * rand() / RAND_MAX - 1.0));
+            }
+        }
+    }
+}
+
+static void print_result(uint32_t coalesce_us, const sim_res_t *res, uint32_t duration_s)
+{
+    printf("%8u %10.1f %10.1f %10.1f %10.1f %10.1f %8.2f %10.1f %10.1f %8llu %8llu\n",
+           coalesce_us, (double)res->raised / duration_s, (double)res->irqs / duration_s,
+           (double)res->events / duration_s, (double)res->wakeups / duration_s,
+           (double)res->reads / duration_s,
+           res->reads ? (double)res->read_irqs / res->reads : 0.0,
+           res->read_events ? res->lat_sum_ns / 1000.0 / res->read_events : 0.0,
+           res->lat_max_ns / 1000.0, (unsigned long long)res->hw_merged,
+           (unsigned long long)(res->raw_dropped + res->evt_dropped));
+}
+
+static void usage(char *prog)
+{
+    printf("Usage : \n");
+    printf("%s [-r <irqs/s>] [-j <jitter %%>] [-b <irqs> -g <gap ns>] [-t <wakeup us>] [-w <wakeup us>]\n"
+           "   [-n <events/read>] [-c <ns/event>] [-d <s>] [-u <coalesce_us>]\n", prog);
+    printf("  -r: IRQ rate of the source, bursts per second with -b (default 20000)\n");
+    printf("  -j: jitter of the period in %% (default 50)\n");
+    printf("  -b, -g: IRQs per burst and their spacing (default 1, 2000)\n");
+    printf("  -t: IRQ thread wakeup time (default 15)\n");
+    printf("  -w: reader wakeup time (default 30)\n");
+    printf("  -n: events per read() (default 64)\n");
+    printf("  -c: reader time per event (default 1000)\n");
+    printf("  -d: simulated duration (default 10)\n");
+    printf("  -u: coalesce_us of the driver, default: a set of windows\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t windows[] = { 0, 10, 50, 200, 1000 };
+    sim_cfg_t cfg = {
+        .rate = 20000, .jitter = 0.5, .burst = 1, .gap_ns = 2000,
+        .hard_ns = 3000, .thread_wake_us = 15, .thread_ns = 500,
+        .read_wake_us = 30, .read_ns = 1000, .batch = 64, .duration_s = 10,
+    };
+    int coalesce_us = -1, opt;
+    uint32_t i;
+    sim_res_t res;
+
+    while ((opt = getopt(argc, argv, "r:j:b:g:t:w:n:c:d:u:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            cfg.rate = atof(optarg);
+            break;
+        case 'j':
+            cfg.jitter = atof(optarg) / 100;
+            break;
+        case 'b':
+            cfg.burst = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            cfg.gap_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            cfg.thread_wake_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            cfg.read_wake_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            cfg.batch = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            cfg.read_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            cfg.duration_s = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            coalesce_us = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if (cfg.rate <= 0 || !cfg.duration_s || cfg.jitter < 0 || cfg.jitter >= 1 ||
+        !cfg.burst || !cfg.gap_ns || !cfg.batch) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    printf("%.0f %s/s of %u IRQs %u ns apart, jitter %.0f%%, thread wakeup %u us, "
+           "reader wakeup %u us, %u events/read, %u s\n",
+           cfg.rate, cfg.burst > 1 ? "bursts" : "IRQ", cfg.burst, cfg.gap_ns, cfg.jitter * 100,
+           cfg.thread_wake_us, cfg.read_wake_us, cfg.batch, cfg.duration_s);
+    printf("coal us   raised/s     irqs/s   events/s  wakeups/s    reads/s irq/read lat avg us lat max us hw merged  dropped\n");
+
+    if (coalesce_us >= 0) {
+        simulate(&cfg, coalesce_us, &res);
+        print_result(coalesce_us, &res, cfg.duration_s);
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        simulate(&cfg, windows[i], &res);
+        print_result(windows[i], &res, cfg.duration_s);
+    }
+    return 0;
+}
@@ -1,69 +1,544 @@
+/*
+ * neon_test.c
+ * Checks the kernels of simd_kernels.c against their scalar reference and
+ * benchmarks them: GB/s of input data and CPU cycles per input byte.
+ *
+ * Builds for the board (NEON) as well as for a x86 Linux host (SSE2).
+ */
+
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <arm_neon.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "simd_kernels.h"
+
+#define DEFAULT_SIZE (64 * 1024)	/* bytes per input buffer */
+#define DEFAULT_LOOP 200
+#define CHECK_MAX_COUNT 300		/* all counts up to this one are checked */
+
+#define GAIN_Q15 ((int16_t)(0.75 * 32768))
+#define GAIN_Q31 ((int32_t)(-0.3 * 2147483648.0))
 
-void add_intarr_normal(int * dst, int * src1, int *src2, int count)
+typedef struct
 {
-    int i;
-	for (i = 0; i < count; i++)
-	{
-		dst[i] = src1[i] + src2[i];
-	}
+	size_t size;		/* bytes per buffer */
+	uint8_t *in1, *in2;	/* inputs, SIMD_ALIGN aligned */
+	uint8_t *out;		/* output, 2 * size bytes */
+	uint8_t *wave;		/* logic samples, pulses of 17 samples at least */
+	int off;		/* byte offset applied to in1/in2/out */
+	volatile uint64_t sink;
+} bench_ctx_t;
+
+typedef void (*bench_fn_t)(bench_ctx_t *c);
+
+typedef struct
+{
+	const char *name;
+	size_t elt_size;	/* input element size in bytes */
+	int nb_in;		/* number of input buffers read */
+	bench_fn_t fn[3];	/* scalar, simd, simd aligned */
+} kernel_t;
+
+#define IN1(c, t) ((const t *)((c)->in1 + (c)->off))
+#define IN2(c, t) ((const t *)((c)->in2 + (c)->off))
+#define OUT(c, t) ((t *)((c)->out + (c)->off))
+#define COUNT(c, t) (((c)->size - SIMD_ALIGN) / sizeof(t))
+
+/* one benchmark wrapper per kernel and variant */
+#define BENCH_ADD(name, t, fn) \
+	static void bench_##name(bench_ctx_t *c) { fn(OUT(c, t), IN1(c, t), IN2(c, t), COUNT(c, t)); }
+#define BENCH_SCALE(name, t, fn, gain) \
+	static void bench_##name(bench_ctx_t *c) { fn(OUT(c, t), IN1(c, t), gain, COUNT(c, t)); }
+#define BENCH_STATS(name, fn) \
+	static void bench_##name(bench_ctx_t *c) { simd_stats_s16_t st; \
+		fn(IN1(c, int16_t), COUNT(c, int16_t), &st); c->sink += st.sum; }
+#define BENCH_UNPACK(name, fn, num, den) \
+	static void bench_##name(bench_ctx_t *c) { \
+		fn(OUT(c, uint16_t), IN1(c, uint8_t), (c->size - SIMD_ALIGN) * (den) / (num)); }
+
+BENCH_ADD(add_s16_scalar, int16_t, scalar_add_s16)
+BENCH_ADD(add_s16_simd, int16_t, simd_add_s16)
+BENCH_ADD(add_s16_aligned, int16_t, simd_add_s16_aligned)
+BENCH_ADD(add_s32_scalar, int32_t, scalar_add_s32)
+BENCH_ADD(add_s32_simd, int32_t, simd_add_s32)
+BENCH_ADD(add_s32_aligned, int32_t, simd_add_s32_aligned)
+BENCH_SCALE(scale_s16_scalar, int16_t, scalar_scale_s16, GAIN_Q15)
+BENCH_SCALE(scale_s16_simd, int16_t, simd_scale_s16, GAIN_Q15)
+BENCH_SCALE(scale_s16_aligned, int16_t, simd_scale_s16_aligned, GAIN_Q15)
+BENCH_SCALE(scale_s32_scalar, int32_t, scalar_scale_s32, GAIN_Q31)
+BENCH_SCALE(scale_s32_simd, int32_t, simd_scale_s32, GAIN_Q31)
+BENCH_SCALE(scale_s32_aligned, int32_t, simd_scale_s32_aligned, GAIN_Q31)
+BENCH_STATS(stats_s16_scalar, scalar_stats_s16)
+BENCH_STATS(stats_s16_simd, simd_stats_s16)
+BENCH_STATS(stats_s16_aligned, simd_stats_s16_aligned)
+BENCH_UNPACK(unpack8_scalar, scalar_unpack8, 1, 1)
+BENCH_UNPACK(unpack8_simd, simd_unpack8, 1, 1)
+BENCH_UNPACK(unpack8_aligned, simd_unpack8_aligned, 1, 1)
+BENCH_UNPACK(unpack12_scalar, scalar_unpack12, 3, 2)
+BENCH_UNPACK(unpack12_simd, simd_unpack12, 3, 2)
+BENCH_UNPACK(unpack12_aligned, simd_unpack12_aligned, 3, 2)
+BENCH_UNPACK(unpack16be_scalar, scalar_unpack16be, 2, 1)
+BENCH_UNPACK(unpack16be_simd, simd_unpack16be, 2, 1)
+BENCH_UNPACK(unpack16be_aligned, simd_unpack16be_aligned, 2, 1)
+
+static void bench_hist_u8_scalar(bench_ctx_t *c)
+{
+	uint32_t hist[256] = {0};
+
+	scalar_hist_u8(IN1(c, uint8_t), c->size - SIMD_ALIGN, hist);
+	c->sink += hist[0];
 }
 
+static void bench_hist_u8_simd(bench_ctx_t *c)
+{
+	uint32_t hist[256] = {0};
+
+	simd_hist_u8(IN1(c, uint8_t), c->size - SIMD_ALIGN, hist);
+	c->sink += hist[0];
+}
 
-void add_intarr_neon(int * dst, int * src1, int *src2, int count)
+static void bench_summary_u8_scalar(bench_ctx_t *c)
 {
-    int i;
-	for (i = 0; i < count; i += 4)
-	{
-		int32x4_t in1, in2, out;
-		in1 = vld1q_s32(src1);
-		in2 = vld1q_s32(src2);
-		out = vaddq_s32(in1, in2);
-		vst1q_s32(dst, out);
+	simd_summary_u8_t su;
 
-		src1 += 4;
-		src2 += 4;
-		dst += 4;
-	}
+	scalar_summary_u8(IN1(c, uint8_t), c->size - SIMD_ALIGN, 0, &su);
+	c->sink += su.edges;
 }
 
-#define ARR_COUNT (1024 * 4)
-static int arr_src1[ARR_COUNT];
-static int arr_src2[ARR_COUNT];
-static int arr_dst[ARR_COUNT];
+static void bench_summary_u8_simd(bench_ctx_t *c)
+{
+	simd_summary_u8_t su;
 
-int main(int argc, char **argv)
+	simd_summary_u8(IN1(c, uint8_t), c->size - SIMD_ALIGN, 0, &su);
+	c->sink += su.edges;
+}
+
+/* a condition never met: the whole buffer is scanned */
+static const simd_match_u8_t mBenchMatch = { 0x00, 0x01, 0x01, 0x02, 0 };
+
+static void bench_find_u8_scalar(bench_ctx_t *c)
 {
-	int32_t i, loop = 1000000;
+	c->sink += scalar_find_u8(c->wave + c->off, c->size - SIMD_ALIGN, 0, &mBenchMatch);
+}
 
-	if (argc != 2)
-	{
-		goto help;
-	}
+static void bench_find_u8_simd(bench_ctx_t *c)
+{
+	c->sink += simd_find_u8(c->wave + c->off, c->size - SIMD_ALIGN, 0, &mBenchMatch);
+}
 
-	for (i = 0; i < ARR_COUNT; i++) {
-		arr_src1[i] = arr_src2[i] = i;
+static void bench_find_glitch_u8_scalar(bench_ctx_t *c)
+{
+	c->sink += scalar_find_glitch_u8(c->wave + c->off, c->size - SIMD_ALIGN, SIMD_GLITCH_MAX,
+					 0xff, SIMD_GLITCH_MAX);
+}
+
+static void bench_find_glitch_u8_simd(bench_ctx_t *c)
+{
+	c->sink += simd_find_glitch_u8(c->wave + c->off, c->size - SIMD_ALIGN, SIMD_GLITCH_MAX,
+				       0xff, SIMD_GLITCH_MAX);
+}
+
+/* edges of channel 0, every 17 samples */
+static void bench_edges_u8_scalar(bench_ctx_t *c)
+{
+	c->sink += scalar_edges_u8(c->wave + c->off, c->size - SIMD_ALIGN, 0, 0x01,
+				   (uint32_t *)c->out, 2 * c->size / sizeof(uint32_t));
+}
+
+static void bench_edges_u8_simd(bench_ctx_t *c)
+{
+	c->sink += simd_edges_u8(c->wave + c->off, c->size - SIMD_ALIGN, 0, 0x01,
+				 (uint32_t *)c->out, 2 * c->size / sizeof(uint32_t));
+}
+
+static void bench_crc32_scalar(bench_ctx_t *c)
+{
+	c->sink += scalar_crc32(0, IN1(c, uint8_t), c->size - SIMD_ALIGN);
+}
+
+static void bench_crc32_simd(bench_ctx_t *c)
+{
+	c->sink += simd_crc32(0, IN1(c, uint8_t), c->size - SIMD_ALIGN);
+}
+
+static const kernel_t mKernels[] = {
+	{ "add_s16",    2, 2, { bench_add_s16_scalar, bench_add_s16_simd, bench_add_s16_aligned } },
+	{ "add_s32",    4, 2, { bench_add_s32_scalar, bench_add_s32_simd, bench_add_s32_aligned } },
+	{ "scale_s16",  2, 1, { bench_scale_s16_scalar, bench_scale_s16_simd, bench_scale_s16_aligned } },
+	{ "scale_s32",  4, 1, { bench_scale_s32_scalar, bench_scale_s32_simd, bench_scale_s32_aligned } },
+	{ "stats_s16",  2, 1, { bench_stats_s16_scalar, bench_stats_s16_simd, bench_stats_s16_aligned } },
+	{ "hist_u8",    1, 1, { bench_hist_u8_scalar, bench_hist_u8_simd, NULL } },
+	{ "summary_u8", 1, 1, { bench_summary_u8_scalar, bench_summary_u8_simd, NULL } },
+	{ "find_u8",    1, 1, { bench_find_u8_scalar, bench_find_u8_simd, NULL } },
+	{ "find_glitch_u8", 1, 1, { bench_find_glitch_u8_scalar, bench_find_glitch_u8_simd, NULL } },
+	{ "edges_u8",   1, 1, { bench_edges_u8_scalar, bench_edges_u8_simd, NULL } },
+	{ "crc32",      1, 1, { bench_crc32_scalar, bench_crc32_simd, NULL } },
+	{ "unpack8",    1, 1, { bench_unpack8_scalar, bench_unpack8_simd, bench_unpack8_aligned } },
+	{ "unpack12",   1, 1, { bench_unpack12_scalar, bench_unpack12_simd, bench_unpack12_aligned } },
+	{ "unpack16be", 1, 1, { bench_unpack16be_scalar, bench_unpack16be_simd, bench_unpack16be_aligned } },
+};
+
+static const char *mVariantName[3] = { "scalar", "simd", "aligned" };
+
+/********************************************************************************
+Correctness checks: every count up to CHECK_MAX_COUNT, at every misalignment
+*********************************************************************************/
+
+static int check_fail(const char *name, size_t n, int off)
+{
+	printf("FAIL %s: count=%zu offset=%d\n", name, n, off);
+	return 1;
+}
+
+/* trigger conditions, of the first sample to none */
+static const simd_match_u8_t mCheckMatch[] = {
+	{ 0xf0, 0xf0, 0, 0, 0 },	/* pattern */
+	{ 0x20, 0x20, 0x10, 0, 0 },	/* rising edge with a pattern */
+	{ 0, 0, 0, 0x80, 0 },		/* falling edge */
+	{ 0, 0, 0x41, 0x41, 0 },	/* any edge */
+	{ 0xf0, 0x00, 0, 0, 1 },	/* out of a pattern */
+	{ 0, 0, 0, 0, 1 },		/* never */
+};
+
+/* all the edges, then 3 at most: the search stops there */
+static int check_edges(const uint8_t *src, size_t n, int off, const char *name)
+{
+	uint32_t p1[CHECK_MAX_COUNT], p2[CHECK_MAX_COUNT];
+	size_t c1, c2, max;
+	int err = 0;
+
+	for (max = CHECK_MAX_COUNT; max; max = max > 3 ? 3 : 0) {
+		c1 = scalar_edges_u8(src, n, 0x5a, 0x31, p1, max);
+		c2 = simd_edges_u8(src, n, 0x5a, 0x31, p2, max);
+		if (c1 != c2 || memcmp(p1, p2, c1 * sizeof(p1[0])))
+			err |= check_fail(name, n, off);
 	}
+	return err;
+}
 
-	if (strcmp(argv[1], "off") == 0) {
-		for (i = 0; i < loop; i++) {
-			add_intarr_normal(arr_dst, arr_src1, arr_src2, ARR_COUNT);
+static int check_find(const uint8_t *src, size_t n, int off, const char *name, const char *gname)
+{
+	unsigned int j, w;
+	int err = 0;
+
+	for (j = 0; j < sizeof(mCheckMatch) / sizeof(mCheckMatch[0]); j++)
+		if (scalar_find_u8(src, n, 0x5a, &mCheckMatch[j]) !=
+		    simd_find_u8(src, n, 0x5a, &mCheckMatch[j]))
+			err |= check_fail(name, n, off);
+	for (w = 2; w <= SIMD_GLITCH_MAX && w <= n; w++)
+		if (scalar_find_glitch_u8(src, n, w, 0x30, w) != simd_find_glitch_u8(src, n, w, 0x30, w))
+			err |= check_fail(gname, n, off);
+	return err;
+}
+
+static int check_kernels(bench_ctx_t *c)
+{
+	uint8_t *ref = malloc(2 * c->size);
+	size_t n, k, r;
+	int off, err = 0;
+	uint32_t h1[256], h2[256];
+	simd_stats_s16_t s1, s2;
+	simd_summary_u8_t u1, u2;
+
+	if (ref == NULL)
+		return 1;
+
+	/* known value: crc32("123456789") */
+	if (simd_crc32(0, (const uint8_t *)"123456789", 9) != 0xcbf43926 ||
+	    scalar_crc32(0, (const uint8_t *)"123456789", 9) != 0xcbf43926)
+		err |= check_fail("crc32 check value", 9, 0);
+
+	for (off = 0; off < SIMD_ALIGN; off++) {
+		const uint8_t *i1 = c->in1 + off, *i2 = c->in2 + off;
+		uint8_t *o = c->out + off;
+
+		for (n = 0; n <= CHECK_MAX_COUNT; n++) {
+#define CHECK_OUT(name, bytes, ref_call, simd_call) do { \
+		memset(ref, 0x5a, (bytes) + 4); memset(o, 0x5a, (bytes) + 4); \
+		ref_call; simd_call; \
+		if (memcmp(ref, o, (bytes) + 4)) err |= check_fail(name, n, off); } while (0)
+
+			CHECK_OUT("add_s16", n * 2,
+				  scalar_add_s16((int16_t *)ref, (const int16_t *)i1, (const int16_t *)i2, n),
+				  simd_add_s16((int16_t *)o, (const int16_t *)i1, (const int16_t *)i2, n));
+			CHECK_OUT("add_s32", n * 4,
+				  scalar_add_s32((int32_t *)ref, (const int32_t *)i1, (const int32_t *)i2, n),
+				  simd_add_s32((int32_t *)o, (const int32_t *)i1, (const int32_t *)i2, n));
+			CHECK_OUT("scale_s16", n * 2,
+				  scalar_scale_s16((int16_t *)ref, (const int16_t *)i1, GAIN_Q15, n),
+				  simd_scale_s16((int16_t *)o, (const int16_t *)i1, GAIN_Q15, n));
+			CHECK_OUT("scale_s16 -1.0", n * 2,
+				  scalar_scale_s16((int16_t *)ref, (const int16_t *)i1, INT16_MIN, n),
+				  simd_scale_s16((int16_t *)o, (const int16_t *)i1, INT16_MIN, n));
+			CHECK_OUT("scale_s32", n * 4,
+				  scalar_scale_s32((int32_t *)ref, (const int32_t *)i1, GAIN_Q31, n),
+				  simd_scale_s32((int32_t *)o, (const int32_t *)i1, GAIN_Q31, n));
+			CHECK_OUT("unpack8", n * 2,
+				  scalar_unpack8((uint16_t *)ref, i1, n),
+				  simd_unpack8((uint16_t *)o, i1, n));
+			CHECK_OUT("unpack12", n * 2,
+				  scalar_unpack12((uint16_t *)ref, i1, n),
+				  simd_unpack12((uint16_t *)o, i1, n));
+			CHECK_OUT("unpack16be", n * 2,
+				  scalar_unpack16be((uint16_t *)ref, i1, n),
+				  simd_unpack16be((uint16_t *)o, i1, n));
+			if (off == 0) {
+				CHECK_OUT("add_s16_aligned", n * 2,
+					  scalar_add_s16((int16_t *)ref, (const int16_t *)i1, (const int16_t *)i2, n),
+					  simd_add_s16_aligned((int16_t *)o, (const int16_t *)i1, (const int16_t *)i2, n));
+				CHECK_OUT("add_s32_aligned", n * 4,
+					  scalar_add_s32((int32_t *)ref, (const int32_t *)i1, (const int32_t *)i2, n),
+					  simd_add_s32_aligned((int32_t *)o, (const int32_t *)i1, (const int32_t *)i2, n));
+				CHECK_OUT("scale_s16_aligned", n * 2,
+					  scalar_scale_s16((int16_t *)ref, (const int16_t *)i1, GAIN_Q15, n),
+					  simd_scale_s16_aligned((int16_t *)o, (const int16_t *)i1, GAIN_Q15, n));
+				CHECK_OUT("scale_s32_aligned", n * 4,
+					  scalar_scale_s32((int32_t *)ref, (const int32_t *)i1, GAIN_Q31, n),
+					  simd_scale_s32_aligned((int32_t *)o, (const int32_t *)i1, GAIN_Q31, n));
+				CHECK_OUT("unpack8_aligned", n * 2,
+					  scalar_unpack8((uint16_t *)ref, i1, n),
+					  simd_unpack8_aligned((uint16_t *)o, i1, n));
+				CHECK_OUT("unpack12_aligned", n * 2,
+					  scalar_unpack12((uint16_t *)ref, i1, n),
+					  simd_unpack12_aligned((uint16_t *)o, i1, n));
+				CHECK_OUT("unpack16be_aligned", n * 2,
+					  scalar_unpack16be((uint16_t *)ref, i1, n),
+					  simd_unpack16be_aligned((uint16_t *)o, i1, n));
+			}
+#undef CHECK_OUT
+
+			scalar_stats_s16((const int16_t *)i1, n, &s1);
+			simd_stats_s16((const int16_t *)i1, n, &s2);
+			if (s1.min != s2.min || s1.max != s2.max || s1.sum != s2.sum)
+				err |= check_fail("stats_s16", n, off);
+			if (off == 0) {
+				simd_stats_s16_aligned((const int16_t *)i1, n, &s2);
+				if (s1.min != s2.min || s1.max != s2.max || s1.sum != s2.sum)
+					err |= check_fail("stats_s16_aligned", n, off);
+			}
+
+			memset(h1, 0, sizeof(h1));
+			memset(h2, 0, sizeof(h2));
+			scalar_hist_u8(i1, n, h1);
+			simd_hist_u8(i1, n, h2);
+			if (memcmp(h1, h2, sizeof(h1)))
+				err |= check_fail("hist_u8", n, off);
+
+			if (scalar_crc32(0, i1, n) != simd_crc32(0, i1, n))
+				err |= check_fail("crc32", n, off);
+
+			/* random samples and runs of 1 to 7 samples */
+			for (k = 0; k < n; k++)
+				ref[off + k] = (k * k / 7) & 0xf0;
+			for (k = 0; k < 2; k++) {
+				const uint8_t *src = k ? ref + off : i1;
+
+				scalar_summary_u8(src, n, 0x5a, &u1);
+				simd_summary_u8(src, n, 0x5a, &u2);
+				if (u1.min != u2.min || u1.max != u2.max || u1.and_bits != u2.and_bits ||
+				    u1.or_bits != u2.or_bits || u1.edges != u2.edges)
+					err |= check_fail(k ? "summary_u8 runs" : "summary_u8", n, off);
+			}
+			err |= check_find(i1, n, off, "find_u8", "find_glitch_u8");
+			err |= check_find(ref + off, n, off, "find_u8 runs", "find_glitch_u8 runs");
+			err |= check_edges(i1, n, off, "edges_u8");
+			err |= check_edges(ref + off, n, off, "edges_u8 runs");
 		}
-		return 0;
 	}
-	else if  (strcmp(argv[1], "on") == 0) {
-		for (i = 0; i < loop; i++) {
-			add_intarr_neon(arr_dst, arr_src1, arr_src2, ARR_COUNT);
+
+	/* large buffer: stats accumulator flush and long CRC */
+	n = (c->size - SIMD_ALIGN) / 2;
+	scalar_stats_s16((const int16_t *)c->in1, n, &s1);
+	simd_stats_s16((const int16_t *)c->in1, n, &s2);
+	if (s1.min != s2.min || s1.max != s2.max || s1.sum != s2.sum)
+		err |= check_fail("stats_s16", n, 0);
+	/* edge counter flush, on long runs */
+	for (k = 0; k < 2 * n; k++)
+		ref[k] = k / 1000 & 0x11;
+	scalar_summary_u8(ref, 2 * n, 0, &u1);
+	simd_summary_u8(ref, 2 * n, 0, &u2);
+	if (u1.edges != u2.edges || u1.and_bits != u2.and_bits || u1.or_bits != u2.or_bits)
+		err |= check_fail("summary_u8", 2 * n, 0);
+	/* whole buffer without glitch, then with one ending near its end */
+	memcpy(ref, c->wave, 2 * n);
+	for (k = 0; k < 2; k++) {
+		r = simd_find_glitch_u8(ref, 2 * n, SIMD_GLITCH_MAX, 0xff, SIMD_GLITCH_MAX);
+		if (r != scalar_find_glitch_u8(ref, 2 * n, SIMD_GLITCH_MAX, 0xff, SIMD_GLITCH_MAX) ||
+		    (k ? r < 2 * n - 5 || r >= 2 * n : r != 2 * n))
+			err |= check_fail("find_glitch_u8", 2 * n, 0);
+		ref[2 * n - 5] ^= 0x08;
+	}
+	if (scalar_crc32(0, c->in1, 2 * n) != simd_crc32(0, c->in1, 2 * n))
+		err |= check_fail("crc32", 2 * n, 0);
+
+	free(ref);
+	printf("%s: kernel checks %s\n", simd_impl_name(), err ? "FAILED" : "passed");
+	return err;
+}
+
+/********************************************************************************
+Benchmark
+*********************************************************************************/
+
+static int perf_open_cycles(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_kernels(bench_ctx_t *c, int loop, const char *only)
+{
+	int fd = perf_open_cycles();
+	unsigned int k, v;
+	int i;
+
+	if (fd < 0)
+		printf("no access to the cycle counter, cycles/B not reported\n");
+
+	printf("%-12s %-8s %10s %10s\n", "kernel", "variant", "GB/s", "cycles/B");
+	for (k = 0; k < sizeof(mKernels) / sizeof(mKernels[0]); k++) {
+		const kernel_t *kn = &mKernels[k];
+		/* bytes of input read per call */
+		double bytes = (double)(c->size - SIMD_ALIGN) * kn->nb_in;
+
+		if (only && strcmp(only, kn->name))
+			continue;
+
+		for (v = 0; v < 3; v++) {
+			uint64_t t0, t1, cycles = 0;
+
+			if (kn->fn[v] == NULL)
+				continue;
+			/* unaligned entry points are measured off by one element */
+			c->off = v == 1 ? kn->elt_size : 0;
+
+			kn->fn[v](c);	/* warm up caches */
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+			t0 = now_ns();
+			for (i = 0; i < loop; i++)
+				kn->fn[v](c);
+			t1 = now_ns();
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+				if (read(fd, &cycles, sizeof(cycles)) != sizeof(cycles))
+					cycles = 0;
+			}
+
+			printf("%-12s %-8s %10.3f ", kn->name, mVariantName[v],
+			       bytes * loop / (double)(t1 - t0));
+			if (cycles)
+				printf("%10.3f\n", (double)cycles / (bytes * loop));
+			else
+				printf("%10s\n", "n/a");
 		}
-		return 0;
 	}
 
-help:
+	if (fd >= 0)
+		close(fd);
+}
+
+static void usage(char *prog)
+{
 	printf("Usage : \n");
-	printf("%s <on|off>\n", argv[0]);
-	return 0;
+	printf("%s [-t] [-n <bytes>] [-l <loops>] [-k <kernel>]\n", prog);
+	printf("  -t: only run the correctness checks\n");
+	printf("  -n: input buffer size (default %d)\n", DEFAULT_SIZE);
+	printf("  -l: calls per measure (default %d)\n", DEFAULT_LOOP);
+	printf("  -k: only benchmark this kernel\n");
 }
 
+int main(int argc, char **argv)
+{
+	bench_ctx_t c;
+	int opt, check_only = 0, loop = DEFAULT_LOOP, ret;
+	const char *only = NULL;
+	size_t i;
+
+	memset(&c, 0, sizeof(c));
+	c.size = DEFAULT_SIZE;
+
+	while ((opt = getopt(argc, argv, "tn:l:k:h")) != -1) {
+		switch (opt) {
+		case 't':
+			check_only = 1;
+			break;
+		case 'n':
+			c.size = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			loop = atoi(optarg);
+			break;
+		case 'k':
+			only = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 0;
+		}
+	}
+
+	/* room for the checks and the misaligned runs */
+	c.size = (c.size + SIMD_ALIGN - 1) & ~(SIMD_ALIGN - 1);
+	if (c.size < 8 * CHECK_MAX_COUNT)
+		c.size = 8 * CHECK_MAX_COUNT;
+	c.size += SIMD_ALIGN;
+
+	if (posix_memalign((void **)&c.in1, SIMD_ALIGN, c.size) ||
+	    posix_memalign((void **)&c.in2, SIMD_ALIGN, c.size) ||
+	    posix_memalign((void **)&c.out, SIMD_ALIGN, 2 * c.size) ||
+	    posix_memalign((void **)&c.wave, SIMD_ALIGN, c.size)) {
+		printf("fails to allocate buffers\n");
+		return -1;
+	}
+
+	srand(1);
+	for (i = 0; i < c.size; i++) {
+		c.in1[i] = rand();
+		c.in2[i] = rand();
+		c.wave[i] = 0;
+		for (opt = 0; opt < 8; opt++)
+			c.wave[i] |= (i / (17 + 3 * opt) & 1) << opt;
+	}
+	/* extreme values to exercise the saturations */
+	((int16_t *)c.in1)[1] = INT16_MIN;
+	((int16_t *)c.in2)[1] = INT16_MIN;
+	((int16_t *)c.in1)[2] = INT16_MAX;
+	((int16_t *)c.in2)[2] = INT16_MAX;
+	((int32_t *)c.in1)[3] = INT32_MIN;
+
+	ret = check_kernels(&c);
+	if (!ret && !check_only)
+		bench_kernels(&c, loop, only);
+
+	free(c.in1);
+	free(c.in2);
+	free(c.out);
+	free(c.wave);
+	return ret;
+}
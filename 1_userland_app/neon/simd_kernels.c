@@ -0,0 +1,1075 @@
+/*
+ * simd_kernels.c
+ * Scalar, NEON and SSE2 implementations of the kernels of simd_kernels.h.
+ *
+ * The vector loops handle whole registers, the remaining elements go
+ * through the scalar code so any count is supported. The *_aligned entry
+ * points let the compiler use aligned accesses (SSE2 movdqa, NEON
+ * alignment hints).
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "simd_kernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define IS_ALIGNED(p) ((((uintptr_t)(p)) & (SIMD_ALIGN - 1)) == 0)
+
+#define ASSUME_ALIGNED(p) (__typeof__(p))__builtin_assume_aligned((p), SIMD_ALIGN)
+
+#if defined(SIMD_SSE2)
+#define SSE_LOAD(p, al) ((al) ? _mm_load_si128((const __m128i *)(p)) : \
+				_mm_loadu_si128((const __m128i *)(p)))
+#define SSE_STORE(p, v, al) do { if (al) _mm_store_si128((__m128i *)(p), (v)); \
+				 else _mm_storeu_si128((__m128i *)(p), (v)); } while (0)
+#endif
+
+const char *simd_impl_name(void)
+{
+#if defined(SIMD_NEON)
+	return "NEON";
+#elif defined(SIMD_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+static inline int16_t sat_s16(int32_t v)
+{
+	if (v > INT16_MAX)
+		return INT16_MAX;
+	if (v < INT16_MIN)
+		return INT16_MIN;
+	return v;
+}
+
+static inline int32_t sat_s32(int64_t v)
+{
+	if (v > INT32_MAX)
+		return INT32_MAX;
+	if (v < INT32_MIN)
+		return INT32_MIN;
+	return v;
+}
+
+/********************************************************************************
+Scalar reference
+*********************************************************************************/
+
+void scalar_add_s16(int16_t *dst, const int16_t *a, const int16_t *b, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = sat_s16((int32_t)a[i] + b[i]);
+}
+
+void scalar_add_s32(int32_t *dst, const int32_t *a, const int32_t *b, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (int32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+}
+
+void scalar_scale_s16(int16_t *dst, const int16_t *src, int16_t gain_q15, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = sat_s16(((int32_t)src[i] * gain_q15 + (1 << 14)) >> 15);
+}
+
+void scalar_scale_s32(int32_t *dst, const int32_t *src, int32_t gain_q31, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = sat_s32(((int64_t)src[i] * gain_q31 + (1LL << 30)) >> 31);
+}
+
+void scalar_stats_s16(const int16_t *src, size_t n, simd_stats_s16_t *st)
+{
+	size_t i;
+
+	st->min = INT16_MAX;
+	st->max = INT16_MIN;
+	st->sum = 0;
+	for (i = 0; i < n; i++) {
+		if (src[i] < st->min)
+			st->min = src[i];
+		if (src[i] > st->max)
+			st->max = src[i];
+		st->sum += src[i];
+	}
+}
+
+void scalar_summary_u8(const uint8_t *src, size_t n, uint8_t prev, simd_summary_u8_t *s)
+{
+	size_t i;
+
+	s->min = 0xff;
+	s->max = 0;
+	s->and_bits = 0xff;
+	s->or_bits = 0;
+	s->edges = 0;
+	for (i = 0; i < n; i++) {
+		if (src[i] < s->min)
+			s->min = src[i];
+		if (src[i] > s->max)
+			s->max = src[i];
+		s->and_bits &= src[i];
+		s->or_bits |= src[i];
+		s->edges += src[i] != prev;
+		prev = src[i];
+	}
+}
+
+static inline int match_u8(uint8_t s, uint8_t prev, const simd_match_u8_t *m)
+{
+	int hit = (s & m->mask) == m->value;
+
+	if (m->rise | m->fall)
+		hit = hit && ((s & ~prev & m->rise) | (~s & prev & m->fall));
+	return hit != !!m->invert;
+}
+
+size_t scalar_find_u8(const uint8_t *src, size_t n, uint8_t prev, const simd_match_u8_t *m)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (match_u8(src[i], prev, m))
+			return i;
+		prev = src[i];
+	}
+	return n;
+}
+
+size_t scalar_find_glitch_u8(const uint8_t *src, size_t n, size_t from, uint8_t mask,
+			     unsigned int width)
+{
+	size_t i, j;
+	uint8_t e;
+
+	for (i = from; i < n; i++) {
+		e = (src[i] ^ src[i - 1]) & mask;
+		if (!e)
+			continue;
+		for (j = i - width + 1; j < i; j++)
+			if (e & (src[j] ^ src[j - 1]))
+				return i;
+	}
+	return n;
+}
+
+size_t scalar_edges_u8(const uint8_t *src, size_t n, uint8_t prev, uint8_t mask, uint32_t *pos,
+		       size_t max)
+{
+	size_t i, count = 0;
+
+	for (i = 0; i < n && count < max; i++) {
+		if ((src[i] ^ prev) & mask)
+			pos[count++] = i;
+		prev = src[i];
+	}
+	return count;
+}
+
+void scalar_hist_u8(const uint8_t *src, size_t n, uint32_t hist[256])
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		hist[src[i]]++;
+}
+
+static uint32_t crc32_table[8][256];
+static int crc32_table_ready;
+
+static void crc32_init(void)
+{
+	uint32_t c;
+	int i, k;
+
+	if (crc32_table_ready)
+		return;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = c & 1 ? (c >> 1) ^ 0xedb88320 : c >> 1;
+		crc32_table[0][i] = c;
+	}
+	/* tables for slicing by 8 */
+	for (i = 0; i < 256; i++) {
+		c = crc32_table[0][i];
+		for (k = 1; k < 8; k++) {
+			c = crc32_table[0][c & 0xff] ^ (c >> 8);
+			crc32_table[k][i] = c;
+		}
+	}
+	crc32_table_ready = 1;
+}
+
+uint32_t scalar_crc32(uint32_t crc, const uint8_t *src, size_t n)
+{
+	size_t i;
+
+	crc32_init();
+	crc = ~crc;
+	for (i = 0; i < n; i++)
+		crc = crc32_table[0][(crc ^ src[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+void scalar_unpack8(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = src[i];
+}
+
+void scalar_unpack12(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i + 2 <= n; i += 2, src += 3) {
+		dst[i] = src[0] | (src[1] & 0xf) << 8;
+		dst[i + 1] = src[1] >> 4 | src[2] << 4;
+	}
+	if (i < n)
+		dst[i] = src[0] | (src[1] & 0xf) << 8;
+}
+
+void scalar_unpack16be(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = src[2 * i] << 8 | src[2 * i + 1];
+}
+
+/********************************************************************************
+Vector cores, "aligned" is a constant so each entry point gets its own copy
+*********************************************************************************/
+
+static inline void add_s16_core(int16_t *dst, const int16_t *a, const int16_t *b,
+				size_t n, const int aligned)
+{
+	size_t i = 0;
+
+	if (aligned) {
+		dst = ASSUME_ALIGNED(dst);
+		a = ASSUME_ALIGNED(a);
+		b = ASSUME_ALIGNED(b);
+	}
+#if defined(SIMD_NEON)
+	for (; i + 8 <= n; i += 8)
+		vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(a + i), vld1q_s16(b + i)));
+#elif defined(SIMD_SSE2)
+	for (; i + 8 <= n; i += 8)
+		SSE_STORE(dst + i, _mm_adds_epi16(SSE_LOAD(a + i, aligned),
+						  SSE_LOAD(b + i, aligned)), aligned);
+#endif
+	scalar_add_s16(dst + i, a + i, b + i, n - i);
+}
+
+static inline void add_s32_core(int32_t *dst, const int32_t *a, const int32_t *b,
+				size_t n, const int aligned)
+{
+	size_t i = 0;
+
+	if (aligned) {
+		dst = ASSUME_ALIGNED(dst);
+		a = ASSUME_ALIGNED(a);
+		b = ASSUME_ALIGNED(b);
+	}
+#if defined(SIMD_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_s32(dst + i, vaddq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+#elif defined(SIMD_SSE2)
+	for (; i + 4 <= n; i += 4)
+		SSE_STORE(dst + i, _mm_add_epi32(SSE_LOAD(a + i, aligned),
+						 SSE_LOAD(b + i, aligned)), aligned);
+#endif
+	scalar_add_s32(dst + i, a + i, b + i, n - i);
+}
+
+static inline void scale_s16_core(int16_t *dst, const int16_t *src, int16_t gain_q15,
+				  size_t n, const int aligned)
+{
+	size_t i = 0;
+
+	if (aligned) {
+		dst = ASSUME_ALIGNED(dst);
+		src = ASSUME_ALIGNED(src);
+	}
+#if defined(SIMD_NEON)
+	/* vqrdmulh computes sat((2 * a * b + 2^15) >> 16), same as the scalar code */
+	for (; i + 8 <= n; i += 8)
+		vst1q_s16(dst + i, vqrdmulhq_n_s16(vld1q_s16(src + i), gain_q15));
+#elif defined(SIMD_SSE2)
+	{
+		const __m128i g = _mm_set1_epi16(gain_q15);
+		const __m128i rnd = _mm_set1_epi32(1 << 14);
+
+		for (; i + 8 <= n; i += 8) {
+			__m128i v = SSE_LOAD(src + i, aligned);
+			__m128i lo = _mm_mullo_epi16(v, g);
+			__m128i hi = _mm_mulhi_epi16(v, g);
+			__m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), rnd), 15);
+			__m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), rnd), 15);
+
+			SSE_STORE(dst + i, _mm_packs_epi32(p0, p1), aligned);
+		}
+	}
+#endif
+	scalar_scale_s16(dst + i, src + i, gain_q15, n - i);
+}
+
+static inline void scale_s32_core(int32_t *dst, const int32_t *src, int32_t gain_q31,
+				  size_t n, const int aligned)
+{
+	size_t i = 0;
+
+	if (aligned) {
+		dst = ASSUME_ALIGNED(dst);
+		src = ASSUME_ALIGNED(src);
+	}
+#if defined(SIMD_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_s32(dst + i, vqrdmulhq_n_s32(vld1q_s32(src + i), gain_q31));
+#endif
+	/* SSE2 has no signed 32x32->64 multiply: scalar */
+	scalar_scale_s32(dst + i, src + i, gain_q31, n - i);
+}
+
+/* blocks of 8 samples summed in 32-bit lanes before overflow is possible */
+#define STATS_FLUSH_BLOCKS 16384
+
+static inline void stats_s16_core(const int16_t *src, size_t n, simd_stats_s16_t *st,
+				  const int aligned)
+{
+	simd_stats_s16_t tail;
+	int16_t min = INT16_MAX, max = INT16_MIN;
+	int64_t sum = 0;
+	size_t i = 0, blk = 0;
+
+	if (aligned)
+		src = ASSUME_ALIGNED(src);
+#if defined(SIMD_NEON)
+	{
+		int16x8_t vmin = vdupq_n_s16(INT16_MAX);
+		int16x8_t vmax = vdupq_n_s16(INT16_MIN);
+		int32x4_t vacc = vdupq_n_s32(0);
+		int16x4_t m;
+		int64x2_t s;
+
+		for (; i + 8 <= n; i += 8) {
+			int16x8_t v = vld1q_s16(src + i);
+
+			vmin = vminq_s16(vmin, v);
+			vmax = vmaxq_s16(vmax, v);
+			vacc = vpadalq_s16(vacc, v);
+			if (++blk == STATS_FLUSH_BLOCKS) {
+				s = vpaddlq_s32(vacc);
+				sum += vgetq_lane_s64(s, 0) + vgetq_lane_s64(s, 1);
+				vacc = vdupq_n_s32(0);
+				blk = 0;
+			}
+		}
+		s = vpaddlq_s32(vacc);
+		sum += vgetq_lane_s64(s, 0) + vgetq_lane_s64(s, 1);
+
+		m = vpmin_s16(vget_low_s16(vmin), vget_high_s16(vmin));
+		m = vpmin_s16(m, m);
+		m = vpmin_s16(m, m);
+		min = vget_lane_s16(m, 0);
+		m = vpmax_s16(vget_low_s16(vmax), vget_high_s16(vmax));
+		m = vpmax_s16(m, m);
+		m = vpmax_s16(m, m);
+		max = vget_lane_s16(m, 0);
+	}
+#elif defined(SIMD_SSE2)
+	{
+		__m128i vmin = _mm_set1_epi16(INT16_MAX);
+		__m128i vmax = _mm_set1_epi16(INT16_MIN);
+		__m128i vacc = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi16(1);
+		int16_t lmin[8], lmax[8];
+		int32_t lacc[4];
+		int k;
+
+		for (; i + 8 <= n; i += 8) {
+			__m128i v = SSE_LOAD(src + i, aligned);
+
+			vmin = _mm_min_epi16(vmin, v);
+			vmax = _mm_max_epi16(vmax, v);
+			vacc = _mm_add_epi32(vacc, _mm_madd_epi16(v, ones));
+			if (++blk == STATS_FLUSH_BLOCKS) {
+				_mm_storeu_si128((__m128i *)lacc, vacc);
+				sum += (int64_t)lacc[0] + lacc[1] + lacc[2] + lacc[3];
+				vacc = _mm_setzero_si128();
+				blk = 0;
+			}
+		}
+		_mm_storeu_si128((__m128i *)lacc, vacc);
+		sum += (int64_t)lacc[0] + lacc[1] + lacc[2] + lacc[3];
+
+		_mm_storeu_si128((__m128i *)lmin, vmin);
+		_mm_storeu_si128((__m128i *)lmax, vmax);
+		for (k = 0; k < 8; k++) {
+			if (lmin[k] < min)
+				min = lmin[k];
+			if (lmax[k] > max)
+				max = lmax[k];
+		}
+	}
+#endif
+	scalar_stats_s16(src + i, n - i, &tail);
+	st->min = tail.min < min ? tail.min : min;
+	st->max = tail.max > max ? tail.max : max;
+	st->sum = sum + tail.sum;
+}
+
+static inline void unpack8_core(uint16_t *dst, const uint8_t *src, size_t n,
+				const int aligned)
+{
+	size_t i = 0;
+
+	if (aligned) {
+		dst = ASSUME_ALIGNED(dst);
+		src = ASSUME_ALIGNED(src);
+	}
+#if defined(SIMD_NEON)
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i);
+
+		vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+		vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+	}
+#elif defined(SIMD_SSE2)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i v = SSE_LOAD(src + i, aligned);
+
+			SSE_STORE(dst + i, _mm_unpacklo_epi8(v, zero), aligned);
+			SSE_STORE(dst + i + 8, _mm_unpackhi_epi8(v, zero), aligned);
+		}
+	}
+#endif
+	scalar_unpack8(dst + i, src + i, n - i);
+}
+
+static inline void unpack12_core(uint16_t *dst, const uint8_t *src, size_t n,
+				 const int aligned)
+{
+	size_t i = 0;
+
+	if (aligned) {
+		dst = ASSUME_ALIGNED(dst);
+		src = ASSUME_ALIGNED(src);
+	}
+#if defined(SIMD_NEON)
+	{
+		const uint16x8_t mask = vdupq_n_u16(0xf);
+
+		/* 8 byte triplets give 8 even and 8 odd samples */
+		for (; i + 16 <= n; i += 16) {
+			uint8x8x3_t t = vld3_u8(src + i / 2 * 3);
+			uint16x8_t b0 = vmovl_u8(t.val[0]);
+			uint16x8_t b1 = vmovl_u8(t.val[1]);
+			uint16x8_t b2 = vmovl_u8(t.val[2]);
+			uint16x8x2_t s;
+
+			s.val[0] = vorrq_u16(b0, vshlq_n_u16(vandq_u16(b1, mask), 8));
+			s.val[1] = vorrq_u16(vshrq_n_u16(b1, 4), vshlq_n_u16(b2, 4));
+			vst2q_u16(dst + i, s);
+		}
+	}
+#endif
+	/* SSE2 has no byte shuffle: scalar */
+	scalar_unpack12(dst + i, src + i / 2 * 3, n - i);
+}
+
+static inline void unpack16be_core(uint16_t *dst, const uint8_t *src, size_t n,
+				   const int aligned)
+{
+	size_t i = 0;
+
+	if (aligned) {
+		dst = ASSUME_ALIGNED(dst);
+		src = ASSUME_ALIGNED(src);
+	}
+#if defined(SIMD_NEON)
+	for (; i + 8 <= n; i += 8)
+		vst1q_u16(dst + i, vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(src + 2 * i))));
+#elif defined(SIMD_SSE2)
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = SSE_LOAD(src + 2 * i, aligned);
+
+		SSE_STORE(dst + i, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)), aligned);
+	}
+#endif
+	scalar_unpack16be(dst + i, src + 2 * i, n - i);
+}
+
+/*
+ * The edges compare each vector with the one loaded a byte earlier, the
+ * equal lanes (-1) are counted in 8-bit lanes flushed every 255 vectors
+ */
+#define SUMMARY_FLUSH_BLOCKS 255
+
+#if defined(SIMD_NEON)
+/* ARMv7 has no vaddvq */
+static inline uint64_t neon_sum_u8(uint8x16_t v)
+{
+	uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(v)));
+
+	return vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1);
+}
+#endif
+
+static inline void summary_u8_core(const uint8_t *src, size_t n, uint8_t prev,
+				   simd_summary_u8_t *s)
+{
+	simd_summary_u8_t tail;
+	uint8_t min = 0xff, max = 0, and_bits = 0xff, or_bits = 0;
+	uint64_t equal = 0;
+	size_t i = 0, blk = 0;
+
+	if (n == 0) {
+		scalar_summary_u8(src, 0, prev, s);
+		return;
+	}
+	/* the first sample against prev, the vectors against the sample before */
+	scalar_summary_u8(src, 1, prev, &tail);
+	min = max = and_bits = or_bits = src[0];
+	s->edges = tail.edges;
+	i = 1;
+#if defined(SIMD_NEON)
+	{
+		uint8x16_t vmin = vdupq_n_u8(0xff), vmax = vdupq_n_u8(0);
+		uint8x16_t vand = vdupq_n_u8(0xff), vor = vdupq_n_u8(0);
+		uint8x16_t veq = vdupq_n_u8(0);
+		uint8x8_t m;
+		uint8_t lane[16];
+		int k;
+
+		for (; i + 16 <= n; i += 16) {
+			uint8x16_t v = vld1q_u8(src + i);
+
+			vmin = vminq_u8(vmin, v);
+			vmax = vmaxq_u8(vmax, v);
+			vand = vandq_u8(vand, v);
+			vor = vorrq_u8(vor, v);
+			veq = vsubq_u8(veq, vceqq_u8(v, vld1q_u8(src + i - 1)));
+			if (++blk == SUMMARY_FLUSH_BLOCKS) {
+				equal += neon_sum_u8(veq);
+				veq = vdupq_n_u8(0);
+				blk = 0;
+			}
+		}
+		equal += neon_sum_u8(veq);
+
+		m = vpmin_u8(vget_low_u8(vmin), vget_high_u8(vmin));
+		m = vpmin_u8(m, m);
+		m = vpmin_u8(m, m);
+		m = vpmin_u8(m, m);
+		if (vget_lane_u8(m, 0) < min)
+			min = vget_lane_u8(m, 0);
+		m = vpmax_u8(vget_low_u8(vmax), vget_high_u8(vmax));
+		m = vpmax_u8(m, m);
+		m = vpmax_u8(m, m);
+		m = vpmax_u8(m, m);
+		if (vget_lane_u8(m, 0) > max)
+			max = vget_lane_u8(m, 0);
+		vst1q_u8(lane, vandq_u8(vand, vextq_u8(vand, vand, 8)));
+		for (k = 0; k < 8; k++)
+			and_bits &= lane[k];
+		vst1q_u8(lane, vorrq_u8(vor, vextq_u8(vor, vor, 8)));
+		for (k = 0; k < 8; k++)
+			or_bits |= lane[k];
+	}
+#elif defined(SIMD_SSE2)
+	{
+		__m128i vmin = _mm_set1_epi8((char)0xff), vmax = _mm_setzero_si128();
+		__m128i vand = _mm_set1_epi8((char)0xff), vor = _mm_setzero_si128();
+		__m128i veq = _mm_setzero_si128(), vsum;
+		const __m128i zero = _mm_setzero_si128();
+		uint8_t lane[16];
+		int k;
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+
+			vmin = _mm_min_epu8(vmin, v);
+			vmax = _mm_max_epu8(vmax, v);
+			vand = _mm_and_si128(vand, v);
+			vor = _mm_or_si128(vor, v);
+			veq = _mm_sub_epi8(veq, _mm_cmpeq_epi8(v,
+					   _mm_loadu_si128((const __m128i *)(src + i - 1))));
+			if (++blk == SUMMARY_FLUSH_BLOCKS) {
+				/* sum of the bytes in the 2 64-bit halves */
+				vsum = _mm_sad_epu8(veq, zero);
+				equal += (uint64_t)_mm_cvtsi128_si32(vsum) +
+					 _mm_cvtsi128_si32(_mm_srli_si128(vsum, 8));
+				veq = _mm_setzero_si128();
+				blk = 0;
+			}
+		}
+		vsum = _mm_sad_epu8(veq, zero);
+		equal += (uint64_t)_mm_cvtsi128_si32(vsum) + _mm_cvtsi128_si32(_mm_srli_si128(vsum, 8));
+
+		_mm_storeu_si128((__m128i *)lane, vmin);
+		for (k = 0; k < 16; k++)
+			if (lane[k] < min)
+				min = lane[k];
+		_mm_storeu_si128((__m128i *)lane, vmax);
+		for (k = 0; k < 16; k++)
+			if (lane[k] > max)
+				max = lane[k];
+		_mm_storeu_si128((__m128i *)lane, vand);
+		for (k = 0; k < 16; k++)
+			and_bits &= lane[k];
+		_mm_storeu_si128((__m128i *)lane, vor);
+		for (k = 0; k < 16; k++)
+			or_bits |= lane[k];
+	}
+#endif
+	/* the vectors covered samples 1 to i - 1 */
+	s->edges += (i - 1) - equal;
+	scalar_summary_u8(src + i, n - i, src[i - 1], &tail);
+	s->min = tail.min < min ? tail.min : min;
+	s->max = tail.max > max ? tail.max : max;
+	s->and_bits = and_bits & tail.and_bits;
+	s->or_bits = or_bits | tail.or_bits;
+	s->edges += tail.edges;
+}
+
+/*
+ * Trigger searches: a vector of 16 samples is tested at once, the sample
+ * is then located by the scalar code within the vector that hit.
+ */
+static inline size_t find_u8_core(const uint8_t *src, size_t n, uint8_t prev,
+				  const simd_match_u8_t *m)
+{
+	size_t i;
+
+	/* the first sample against prev, the vectors against the sample before */
+	if (n == 0 || scalar_find_u8(src, 1, prev, m) == 0)
+		return 0;
+	i = 1;
+#if defined(SIMD_NEON)
+	{
+		const uint8x16_t vmask = vdupq_n_u8(m->mask), vvalue = vdupq_n_u8(m->value);
+		const uint8x16_t vrise = vdupq_n_u8(m->rise), vfall = vdupq_n_u8(m->fall);
+		const uint8x16_t vinv = vdupq_n_u8(m->invert ? 0xff : 0);
+		const int edge = (m->rise | m->fall) != 0;
+
+		for (; i + 16 <= n; i += 16) {
+			uint8x16_t v = vld1q_u8(src + i), p = vld1q_u8(src + i - 1), e;
+			uint8x16_t hit = vceqq_u8(vandq_u8(v, vmask), vvalue);
+			uint8x8_t h;
+
+			if (edge) {
+				e = vorrq_u8(vandq_u8(vbicq_u8(v, p), vrise),
+					     vandq_u8(vbicq_u8(p, v), vfall));
+				hit = vandq_u8(hit, vtstq_u8(e, e));
+			}
+			hit = veorq_u8(hit, vinv);
+			h = vorr_u8(vget_low_u8(hit), vget_high_u8(hit));
+			if (vget_lane_u64(vreinterpret_u64_u8(h), 0))
+				return i + scalar_find_u8(src + i, 16, src[i - 1], m);
+		}
+	}
+#elif defined(SIMD_SSE2)
+	{
+		const __m128i vmask = _mm_set1_epi8((char)m->mask), vvalue = _mm_set1_epi8((char)m->value);
+		const __m128i vrise = _mm_set1_epi8((char)m->rise), vfall = _mm_set1_epi8((char)m->fall);
+		const __m128i vinv = _mm_set1_epi8(m->invert ? (char)0xff : 0);
+		const __m128i zero = _mm_setzero_si128();
+		const int edge = (m->rise | m->fall) != 0;
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+			__m128i p = _mm_loadu_si128((const __m128i *)(src + i - 1)), e;
+			__m128i hit = _mm_cmpeq_epi8(_mm_and_si128(v, vmask), vvalue);
+			int bits;
+
+			if (edge) {
+				/* andnot(a, b): ~a & b */
+				e = _mm_or_si128(_mm_and_si128(_mm_andnot_si128(p, v), vrise),
+						 _mm_and_si128(_mm_andnot_si128(v, p), vfall));
+				hit = _mm_andnot_si128(_mm_cmpeq_epi8(e, zero), hit);
+			}
+			bits = _mm_movemask_epi8(_mm_xor_si128(hit, vinv));
+			if (bits)
+				return i + __builtin_ctz(bits);
+		}
+	}
+#endif
+	return i + scalar_find_u8(src + i, n - i, src[i - 1], m);
+}
+
+/*
+ * Edges: the vectors without any are skipped, the others give their
+ * lanes from a bit mask (SSE2) or by the scalar code (NEON)
+ */
+static inline size_t edges_u8_core(const uint8_t *src, size_t n, uint8_t prev, uint8_t mask,
+				   uint32_t *pos, size_t max)
+{
+	size_t i, count;
+
+	/* the first sample against prev, the vectors against the sample before */
+	if (n == 0 || max == 0)
+		return 0;
+	count = scalar_edges_u8(src, 1, prev, mask, pos, max);
+	i = 1;
+#if defined(SIMD_NEON)
+	{
+		const uint8x16_t vmask = vdupq_n_u8(mask);
+		uint8x16_t e;
+		uint8x8_t h;
+		size_t k;
+
+		for (; i + 16 <= n; i += 16) {
+			e = vandq_u8(veorq_u8(vld1q_u8(src + i), vld1q_u8(src + i - 1)), vmask);
+			h = vorr_u8(vget_low_u8(e), vget_high_u8(e));
+			if (!vget_lane_u64(vreinterpret_u64_u8(h), 0))
+				continue;
+			for (k = i; k < i + 16; k++) {
+				if (!((src[k] ^ src[k - 1]) & mask))
+					continue;
+				if (count == max)
+					return count;
+				pos[count++] = k;
+			}
+		}
+	}
+#elif defined(SIMD_SSE2)
+	{
+		const __m128i vmask = _mm_set1_epi8((char)mask), zero = _mm_setzero_si128();
+		__m128i e;
+		int bits;
+
+		for (; i + 16 <= n; i += 16) {
+			e = _mm_and_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)),
+							_mm_loadu_si128((const __m128i *)(src + i - 1))),
+					  vmask);
+			bits = _mm_movemask_epi8(_mm_cmpeq_epi8(e, zero)) ^ 0xffff;
+			for (; bits; bits &= bits - 1) {
+				if (count == max)
+					return count;
+				pos[count++] = i + __builtin_ctz(bits);
+			}
+		}
+	}
+#endif
+	if (count == max || i >= n)
+		return count;
+	/* the tail, its indexes from src + i */
+	n = scalar_edges_u8(src + i, n - i, src[i - 1], mask, pos + count, max - count);
+	for (; n; n--, count++)
+		pos[count] += i;
+	return count;
+}
+
+/*
+ * Glitches: the edges of a chunk of samples go to a buffer, then the OR of
+ * the width - 1 edges before each sample is made by doubling: log2(width)
+ * passes over the chunk instead of width loads per vector. The buffers
+ * start GLITCH_LOOKBACK samples before the chunk.
+ */
+#define GLITCH_CHUNK	1024
+#define GLITCH_LOOKBACK	32	/* >= 2 * SIMD_GLITCH_MAX */
+
+#if defined(SIMD_NEON) || defined(SIMD_SSE2)
+/* dst[t] = src[t] | src[t - shift], t from from to to by vectors */
+static inline void glitch_or_pass(uint8_t *dst, const uint8_t *src, size_t shift, size_t from,
+				  size_t to)
+{
+	size_t t;
+
+	for (t = from; t < to; t += 16) {
+#if defined(SIMD_NEON)
+		vst1q_u8(dst + t, vorrq_u8(vld1q_u8(src + t), vld1q_u8(src + t - shift)));
+#else
+		_mm_store_si128((__m128i *)(dst + t),
+				_mm_or_si128(_mm_load_si128((const __m128i *)(src + t)),
+					     _mm_loadu_si128((const __m128i *)(src + t - shift))));
+#endif
+	}
+}
+#endif
+
+static inline size_t find_glitch_u8_core(const uint8_t *src, size_t n, size_t from, uint8_t mask,
+					 unsigned int width)
+{
+	size_t i = from;
+
+#if defined(SIMD_NEON) || defined(SIMD_SSE2)
+	uint8_t buf[3][GLITCH_CHUNK + GLITCH_LOOKBACK] __attribute__((aligned(SIMD_ALIGN)));
+	uint8_t *e = buf[0], *t_cur, *t_nxt, *tmp;
+	size_t len, t, x, span, r, end;
+
+	/* widest power of 2 within the width - 1 samples before, the rest r */
+	for (span = 1; span * 2 <= width - 1; span *= 2)
+		;
+	r = width - 1 - span;
+	/* read by the first passes, not used */
+	memset(buf[1], 0, GLITCH_LOOKBACK);
+	memset(buf[2], 0, GLITCH_LOOKBACK);
+
+	for (; i + 16 <= n; i += len) {
+		len = n - i < GLITCH_CHUNK ? (n - i) & ~(size_t)15 : GLITCH_CHUNK;
+		end = GLITCH_LOOKBACK + len;
+
+		/* edges before the chunk, none before the samples readable */
+		for (t = 0; t < GLITCH_LOOKBACK; t++) {
+			x = i - GLITCH_LOOKBACK + t;
+			e[t] = i + t >= GLITCH_LOOKBACK + from - width + 1 ?
+			       (src[x] ^ src[x - 1]) & mask : 0;
+		}
+		for (t = GLITCH_LOOKBACK; t < end; t += 16) {
+			x = i - GLITCH_LOOKBACK + t;
+#if defined(SIMD_NEON)
+			vst1q_u8(e + t, vandq_u8(veorq_u8(vld1q_u8(src + x), vld1q_u8(src + x - 1)),
+						 vdupq_n_u8(mask)));
+#else
+			_mm_store_si128((__m128i *)(e + t),
+					_mm_and_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + x)),
+								    _mm_loadu_si128((const __m128i *)(src + x - 1))),
+						      _mm_set1_epi8((char)mask)));
+#endif
+		}
+
+		/* t_cur[t]: OR of the span edges up to t */
+		t_cur = e;
+		t_nxt = buf[1];
+		for (x = 1; x < span; x *= 2) {
+			glitch_or_pass(t_nxt, t_cur, x, GLITCH_LOOKBACK / 2, end);
+			tmp = t_cur == e ? buf[2] : t_cur;
+			t_cur = t_nxt;
+			t_nxt = tmp;
+		}
+
+		/* an edge and one within the width - 1 samples before */
+		for (t = GLITCH_LOOKBACK; t < end; t += 16) {
+#if defined(SIMD_NEON)
+			uint8x16_t hit = vandq_u8(vld1q_u8(e + t),
+						  vorrq_u8(vld1q_u8(t_cur + t - 1),
+							   vld1q_u8(t_cur + t - 1 - r)));
+			uint8x8_t h = vorr_u8(vget_low_u8(hit), vget_high_u8(hit));
+
+			if (vget_lane_u64(vreinterpret_u64_u8(h), 0)) {
+				x = i - GLITCH_LOOKBACK + t;
+				return scalar_find_glitch_u8(src, x + 16, x, mask, width);
+			}
+#else
+			__m128i hit = _mm_and_si128(_mm_load_si128((const __m128i *)(e + t)),
+						    _mm_or_si128(_mm_loadu_si128((const __m128i *)(t_cur + t - 1)),
+								 _mm_loadu_si128((const __m128i *)(t_cur + t - 1 - r))));
+			int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) ^ 0xffff;
+
+			if (bits)
+				return i - GLITCH_LOOKBACK + t + __builtin_ctz(bits);
+#endif
+		}
+	}
+#endif
+	return scalar_find_glitch_u8(src, n, i, mask, width);
+}
+
+/********************************************************************************
+Entry points
+*********************************************************************************/
+
+void simd_add_s16(int16_t *dst, const int16_t *a, const int16_t *b, size_t n)
+{
+	add_s16_core(dst, a, b, n, 0);
+}
+
+void simd_add_s16_aligned(int16_t *dst, const int16_t *a, const int16_t *b, size_t n)
+{
+	assert(IS_ALIGNED(dst) && IS_ALIGNED(a) && IS_ALIGNED(b));
+	add_s16_core(dst, a, b, n, 1);
+}
+
+void simd_add_s32(int32_t *dst, const int32_t *a, const int32_t *b, size_t n)
+{
+	add_s32_core(dst, a, b, n, 0);
+}
+
+void simd_add_s32_aligned(int32_t *dst, const int32_t *a, const int32_t *b, size_t n)
+{
+	assert(IS_ALIGNED(dst) && IS_ALIGNED(a) && IS_ALIGNED(b));
+	add_s32_core(dst, a, b, n, 1);
+}
+
+void simd_scale_s16(int16_t *dst, const int16_t *src, int16_t gain_q15, size_t n)
+{
+	scale_s16_core(dst, src, gain_q15, n, 0);
+}
+
+void simd_scale_s16_aligned(int16_t *dst, const int16_t *src, int16_t gain_q15, size_t n)
+{
+	assert(IS_ALIGNED(dst) && IS_ALIGNED(src));
+	scale_s16_core(dst, src, gain_q15, n, 1);
+}
+
+void simd_scale_s32(int32_t *dst, const int32_t *src, int32_t gain_q31, size_t n)
+{
+	scale_s32_core(dst, src, gain_q31, n, 0);
+}
+
+void simd_scale_s32_aligned(int32_t *dst, const int32_t *src, int32_t gain_q31, size_t n)
+{
+	assert(IS_ALIGNED(dst) && IS_ALIGNED(src));
+	scale_s32_core(dst, src, gain_q31, n, 1);
+}
+
+void simd_stats_s16(const int16_t *src, size_t n, simd_stats_s16_t *st)
+{
+	stats_s16_core(src, n, st, 0);
+}
+
+void simd_stats_s16_aligned(const int16_t *src, size_t n, simd_stats_s16_t *st)
+{
+	assert(IS_ALIGNED(src));
+	stats_s16_core(src, n, st, 1);
+}
+
+void simd_summary_u8(const uint8_t *src, size_t n, uint8_t prev, simd_summary_u8_t *s)
+{
+	summary_u8_core(src, n, prev, s);
+}
+
+size_t simd_find_u8(const uint8_t *src, size_t n, uint8_t prev, const simd_match_u8_t *m)
+{
+	return find_u8_core(src, n, prev, m);
+}
+
+size_t simd_find_glitch_u8(const uint8_t *src, size_t n, size_t from, uint8_t mask,
+			   unsigned int width)
+{
+	assert(width >= 2 && width <= SIMD_GLITCH_MAX && from >= width);
+	return find_glitch_u8_core(src, n, from, mask, width);
+}
+
+size_t simd_edges_u8(const uint8_t *src, size_t n, uint8_t prev, uint8_t mask, uint32_t *pos,
+		     size_t max)
+{
+	return edges_u8_core(src, n, prev, mask, pos, max);
+}
+
+/*
+ * A byte histogram does not vectorize: the gain comes from 4 sub-histograms
+ * that break the store-to-load dependency on repeated values.
+ */
+void simd_hist_u8(const uint8_t *src, size_t n, uint32_t hist[256])
+{
+	uint32_t sub[4][256];
+	uint32_t w;
+	size_t i = 0;
+	int k;
+
+	memset(sub, 0, sizeof(sub));
+	for (; i + 4 <= n; i += 4) {
+		memcpy(&w, src + i, sizeof(w));
+		sub[0][w & 0xff]++;
+		sub[1][(w >> 8) & 0xff]++;
+		sub[2][(w >> 16) & 0xff]++;
+		sub[3][w >> 24]++;
+	}
+	for (; i < n; i++)
+		sub[0][src[i]]++;
+
+	for (k = 0; k < 256; k++)
+		hist[k] += sub[0][k] + sub[1][k] + sub[2][k] + sub[3][k];
+}
+
+/*
+ * Uses the ARMv8 CRC32 instructions when available; Cortex-A7 has none (and
+ * the SSE4.2 crc32 is CRC-32C), so slicing by 8 otherwise.
+ */
+uint32_t simd_crc32(uint32_t crc, const uint8_t *src, size_t n)
+{
+	uint32_t w0, w1;
+
+	crc = ~crc;
+#if defined(__ARM_FEATURE_CRC32)
+	for (; n >= 4; n -= 4, src += 4) {
+		memcpy(&w0, src, sizeof(w0));
+		crc = __crc32w(crc, w0);
+	}
+	for (; n; n--)
+		crc = __crc32b(crc, *src++);
+	(void)w1;
+#else
+	crc32_init();
+	for (; n >= 8; n -= 8, src += 8) {
+		memcpy(&w0, src, sizeof(w0));
+		memcpy(&w1, src + 4, sizeof(w1));
+		/* little endian only, as both targets */
+		w0 ^= crc;
+		crc = crc32_table[7][w0 & 0xff] ^ crc32_table[6][(w0 >> 8) & 0xff] ^
+		      crc32_table[5][(w0 >> 16) & 0xff] ^ crc32_table[4][w0 >> 24] ^
+		      crc32_table[3][w1 & 0xff] ^ crc32_table[2][(w1 >> 8) & 0xff] ^
+		      crc32_table[1][(w1 >> 16) & 0xff] ^ crc32_table[0][w1 >> 24];
+	}
+	for (; n; n--)
+		crc = crc32_table[0][(crc ^ *src++) & 0xff] ^ (crc >> 8);
+#endif
+	return ~crc;
+}
+
+void simd_unpack8(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack8_core(dst, src, n, 0);
+}
+
+void simd_unpack8_aligned(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	assert(IS_ALIGNED(dst) && IS_ALIGNED(src));
+	unpack8_core(dst, src, n, 1);
+}
+
+void simd_unpack12(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack12_core(dst, src, n, 0);
+}
+
+void simd_unpack12_aligned(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	assert(IS_ALIGNED(dst) && IS_ALIGNED(src));
+	unpack12_core(dst, src, n, 1);
+}
+
+void simd_unpack16be(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack16be_core(dst, src, n, 0);
+}
+
+void simd_unpack16be_aligned(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	assert(IS_ALIGNED(dst) && IS_ALIGNED(src));
+	unpack16be_core(dst, src, n, 1);
+}
@@ -0,0 +1,147 @@
+/*
+ * simd_kernels.h
+ * Kernels used on the captured SDB buffers.
+ *
+ * Each kernel comes as:
+ *  - scalar_xxx():       reference C implementation
+ *  - simd_xxx():         NEON on ARM, SSE2 on x86, scalar otherwise;
+ *                        any alignment and any count
+ *  - simd_xxx_aligned(): same, buffers must be SIMD_ALIGN aligned
+ *
+ * Counts are in elements (samples), not bytes.
+ */
+
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIMD_ALIGN 16
+
+typedef struct
+{
+	int16_t min;
+	int16_t max;
+	int64_t sum;	/* mean = sum / count */
+} simd_stats_s16_t;
+
+/* 8 logic channels per byte */
+typedef struct
+{
+	uint8_t min;
+	uint8_t max;
+	uint8_t and_bits;	/* channels high in every sample */
+	uint8_t or_bits;	/* channels high in a sample at least */
+	uint64_t edges;		/* samples different from the one before */
+} simd_summary_u8_t;
+
+/*
+ * Sample match of the triggers: (s & mask) == value and, when rise or
+ * fall is set, an edge from the sample before: a channel of rise going
+ * high or a channel of fall going low. invert: samples not matching.
+ */
+typedef struct
+{
+	uint8_t mask;
+	uint8_t value;
+	uint8_t rise;
+	uint8_t fall;
+	uint8_t invert;
+} simd_match_u8_t;
+
+#define SIMD_GLITCH_MAX 16	/* widest glitch of simd_find_glitch_u8() */
+
+/* name of the instruction set used by simd_xxx() */
+const char *simd_impl_name(void);
+
+/* dst = saturate(a + b) */
+void scalar_add_s16(int16_t *dst, const int16_t *a, const int16_t *b, size_t n);
+void simd_add_s16(int16_t *dst, const int16_t *a, const int16_t *b, size_t n);
+void simd_add_s16_aligned(int16_t *dst, const int16_t *a, const int16_t *b, size_t n);
+
+/* dst = a + b (wrapping) */
+void scalar_add_s32(int32_t *dst, const int32_t *a, const int32_t *b, size_t n);
+void simd_add_s32(int32_t *dst, const int32_t *a, const int32_t *b, size_t n);
+void simd_add_s32_aligned(int32_t *dst, const int32_t *a, const int32_t *b, size_t n);
+
+/* dst = saturate(round(src * gain / 2^15)) */
+void scalar_scale_s16(int16_t *dst, const int16_t *src, int16_t gain_q15, size_t n);
+void simd_scale_s16(int16_t *dst, const int16_t *src, int16_t gain_q15, size_t n);
+void simd_scale_s16_aligned(int16_t *dst, const int16_t *src, int16_t gain_q15, size_t n);
+
+/* dst = saturate(round(src * gain / 2^31)) */
+void scalar_scale_s32(int32_t *dst, const int32_t *src, int32_t gain_q31, size_t n);
+void simd_scale_s32(int32_t *dst, const int32_t *src, int32_t gain_q31, size_t n);
+void simd_scale_s32_aligned(int32_t *dst, const int32_t *src, int32_t gain_q31, size_t n);
+
+/* min, max and sum; an empty buffer gives min=INT16_MAX, max=INT16_MIN, sum=0 */
+void scalar_stats_s16(const int16_t *src, size_t n, simd_stats_s16_t *st);
+void simd_stats_s16(const int16_t *src, size_t n, simd_stats_s16_t *st);
+void simd_stats_s16_aligned(const int16_t *src, size_t n, simd_stats_s16_t *st);
+
+/*
+ * Summary of n samples, prev: the sample before src[0] (src[0] for none);
+ * an empty buffer gives min=0xff, max=0, and_bits=0xff, or_bits=0, edges=0
+ * (no alignment requirement)
+ */
+void scalar_summary_u8(const uint8_t *src, size_t n, uint8_t prev, simd_summary_u8_t *s);
+void simd_summary_u8(const uint8_t *src, size_t n, uint8_t prev, simd_summary_u8_t *s);
+
+/*
+ * Index of the first sample matching m, n if none; prev: the sample
+ * before src[0] (no alignment requirement)
+ */
+size_t scalar_find_u8(const uint8_t *src, size_t n, uint8_t prev, const simd_match_u8_t *m);
+size_t simd_find_u8(const uint8_t *src, size_t n, uint8_t prev, const simd_match_u8_t *m);
+
+/*
+ * Index of the first sample i in [from, n) ending a pulse shorter than
+ * width samples on a channel of mask: edges at i and at j on the channel,
+ * i - width < j < i; n if none. The samples from src[from - width] are
+ * read: from >= width, 2 <= width <= SIMD_GLITCH_MAX
+ */
+size_t scalar_find_glitch_u8(const uint8_t *src, size_t n, size_t from, uint8_t mask,
+			     unsigned int width);
+size_t simd_find_glitch_u8(const uint8_t *src, size_t n, size_t from, uint8_t mask,
+			   unsigned int width);
+
+/*
+ * Indexes of the samples different from the one before on a channel of
+ * mask, prev: the sample before src[0]. Stores max at most and returns
+ * their number: when it is max, the search goes on after pos[max - 1]
+ * (no alignment requirement)
+ */
+size_t scalar_edges_u8(const uint8_t *src, size_t n, uint8_t prev, uint8_t mask, uint32_t *pos,
+		       size_t max);
+size_t simd_edges_u8(const uint8_t *src, size_t n, uint8_t prev, uint8_t mask, uint32_t *pos,
+		     size_t max);
+
+/* hist[v] += number of bytes equal to v (no alignment requirement) */
+void scalar_hist_u8(const uint8_t *src, size_t n, uint32_t hist[256]);
+void simd_hist_u8(const uint8_t *src, size_t n, uint32_t hist[256]);
+
+/* CRC-32 as zlib crc32(): start with crc = 0 (no alignment requirement) */
+uint32_t scalar_crc32(uint32_t crc, const uint8_t *src, size_t n);
+uint32_t simd_crc32(uint32_t crc, const uint8_t *src, size_t n);
+
+/* 8-bit unsigned samples to 16-bit */
+void scalar_unpack8(uint16_t *dst, const uint8_t *src, size_t n);
+void simd_unpack8(uint16_t *dst, const uint8_t *src, size_t n);
+void simd_unpack8_aligned(uint16_t *dst, const uint8_t *src, size_t n);
+
+/*
+ * 12-bit samples packed 2 in 3 bytes, little endian:
+ * s0 = b0 | (b1 & 0xf) << 8, s1 = b1 >> 4 | b2 << 4
+ * src holds (3 * n + 1) / 2 bytes.
+ */
+void scalar_unpack12(uint16_t *dst, const uint8_t *src, size_t n);
+void simd_unpack12(uint16_t *dst, const uint8_t *src, size_t n);
+void simd_unpack12_aligned(uint16_t *dst, const uint8_t *src, size_t n);
+
+/* 16-bit big endian samples to native 16-bit */
+void scalar_unpack16be(uint16_t *dst, const uint8_t *src, size_t n);
+void simd_unpack16be(uint16_t *dst, const uint8_t *src, size_t n);
+void simd_unpack16be_aligned(uint16_t *dst, const uint8_t *src, size_t n);
+
+#endif /* SIMD_KERNELS_H */
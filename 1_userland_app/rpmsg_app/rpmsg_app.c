@@ -47,8 +47,9 @@
 #include <errno.h>
 #include <error.h>
 
+#include "copro.h"
+
 #define DATA_BUF_POOL_SIZE 1024*1024 /* 1MB */
-#define MAX_BUF 80
 
 #define PORT 8888
 #define GET             0
@@ -90,9 +91,6 @@ struct MHD_Daemon *mHttpDaemon;
 char FIRM_NAME[50];
 struct timeval tval_before, tval_after, tval_result;
 
-/* The file descriptor used to manage our TTY over RPMSG */
-static int mFdRpmsg = -1;
-
 
 static int virtual_tty_send_command(int len, char* commandStr);
 
@@ -111,184 +109,6 @@ static pthread_t thread, thread2;
 static int efd[NB_BUF];
 static struct pollfd fds[NB_BUF];
     
-/********************************************************************************
-Copro functions allowing to manage a virtual TTY over RPMSG
-*********************************************************************************/
-int copro_isFwRunning(void)
-{
-    int fd;
-    size_t byte_read;
-    int result = 0;
-    unsigned char bufRead[MAX_BUF];
-    fd = open("/sys/class/remoteproc/remoteproc0/state", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/state, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    byte_read = (size_t) read (fd, bufRead, MAX_BUF);
-    if (byte_read >= strlen("running")) {
-        char* pos = strstr((char*)bufRead, "running");
-        if(pos) {
-            result = 1;
-        }
-    }
-    close(fd);
-    return result;
-}
-
-int copro_stopFw(void)
-{
-    int fd;
-    fd = open("/sys/class/remoteproc/remoteproc0/state", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/state, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    write(fd, "stop", strlen("stop"));
-    close(fd);
-    return 0;
-}
-
-int copro_startFw(void)
-{
-    int fd;
-    fd = open("/sys/class/remoteproc/remoteproc0/state", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/state, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    write(fd, "start", strlen("start"));
-    close(fd);
-    return 0;
-}
-
-int copro_getFwPath(char* pathStr)
-{
-    int fd;
-    int byte_read;
-    fd = open("/sys/module/firmware_class/parameters/path", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening firmware_class/parameters/path, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    byte_read = read (fd, pathStr, MAX_BUF);
-    close(fd);
-    return byte_read;
-}
-
-int copro_setFwPath(char* pathStr)
-{
-    int fd;
-    int result = 0;
-    fd = open("/sys/module/firmware_class/parameters/path", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening firmware_class/parameters/path, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    result = write(fd, pathStr, strlen(pathStr));
-    close(fd);
-    return result;
-}
-
-int copro_getFwName(char* pathStr)
-{
-    int fd;
-    int byte_read;
-    fd = open("/sys/class/remoteproc/remoteproc0/firmware", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/firmware, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    byte_read = read (fd, pathStr, MAX_BUF);
-    close(fd);
-    return byte_read;
-}
-
-int copro_setFwName(char* nameStr)
-{
-    int fd;
-    int result = 0;
-    fd = open("/sys/class/remoteproc/remoteproc0/firmware", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/firmware, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    result = write(fd, nameStr, strlen(nameStr));
-    close(fd);
-    return result;
-}
-
-int copro_openTtyRpmsg(int modeRaw)
-{
-    struct termios tiorpmsg;
-    mFdRpmsg = open("/dev/ttyRPMSG0", O_RDWR |  O_NOCTTY | O_NONBLOCK);
-    if (mFdRpmsg < 0) {
-        printf("Error opening ttyRPMSG0, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    /* get current port settings */
-    tcgetattr(mFdRpmsg,&tiorpmsg);
-    if (modeRaw) {
-        tiorpmsg.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
-                      | INLCR | IGNCR | ICRNL | IXON);
-        tiorpmsg.c_oflag &= ~OPOST;
-        tiorpmsg.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-        tiorpmsg.c_cflag &= ~(CSIZE | PARENB);
-        tiorpmsg.c_cflag |= CS8;
-    } else {
-        /* ECHO off, other bits unchanged */
-        tiorpmsg.c_lflag &= ~ECHO;
-        /*do not convert LF to CR LF */
-        tiorpmsg.c_oflag &= ~ONLCR;
-    }
-    tcsetattr(mFdRpmsg, TCSANOW, &tiorpmsg);
-    return 0;
-}
-
-int copro_closeTtyRpmsg(void)
-{
-    close(mFdRpmsg);
-    mFdRpmsg = -1;
-    return 0;
-}
-
-int copro_writeTtyRpmsg(int len, char* pData)
-{
-    int result = 0;
-    if (mFdRpmsg < 0) {
-        printf("Error writing ttyRPMSG0, fileDescriptor is not set\n");
-        return mFdRpmsg;
-    }
-
-    result = write(mFdRpmsg, pData, len);
-    return result;
-}
-
-int copro_readTtyRpmsg(int len, char* pData)
-{
-    int byte_rd, byte_avail;
-    int result = 0;
-    if (mFdRpmsg < 0) {
-        printf("Error reading ttyRPMSG0, fileDescriptor is not set\n");
-        return mFdRpmsg;
-    }
-    ioctl(mFdRpmsg, FIONREAD, &byte_avail);
-    if (byte_avail > 0) {
-        if (byte_avail >= len) {
-            byte_rd = read (mFdRpmsg, pData, len);
-        } else {
-            byte_rd = read (mFdRpmsg, pData, byte_avail);
-        }
-        //printf("read successfully %d bytes to %p, [0]=0x%x\n", byte_rd, pData, pData[0]);
-        result = byte_rd;
-    } else {
-        result = 0;
-    }
-    return result;
-}
-/********************************************************************************
-End of Copro functions
-*********************************************************************************/
 
 static void
 open_raw_file(void) {
@@ -395,62 +215,29 @@ void *vitural_tty_thread(void *arg)
 int main(int argc, char **argv)
 {
     int ret = 0, i, cmd;
-    char FwName[30];
+    copro_boot_times_t bootTimes;
     
     strcpy(FIRM_NAME, "exchange_buf_CM4.elf");
-    /* check if copro is already running */
-    ret = copro_isFwRunning();
+    /*
+     * start the firmware unless it runs, wait for the ttyRPMSGx and for the
+     * answer to "ST", the start of the sampling
+     */
+    ret = copro_boot(FIRM_NAME, NULL, "ST", COPRO_BOOT_TIMEOUT_MS, &bootTimes);
+    copro_printBootTimes(&bootTimes);
     if (ret) {
-        // check FW name
-        int nameLn = copro_getFwName(FwName);
-        if (FwName[nameLn-1] == 0x0a) {
-            FwName[nameLn-1] = 0x00;   // replace \n by \0
-        }
-        if (strcmp(FwName, FIRM_NAME) == 0) {
-            printf("%s is already running.\n", FIRM_NAME);
-            goto fwrunning;
-        }else {
-            printf("wrong FW running. Try to stop it... \n");
-            if (copro_stopFw()) {
-                printf("fails to stop firmware\n");
-                goto end;
-            }
-        }
-    }
-
-setname:
-    /* set the firmware name to load */
-    ret = copro_setFwName(FIRM_NAME);
-    if (ret <= 0) {
-        printf("fails to change the firmware name\n");
+        printf("fails to boot the firmware\n");
         goto end;
     }
 
-    /* start the firmware */
-    if (copro_startFw()) {
-        printf("fails to start firmware\n");
-        goto end;
-    }
-    /* wait for 1 seconds the creation of the virtual ttyRPMSGx */
-    sleep_ms(1000);
-
-fwrunning:
     signal(SIGINT, exit_fct); /* Ctrl-C signal */
     signal(SIGTERM, exit_fct); /* kill command */
     gettimeofday(&tval_before, NULL);    // get current time
-    // open the ttyRPMSG in raw mode
-    if (copro_openTtyRpmsg(1)) {
-        printf("fails to open the tty RPMESG\n");
-        return (errno * -1);
-    }
     
     if (pthread_create( &thread_tty, NULL, vitural_tty_thread, NULL) != 0) {
         printf("vitural_tty_thread creation fails\n");
         goto end;
     }
     
-    virtual_tty_send_command(strlen("ST"), "ST");    // start sampling
-            
     printf("Entering in Main loop\n");
 
     while (1) {
@@ -47,17 +47,18 @@
 #include <errno.h>
 #include <error.h>
 
-#define DATA_BUF_POOL_SIZE 4096 /* 1MB */
-#define MAX_BUF 80
+#include "sdb_capture.h"
+#include "sdb_compress.h"
+#include "sdb_pipeline.h"
+#include "sdb_stream.h"
+#include "sdb_pyramid.h"
+#include "sdb_trigger.h"
+#include "sdb_decode.h"
+#include "copro.h"
 
-#define PORT 8888
-#define GET             0
-#define POST            1
-#define POSTBUFFERSIZE  512
+#define DATA_BUF_POOL_SIZE 4096 /* 1MB */
 
 #define DMA_DDR_BUFF 1
-#define PHYS_RESERVED_REGION_ADDR 0xdb000000
-#define PHYS_RESERVED_REGION_SIZE 0x1000000
 
 #define RPMSG_SDB_IOCTL_SET_EFD _IOW('R', 0x00, struct rpmsg_sdb_ioctl_set_efd *)
 #define RPMSG_SDB_IOCTL_GET_DATA_SIZE _IOWR('R', 0x01, struct rpmsg_sdb_ioctl_get_data_size *)
@@ -65,6 +66,40 @@
 #define TIMEOUT 60
 #define NB_BUF 1
 
+/* CM4 status events, must match status_evt.h of exchange_large_buf */
+#define STS_SYNC 0xA5
+#define STS_LVL_WARN 2
+
+typedef struct
+{
+    uint8_t sync;
+    uint8_t level;
+    uint16_t code;
+    uint32_t arg[3];
+} sts_event_t;
+
+static const char *mStsLevelStr[] = {"", "ERR", "WRN", "INF", "DBG"};
+
+static const char *mStsCodeFmt[] = {
+    [1]  = "%u events lost",
+    [2]  = "boot, HAL version 0x%08x",
+    [3]  = "verbosity %u",
+    [4]  = "virtual UART rx %u bytes: %c...",
+    [5]  = "SDB rx %u bytes: %c...",
+    [6]  = "START command",
+    [7]  = "START with error status:%u",
+    [8]  = "EXIT command",
+    [9]  = "Error command:%c",
+    [10] = "SDB buffer %u physAddr=0x%x physSize=%u",
+    [11] = "SDB wrong buffer command:%c",
+    [12] = "SDB wrong buffer index:%c awaited index:%u",
+    [13] = "SDB wrong tag:%c instead of:%c",
+    [14] = "SDB wrong digit:%c at offset:%u",
+    [15] = "HAL_DMA_Start_IT() error",
+    [16] = "DMA DDR transfer error 0x%x",
+    [17] = "SDB rx queue full, %c... of %u bytes lost",
+};
+
 typedef struct
 {
     int bufferId, eventfd;
@@ -76,17 +111,8 @@ typedef struct
     uint32_t size;
 } rpmsg_sdb_ioctl_get_data_size;
 
-struct connection_info_struct
-{
-  int connectiontype;
-  char *answerstring;
-  struct MHD_PostProcessor *postprocessor;
-};
-
 //pthread_mutex_t ttyMutex;
 
-struct MHD_Daemon *mHttpDaemon;
-
 char FIRM_NAME[50];
 struct timeval tval_before, tval_after, tval_result;
 
@@ -102,9 +128,6 @@ static char NOT_SELECTED[10] = {""};
 static char freq_unit_str[3][4] = {"MHz", "kHz", "Hz"};
 static char FREQU[3] = {'M', 'k', 'H'};
 
-/* The file descriptor used to manage our TTY over RPMSG */
-static int mFdRpmsg = -1;
-
 /* The file descriptor used to manage our SDB over RPMSG */
 static int mFdSdbRpmsg = -1;
 
@@ -113,7 +136,8 @@ static char mLogBuffer[1024];
 
 static int virtual_tty_send_command(int len, char* commandStr);
 
-static char mByteBuffer[512];
+static char mByteBuffer[512 + sizeof(sts_event_t)];
+static int mStsVerbosity = STS_LVL_WARN;
 static char mByteBuffCpy[512];
 
 static pthread_t thread_tty;
@@ -130,190 +154,55 @@ void* mmappedData[NB_BUF];
 static    int fMappedData = 0;
 FILE *pOutFile;
 FILE *pLogFile;
+/* buffers recorded in a capture file (sdb_capture.h) unless -r: raw stream */
+static int mRawOutput = 0;
+static sdb_cap_writer_t mCapWriter;
+/* -z: capture records compressed by mCompWorkers threads, -1: not compressed */
+static int mCompWorkers = -1;
+static int mCompDelta = 1;
+static sdb_comp_pool_t mCompPool;
+/* -p: capture through the pipeline, checksum -> [encode] -> sink */
+static int mPipeline = 0;
+static sdb_pipe_t mPipe;
+static uint64_t mPipeStartNs;
+#define PIPE_BUFS 8
+/* decimation pyramid of the capture, saved next to it (<file>.pyr) */
+static sdb_pyr_t mPyr;
 static char mFileNameStr[150];
+/*
+ * -s: completed buffers streamed live to the TCP clients of a port (8888
+ * for instance), -u: as datagrams to host:port. A buffer is streamed
+ * from the mapping and goes back to the copro once every client is done.
+ */
+static int mStreamPort = -1;
+static char *mStreamUdp;
+static sdb_stream_t mStream;
+static int mStreaming = 0;
+static uint64_t mStreamStartNs;
+#define STREAM_QUEUE 4
+/*
+ * -T: only the windows around the triggers are recorded (see sdb_trigger.h),
+ * each buffer scanned once copied out of the mapping
+ */
+static char *mTrigSpec;
+static sdb_trig_t mTrig;
+static int mTriggering = 0;
+static uint8_t *mTrigBuf;
+static int mTrigBufferId;
+/*
+ * -D: frames of a protocol decoder (see sdb_decode.h) written to the log
+ * file, each buffer decoded once recorded, from the copy of the trigger
+ * if any
+ */
+static char *mDecSpec;
+static sdb_dec_t mDec;
+static int mDecoding = 0;
+static uint8_t *mDecBuf;
 static pthread_t thread, thread2;
 
 static int efd[NB_BUF];
 static struct pollfd fds[NB_BUF];
     
-/********************************************************************************
-Copro functions allowing to manage a virtual TTY over RPMSG
-*********************************************************************************/
-int copro_isFwRunning(void)
-{
-    int fd;
-    size_t byte_read;
-    int result = 0;
-    unsigned char bufRead[MAX_BUF];
-    fd = open("/sys/class/remoteproc/remoteproc0/state", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/state, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    byte_read = (size_t) read (fd, bufRead, MAX_BUF);
-    if (byte_read >= strlen("running")) {
-        char* pos = strstr((char*)bufRead, "running");
-        if(pos) {
-            result = 1;
-        }
-    }
-    close(fd);
-    return result;
-}
-
-int copro_stopFw(void)
-{
-    int fd;
-    fd = open("/sys/class/remoteproc/remoteproc0/state", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/state, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    write(fd, "stop", strlen("stop"));
-    close(fd);
-    return 0;
-}
-
-int copro_startFw(void)
-{
-    int fd;
-    fd = open("/sys/class/remoteproc/remoteproc0/state", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/state, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    write(fd, "start", strlen("start"));
-    close(fd);
-    return 0;
-}
-
-int copro_getFwPath(char* pathStr)
-{
-    int fd;
-    int byte_read;
-    fd = open("/sys/module/firmware_class/parameters/path", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening firmware_class/parameters/path, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    byte_read = read (fd, pathStr, MAX_BUF);
-    close(fd);
-    return byte_read;
-}
-
-int copro_setFwPath(char* pathStr)
-{
-    int fd;
-    int result = 0;
-    fd = open("/sys/module/firmware_class/parameters/path", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening firmware_class/parameters/path, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    result = write(fd, pathStr, strlen(pathStr));
-    close(fd);
-    return result;
-}
-
-int copro_getFwName(char* pathStr)
-{
-    int fd;
-    int byte_read;
-    fd = open("/sys/class/remoteproc/remoteproc0/firmware", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/firmware, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    byte_read = read (fd, pathStr, MAX_BUF);
-    close(fd);
-    return byte_read;
-}
-
-int copro_setFwName(char* nameStr)
-{
-    int fd;
-    int result = 0;
-    fd = open("/sys/class/remoteproc/remoteproc0/firmware", O_RDWR);
-    if (fd < 0) {
-        printf("Error opening remoteproc0/firmware, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    result = write(fd, nameStr, strlen(nameStr));
-    close(fd);
-    return result;
-}
-
-int copro_openTtyRpmsg(int modeRaw)
-{
-    struct termios tiorpmsg;
-    mFdRpmsg = open("/dev/ttyRPMSG0", O_RDWR |  O_NOCTTY | O_NONBLOCK);
-    if (mFdRpmsg < 0) {
-        printf("Error opening ttyRPMSG0, err=-%d\n", errno);
-        return (errno * -1);
-    }
-    /* get current port settings */
-    tcgetattr(mFdRpmsg,&tiorpmsg);
-    if (modeRaw) {
-        tiorpmsg.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
-                      | INLCR | IGNCR | ICRNL | IXON);
-        tiorpmsg.c_oflag &= ~OPOST;
-        tiorpmsg.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-        tiorpmsg.c_cflag &= ~(CSIZE | PARENB);
-        tiorpmsg.c_cflag |= CS8;
-    } else {
-        /* ECHO off, other bits unchanged */
-        tiorpmsg.c_lflag &= ~ECHO;
-        /*do not convert LF to CR LF */
-        tiorpmsg.c_oflag &= ~ONLCR;
-    }
-    tcsetattr(mFdRpmsg, TCSANOW, &tiorpmsg);
-    return 0;
-}
-
-int copro_closeTtyRpmsg(void)
-{
-    close(mFdRpmsg);
-    mFdRpmsg = -1;
-    return 0;
-}
-
-int copro_writeTtyRpmsg(int len, char* pData)
-{
-    int result = 0;
-    if (mFdRpmsg < 0) {
-        printf("Error writing ttyRPMSG0, fileDescriptor is not set\n");
-        return mFdRpmsg;
-    }
-
-    result = write(mFdRpmsg, pData, len);
-    return result;
-}
-
-int copro_readTtyRpmsg(int len, char* pData)
-{
-    int byte_rd, byte_avail;
-    int result = 0;
-    if (mFdRpmsg < 0) {
-        printf("Error reading ttyRPMSG0, fileDescriptor is not set\n");
-        return mFdRpmsg;
-    }
-    ioctl(mFdRpmsg, FIONREAD, &byte_avail);
-    if (byte_avail > 0) {
-        if (byte_avail >= len) {
-            byte_rd = read (mFdRpmsg, pData, len);
-        } else {
-            byte_rd = read (mFdRpmsg, pData, byte_avail);
-        }
-        //printf("read successfully %d bytes to %p, [0]=0x%x\n", byte_rd, pData, pData[0]);
-        result = byte_rd;
-    } else {
-        result = 0;
-    }
-    return result;
-}
-/********************************************************************************
-End of Copro functions
-*********************************************************************************/
 
 static void
 open_log_file(void) {
@@ -347,17 +236,129 @@ close_log_file(void) {
     fclose(pLogFile);
 }
 
+/* crc of the buffer as received, logged by the sink */
+static int
+pipe_checksum(void *ctx, sdb_pipe_buf_t *b) {
+    b->crc = sdb_cap_crc32(0, b->data, b->size);
+    return 0;
+}
+
+static int
+pipe_encode(void *ctx, sdb_pipe_buf_t *b) {
+    b->flags = 0;
+    b->out_size = sdb_comp_encode(b->data, b->size, mCompDelta, b->tmp, b->out, &b->flags);
+    return 0;
+}
+
+/* ordered: the records are appended in the order of the completions */
+static int
+pipe_sink(void *ctx, sdb_pipe_buf_t *b) {
+    char line[96];
+    int ret, n;
+
+    ret = sdb_cap_writer_append_rec(&mCapWriter, b->buffer_id, b->flags, b->ts_ns,
+                                    b->out_size ? b->out : b->data,
+                                    b->out_size ? b->out_size : b->size);
+    /* the raw samples, still there after the encode */
+    if (!ret)
+        ret = sdb_pyr_append(&mPyr, b->data, b->size);
+    n = sprintf(line, "sdb buffer %llu: id %u, %u bytes, crc %08x, stored %u\n",
+                (unsigned long long)b->seq, b->buffer_id, b->size, b->crc,
+                b->out_size ? b->out_size : b->size);
+    write_log_file((unsigned char *)line, n);
+    return ret;
+}
+
+static int
+start_pipeline(void) {
+    int ret;
+
+    ret = sdb_pipe_init(&mPipe, PIPE_BUFS, DATA_BUF_POOL_SIZE);
+    /* checksum on the first core, storage on the second one */
+    if (!ret)
+        ret = sdb_pipe_add_stage(&mPipe, "checksum", pipe_checksum, NULL, 1, 0, 0, 4);
+    if (!ret && mCompWorkers >= 0)
+        ret = sdb_pipe_add_stage(&mPipe, "encode", pipe_encode, NULL,
+                                 mCompWorkers ? mCompWorkers : 1, -1, 0, 4);
+    if (!ret)
+        ret = sdb_pipe_add_stage(&mPipe, "sink", pipe_sink, NULL, 1, 1, 1, 4);
+    if (!ret)
+        ret = sdb_pipe_start(&mPipe);
+    if (ret)
+        sdb_pipe_free(&mPipe);
+    return ret;
+}
+
 static void
 open_raw_file(void) {
     time_t t = time(NULL);
     struct tm tm = *localtime(&t);
-    sprintf(mFileNameStr, "./sdb_demo_%04d%02d%02d-%02d%02d%02d.dat",
-        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
-    pOutFile = fopen(mFileNameStr,"wb");
+    int ret;
+
+    sprintf(mFileNameStr, "./sdb_demo_%04d%02d%02d-%02d%02d%02d.%s",
+        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+        mRawOutput ? "dat" : "sdbcap");
+    if (mRawOutput) {
+        pOutFile = fopen(mFileNameStr,"wb");
+        return;
+    }
+    ret = sdb_cap_writer_open(&mCapWriter, mFileNameStr);
+    if (ret) {
+        printf("Error opening %s, err=%d\n", mFileNameStr, ret);
+        return;
+    }
+    sdb_pyr_init(&mPyr);
+    if (mPipeline) {
+        ret = start_pipeline();
+        if (ret) {
+            printf("Error starting the pipeline, err=%d, recording without it\n", ret);
+            mPipeline = 0;
+            mCompWorkers = -1;
+        }
+        mPipeStartNs = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    } else if (mCompWorkers >= 0) {
+        ret = sdb_comp_pool_start(&mCompPool, &mCapWriter, mCompWorkers, mCompDelta,
+                                  DATA_BUF_POOL_SIZE, NB_BUF + mCompWorkers * 2);
+        if (ret) {
+            printf("Error starting the compression, err=%d, recording uncompressed\n", ret);
+            mCompWorkers = -1;
+        }
+    }
 }
 
 static int32_t
-write_raw_file(unsigned char* pData, unsigned int size) {
+write_raw_file(int bufferId, unsigned char* pData, unsigned int size) {
+    if (!mRawOutput) {
+        /* stamped when the buffer is fetched, see sdb_cap_rec_t */
+        if (mPipeline) {
+            sdb_pipe_buf_t *b;
+
+            if (size > DATA_BUF_POOL_SIZE)
+                return -1;
+            /* one copy out of the write-combined mapping, handles from there on */
+            b = sdb_pipe_get(&mPipe);
+            memcpy(b->data, pData, size);
+            b->size = size;
+            b->buffer_id = bufferId;
+            b->ts_ns = sdb_cap_now_ns(CLOCK_MONOTONIC);
+            sdb_pipe_put(&mPipe, b);
+            return atomic_load(&mPipe.error) ? -1 : (int32_t)size;
+        }
+        if (sdb_pyr_append(&mPyr, pData, size))
+            return -1;
+        if (mCompWorkers >= 0) {
+            /* copied: the buffer goes back to the copro while it is compressed */
+            if (sdb_comp_pool_submit(&mCompPool, bufferId, sdb_cap_now_ns(CLOCK_MONOTONIC),
+                                     pData, size))
+                return -1;
+            return size;
+        }
+        if (sdb_cap_writer_append(&mCapWriter, bufferId, sdb_cap_now_ns(CLOCK_MONOTONIC),
+                                  pData, size))
+            return -1;
+        return size;
+    }
+
     // perform the write by packets of 4kB
     int rest2write = size;
     int index = 0;
@@ -378,9 +379,206 @@ write_raw_file(unsigned char* pData, unsigned int size) {
 
 static void
 close_raw_file(void) {
+    char pyr_path[160];
+    int ret;
+
+    if (!mRawOutput) {
+        if (mPipeline) {
+            sdb_pipe_stop(&mPipe);
+            sdb_pipe_print(&mPipe, stdout, sdb_cap_now_ns(CLOCK_MONOTONIC) - mPipeStartNs);
+            sdb_pipe_free(&mPipe);
+        } else if (mCompWorkers >= 0) {
+            sdb_comp_stats_t *st = &mCompPool.stats;
+
+            sdb_comp_pool_stop(&mCompPool);
+            if (st->raw_bytes)
+                printf("compression: %llu buffers, ratio %.2f, %.2f ms CPU/MB, %llu raw, %llu stalls\n",
+                       (unsigned long long)st->records, (double)st->raw_bytes / st->stored_bytes,
+                       st->cpu_ns / 1e6 / (st->raw_bytes / 1048576.0),
+                       (unsigned long long)st->raw_fallbacks, (unsigned long long)st->stalls);
+        }
+        /* writes the index, the file is still readable without it */
+        sdb_cap_writer_close(&mCapWriter);
+        /* a view can make it again from the capture if it is lost */
+        snprintf(pyr_path, sizeof(pyr_path), "%s.pyr", mFileNameStr);
+        ret = sdb_pyr_save(&mPyr, pyr_path);
+        if (ret)
+            printf("Error saving %s, err=%d\n", pyr_path, ret);
+        sdb_pyr_free(&mPyr);
+        return;
+    }
     fclose(pOutFile);
 }
 
+static void
+open_stream(void) {
+    char host[64];
+    unsigned int port;
+    int ret;
+
+    if (mStreamPort < 0 && !mStreamUdp)
+        return;
+    /* one buffer at a time is filled by the copro, SDB_STREAM_BLOCK by default */
+    ret = sdb_stream_init(&mStream, NB_BUF, DATA_BUF_POOL_SIZE, STREAM_QUEUE, SDB_STREAM_BLOCK, 1);
+    if (!ret && mStreamPort >= 0) {
+        ret = sdb_stream_listen(&mStream, mStreamPort);
+        if (ret >= 0) {
+            printf("streaming on tcp port %d\n", ret);
+            ret = 0;
+        }
+    }
+    if (!ret && mStreamUdp) {
+        if (sscanf(mStreamUdp, "%63[^:]:%u", host, &port) != 2)
+            ret = -EINVAL;
+        else
+            ret = sdb_stream_add_udp(&mStream, host, port, SDB_STREAM_LATEST);
+    }
+    if (!ret)
+        ret = sdb_stream_start(&mStream);
+    if (ret) {
+        printf("Error starting the streaming, err=%d, not streamed\n", ret);
+        sdb_stream_free(&mStream);
+        return;
+    }
+    mStreaming = 1;
+    mStreamStartNs = sdb_cap_now_ns(CLOCK_MONOTONIC);
+}
+
+static void
+close_stream(void) {
+    if (!mStreaming)
+        return;
+    mStreaming = 0;
+    sdb_stream_stop(&mStream);
+    sdb_stream_print(&mStream, stdout, sdb_cap_now_ns(CLOCK_MONOTONIC) - mStreamStartNs);
+    sdb_stream_free(&mStream);
+}
+
+static void
+trig_log(void *ctx, uint64_t pos) {
+    char line[64];
+    int n;
+
+    n = sprintf(line, "sdb trigger at sample %llu\n", (unsigned long long)pos);
+    write_log_file((unsigned char *)line, n);
+}
+
+/* recorded as any buffer, by pieces of a pipeline buffer at most */
+static int
+trig_keep(void *ctx, uint64_t first, const uint8_t *samples, uint32_t n) {
+    uint32_t len;
+
+    for (; n; samples += len, n -= len) {
+        len = n < DATA_BUF_POOL_SIZE ? n : DATA_BUF_POOL_SIZE;
+        if (write_raw_file(mTrigBufferId, (unsigned char *)samples, len) != (int32_t)len)
+            return -EIO;
+    }
+    return 0;
+}
+
+static void
+open_trigger(void) {
+    sdb_trig_cond_t c;
+    int ret;
+
+    if (!mTrigSpec)
+        return;
+    ret = sdb_trig_parse(&c, mTrigSpec);
+    if (!ret)
+        ret = sdb_trig_init(&mTrig, &c, trig_log, trig_keep, NULL);
+    if (!ret) {
+        mTrigBuf = malloc(DATA_BUF_POOL_SIZE);
+        if (!mTrigBuf) {
+            sdb_trig_free(&mTrig);
+            ret = -ENOMEM;
+        }
+    }
+    if (ret) {
+        printf("Error with the trigger %s, err=%d, recording everything\n", mTrigSpec, ret);
+        return;
+    }
+    mTriggering = 1;
+}
+
+static void
+close_trigger(void) {
+    if (!mTriggering)
+        return;
+    mTriggering = 0;
+    printf("trigger: %llu triggers, %llu of %llu samples recorded\n",
+           (unsigned long long)mTrig.triggers, (unsigned long long)mTrig.kept_samples,
+           (unsigned long long)mTrig.nb_samples);
+    sdb_trig_free(&mTrig);
+    free(mTrigBuf);
+}
+
+static int32_t
+trigger_buffer(int bufferId, unsigned char *pData, unsigned int size) {
+    if (size > DATA_BUF_POOL_SIZE)
+        return -1;
+    /* one copy out of the write-combined mapping, scanned from there */
+    memcpy(mTrigBuf, pData, size);
+    mTrigBufferId = bufferId;
+    return sdb_trig_process(&mTrig, mTrigBuf, size) ? -1 : (int32_t)size;
+}
+
+static void
+dec_log(void *ctx, const sdb_dec_frame_t *f) {
+    char line[SDB_DEC_LINE + 16];
+    int n;
+
+    n = sprintf(line, "sdb frame ");
+    n += sdb_dec_format(&mDec, f, line + n, SDB_DEC_LINE);
+    line[n++] = '\n';
+    write_log_file((unsigned char *)line, n);
+}
+
+static void
+open_decoder(void) {
+    sdb_dec_cfg_t c;
+    int ret;
+
+    if (!mDecSpec)
+        return;
+    ret = sdb_dec_parse(&c, mDecSpec);
+    if (!ret)
+        ret = sdb_dec_init(&mDec, &c, dec_log, NULL);
+    if (!ret) {
+        mDecBuf = malloc(DATA_BUF_POOL_SIZE);
+        if (!mDecBuf)
+            ret = -ENOMEM;
+    }
+    if (ret) {
+        printf("Error with the decoder %s, err=%d, not decoding\n", mDecSpec, ret);
+        return;
+    }
+    mDecoding = 1;
+}
+
+static void
+close_decoder(void) {
+    if (!mDecoding)
+        return;
+    mDecoding = 0;
+    printf("decoder: %llu frames, %llu errors, %llu edges of %llu samples\n",
+           (unsigned long long)mDec.frames, (unsigned long long)mDec.errors,
+           (unsigned long long)mDec.edges, (unsigned long long)mDec.nb_samples);
+    free(mDecBuf);
+}
+
+static void
+decode_buffer(unsigned char *pData, unsigned int size) {
+    const uint8_t *src = mTrigBuf;
+
+    if (size > DATA_BUF_POOL_SIZE)
+        return;
+    if (!mTriggering) {
+        memcpy(mDecBuf, pData, size);
+        src = mDecBuf;
+    }
+    sdb_dec_process(&mDec, src, size);
+}
+
 int64_t
 print_time() {
     struct timespec ts;
@@ -434,6 +632,8 @@ void exit_fct(int signum)
 {
     mThreadCancel = 1;
     sleep_ms(100);
+    /* nothing sent from the mapping anymore */
+    close_stream();
     if (fMappedData) {
         for (int i=0;i<NB_BUF;i++){
             int rc = munmap(mmappedData[i], DATA_BUF_POOL_SIZE);
@@ -453,6 +653,8 @@ void exit_fct(int signum)
         printf("stop the firmware before exit\n");
     }
     
+    close_trigger();
+    close_decoder();
     close_log_file();
     close_raw_file();
     
@@ -483,21 +685,51 @@ void *key_thread(void *arg)
     }
 }*/
 
+/* Formats the CM4 status events in the log file, returns the bytes consumed */
+static int decode_status_events(char *pData, int len)
+{
+    sts_event_t evt;
+    int pos = 0, n;
+
+    gettimeofday(&tval_after, NULL);
+    timersub(&tval_after, &tval_before, &tval_result);
+
+    while (len - pos >= (int)sizeof(sts_event_t)) {
+        /* resync on the next record if the stream is misaligned */
+        if ((uint8_t)pData[pos] != STS_SYNC) {
+            pos++;
+            continue;
+        }
+        memcpy(&evt, pData + pos, sizeof(evt));
+        pos += sizeof(evt);
+
+        n = sprintf(mLogBuffer, "[%ld.%06ld] CM4 %s: ",
+            (long int)tval_result.tv_sec, (long int)tval_result.tv_usec,
+            evt.level <= 4 ? mStsLevelStr[evt.level] : "???");
+        if (evt.code < sizeof(mStsCodeFmt) / sizeof(mStsCodeFmt[0]) && mStsCodeFmt[evt.code])
+            n += sprintf(mLogBuffer + n, mStsCodeFmt[evt.code], evt.arg[0], evt.arg[1], evt.arg[2]);
+        else
+            n += sprintf(mLogBuffer + n, "event %u (0x%x 0x%x 0x%x)",
+                evt.code, evt.arg[0], evt.arg[1], evt.arg[2]);
+        mLogBuffer[n++] = '\n';
+        write_log_file(mLogBuffer, n);
+    }
+    return pos;
+}
+
 void *vitural_tty_thread(void *arg)
 {
-    int read;
-    int32_t wsize;
+    int read, pending = 0, used;
 
     while (1) {
         if (mThreadCancel) break;    // kill thread requested
-        read = copro_readTtyRpmsg(512, mByteBuffer);
+        read = copro_readTtyRpmsg(512, mByteBuffer + pending);
         if (read > 0) {
-            mByteBuffer[read] = 0;
-            gettimeofday(&tval_after, NULL);
-            timersub(&tval_after, &tval_before, &tval_result);
-            sprintf(mLogBuffer, "[%ld.%06ld] virtTTY_RX %d bytes: %s\n",
-            	(long int)tval_result.tv_sec, (long int)tval_result.tv_usec, read, mByteBuffer);
-            write_log_file(mLogBuffer, strlen(mLogBuffer));
+            pending += read;
+            used = decode_status_events(mByteBuffer, pending);
+            /* keep a partial record for the next read */
+            pending -= used;
+            memmove(mByteBuffer, mByteBuffer + used, pending);
         }
         sleep_ms(5);      // give time to UI
     }
@@ -542,7 +774,24 @@ void *sdb_thread(void *arg)
                     mNbCompData += q_get_data_size.size;
 
                     unsigned char* pCompData = (unsigned char*)mmappedData[mDdrBuffAwaited];
-                    wsize= write_raw_file(mmappedData[mDdrBuffAwaited], q_get_data_size.size);
+                    int64_t streamSeq = -1;
+
+                    /* sent while the buffer is recorded */
+                    if (mStreaming)
+                        streamSeq = sdb_stream_publish(&mStream, q_get_data_size.bufferId, pCompData,
+                                                       q_get_data_size.size,
+                                                       sdb_cap_now_ns(CLOCK_MONOTONIC));
+                    if (mTriggering)
+                        wsize = trigger_buffer(q_get_data_size.bufferId, pCompData,
+                                               q_get_data_size.size);
+                    else
+                        wsize= write_raw_file(q_get_data_size.bufferId, mmappedData[mDdrBuffAwaited],
+                                              q_get_data_size.size);
+                    if (mDecoding)
+                        decode_buffer(pCompData, q_get_data_size.size);
+                    /* the copro fills the buffer again after STATE_IDLE */
+                    if (streamSeq >= 0)
+                        sdb_stream_wait(&mStream, streamSeq);
                     if (wsize == (int32_t)q_get_data_size.size) {
                         mNbWrittenInFileData += wsize;
                         printf("[%ld.%06ld] sdb_thread data EVENT buffIdx=%d mNbCompData=%u mNbWrittenInFileData=%u\n", 
@@ -574,59 +823,86 @@ int main(int argc, char **argv)
     int ret = 0, i;
     char *filename = "/dev/rpmsg-sdb";
     rpmsg_sdb_ioctl_set_efd q_set_efd;
-    char FwName[30];
-    
+    static const char *const sdbDevs[] = { "rpmsg-sdb", NULL };
+    copro_boot_times_t bootTimes;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v:rz:d:ps:u:T:D:")) != -1) {
+        switch (opt) {
+        case 'v':
+            /* CM4 status verbosity: 0 none, 1 error, 2 warning, 3 info, 4 debug */
+            mStsVerbosity = atoi(optarg);
+            if (mStsVerbosity < 0 || mStsVerbosity > 4) {
+                printf("invalid verbosity %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'r':
+            /* headerless stream of the buffers instead of a capture file */
+            mRawOutput = 1;
+            break;
+        case 'z':
+            /* delta + LZ4 records, 0 workers: compressed by sdb_thread */
+            mCompWorkers = atoi(optarg);
+            break;
+        case 'd':
+            /* delta sample bytes, 0: LZ4 only */
+            mCompDelta = atoi(optarg);
+            break;
+        case 'p':
+            /* capture through the pipeline, -z sets its encode threads */
+            mPipeline = 1;
+            break;
+        case 's':
+            /* live stream to TCP clients on port, 0: any */
+            mStreamPort = atoi(optarg);
+            break;
+        case 'u':
+            /* live stream of datagrams to host:port */
+            mStreamUdp = optarg;
+            break;
+        case 'T':
+            /* trigger spec, e.g. edge=r0,pattern=0x04/0,pre=4096,post=65536 */
+            mTrigSpec = optarg;
+            break;
+        case 'D':
+            /* decoder spec, e.g. uart=0,period=868 or i2c=0/1 */
+            mDecSpec = optarg;
+            break;
+        default:
+            printf("Usage : %s [-v <CM4 verbosity 0..4>] [-r] [-p] [-z <workers> [-d <0|1|2|4>]]"
+                   " [-s <port>] [-u <host:port>] [-T <trigger>] [-D <decoder>]\n", argv[0]);
+            return -1;
+        }
+    }
+
     strcpy(FIRM_NAME, "exchange_large_buf_CM4.elf");
     
     open_log_file();
     open_raw_file();
+    open_trigger();
+    open_decoder();
+    open_stream();
     
-    /* check if copro is already running */
-    ret = copro_isFwRunning();
+    /*
+     * start the firmware unless it runs, wait for the ttyRPMSGx, the
+     * rpmsg-sdb device and the answer to "R", needed to allow M4 to send
+     * any data over virtualTTY: its boot event
+     */
+    ret = copro_boot(FIRM_NAME, sdbDevs, "R", COPRO_BOOT_TIMEOUT_MS, &bootTimes);
+    copro_printBootTimes(&bootTimes);
     if (ret) {
-        // check FW name
-        int nameLn = copro_getFwName(FwName);
-        if (FwName[nameLn-1] == 0x0a) {
-            FwName[nameLn-1] = 0x00;   // replace \n by \0
-        }
-        if (strcmp(FwName, FIRM_NAME) == 0) {
-            printf("%s is already running.\n", FIRM_NAME);
-            goto fwrunning;
-        }else {
-            printf("wrong FW running. Try to stop it... \n");
-            if (copro_stopFw()) {
-                printf("fails to stop firmware\n");
-                goto end;
-            }
-        }
-    }
-
-setname:
-    /* set the firmware name to load */
-    ret = copro_setFwName(FIRM_NAME);
-    if (ret <= 0) {
-        printf("fails to change the firmware name\n");
-        goto end;
-    }
-
-    /* start the firmware */
-    if (copro_startFw()) {
-        printf("fails to start firmware\n");
+        printf("fails to boot the firmware\n");
         goto end;
     }
-    /* wait for 1 seconds the creation of the virtual ttyRPMSGx */
-    sleep_ms(1000);
 
-fwrunning:
     signal(SIGINT, exit_fct); /* Ctrl-C signal */
     signal(SIGTERM, exit_fct); /* kill command */
     gettimeofday(&tval_before, NULL);    // get current time
-    // open the ttyRPMSG in raw mode
-    if (copro_openTtyRpmsg(1)) {
-        printf("fails to open the tty RPMESG\n");
-        return (errno * -1);
+    if (mStsVerbosity != STS_LVL_WARN) {
+        char verbosityCmd[3] = {'V', '0' + mStsVerbosity, 0};
+        virtual_tty_send_command(strlen(verbosityCmd), verbosityCmd);
     }
-    virtual_tty_send_command(strlen("R"), "R");    // needed to allow M4 to send any data over virtualTTY
 
     
     if (pthread_create( &thread, NULL, vitural_tty_thread, NULL) != 0) {
@@ -694,6 +970,7 @@ fwrunning:
         sleep_ms(1);      // give time to UI
     }
     
+    close_stream();
     for (i=0; i<NB_BUF; i++) {
         int rc = munmap(mmappedData[i], buffsize);
         assert(rc == 0);
@@ -702,6 +979,9 @@ fwrunning:
     printf("Buffers successfully unmapped\n");
 
 end:
+    close_stream();
+    close_trigger();
+    close_decoder();
     close_log_file();
     close_raw_file();
     
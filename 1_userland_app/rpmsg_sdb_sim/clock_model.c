@@ -0,0 +1,247 @@
+/*
+ * clock_model.c
+ * Model of the correlation of the CM4 clock with CLOCK_MONOTONIC.
+ *
+ * The CM4 clock drifts from the local one by a fixed ppm and starts
+ * close to the wrap of its 32-bit us counter. The driver pings it every
+ * period: each way of a ping takes a base delay plus a random jitter,
+ * with a spike now and then, the way back being slower than the way out;
+ * the CM4 answers after a random processing time and truncates its
+ * timestamps to the us. Between pings the CM4 completes buffers and
+ * stamps them.
+ *
+ * The estimator is rpmsg_sdb_clock.h of the driver. Every buffer stamp
+ * converted to local time must be within the error bound returned with
+ * it. The model prints the real and bounded errors, once the window of
+ * pings is full, and the estimated drift.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "rpmsg_sdb_clock.h"
+#include "clock_model.h"
+
+#define BUFFERS_PER_PING 8
+
+typedef struct
+{
+    double drift_ppm;   /* CM4 clock against the local one */
+    double base_us;     /* delay of the way out, the way back is 2x */
+    double jitter_us;   /* uniform jitter of each way */
+    double spike;       /* probability of a 20x jitter */
+    double proc_us;     /* CM4 processing of a ping at most */
+    uint32_t period_ms;
+    uint32_t pings;
+} clk_cfg_t;
+
+typedef struct
+{
+    uint64_t buffers;
+    uint64_t violations;
+    uint64_t conv_fails;
+    double max_err_ns;
+    double max_bound_ns;
+    double sum_bound_ns;
+    uint64_t steady;    /* buffers once the window is full */
+} clk_res_t;
+
+static double rnd(void)
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static double way_ns(const clk_cfg_t *cfg, double factor)
+{
+    double j = cfg->jitter_us * rnd();
+
+    if (rnd() < cfg->spike)
+        j *= 20;
+    return (cfg->base_us * factor + j) * 1000;
+}
+
+/* CM4 time in ns of a local time, it wraps 200ms after the start */
+static double remote_at(const clk_cfg_t *cfg, double local_ns)
+{
+    return 4294967296e3 - 200e6 + local_ns * (1 + cfg->drift_ppm * 1e-6);
+}
+
+static uint32_t remote_us(double remote_ns)
+{
+    return (uint32_t)(uint64_t)(remote_ns / 1000);
+}
+
+/* The local time of the first ping, CLOCK_MONOTONIC is far from 0 */
+#define LOCAL_START 123456789012ull
+
+static int run(const clk_cfg_t *cfg, struct rpmsg_sdb_clock_t *c, clk_res_t *res, int verbose)
+{
+    double t = 0, t1, t2, t3, t4, e, err;
+    uint64_t local, bound;
+    uint32_t p, b;
+
+    memset(res, 0, sizeof(*res));
+    rpmsg_sdb_clock_reset(c);
+
+    /* nothing to convert before the first ping */
+    if (!rpmsg_sdb_clock_to_local(c, remote_us(remote_at(cfg, 0)), &local, &bound)) {
+        printf("conversion without ping\n");
+        return -1;
+    }
+
+    for (p = 0; p < cfg->pings; p++) {
+        t1 = t;
+        t2 = t1 + way_ns(cfg, 1);
+        t3 = t2 + cfg->proc_us * 1000 * rnd();
+        t4 = t3 + way_ns(cfg, 2);
+        rpmsg_sdb_clock_add(c, LOCAL_START + (uint64_t)t1, remote_us(remote_at(cfg, t2)),
+                            remote_us(remote_at(cfg, t3)), LOCAL_START + (uint64_t)t4);
+
+        for (b = 0; b < BUFFERS_PER_PING; b++) {
+            /* anywhere until the next ping, as the stamps of the late buffers */
+            e = t1 + cfg->period_ms * 1e6 * rnd();
+            if (rpmsg_sdb_clock_to_local(c, remote_us(remote_at(cfg, e)), &local, &bound)) {
+                res->conv_fails++;
+                continue;
+            }
+            err = fabs((double)local - (LOCAL_START + e));
+            res->buffers++;
+            if (err > bound) {
+                res->violations++;
+                if (verbose && res->violations <= 5)
+                    printf("ping %u: error %.0f ns above the bound %llu ns\n",
+                           p, err, (unsigned long long)bound);
+            }
+            if (c->nb < RPMSG_SDB_CLOCK_SAMPLES)
+                continue;
+            res->steady++;
+            if (err > res->max_err_ns)
+                res->max_err_ns = err;
+            if (bound > res->max_bound_ns)
+                res->max_bound_ns = bound;
+            res->sum_bound_ns += bound;
+        }
+        t += cfg->period_ms * 1e6;
+    }
+
+    return res->violations || res->conv_fails ? -1 : 0;
+}
+
+static void print_result(const clk_cfg_t *cfg, const struct rpmsg_sdb_clock_t *c,
+                         const clk_res_t *res)
+{
+    printf("drift %+.1f ppm, delays %.0f/%.0f us, jitter %.0f us, spikes %.0f%%: "
+           "%llu buffers, %llu out of bound\n",
+           cfg->drift_ppm, cfg->base_us, 2 * cfg->base_us, cfg->jitter_us, cfg->spike * 100,
+           (unsigned long long)res->buffers, (unsigned long long)res->violations);
+    if (!res->steady)
+        return;
+    printf("  full window: error max %.1f us, bound avg %.1f us max %.1f us, "
+           "drift %+.3f +/- %.3f ppm\n",
+           res->max_err_ns / 1000, res->sum_bound_ns / res->steady / 1000,
+           res->max_bound_ns / 1000, -c->skew_ppb / 1000.0, c->skew_err_ppb / 1000.0);
+}
+
+/* Bounds always hold; with a quiet link the drift is found within 1 ppm */
+static int run_checks(void)
+{
+    static const clk_cfg_t cases[] = {
+        { 0,      20, 10,  0,    50, 1000, 200 },
+        { 57.3,   20, 10,  0.05, 50, 1000, 200 },
+        { -150,   20, 100, 0.1,  50, 1000, 200 },
+        { 200,    50, 500, 0.2,  200, 100, 500 },
+        { -40,    20, 10,  0.05, 50, 10,   2000 },
+    };
+    struct rpmsg_sdb_clock_t c;
+    clk_res_t res;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (run(&cases[i], &c, &res, 1)) {
+            printf("check failed, case %u\n", i);
+            print_result(&cases[i], &c, &res);
+            return -1;
+        }
+        if (cases[i].jitter_us <= 10 && cases[i].period_ms >= 1000 &&
+            fabs(c.skew_ppb / 1000.0 + cases[i].drift_ppm) > 1) {
+            printf("check failed, case %u: drift %+.3f ppm\n", i, -c.skew_ppb / 1000.0);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage : \n");
+    printf("%s clock [-d <ppm>] [-b <us>] [-j <us>] [-s <%%>] [-p <ms>] [-n <pings>] [-r <seed>]\n",
+           prog);
+    printf("  -d: drift of the CM4 clock (default 50)\n");
+    printf("  -b: delay of the way out, twice for the way back (default 20)\n");
+    printf("  -j: jitter of each way (default 20)\n");
+    printf("  -s: percentage of 20x jitter spikes (default 5)\n");
+    printf("  -p: ping period (default 1000)\n");
+    printf("  -n: pings (default 600)\n");
+    printf("  -r: random seed (default 1)\n");
+}
+
+int clock_model_main(int argc, char **argv)
+{
+    clk_cfg_t cfg = { 50, 20, 20, 0.05, 50, 1000, 600 };
+    struct rpmsg_sdb_clock_t c;
+    clk_res_t res;
+    unsigned int seed = 1;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "d:b:j:s:p:n:r:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            cfg.drift_ppm = atof(optarg);
+            break;
+        case 'b':
+            cfg.base_us = atof(optarg);
+            break;
+        case 'j':
+            cfg.jitter_us = atof(optarg);
+            break;
+        case 's':
+            cfg.spike = atof(optarg) / 100;
+            break;
+        case 'p':
+            cfg.period_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            cfg.pings = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!cfg.period_ms || !cfg.pings || cfg.base_us < 0 || cfg.jitter_us < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    srand(seed);
+    if (run_checks())
+        return 1;
+    printf("checks passed\n");
+
+    run(&cfg, &c, &res, 1);
+    print_result(&cfg, &c, &res);
+    if (fabs(cfg.drift_ppm) > RPMSG_SDB_CLOCK_MAX_PPM)
+        printf("  drift above %u ppm, the bounds only hold once it is estimated\n",
+               RPMSG_SDB_CLOCK_MAX_PPM);
+
+    return res.violations ? 1 : 0;
+}
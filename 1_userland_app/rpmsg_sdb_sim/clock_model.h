@@ -0,0 +1,11 @@
+/*
+ * clock_model.h
+ * Model of the CM4 clock correlation, see clock_model.c.
+ */
+
+#ifndef CLOCK_MODEL_H
+#define CLOCK_MODEL_H
+
+int clock_model_main(int argc, char **argv);
+
+#endif /* CLOCK_MODEL_H */
@@ -0,0 +1,367 @@
+/*
+ * pool_model.c
+ * Model of the rpmsg_sdb buffer pool against a fragmented CMA area.
+ *
+ * Each session allocates the capture buffers then frees them on close,
+ * like rpmsg_sdb_mmap() and rpmsg_sdb_close(). Between sessions the rest
+ * of the system allocates and frees pinned (unmovable) pages in the CMA
+ * area and fills it with movable pages.
+ *
+ * A CMA allocation takes the first range aligned on its size without
+ * pinned pages; its cost is base_us + zero_us per page + migrate_us per
+ * movable page. It fails when no such range is left. The pool is the
+ * rpmsg_sdb_pool.h of the driver.
+ *
+ * The "region" backend takes the buffers from a dedicated reserved
+ * region with rpmsg_sdb_region.h instead, the rest of the system does
+ * not touch it and the cost is the measured time of the allocator.
+ *
+ * The model prints the allocation latency and the failures with and
+ * without the pool. It also measures the real cost of a pool get/put
+ * and of the region allocator under random allocations and frees.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "rpmsg_sdb_pool.h"
+#include "rpmsg_sdb_region.h"
+#include "pool_model.h"
+
+#define MAX_BUFS 16
+
+enum {
+    PG_FREE = 0,
+    PG_MOVABLE,
+    PG_PINNED,
+    PG_SDB,
+};
+
+typedef struct
+{
+    uint32_t cma_pages;
+    uint32_t sessions;
+    uint32_t nb_bufs;
+    size_t buf_size;
+    uint32_t pinned_pm;     /* pinned pages target, per mille of the area */
+    uint32_t movable_pct;
+    uint32_t base_us, zero_us, migrate_us;
+    size_t pool_max;
+    uint32_t region_pages;
+} model_cfg_t;
+
+typedef enum {
+    BK_CMA = 0,
+    BK_REGION,
+} backend_t;
+
+typedef struct
+{
+    uint64_t allocs;
+    uint64_t failures;
+    double lat_sum_us;
+    double lat_max_us;
+} model_res_t;
+
+static uint8_t *mPages;
+static struct rpmsg_sdb_region_t mRegion;
+static uint32_t *mRegionBitmap;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double alloc_cost(const model_cfg_t *cfg, uint32_t first, uint32_t nb)
+{
+    double cost = cfg->base_us;
+    uint32_t i;
+
+    for (i = first; i < first + nb; i++)
+        cost += cfg->zero_us + (mPages[i] == PG_MOVABLE ? cfg->migrate_us : 0);
+    return cost;
+}
+
+/* first fit aligned on the size, -1 if no range without pinned/SDB pages */
+static int cma_alloc(const model_cfg_t *cfg, unsigned int order, double *cost)
+{
+    uint32_t nb = 1u << order, first, i;
+
+    for (first = 0; first + nb <= cfg->cma_pages; first += nb) {
+        for (i = first; i < first + nb; i++)
+            if (mPages[i] >= PG_PINNED)
+                break;
+        if (i < first + nb)
+            continue;
+        *cost = alloc_cost(cfg, first, nb);
+        memset(mPages + first, PG_SDB, nb);
+        return first;
+    }
+    *cost = cfg->base_us;
+    return -1;
+}
+
+static void cma_free(uint64_t first, unsigned int order)
+{
+    memset(mPages + first, PG_FREE, 1u << order);
+}
+
+/* activity of the rest of the system between two sessions */
+static void background(const model_cfg_t *cfg)
+{
+    uint32_t i, n, pinned = 0, target = cfg->cma_pages / 1000 * cfg->pinned_pm;
+
+    for (i = 0; i < cfg->cma_pages; i++)
+        pinned += mPages[i] == PG_PINNED;
+
+    /* free some pinned pages, pin small blocks up to the target */
+    for (i = 0; i < cfg->cma_pages; i++)
+        if (mPages[i] == PG_PINNED && rand() % 8 == 0) {
+            mPages[i] = PG_FREE;
+            pinned--;
+        }
+    while (pinned < target) {
+        i = rand() % cfg->cma_pages;
+        for (n = 1u << (rand() % 4); n && i < cfg->cma_pages; n--, i++) {
+            if (mPages[i] == PG_FREE || mPages[i] == PG_MOVABLE) {
+                mPages[i] = PG_PINNED;
+                pinned++;
+            }
+        }
+    }
+    for (i = 0; i < cfg->cma_pages; i++)
+        if (mPages[i] == PG_FREE && (uint32_t)(rand() % 100) < cfg->movable_pct)
+            mPages[i] = PG_MOVABLE;
+}
+
+static int region_alloc(unsigned int order, double *cost)
+{
+    double t = now_ns();
+    int first = rpmsg_sdb_region_alloc(&mRegion, order);
+
+    *cost = (now_ns() - t) / 1000;
+    return first;
+}
+
+static void run(const model_cfg_t *cfg, backend_t bk, int use_pool, model_res_t *res,
+                struct rpmsg_sdb_pool_t *pool)
+{
+    struct rpmsg_sdb_chunk_t *bufs[MAX_BUFS], *chunk;
+    int order = rpmsg_sdb_pool_order(cfg->buf_size), first;
+    uint32_t s, b;
+    double cost;
+
+    memset(mPages, PG_FREE, cfg->cma_pages);
+    rpmsg_sdb_region_init(&mRegion, mRegionBitmap, cfg->region_pages);
+    memset(res, 0, sizeof(*res));
+    memset(pool, 0, sizeof(*pool));
+    pool->max_cached = use_pool ? cfg->pool_max : 0;
+    srand(1);
+
+    for (s = 0; s < cfg->sessions; s++) {
+        background(cfg);
+
+        for (b = 0; b < cfg->nb_bufs; b++) {
+            res->allocs++;
+            chunk = rpmsg_sdb_pool_get(pool, order);
+            cost = 0.1; /* list pop */
+            if (!chunk) {
+                if (bk == BK_REGION)
+                    first = region_alloc(order, &cost);
+                else
+                    first = cma_alloc(cfg, order, &cost);
+                if (first >= 0) {
+                    chunk = calloc(1, sizeof(*chunk));
+                    chunk->order = order;
+                    chunk->paddr = first;
+                    rpmsg_sdb_pool_alloced(pool, chunk);
+                } else {
+                    res->failures++;
+                }
+            }
+            bufs[b] = chunk;
+            res->lat_sum_us += cost;
+            if (cost > res->lat_max_us)
+                res->lat_max_us = cost;
+        }
+
+        for (b = 0; b < cfg->nb_bufs; b++) {
+            if (!bufs[b])
+                continue;
+            chunk = rpmsg_sdb_pool_put(pool, bufs[b]);
+            if (chunk) {
+                if (bk == BK_REGION)
+                    rpmsg_sdb_region_free(&mRegion, chunk->paddr, chunk->order);
+                else
+                    cma_free(chunk->paddr, chunk->order);
+                free(chunk);
+            }
+        }
+    }
+
+    while ((chunk = rpmsg_sdb_pool_drain(pool)))
+        free(chunk);
+}
+
+/* real cost of a get/put pair on a warm pool */
+static double bench_get_put(void)
+{
+    static struct rpmsg_sdb_chunk_t chunks[4];
+    struct rpmsg_sdb_pool_t pool = { .max_cached = SIZE_MAX };
+    struct rpmsg_sdb_chunk_t *c;
+    uint32_t i, loops = 10000000;
+    double t;
+
+    for (i = 0; i < 4; i++) {
+        chunks[i].order = 8;
+        rpmsg_sdb_pool_add(&pool, &chunks[i]);
+    }
+    t = now_ns();
+    for (i = 0; i < loops; i++) {
+        c = rpmsg_sdb_pool_get(&pool, 8);
+        rpmsg_sdb_pool_put(&pool, c);
+    }
+    return (now_ns() - t) / loops;
+}
+
+/* random allocations and frees of 2^0..2^max_order pages in the region */
+static void bench_region(uint32_t nb_pages, unsigned int max_order)
+{
+    static struct { int first; unsigned int order; } live[1024];
+    uint32_t i, n = 0, loops = 1000000, allocs = 0, fails = 0, k;
+    unsigned int order;
+    double t, t_alloc = 0;
+    int first;
+
+    rpmsg_sdb_region_init(&mRegion, mRegionBitmap, nb_pages);
+    srand(2);
+    for (i = 0; i < loops; i++) {
+        if (n && (n == 1024 || rand() % 2)) {
+            k = rand() % n;
+            rpmsg_sdb_region_free(&mRegion, live[k].first, live[k].order);
+            live[k] = live[--n];
+            continue;
+        }
+        order = rand() % (max_order + 1);
+        t = now_ns();
+        first = rpmsg_sdb_region_alloc(&mRegion, order);
+        t_alloc += now_ns() - t;
+        allocs++;
+        if (first < 0) {
+            fails++;
+            continue;
+        }
+        live[n].first = first;
+        live[n].order = order;
+        n++;
+    }
+    printf("region %u pages, orders 0..%u: %.0f ns/alloc, %.1f%% failed\n", nb_pages,
+           max_order, t_alloc / allocs, 100.0 * fails / allocs);
+}
+
+static void print_result(const char *name, const model_res_t *res, const struct rpmsg_sdb_pool_t *pool)
+{
+    printf("%-8s %8llu %8llu %12.1f %12.1f %8llu %8llu %10zuK\n", name,
+           (unsigned long long)res->allocs, (unsigned long long)res->failures,
+           res->allocs ? res->lat_sum_us / res->allocs : 0.0, res->lat_max_us,
+           (unsigned long long)pool->hits, (unsigned long long)pool->misses,
+           pool->high_water >> 10);
+}
+
+static void usage(char *prog)
+{
+    printf("Usage : \n");
+    printf("%s pool [-a <CMA MB>] [-g <region MB>] [-s <sessions>] [-b <buffers>] [-k <buffer KB>] [-p <pinned per mille>] [-m <movable %%>] [-c <pool KB>]\n", prog);
+    printf("  -a: CMA area size (default 64)\n");
+    printf("  -g: reserved region size (default 16)\n");
+    printf("  -s: capture sessions (default 200)\n");
+    printf("  -b, -k: buffers per session and their size (default 3 x 1024)\n");
+    printf("  -p: CMA pages pinned by the rest of the system, per mille (default 2)\n");
+    printf("  -m: free CMA pages used by movable memory (default 50)\n");
+    printf("  -c: pool max cached (default 16384)\n");
+}
+
+int pool_model_main(int argc, char **argv)
+{
+    model_cfg_t cfg = {
+        .cma_pages = 64 << 8, .sessions = 200, .nb_bufs = 3, .buf_size = 1 << 20,
+        .pinned_pm = 2, .movable_pct = 50, .base_us = 20, .zero_us = 1, .migrate_us = 10,
+        .pool_max = 16 << 20, .region_pages = 16 << 8,
+    };
+    struct rpmsg_sdb_pool_t pool;
+    model_res_t res;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "a:g:s:b:k:p:m:c:h")) != -1) {
+        switch (opt) {
+        case 'g':
+            cfg.region_pages = strtoul(optarg, NULL, 0) << 8;
+            break;
+        case 'a':
+            cfg.cma_pages = strtoul(optarg, NULL, 0) << 8;
+            break;
+        case 's':
+            cfg.sessions = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            cfg.nb_bufs = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            cfg.buf_size = strtoul(optarg, NULL, 0) << 10;
+            break;
+        case 'p':
+            cfg.pinned_pm = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            cfg.movable_pct = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            cfg.pool_max = strtoul(optarg, NULL, 0) << 10;
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if (!cfg.cma_pages || !cfg.region_pages || cfg.nb_bufs > MAX_BUFS || cfg.pinned_pm > 900 ||
+        cfg.movable_pct > 100 || rpmsg_sdb_pool_order(cfg.buf_size) < 0) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    mPages = malloc(cfg.cma_pages);
+    mRegionBitmap = malloc(rpmsg_sdb_region_words(cfg.region_pages) * sizeof(uint32_t));
+    if (!mPages || !mRegionBitmap)
+        return -1;
+
+    printf("CMA %u MB, %u sessions of %u x %zu KB, %u/1000 pinned, %u%% movable\n",
+           cfg.cma_pages >> 8, cfg.sessions, cfg.nb_bufs, cfg.buf_size >> 10,
+           cfg.pinned_pm, cfg.movable_pct);
+    printf("alloc cost: %u us + %u us/page + %u us/migrated page\n",
+           cfg.base_us, cfg.zero_us, cfg.migrate_us);
+    printf("          allocs failures lat avg us   lat max us     hits   misses high water\n");
+
+    run(&cfg, BK_CMA, 0, &res, &pool);
+    print_result("CMA", &res, &pool);
+    run(&cfg, BK_CMA, 1, &res, &pool);
+    print_result("pool", &res, &pool);
+    run(&cfg, BK_REGION, 0, &res, &pool);
+    print_result("region", &res, &pool);
+    run(&cfg, BK_REGION, 1, &res, &pool);
+    print_result("pool+reg", &res, &pool);
+
+    printf("pool get+put: %.1f ns\n", bench_get_put());
+    bench_region(cfg.region_pages, 4);
+    bench_region(cfg.region_pages, 8);
+    free(mRegionBitmap);
+    free(mPages);
+    return 0;
+}
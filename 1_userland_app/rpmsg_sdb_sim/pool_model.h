@@ -0,0 +1,11 @@
+/*
+ * pool_model.h
+ * Model of the rpmsg_sdb buffer pool, see pool_model.c.
+ */
+
+#ifndef POOL_MODEL_H
+#define POOL_MODEL_H
+
+int pool_model_main(int argc, char **argv);
+
+#endif /* POOL_MODEL_H */
@@ -0,0 +1,238 @@
+/*
+ * rpmsg_sdb_sim.c
+ * Simulates the eventfd moderation of the rpmsg_sdb driver against a
+ * consumer thread, with a fake clock.
+ *
+ * The copro completes buffers at a fixed rate (with optional jitter).
+ * The driver runs the policy of rpmsg_sdb_moderation.h, the same code as
+ * the kernel module. The consumer sleeps on the eventfd, pays a wakeup
+ * cost, then reads all the pending completions in bulk and spends a
+ * fixed time per buffer. It prints the wakeups per second against the
+ * delivered buffers and the completion to read latency, accounted with
+ * the histograms of the driver (rpmsg_sdb_hist.h).
+ *
+ * "rpmsg_sdb_sim pool ..." runs the model of the buffer pool instead,
+ * see pool_model.c, "rpmsg_sdb_sim clock ..." the model of the correlation
+ * of the CM4 clock, see clock_model.c.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rpmsg_sdb_moderation.h"
+#include "rpmsg_sdb_hist.h"
+#include "pool_model.h"
+#include "clock_model.h"
+
+#define NEVER UINT64_MAX
+#define FIFO_SIZE 4096 /* power of 2 */
+
+typedef struct
+{
+    double rate;        /* buffers per second */
+    double jitter;      /* +/- fraction of the period */
+    uint32_t cost_us;   /* consumer time per buffer */
+    uint32_t wake_us;   /* consumer wakeup time */
+    uint32_t duration_s;
+} sim_cfg_t;
+
+typedef struct
+{
+    uint64_t buffers;
+    uint64_t signals;
+    uint64_t wakeups;
+    uint64_t lost;
+    struct rpmsg_sdb_hist_t lat;
+} sim_res_t;
+
+typedef enum {
+    CONS_SLEEP = 0,
+    CONS_RUN,       /* waking up or processing a batch */
+} cons_state_t;
+
+typedef struct
+{
+    struct rpmsg_sdb_mod_t mod;
+    uint64_t fifo[FIFO_SIZE]; /* completion times */
+    uint32_t head, tail;
+    int efd;
+    cons_state_t cons;
+    uint64_t t_cons, t_timer;
+    const sim_cfg_t *cfg;
+    sim_res_t *res;
+} sim_t;
+
+static void sim_signal(sim_t *s, uint64_t now)
+{
+    s->efd = 1;
+    if (s->cons == CONS_SLEEP) {
+        s->cons = CONS_RUN;
+        s->res->wakeups++;
+        s->t_cons = now + s->cfg->wake_us * 1000ULL;
+    }
+}
+
+static void sim_action(sim_t *s, enum rpmsg_sdb_mod_action act, uint64_t now)
+{
+    if (act == RPMSG_SDB_MOD_SIGNAL)
+        sim_signal(s, now);
+    else if (act == RPMSG_SDB_MOD_DEFER && s->t_timer == NEVER)
+        s->t_timer = rpmsg_sdb_mod_deadline(&s->mod);
+}
+
+/* consumer polled its eventfd: read all the completions or sleep */
+static void sim_consumer(sim_t *s, uint64_t now)
+{
+    uint32_t n = 0;
+    uint64_t lat;
+
+    if (!s->efd) {
+        s->cons = CONS_SLEEP;
+        s->t_cons = NEVER;
+        return;
+    }
+
+    s->efd = 0;
+    while (s->tail != s->head) {
+        lat = now - s->fifo[s->tail++ & (FIFO_SIZE - 1)];
+        rpmsg_sdb_hist_add(&s->res->lat, lat);
+        n++;
+    }
+    rpmsg_sdb_mod_consumed(&s->mod, n);
+    s->res->buffers += n;
+    s->t_cons = now + n * s->cfg->cost_us * 1000ULL;
+}
+
+static void simulate(const sim_cfg_t *cfg, uint32_t count, uint32_t usecs, sim_res_t *res)
+{
+    uint64_t end = cfg->duration_s * 1000000000ULL, period = 1e9 / cfg->rate, t_arr = 0, t;
+    static sim_t s;
+
+    memset(&s, 0, sizeof(s));
+    memset(res, 0, sizeof(*res));
+    rpmsg_sdb_hist_reset(&res->lat);
+    s.mod.count = count;
+    s.mod.usecs = usecs;
+    s.cfg = cfg;
+    s.res = res;
+    s.t_cons = s.t_timer = NEVER;
+    srand(1);
+
+    for (;;) {
+        t = t_arr;
+        if (s.t_timer < t)
+            t = s.t_timer;
+        if (s.t_cons < t)
+            t = s.t_cons;
+        if (t > end)
+            break;
+
+        if (t == s.t_cons) {
+            sim_consumer(&s, t);
+        } else if (t == s.t_timer) {
+            s.t_timer = NEVER;
+            sim_action(&s, rpmsg_sdb_mod_timeout(&s.mod, t), t);
+        } else {
+            if (s.head - s.tail < FIFO_SIZE)
+                s.fifo[s.head++ & (FIFO_SIZE - 1)] = t;
+            else
+                res->lost++;
+            sim_action(&s, rpmsg_sdb_mod_complete(&s.mod, t), t);
+            t_arr += period + (int64_t)(period * cfg->jitter * (2.0 * rand() / RAND_MAX - 1.0));
+        }
+    }
+    res->signals = s.mod.signals;
+}
+
+static void print_result(uint32_t count, uint32_t usecs, const sim_res_t *res, uint32_t duration_s)
+{
+    printf("%5u %6u %10.1f %10.1f %10.1f %10.2f %10.1f %10.1f %10.1f %8llu\n", count, usecs,
+           (double)res->buffers / duration_s, (double)res->signals / duration_s,
+           (double)res->wakeups / duration_s,
+           res->wakeups ? (double)res->buffers / res->wakeups : 0.0,
+           rpmsg_sdb_hist_avg(&res->lat) / 1000.0,
+           rpmsg_sdb_hist_percentile(&res->lat, 990) / 1000.0,
+           res->lat.max_ns / 1000.0, (unsigned long long)res->lost);
+}
+
+static void usage(char *prog)
+{
+    printf("Usage : \n");
+    printf("%s [-r <buffers/s>] [-j <jitter %%>] [-c <us/buffer>] [-w <wakeup us>] [-d <s>] [-n <count> -t <usecs>]\n", prog);
+    printf("  -r: completion rate of the copro (default 2000)\n");
+    printf("  -j: jitter of the completion period in %% (default 20)\n");
+    printf("  -c: consumer time per buffer (default 300)\n");
+    printf("  -w: consumer wakeup time (default 50)\n");
+    printf("  -d: simulated duration (default 10)\n");
+    printf("  -n, -t: moderation count and usecs, default: a set of policies\n");
+    printf("%s pool -h: buffer pool model\n", prog);
+    printf("%s clock -h: CM4 clock correlation model\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t policies[][2] = {
+        {1, 1}, {2, 200}, {4, 500}, {8, 1000}, {16, 2000}, {32, 5000},
+    };
+    sim_cfg_t cfg = { .rate = 2000, .jitter = 0.2, .cost_us = 300, .wake_us = 50, .duration_s = 10 };
+    uint32_t count = 0, usecs = 0, i;
+    sim_res_t res;
+    int opt;
+
+    if (argc > 1 && !strcmp(argv[1], "pool"))
+        return pool_model_main(argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "clock"))
+        return clock_model_main(argc - 1, argv + 1);
+
+    while ((opt = getopt(argc, argv, "r:j:c:w:d:n:t:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            cfg.rate = atof(optarg);
+            break;
+        case 'j':
+            cfg.jitter = atof(optarg) / 100;
+            break;
+        case 'c':
+            cfg.cost_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            cfg.wake_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            cfg.duration_s = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            usecs = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if (cfg.rate <= 0 || !cfg.duration_s || cfg.jitter < 0 || cfg.jitter >= 1) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    printf("%.0f buffers/s, jitter %.0f%%, consumer %u us/buffer, wakeup %u us, %u s\n",
+           cfg.rate, cfg.jitter * 100, cfg.cost_us, cfg.wake_us, cfg.duration_s);
+    printf("count  usecs  buffers/s  signals/s  wakeups/s buf/wakeup lat avg us lat p99 us lat max us     lost\n");
+
+    if (count) {
+        simulate(&cfg, count, usecs ? usecs : 1, &res);
+        print_result(count, usecs ? usecs : 1, &res, cfg.duration_s);
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        simulate(&cfg, policies[i][0], policies[i][1], &res);
+        print_result(policies[i][0], policies[i][1], &res, cfg.duration_s);
+    }
+    return 0;
+}
@@ -0,0 +1,2486 @@
+/*
+ * sdb_cap.c
+ * Reads the capture files recorded by rpmsg_sdb_app (see sdb_capture.h)
+ * and benchmarks the format.
+ *
+ *   sdb_cap info <file>              header and summary
+ *   sdb_cap dump <file> [-s|-t|-n]   records from a sequence or a time
+ *   sdb_cap verify <file>            checks the crc of every record
+ *   sdb_cap bench [-g|-k|-d|-r]      write overhead against a raw stream,
+ *                                    random access and sequential read
+ *   sdb_cap zbench [-m|-k|-d|-w|-z]  compression ratio and CPU cost on
+ *                                    synthetic signals, pool throughput
+ *   sdb_cap pbench [-m|-k|-d|-w|-z]  filter, compression and capture of a
+ *                                    synthetic source through the pipeline
+ *   sdb_cap sbench [-m|-k|-R|-c|-u|-l] live streaming of a synthetic source to
+ *                                    loopback clients, zerocopy and policies
+ *   sdb_cap view <file> [-o|-e|-x]   channels over a range of samples, from
+ *                                    the decimation pyramid of the capture
+ *   sdb_cap vbench [-g|-k|-d]        pyramid build throughput and query
+ *                                    latency on a synthetic logic capture
+ *   sdb_cap trig <file> -T <spec>    triggers of the capture, windows kept
+ *   sdb_cap tbench [-m|-k]           trigger engine throughput and checks on
+ *                                    synthetic logic signals
+ *   sdb_cap decode <file> -P <spec>  UART, SPI or I2C frames of the capture
+ *   sdb_cap dbench [-m|-k]           decoders on golden vectors, throughput
+ *                                    and checks on synthetic buses
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sdb_capture.h"
+#include "sdb_compress.h"
+#include "sdb_pipeline.h"
+#include "sdb_stream.h"
+#include "sdb_pyramid.h"
+#include "sdb_trigger.h"
+#include "sdb_decode.h"
+#include "simd_kernels.h"
+
+static double elapsed_s(uint64_t t0)
+{
+    return (sdb_cap_now_ns(CLOCK_MONOTONIC) - t0) / 1e9;
+}
+
+static int open_reader(sdb_cap_reader_t *r, const char *path)
+{
+    int ret = sdb_cap_reader_open(r, path);
+
+    if (ret)
+        printf("%s: %s\n", path, strerror(-ret));
+    return ret;
+}
+
+static int cmd_info(const char *path)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    uint64_t i, bytes = 0, raw = 0, nb_lz4 = 0, first, last;
+    time_t start;
+    char date[32];
+
+    if (open_reader(&r, path))
+        return -1;
+
+    start = r.hdr.start_real_ns / 1000000000ULL;
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    printf("file: %s, %llu bytes, version %u\n", path, (unsigned long long)r.file_size,
+           r.hdr.version);
+    printf("started: %s\n", date);
+    printf("records: %llu, index: %s\n", (unsigned long long)r.nb_records,
+           r.indexed ? "trailer" : "rebuilt (no valid trailer)");
+
+    for (i = 0; i < r.nb_records; i++) {
+        if (sdb_cap_reader_get(&r, i, &v))
+            break;
+        bytes += v.hdr->size;
+        raw += sdb_comp_raw_size(&v);
+        if (v.hdr->flags & SDB_CAP_REC_LZ4)
+            nb_lz4++;
+    }
+    printf("payload: %llu bytes, %llu raw (ratio %.2f), %llu records compressed\n",
+           (unsigned long long)bytes, (unsigned long long)raw, bytes ? (double)raw / bytes : 1.0,
+           (unsigned long long)nb_lz4);
+    if (r.nb_records) {
+        first = r.idx[0].ts_ns;
+        last = r.idx[r.nb_records - 1].ts_ns;
+        printf("first: %.3f s, last: %.3f s after start, %.1f KB/s\n",
+               (first - r.hdr.start_mono_ns) / 1e9, (last - r.hdr.start_mono_ns) / 1e9,
+               last > first ? raw / 1024.0 / ((last - first) / 1e9) : 0.0);
+    }
+    sdb_cap_reader_close(&r);
+    return 0;
+}
+
+static const char *enc_name(uint16_t flags)
+{
+    static const char *names[] = { "lz4", "lz4d1", "lz4d2", "?", "lz4d4" };
+    int width = (flags & SDB_CAP_REC_DELTA) >> SDB_CAP_REC_DELTA_SHIFT;
+
+    if (!(flags & SDB_CAP_REC_LZ4))
+        return "raw";
+    return width <= 4 ? names[width] : "?";
+}
+
+static int cmd_dump(const char *path, int64_t seq, double t_ms, uint64_t count)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    int64_t i = 0;
+
+    if (open_reader(&r, path))
+        return -1;
+
+    if (seq >= 0)
+        i = sdb_cap_reader_find_seq(&r, seq);
+    else if (t_ms >= 0)
+        i = sdb_cap_reader_find_time(&r, r.hdr.start_mono_ns + (uint64_t)(t_ms * 1e6));
+    if (i < 0) {
+        printf("no such record\n");
+        sdb_cap_reader_close(&r);
+        return -1;
+    }
+
+    printf("     seq       t ms buf       size        raw enc   crc\n");
+    for (; (uint64_t)i < r.nb_records && count--; i++) {
+        if (sdb_cap_reader_get(&r, i, &v))
+            break;
+        printf("%8llu %10.3f %3u %10u %10u %-5s %08x %s\n", (unsigned long long)v.hdr->seq,
+               (v.hdr->ts_ns - r.hdr.start_mono_ns) / 1e6, v.hdr->buffer_id, v.hdr->size,
+               sdb_comp_raw_size(&v), enc_name(v.hdr->flags), v.hdr->crc,
+               sdb_cap_check(&v) ? "ok" : "BAD");
+    }
+    sdb_cap_reader_close(&r);
+    return 0;
+}
+
+static int cmd_verify(const char *path)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    uint64_t i, bad = 0, bytes = 0, t0;
+    uint8_t *buf = NULL;
+    uint32_t raw, max_raw = 0;
+    double t;
+
+    if (open_reader(&r, path))
+        return -1;
+
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < r.nb_records; i++) {
+        if (sdb_cap_reader_get(&r, i, &v)) {
+            printf("record %llu: unreadable\n", (unsigned long long)i);
+            bad++;
+            continue;
+        }
+        raw = sdb_comp_raw_size(&v);
+        bytes += raw;
+        if (!sdb_cap_check(&v)) {
+            printf("record %llu (seq %llu): bad crc\n", (unsigned long long)i,
+                   (unsigned long long)v.hdr->seq);
+            bad++;
+            continue;
+        }
+        if (!(v.hdr->flags & SDB_CAP_REC_LZ4))
+            continue;
+        if (raw > max_raw) {
+            free(buf);
+            buf = malloc(raw);
+            max_raw = buf ? raw : 0;
+        }
+        if (!buf || sdb_comp_decode(&v, buf, max_raw) != (int)raw) {
+            printf("record %llu (seq %llu): cannot decompress\n", (unsigned long long)i,
+                   (unsigned long long)v.hdr->seq);
+            bad++;
+        }
+    }
+    free(buf);
+    t = elapsed_s(t0);
+    printf("%llu records, %llu bad, %.1f MB/s\n", (unsigned long long)r.nb_records,
+           (unsigned long long)bad, t > 0 ? bytes / 1048576.0 / t : 0.0);
+    sdb_cap_reader_close(&r);
+    return bad ? -1 : 0;
+}
+
+/********************************************************************************
+Benchmark
+*********************************************************************************/
+static void fill(uint8_t *buf, uint32_t size, uint64_t seq)
+{
+    uint32_t i, x = (uint32_t)seq * 2654435761u + 1;
+
+    for (i = 0; i < size; i++) {
+        x = x * 1103515245 + 12345;
+        buf[i] = x >> 24;
+    }
+}
+
+static int bench_write(const char *path, int capture, uint64_t total, uint32_t size,
+                       uint8_t *buf)
+{
+    sdb_cap_writer_t w;
+    uint64_t n = total / size, i, t0;
+    FILE *f = NULL;
+    double t;
+
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    if (capture) {
+        if (sdb_cap_writer_open(&w, path))
+            return -1;
+    } else {
+        f = fopen(path, "wb");
+        if (!f)
+            return -1;
+        setvbuf(f, NULL, _IOFBF, 1 << 20);
+    }
+
+    for (i = 0; i < n; i++) {
+        /* the same buffer every time: only the format is measured */
+        memcpy(buf, &i, sizeof(i));
+        if (capture) {
+            if (sdb_cap_writer_append(&w, i & 3, sdb_cap_now_ns(CLOCK_MONOTONIC), buf, size))
+                return -1;
+        } else if (fwrite(buf, 1, size, f) != size) {
+            return -1;
+        }
+    }
+
+    if (capture) {
+        if (sdb_cap_writer_close(&w))
+            return -1;
+    } else {
+        fflush(f);
+        fsync(fileno(f));
+        fclose(f);
+    }
+    t = elapsed_s(t0);
+    printf("%-8s write: %8.1f MB/s, %6.2f us/buffer\n", capture ? "capture" : "raw",
+           n * (double)size / 1048576.0 / t, t * 1e6 / n);
+    return 0;
+}
+
+static int cmd_bench(uint64_t total, uint32_t size, const char *dir, uint32_t nb_reads, int keep)
+{
+    char raw_path[256], cap_path[256];
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    uint8_t *buf;
+    uint64_t i, t0, span, sum = 0;
+    int64_t k;
+    double t;
+
+    buf = malloc(size);
+    if (!buf)
+        return -1;
+    fill(buf, size, 0);
+    snprintf(raw_path, sizeof(raw_path), "%s/sdb_bench.dat", dir);
+    snprintf(cap_path, sizeof(cap_path), "%s/sdb_bench.sdbcap", dir);
+
+    printf("%.2f GB in %u KB buffers, %s\n", total / 1073741824.0, size >> 10, dir);
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < 256; i++)
+        sum += sdb_cap_crc32(0, buf, size);
+    t = elapsed_s(t0);
+    printf("crc32:         %8.1f MB/s\n", 256.0 * size / 1048576.0 / t);
+
+    if (bench_write(raw_path, 0, total, size, buf) ||
+        bench_write(cap_path, 1, total, size, buf)) {
+        printf("write failed: %s\n", strerror(errno));
+        free(buf);
+        return -1;
+    }
+    free(buf);
+
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    if (open_reader(&r, cap_path))
+        return -1;
+    printf("open:          %8.3f ms, %llu records\n", elapsed_s(t0) * 1e3,
+           (unsigned long long)r.nb_records);
+    if (!r.nb_records)
+        goto out;
+
+    srand(1);
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < nb_reads; i++) {
+        if (!sdb_cap_reader_get(&r, ((uint64_t)rand() << 31 | rand()) % r.nb_records, &v))
+            sum += v.data[v.hdr->size / 2];
+    }
+    t = elapsed_s(t0);
+    printf("random get:    %8.2f us/record\n", t * 1e6 / nb_reads);
+
+    span = r.idx[r.nb_records - 1].ts_ns - r.idx[0].ts_ns + 1;
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < nb_reads; i++) {
+        k = sdb_cap_reader_find_time(&r, r.idx[0].ts_ns +
+                                         (uint64_t)((double)rand() / RAND_MAX * span));
+        if (k >= 0 && !sdb_cap_reader_get(&r, k, &v))
+            sum += v.data[0];
+    }
+    t = elapsed_s(t0);
+    printf("random time:   %8.2f us/seek+get\n", t * 1e6 / nb_reads);
+
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < r.nb_records; i++) {
+        if (sdb_cap_reader_get(&r, i, &v) || !sdb_cap_check(&v)) {
+            printf("record %llu is bad\n", (unsigned long long)i);
+            break;
+        }
+    }
+    t = elapsed_s(t0);
+    printf("verify:        %8.1f MB/s\n", r.nb_records * (double)size / 1048576.0 / t);
+
+out:
+    sdb_cap_reader_close(&r);
+    if (!keep) {
+        unlink(raw_path);
+        unlink(cap_path);
+    }
+    /* keeps the reads from being optimized out */
+    return sum == 1 ? 1 : 0;
+}
+
+/********************************************************************************
+Compression benchmark
+*********************************************************************************/
+/* distinct buffers cycled through, generated before the measures */
+#define ZB_BUFFERS  64
+
+typedef void (*gen_fn_t)(uint8_t *buf, uint32_t size, uint32_t k);
+
+static uint32_t mSeed = 1;
+
+static uint32_t rnd(void)
+{
+    mSeed = mSeed * 1103515245 + 12345;
+    return mSeed >> 16;
+}
+
+/* Pattern of LAStateMachine: the whole buffer set to one value */
+static void gen_demo(uint8_t *buf, uint32_t size, uint32_t k)
+{
+    memset(buf, k & 0xff, size);
+}
+
+/* The others are 12-bit samples in 16 bits, as a 12-bit ADC would give */
+static void gen_ramp(uint8_t *buf, uint32_t size, uint32_t k)
+{
+    uint16_t *s = (uint16_t *)buf;
+    uint32_t i, n = size / 2;
+
+    for (i = 0; i < n; i++)
+        s[i] = (k * n + i) & 0xfff;
+}
+
+static void gen_sine_noise(uint8_t *buf, uint32_t size, uint32_t k, int noise)
+{
+    uint16_t *s = (uint16_t *)buf;
+    uint32_t i, n = size / 2;
+    int v;
+
+    for (i = 0; i < n; i++) {
+        v = 2048 + (int)(2000 * sin(2 * M_PI * (k * n + i) / 1000.0));
+        if (noise)
+            v += (int)(rnd() % (2 * noise + 1)) - noise;
+        s[i] = v;
+    }
+}
+
+static void gen_sine(uint8_t *buf, uint32_t size, uint32_t k)
+{
+    gen_sine_noise(buf, size, k, 0);
+}
+
+static void gen_noisy(uint8_t *buf, uint32_t size, uint32_t k)
+{
+    gen_sine_noise(buf, size, k, 8);
+}
+
+static void gen_random(uint8_t *buf, uint32_t size, uint32_t k)
+{
+    fill(buf, size, k);
+}
+
+static const struct
+{
+    const char *name;
+    gen_fn_t gen;
+} mGens[] = {
+    { "demo", gen_demo },
+    { "ramp", gen_ramp },
+    { "sine", gen_sine },
+    { "noisy", gen_noisy },
+    { "random", gen_random },
+};
+
+static void generate(uint8_t *bufs, uint32_t size, gen_fn_t gen)
+{
+    uint32_t k;
+
+    for (k = 0; k < ZB_BUFFERS; k++)
+        gen(bufs + (size_t)k * size, size, k);
+}
+
+/* Ratio, encode CPU and decode speed of one generator, checks the round trip */
+static int zbench_codec(const char *name, const uint8_t *bufs, uint32_t size, int width)
+{
+    uint8_t *tmp = malloc(size), *out = malloc(size), *dec = malloc(size);
+    uint64_t raw = 0, stored = 0, enc_ns = 0, dec_ns = 0, dec_bytes = 0, fallbacks = 0, t0;
+    uint32_t k, n, i, rounds = (16 << 20) / ((uint64_t)ZB_BUFFERS * size);
+    sdb_cap_rec_t hdr;
+    sdb_cap_view_t v = { &hdr, out };
+    const uint8_t *src;
+    uint16_t flags;
+    int bad = 0;
+
+    if (!tmp || !out || !dec) {
+        free(tmp);
+        free(out);
+        free(dec);
+        return -1;
+    }
+    for (i = 0; i < (rounds ? rounds : 1); i++) {
+        for (k = 0; k < ZB_BUFFERS; k++) {
+            src = bufs + (size_t)k * size;
+            t0 = sdb_cap_now_ns(CLOCK_THREAD_CPUTIME_ID);
+            n = sdb_comp_encode(src, size, width, tmp, out, &flags);
+            enc_ns += sdb_cap_now_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+            raw += size;
+            stored += n ? n : size;
+            if (!n) {
+                fallbacks++;
+                continue;
+            }
+
+            hdr.size = n;
+            hdr.flags = flags;
+            t0 = sdb_cap_now_ns(CLOCK_THREAD_CPUTIME_ID);
+            if (sdb_comp_decode(&v, dec, size) != (int)size)
+                bad++;
+            dec_ns += sdb_cap_now_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+            dec_bytes += size;
+            if (memcmp(dec, src, size))
+                bad++;
+        }
+    }
+
+    printf("%-7s %-5s %7.2f %9.2f %9.1f %9.1f %5.0f%% %s\n", name,
+           width ? (width == 1 ? "lz4d1" : width == 2 ? "lz4d2" : "lz4d4") : "lz4",
+           (double)raw / stored, enc_ns / 1e6 / (raw / 1048576.0),
+           raw / 1048576.0 / (enc_ns / 1e9),
+           dec_ns ? dec_bytes / 1048576.0 / (dec_ns / 1e9) : 0.0,
+           100.0 * fallbacks * size / raw, bad ? "MISMATCH" : "");
+    free(tmp);
+    free(out);
+    free(dec);
+    return bad ? -1 : 0;
+}
+
+/* workers < 0: uncompressed writer */
+static int zbench_pool(const char *path, const uint8_t *bufs, uint32_t size, uint64_t total,
+                       int workers, int width)
+{
+    sdb_cap_writer_t w;
+    sdb_comp_pool_t p;
+    uint64_t n = total / size, i, t0, cpu0;
+    int ret;
+    double t, cpu;
+
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    cpu0 = sdb_cap_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    if (sdb_cap_writer_open(&w, path))
+        return -1;
+    if (workers >= 0) {
+        ret = sdb_comp_pool_start(&p, &w, workers, width, size, workers * 4 + 4);
+        if (ret) {
+            printf("pool: %s\n", strerror(-ret));
+            sdb_cap_writer_close(&w);
+            return -1;
+        }
+    }
+
+    for (i = 0, ret = 0; i < n && !ret; i++) {
+        if (workers >= 0)
+            ret = sdb_comp_pool_submit(&p, i & 3, sdb_cap_now_ns(CLOCK_MONOTONIC),
+                                       bufs + (i % ZB_BUFFERS) * size, size);
+        else
+            ret = sdb_cap_writer_append(&w, i & 3, sdb_cap_now_ns(CLOCK_MONOTONIC),
+                                        bufs + (i % ZB_BUFFERS) * size, size);
+    }
+
+    if (workers >= 0)
+        sdb_comp_pool_stop(&p);
+    if (sdb_cap_writer_close(&w) || ret || (workers >= 0 && p.stats.error))
+        return -1;
+    t = elapsed_s(t0);
+    cpu = (sdb_cap_now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu0) / 1e6;
+
+    if (workers < 0)
+        printf("none    %9.1f %9.1f %7.2f %9.2f %9s %7s\n", n * (double)size / 1048576.0 / t,
+               w.bytes / 1048576.0 / t, 1.0, cpu / (n * (double)size / 1048576.0), "-", "-");
+    else
+        printf("%-7d %9.1f %9.1f %7.2f %9.2f %9.2f %7llu\n", workers,
+               n * (double)size / 1048576.0 / t, p.stats.stored_bytes / 1048576.0 / t,
+               (double)p.stats.raw_bytes / p.stats.stored_bytes, cpu / (n * (double)size / 1048576.0),
+               p.stats.cpu_ns / 1e6 / (p.stats.raw_bytes / 1048576.0),
+               (unsigned long long)p.stats.stalls);
+    return 0;
+}
+
+/* Every record of the file decodes to the buffer it was made from */
+static int zbench_check(const char *path, const uint8_t *bufs, uint32_t size)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    uint8_t *dec = malloc(size);
+    uint64_t i, bad = 0;
+
+    if (!dec || open_reader(&r, path)) {
+        free(dec);
+        return -1;
+    }
+    for (i = 0; i < r.nb_records; i++) {
+        if (sdb_cap_reader_get(&r, i, &v) || !sdb_cap_check(&v) ||
+            sdb_comp_decode(&v, dec, size) != (int)size ||
+            memcmp(dec, bufs + (v.hdr->seq % ZB_BUFFERS) * size, size))
+            bad++;
+    }
+    printf("round trip: %llu records, %llu bad\n", (unsigned long long)r.nb_records,
+           (unsigned long long)bad);
+    sdb_cap_reader_close(&r);
+    free(dec);
+    return bad ? -1 : 0;
+}
+
+static int cmd_zbench(uint64_t total, uint32_t size, const char *dir, int max_workers,
+                      int width, int keep)
+{
+    char path[256];
+    uint8_t *bufs;
+    uint32_t g;
+    int workers, ret = 0;
+
+    bufs = malloc((size_t)ZB_BUFFERS * size);
+    if (!bufs)
+        return -1;
+    snprintf(path, sizeof(path), "%s/sdb_zbench.sdbcap", dir);
+
+    printf("codec, %u KB buffers, %s\n", size >> 10, "ms/MB: encode CPU time");
+    printf("signal  enc     ratio     ms/MB  enc MB/s  dec MB/s   raw\n");
+    for (g = 0; g < sizeof(mGens) / sizeof(mGens[0]); g++) {
+        generate(bufs, size, mGens[g].gen);
+        ret |= zbench_codec(mGens[g].name, bufs, size, 0);
+        if (width)
+            ret |= zbench_codec(mGens[g].name, bufs, size, width);
+    }
+
+    generate(bufs, size, gen_noisy);
+    printf("\npool, %.0f MB of noisy in %u KB buffers, delta %d, %s\n", total / 1048576.0,
+           size >> 10, width, dir);
+    printf("workers  in MB/s out MB/s   ratio cpu ms/MB enc ms/MB  stalls\n");
+    ret |= zbench_pool(path, bufs, size, total, -1, width);
+    for (workers = 0; workers <= max_workers; workers = workers ? workers * 2 : 1)
+        ret |= zbench_pool(path, bufs, size, total, workers, width);
+    ret |= zbench_check(path, bufs, size);
+
+    if (!keep)
+        unlink(path);
+    free(bufs);
+    return ret;
+}
+
+/********************************************************************************
+Pipeline benchmark
+*********************************************************************************/
+/* 8-sample moving average of the 16-bit samples, crc of the raw buffer */
+static int pb_filter(void *ctx, sdb_pipe_buf_t *b)
+{
+    const uint16_t *x = (const uint16_t *)b->data;
+    uint16_t *y = (uint16_t *)b->out;
+    uint32_t i, n = b->size / 2;
+    uint8_t *t;
+
+    b->crc = sdb_cap_crc32(0, b->data, b->size);
+    for (i = 0; i < n && i < 7; i++)
+        y[i] = x[i];
+    for (; i < n; i++)
+        y[i] = ((uint32_t)x[i] + x[i - 1] + x[i - 2] + x[i - 3] +
+                x[i - 4] + x[i - 5] + x[i - 6] + x[i - 7]) >> 3;
+    memcpy(b->out + n * 2, b->data + n * 2, b->size & 1);
+
+    /* the result becomes the data, no copy */
+    t = b->data;
+    b->data = b->out;
+    b->out = t;
+    return 0;
+}
+
+static int pb_encode(void *ctx, sdb_pipe_buf_t *b)
+{
+    int *width = ctx;
+
+    b->flags = 0;
+    b->out_size = sdb_comp_encode(b->data, b->size, *width, b->tmp, b->out, &b->flags);
+    return 0;
+}
+
+static int pb_sink(void *ctx, sdb_pipe_buf_t *b)
+{
+    sdb_cap_writer_t *w = ctx;
+
+    return sdb_cap_writer_append_rec(w, b->buffer_id, b->flags, b->ts_ns,
+                                     b->out_size ? b->out : b->data,
+                                     b->out_size ? b->out_size : b->size);
+}
+
+/* threads 0: the three stages one after the other in the source thread */
+static int pbench_run(const char *path, const uint8_t *bufs, uint32_t size, uint64_t total,
+                      int threads, int width)
+{
+    sdb_cap_writer_t w;
+    sdb_pipe_t p;
+    sdb_pipe_buf_t *b, one;
+    uint64_t n = total / size, i, t0;
+    int ret;
+    double t;
+
+    if (sdb_cap_writer_open(&w, path))
+        return -1;
+    if (!threads) {
+        one.cap = size;
+        one.data = malloc(size);
+        one.out = malloc(size);
+        one.tmp = malloc(size);
+        ret = one.data && one.out && one.tmp ? 0 : -ENOMEM;
+        t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        for (i = 0; i < n && !ret; i++) {
+            b = &one;
+            /* the copy out of the rpmsg_sdb mapping */
+            memcpy(b->data, bufs + (i % ZB_BUFFERS) * size, size);
+            b->size = size;
+            b->buffer_id = i & 3;
+            b->ts_ns = sdb_cap_now_ns(CLOCK_MONOTONIC);
+            pb_filter(NULL, b);
+            pb_encode(&width, b);
+            ret = pb_sink(&w, b);
+        }
+        free(one.data);
+        free(one.out);
+        free(one.tmp);
+    } else {
+        ret = sdb_pipe_init(&p, threads * 4 + 4, size);
+        if (!ret)
+            ret = sdb_pipe_add_stage(&p, "filter", pb_filter, NULL, threads, -1, 0, threads * 2);
+        if (!ret)
+            ret = sdb_pipe_add_stage(&p, "encode", pb_encode, &width, threads, -1, 0, threads * 2);
+        if (!ret)
+            ret = sdb_pipe_add_stage(&p, "sink", pb_sink, &w, 1, -1, 1, threads * 2);
+        if (!ret)
+            ret = sdb_pipe_start(&p);
+        if (ret) {
+            printf("pipeline: %s\n", strerror(-ret));
+            sdb_pipe_free(&p);
+            sdb_cap_writer_close(&w);
+            return -1;
+        }
+
+        t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+            b = sdb_pipe_get(&p);
+            memcpy(b->data, bufs + (i % ZB_BUFFERS) * size, size);
+            b->size = size;
+            b->buffer_id = i & 3;
+            b->ts_ns = sdb_cap_now_ns(CLOCK_MONOTONIC);
+            sdb_pipe_put(&p, b);
+        }
+        sdb_pipe_stop(&p);
+        ret = atomic_load(&p.error);
+    }
+    if (sdb_cap_writer_close(&w) || ret) {
+        if (threads)
+            sdb_pipe_free(&p);
+        return -1;
+    }
+    t = elapsed_s(t0);
+
+    if (threads)
+        printf("pipeline, %d thread(s) per stage: ", threads);
+    else
+        printf("serial: ");
+    printf("%.1f MB/s, %.2f us/buffer\n", n * (double)size / 1048576.0 / t, t * 1e6 / n);
+    if (threads) {
+        sdb_pipe_print(&p, stdout, (uint64_t)(t * 1e9));
+        sdb_pipe_free(&p);
+    }
+    return 0;
+}
+
+/* The file holds the filtered buffers in the order of the source */
+static int pbench_check(const char *path, const uint8_t *bufs, uint32_t size)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    sdb_pipe_buf_t ref;
+    uint8_t *dec = malloc(size), *exp = malloc(size * 2);
+    uint64_t i, bad = 0;
+
+    if (!dec || !exp || open_reader(&r, path)) {
+        free(dec);
+        free(exp);
+        return -1;
+    }
+    for (i = 0; i < r.nb_records; i++) {
+        ref.data = exp;
+        ref.out = exp + size;
+        ref.size = size;
+        memcpy(ref.data, bufs + (i % ZB_BUFFERS) * size, size);
+        pb_filter(NULL, &ref);
+        if (sdb_cap_reader_get(&r, i, &v) || v.hdr->seq != i ||
+            sdb_comp_decode(&v, dec, size) != (int)size || memcmp(dec, ref.data, size))
+            bad++;
+    }
+    printf("check: %llu records, %llu bad\n", (unsigned long long)r.nb_records,
+           (unsigned long long)bad);
+    sdb_cap_reader_close(&r);
+    free(dec);
+    free(exp);
+    return bad ? -1 : 0;
+}
+
+static int cmd_pbench(uint64_t total, uint32_t size, const char *dir, int max_threads,
+                      int width, int keep)
+{
+    char path[256];
+    uint8_t *bufs;
+    int threads, ret;
+
+    bufs = malloc((size_t)ZB_BUFFERS * size);
+    if (!bufs)
+        return -1;
+    generate(bufs, size, gen_noisy);
+    snprintf(path, sizeof(path), "%s/sdb_pbench.sdbcap", dir);
+    printf("%.0f MB of noisy in %u KB buffers, delta %d, %ld cpus, %s\n", total / 1048576.0,
+           size >> 10, width, sysconf(_SC_NPROCESSORS_ONLN), dir);
+
+    ret = pbench_run(path, bufs, size, total, 0, width);
+    for (threads = 1; threads <= max_threads && !ret; threads *= 2)
+        ret = pbench_run(path, bufs, size, total, threads, width);
+    if (!ret)
+        ret = pbench_check(path, bufs, size);
+
+    if (!keep)
+        unlink(path);
+    free(bufs);
+    return ret;
+}
+
+/********************************************************************************
+Streaming benchmark
+*********************************************************************************/
+/* buffers of the source, as the rpmsg_sdb mappings */
+#define SB_BUFFERS  8
+#define SB_QUEUE    4
+
+typedef struct
+{
+    int fd;
+    int udp;
+    uint32_t size;
+    uint32_t lag_us;        /* after each buffer: a slow client */
+    volatile int *done;
+    pthread_t tid;
+
+    int64_t last;
+    uint64_t buffers;
+    uint64_t dgrams;
+    uint64_t gaps;
+    uint64_t bad;
+} sb_client_t;
+
+/*
+ * The sequence number of the buffer is written at every datagram offset
+ * and in the last 8 bytes, so that any part sent from a buffer already
+ * reused shows up on the clients
+ */
+static void sb_mark(uint8_t *buf, uint32_t size, uint64_t seq)
+{
+    uint32_t off;
+
+    for (off = 0; off + 8 <= size; off += SDB_STREAM_DGRAM)
+        memcpy(buf + off, &seq, 8);
+    memcpy(buf + size - 8, &seq, 8);
+}
+
+static int sb_check(const uint8_t *buf, uint32_t off, uint32_t len, uint32_t size, uint64_t seq)
+{
+    uint64_t v;
+
+    if (len >= 8) {
+        memcpy(&v, buf, 8);
+        if (v != seq)
+            return -1;
+    }
+    if (off + len == size) {
+        memcpy(&v, buf + len - 8, 8);
+        if (v != seq)
+            return -1;
+    }
+    return 0;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    ssize_t n;
+
+    while (len) {
+        n = recv(fd, p, len, 0);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void sb_seq(sb_client_t *c, uint64_t seq)
+{
+    if (c->last >= 0 && seq <= (uint64_t)c->last) {
+        c->bad++;
+        return;
+    }
+    c->gaps += seq - (c->last + 1);
+    c->last = seq;
+}
+
+static void *sb_tcp_client(void *arg)
+{
+    sb_client_t *c = arg;
+    sdb_stream_hdr_t hdr;
+    uint8_t *buf = malloc(c->size);
+    uint32_t off;
+
+    while (buf && !read_full(c->fd, &hdr, sizeof(hdr))) {
+        if (hdr.magic != SDB_STREAM_MAGIC || hdr.size != c->size ||
+            read_full(c->fd, buf, hdr.size)) {
+            c->bad++;
+            break;
+        }
+        for (off = 0; off < hdr.size; off += SDB_STREAM_DGRAM)
+            if (sb_check(buf + off, off, hdr.size - off < SDB_STREAM_DGRAM ?
+                         hdr.size - off : SDB_STREAM_DGRAM, hdr.size, hdr.seq))
+                break;
+        if (off < hdr.size)
+            c->bad++;
+        sb_seq(c, hdr.seq);
+        c->buffers++;
+        if (c->lag_us)
+            usleep(c->lag_us);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void *sb_udp_client(void *arg)
+{
+    sb_client_t *c = arg;
+    uint8_t dgram[sizeof(sdb_stream_hdr_t) + SDB_STREAM_DGRAM];
+    sdb_stream_hdr_t *hdr = (sdb_stream_hdr_t *)dgram;
+    uint32_t len;
+    ssize_t n;
+
+    for (;;) {
+        n = recv(c->fd, dgram, sizeof(dgram), 0);
+        if (n < 0) {
+            if ((errno == EAGAIN || errno == EINTR) && !*c->done)
+                continue;
+            break;
+        }
+        len = n - sizeof(*hdr);
+        if (n < (ssize_t)sizeof(*hdr) || hdr->magic != SDB_STREAM_MAGIC ||
+            hdr->size != c->size || hdr->offset + len > c->size ||
+            sb_check(dgram + sizeof(*hdr), hdr->offset, len, hdr->size, hdr->seq)) {
+            c->bad++;
+            continue;
+        }
+        c->dgrams++;
+        /* a buffer is counted on its last datagram, the others are lost */
+        if (hdr->offset + len == hdr->size) {
+            sb_seq(c, hdr->seq);
+            c->buffers++;
+            if (c->lag_us)
+                usleep(c->lag_us);
+        }
+    }
+    return NULL;
+}
+
+static int sb_connect(sb_client_t *c, int port, sdb_stream_policy_t policy)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+                                .sin_port = htons(port) };
+    char p = policy == SDB_STREAM_BLOCK ? 'B' : 'L';
+
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        send(c->fd, &p, 1, 0) != 1)
+        return -errno;
+    return 0;
+}
+
+static int sb_bind_udp(sb_client_t *c, sdb_stream_t *s, sdb_stream_policy_t policy)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    struct timeval tv = { 0, 100000 };
+    socklen_t len = sizeof(addr);
+    int rcvbuf = 4 << 20;
+
+    c->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (c->fd < 0)
+        return -errno;
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(c->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        getsockname(c->fd, (struct sockaddr *)&addr, &len))
+        return -errno;
+    return sdb_stream_add_udp(s, "127.0.0.1", ntohs(addr.sin_port), policy);
+}
+
+static int sbench_run(uint32_t size, uint64_t total, double rate, int nb_clients, int udp,
+                      uint32_t lag_us, int zerocopy, sdb_stream_policy_t policy)
+{
+    sdb_stream_t s;
+    sb_client_t clients[SDB_STREAM_MAX_CLIENTS];
+    uint8_t *bufs;
+    int64_t held[SB_BUFFERS], seq;
+    uint64_t i, nb = total / size, t0, t, next, elapsed, stalled = 0;
+    uint64_t period = rate > 0 ? (uint64_t)(size / rate * 1e9) : 0;
+    volatile int done = 0;
+    int k, b, port = 0, ret;
+
+    bufs = malloc((size_t)SB_BUFFERS * size);
+    if (!bufs)
+        return -1;
+    for (b = 0; b < SB_BUFFERS; b++) {
+        gen_noisy(bufs + (size_t)b * size, size, b);
+        held[b] = -1;
+    }
+    memset(clients, 0, sizeof(clients));
+
+    ret = sdb_stream_init(&s, SB_BUFFERS, size, SB_QUEUE, policy, zerocopy);
+    if (!ret && !udp) {
+        port = sdb_stream_listen(&s, 0);
+        ret = port < 0 ? port : 0;
+    }
+    for (k = 0; k < nb_clients && !ret; k++) {
+        clients[k].fd = -1;
+        clients[k].udp = udp;
+        clients[k].size = size;
+        clients[k].lag_us = k == 0 ? lag_us : 0;
+        clients[k].done = &done;
+        clients[k].last = -1;
+        ret = udp ? sb_bind_udp(&clients[k], &s, policy) : sb_connect(&clients[k], port, policy);
+        if (!ret)
+            ret = -pthread_create(&clients[k].tid, NULL, udp ? sb_udp_client : sb_tcp_client,
+                                  &clients[k]);
+        if (ret && clients[k].fd >= 0)
+            close(clients[k].fd);
+    }
+    if (ret) {
+        printf("sbench: %s\n", strerror(-ret));
+        nb_clients = k - 1;
+    }
+    if (!ret)
+        ret = sdb_stream_start(&s);
+    /* the policy byte of every TCP client read before the first buffer */
+    for (i = 0; !ret && i < 200 && sdb_stream_nb_clients(&s) < (uint32_t)nb_clients; i++)
+        usleep(10000);
+    usleep(udp ? 0 : 50000);
+
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    next = t0;
+    for (i = 0; i < nb && !ret; i++) {
+        b = i % SB_BUFFERS;
+        /* as the driver: a buffer is filled again once it has been released */
+        sdb_stream_wait(&s, held[b]);
+        /* the source fills a buffer in period; held too long, it has stalled */
+        t = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        if (period && t > next + period) {
+            stalled += t - next;
+            next = t;
+        }
+        while (next > t) {
+            usleep(100);
+            t = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        }
+        next += period;
+        sb_mark(bufs + (size_t)b * size, size, i);
+        seq = sdb_stream_publish(&s, b, bufs + (size_t)b * size, size, i);
+        if (seq < 0)
+            ret = seq;
+        held[b] = seq;
+    }
+    sdb_stream_drain(&s);
+    elapsed = sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+
+    done = 1;
+    sdb_stream_stop(&s);
+    for (k = 0; k < nb_clients; k++) {
+        pthread_join(clients[k].tid, NULL);
+        close(clients[k].fd);
+    }
+
+    printf("%s, zerocopy %s, %s: %.1f MB/s published, source stalled %.1f ms\n",
+           udp ? "udp" : "tcp", zerocopy ? "on" : "off",
+           policy == SDB_STREAM_BLOCK ? "block" : "latest",
+           nb * (double)size / 1048576.0 / (elapsed / 1e9), stalled / 1e6);
+    sdb_stream_print(&s, stdout, elapsed);
+    for (k = 0; k < nb_clients; k++) {
+        sb_client_t *c = &clients[k];
+
+        printf("  client %d%s: %llu buffers received, %llu gaps, %llu bad", k,
+               c->lag_us ? " (slow)" : "", (unsigned long long)c->buffers,
+               (unsigned long long)c->gaps, (unsigned long long)c->bad);
+        if (udp)
+            printf(", %llu of %llu datagrams", (unsigned long long)c->dgrams,
+                   (unsigned long long)(nb * ((size + SDB_STREAM_DGRAM - 1) / SDB_STREAM_DGRAM)));
+        printf("\n");
+        /* over TCP nothing is lost on the way, every buffer reaches a blocking client */
+        if (c->bad || (!udp && policy == SDB_STREAM_BLOCK && c->buffers != nb)) {
+            printf("check failed\n");
+            ret = -1;
+        }
+    }
+
+    sdb_stream_free(&s);
+    free(bufs);
+    return ret ? -1 : 0;
+}
+
+static int cmd_sbench(uint64_t total, uint32_t size, double rate_mb, int nb_clients, int udp,
+                      uint32_t lag_us)
+{
+    double rate = rate_mb * 1048576.0;
+    int zerocopy, ret = 0;
+
+    printf("%.0f MB in %u KB buffers to %d %s clients over loopback, client 0 %u us late, ",
+           total / 1048576.0, size >> 10, nb_clients, udp ? "udp" : "tcp", lag_us);
+    if (rate > 0)
+        printf("source at %.0f MB/s\n", rate_mb);
+    else
+        printf("source unpaced\n");
+    for (zerocopy = 0; zerocopy <= 1 && !ret; zerocopy++) {
+        ret = sbench_run(size, total, rate, nb_clients, udp, lag_us, zerocopy, SDB_STREAM_BLOCK);
+        if (!ret)
+            ret = sbench_run(size, total, rate, nb_clients, udp, lag_us, zerocopy,
+                             SDB_STREAM_LATEST);
+    }
+    return ret;
+}
+
+/********************************************************************************
+Pyramid view
+*********************************************************************************/
+/*
+ * count samples from first of the capture in out, prev: the sample before
+ * (out[0] for none). Returns 0 or -1
+ */
+static int cap_samples(sdb_cap_reader_t *r, uint64_t first, uint64_t count, uint8_t *out,
+                       uint8_t *prev)
+{
+    sdb_cap_view_t v;
+    uint8_t *buf = NULL, *b;
+    const uint8_t *data;
+    uint64_t i, pos = 0, done = 0, from, len;
+    uint32_t raw, max_raw = 0;
+    int have_prev = 0, ret = -1;
+
+    for (i = 0; i < r->nb_records && done < count; i++) {
+        if (sdb_cap_reader_get(r, i, &v))
+            break;
+        raw = sdb_comp_raw_size(&v);
+        if (pos + raw < first) {
+            pos += raw;
+            continue;
+        }
+        data = v.data;
+        if (v.hdr->flags & SDB_CAP_REC_LZ4) {
+            if (raw > max_raw) {
+                b = realloc(buf, raw);
+                if (!b)
+                    break;
+                buf = b;
+                max_raw = raw;
+            }
+            if (sdb_comp_decode(&v, buf, max_raw) != (int)raw)
+                break;
+            data = buf;
+        }
+        if (first > pos && first - pos <= raw) {
+            *prev = data[first - pos - 1];
+            have_prev = 1;
+        }
+        from = first + done - pos;
+        len = raw - from < count - done ? raw - from : count - done;
+        memcpy(out + done, data + from, len);
+        done += len;
+        pos += raw;
+    }
+    if (done == count) {
+        if (!have_prev)
+            *prev = out[0];
+        ret = 0;
+    }
+    free(buf);
+    return ret;
+}
+
+static uint64_t cap_nb_samples(sdb_cap_reader_t *r)
+{
+    sdb_cap_view_t v;
+    uint64_t i, n = 0;
+
+    for (i = 0; i < r->nb_records && !sdb_cap_reader_get(r, i, &v); i++)
+        n += sdb_comp_raw_size(&v);
+    return n;
+}
+
+/* The pyramid next to the capture, made again when missing or stale */
+static int open_pyramid(sdb_pyr_t *p, const char *path, uint64_t nb_samples)
+{
+    char pyr_path[512];
+    int ret;
+
+    snprintf(pyr_path, sizeof(pyr_path), "%s.pyr", path);
+    if (!sdb_pyr_load(p, pyr_path) && p->nb_samples == nb_samples)
+        return 0;
+    ret = sdb_pyr_build(p, path);
+    if (!ret)
+        ret = sdb_pyr_save(p, pyr_path);
+    if (ret)
+        printf("%s: %s\n", pyr_path, strerror(-ret));
+    else
+        printf("%s: made again from the capture\n", pyr_path);
+    return ret;
+}
+
+/* A row per channel: '-' high, '_' low, 'x' both; edges per pixel in powers of 2 */
+static void print_view(const sdb_pyr_node_t *nodes, uint32_t pixels)
+{
+    uint32_t i, e;
+    int ch, log2;
+
+    for (ch = 7; ch >= 0; ch--) {
+        printf("ch%d ", ch);
+        for (i = 0; i < pixels; i++) {
+            if (nodes[i].and_bits & (1 << ch))
+                putchar('-');
+            else if (!(nodes[i].or_bits & (1 << ch)))
+                putchar('_');
+            else
+                putchar('x');
+        }
+        putchar('\n');
+    }
+    printf("edg ");
+    for (i = 0; i < pixels; i++) {
+        for (e = nodes[i].edges, log2 = 0; e; e >>= 1)
+            log2++;
+        putchar(log2 < 10 ? '0' + log2 : 'a' + log2 - 10);
+    }
+    printf("\nmin ");
+    for (i = 0; i < pixels; i++)
+        putchar("0123456789abcdef"[nodes[i].min >> 4]);
+    printf("\nmax ");
+    for (i = 0; i < pixels; i++)
+        putchar("0123456789abcdef"[nodes[i].max >> 4]);
+    putchar('\n');
+}
+
+static int cmd_view(const char *path, uint64_t first, uint64_t end, uint32_t pixels)
+{
+    sdb_cap_reader_t r;
+    sdb_pyr_t p;
+    sdb_pyr_node_t *nodes = calloc(pixels, sizeof(*nodes));
+    uint8_t *samples, prev;
+    uint64_t nb, t0;
+    int level, ret = -1;
+
+    if (!nodes || open_reader(&r, path)) {
+        free(nodes);
+        return -1;
+    }
+    sdb_pyr_init(&p);
+    nb = cap_nb_samples(&r);
+    if (!end || end > nb)
+        end = nb;
+    if (first >= end || open_pyramid(&p, path, nb))
+        goto out;
+
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    level = sdb_pyr_query(&p, first, end - first, pixels, nodes);
+    if (level == -ERANGE) {
+        /* zoomed in beyond level 0: from the samples */
+        samples = malloc(end - first);
+        if (!samples || cap_samples(&r, first, end - first, samples, &prev)) {
+            free(samples);
+            goto out;
+        }
+        sdb_pyr_summarize(samples, end - first, prev, pixels, nodes);
+        free(samples);
+    } else if (level < 0) {
+        goto out;
+    }
+    printf("samples %llu to %llu of %llu, %llu per pixel, %s %d, %.1f us\n",
+           (unsigned long long)first, (unsigned long long)end, (unsigned long long)nb,
+           (unsigned long long)((end - first) / pixels), level < 0 ? "samples" : "level",
+           level < 0 ? 0 : level, (sdb_cap_now_ns(CLOCK_MONOTONIC) - t0) / 1e3);
+    print_view(nodes, pixels);
+    ret = 0;
+
+out:
+    sdb_pyr_free(&p);
+    sdb_cap_reader_close(&r);
+    free(nodes);
+    return ret;
+}
+
+/********************************************************************************
+Pyramid benchmark
+*********************************************************************************/
+#define VB_PIXELS       1920
+#define VB_QUERIES      10000
+#define VB_CHECKS       200
+#define VB_LIVE_EVERY   256     /* buffers between the queries during the capture */
+
+/*
+ * Logic signals: a 4-bit counter in bursts, three clocks and random data.
+ * x: index of the first sample
+ */
+static void vb_gen(uint8_t *buf, uint32_t size, uint64_t x)
+{
+    uint32_t j;
+    uint64_t s;
+
+    for (j = 0; j < size; j++) {
+        s = x + j;
+        buf[j] = (((s >> 16) % 3 == 0) ? (s >> 3) & 0x0f : 0) |
+                 ((s >> 12) & 1) << 4 | ((s >> 14) & 1) << 5 | ((s >> 20) & 1) << 6 |
+                 (((uint32_t)(s / 37) * 2654435761u) >> 31) << 7;
+    }
+}
+
+static uint64_t rnd64(void)
+{
+    return (uint64_t)rnd() << 48 ^ (uint64_t)rnd() << 32 ^ (uint64_t)rnd() << 16 ^ rnd();
+}
+
+static int vb_same(const sdb_pyr_node_t *a, const sdb_pyr_node_t *b)
+{
+    return a->min == b->min && a->max == b->max && a->and_bits == b->and_bits &&
+           a->or_bits == b->or_bits && a->edges == b->edges;
+}
+
+/* Queries on whole nodes against the samples of the capture */
+static int vbench_check(const char *path, sdb_pyr_t *p)
+{
+    sdb_cap_reader_t r;
+    sdb_pyr_node_t q[64], ref[64];
+    uint64_t span, first, count, bad = 0, i;
+    uint32_t pixels = 64, k;
+    uint8_t *samples, prev;
+    int level;
+
+    if (open_reader(&r, path))
+        return -1;
+    samples = malloc((size_t)pixels * p->base * p->fanout * p->fanout);
+    for (i = 0; samples && i < VB_CHECKS; i++) {
+        level = i % 3;
+        span = p->base;
+        for (k = 0; k < (uint32_t)level; k++)
+            span *= p->fanout;
+        count = pixels * span;
+        if (count > p->nb_samples)
+            break;
+        first = (rnd64() % ((p->nb_samples - count) / span + 1)) * span;
+        if (sdb_pyr_query(p, first, count, pixels, q) != level ||
+            cap_samples(&r, first, count, samples, &prev)) {
+            bad++;
+            continue;
+        }
+        sdb_pyr_summarize(samples, count, prev, pixels, ref);
+        for (k = 0; k < pixels; k++)
+            if (!vb_same(&q[k], &ref[k]))
+                break;
+        if (k < pixels)
+            bad++;
+    }
+    printf("check: %llu queries against the samples, %llu bad\n", (unsigned long long)i,
+           (unsigned long long)bad);
+    free(samples);
+    sdb_cap_reader_close(&r);
+    return !samples || bad ? -1 : 0;
+}
+
+static int cmd_vbench(uint64_t total, uint32_t size, const char *dir, int keep)
+{
+    char path[256], pyr_path[280];
+    sdb_cap_writer_t w;
+    sdb_pyr_t p, p2;
+    sdb_pyr_node_t *nodes = malloc(VB_PIXELS * sizeof(*nodes)), top;
+    simd_summary_u8_t su;
+    sdb_pyr_node_t ref = { 0xff, 0, 0xff, 0, 0 }, n;
+    uint8_t *buf = malloc(size);
+    uint64_t i, nb = total / size, t0, t, t_gen = 0, t_pyr = 0, t_write = 0;
+    uint64_t live_ns = 0, live_max = 0, nb_live = 0, q_ns = 0, q_max = 0, count, first;
+    uint64_t levels[SDB_PYR_MAX_LEVELS] = { 0 }, pyr_bytes = 0;
+    uint8_t prev = 0;
+    uint32_t l;
+    int ret = -1, level;
+
+    snprintf(path, sizeof(path), "%s/sdb_vbench.sdbcap", dir);
+    snprintf(pyr_path, sizeof(pyr_path), "%s.pyr", path);
+    sdb_pyr_init(&p);
+    sdb_pyr_init(&p2);
+    if (!buf || !nodes || sdb_cap_writer_open(&w, path))
+        goto out;
+    printf("%.2f GB of 8 logic channels in %u KB buffers, %s, pixels %u\n",
+           total / 1073741824.0, size >> 10, simd_impl_name(), VB_PIXELS);
+
+    /* capture, the pyramid updated as each buffer completes */
+    for (i = 0; i < nb; i++) {
+        t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        vb_gen(buf, size, i * size);
+        t = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        t_gen += t - t0;
+        if (sdb_pyr_append(&p, buf, size))
+            goto out;
+        t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        t_pyr += t0 - t;
+        if (sdb_cap_writer_append(&w, i, t0, buf, size))
+            goto out;
+        t = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        t_write += t - t0;
+
+        /* reference of the whole capture, scalar */
+        scalar_summary_u8(buf, size, i ? prev : buf[0], &su);
+        n.min = su.min;
+        n.max = su.max;
+        n.and_bits = su.and_bits;
+        n.or_bits = su.or_bits;
+        n.edges = su.edges;
+        sdb_pyr_merge(&ref, &n);
+        prev = buf[size - 1];
+
+        /* a live view of everything captured so far */
+        if (i % VB_LIVE_EVERY == VB_LIVE_EVERY - 1) {
+            t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+            if (sdb_pyr_query(&p, 0, (i + 1) * size, VB_PIXELS, nodes) < 0)
+                goto out;
+            t = sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+            live_ns += t;
+            live_max = t > live_max ? t : live_max;
+            nb_live++;
+        }
+    }
+    if (sdb_cap_writer_close(&w))
+        goto out;
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    if (sdb_pyr_save(&p, pyr_path))
+        goto out;
+    t = sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+    for (l = 0; l < p.nb_levels; l++)
+        pyr_bytes += p.nb_nodes[l] * sizeof(sdb_pyr_node_t);
+    printf("capture:  generate %.2f GB/s, write %.2f GB/s\n", nb * (double)size / t_gen,
+           nb * (double)size / t_write);
+    printf("pyramid:  append %.2f GB/s, %u levels, %.2f MB (%.2f%% of the capture), "
+           "saved in %.1f ms\n", nb * (double)size / t_pyr, p.nb_levels, pyr_bytes / 1048576.0,
+           100.0 * pyr_bytes / (nb * (double)size), t / 1e6);
+    if (nb_live)
+        printf("live:     %llu views of the whole capture, avg %.1f us, max %.1f us\n",
+               (unsigned long long)nb_live, live_ns / 1e3 / nb_live, live_max / 1e3);
+
+    /* as after a capture killed before sdb_pyr_save() */
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    if (sdb_pyr_build(&p2, path))
+        goto out;
+    t = sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+    printf("rebuild:  %.2f GB/s from the capture file\n", nb * (double)size / t);
+    if (sdb_pyr_load(&p2, pyr_path) || p2.nb_levels != p.nb_levels ||
+        p2.nb_samples != p.nb_samples)
+        goto out;
+    for (l = 0; l < p.nb_levels; l++)
+        if (memcmp(p.nodes[l], p2.nodes[l], p.nb_nodes[l] * sizeof(sdb_pyr_node_t)))
+            goto out;
+
+    /* zooms from base samples per pixel to the whole capture, log uniform */
+    for (i = 0; i < VB_QUERIES; i++) {
+        count = (uint64_t)(VB_PIXELS * (double)p.base *
+                           pow((double)p.nb_samples / (VB_PIXELS * (double)p.base),
+                               (rnd() * 65536.0 + rnd()) / 4294967296.0));
+        if (count > p.nb_samples)
+            count = p.nb_samples;
+        first = count < p.nb_samples ?
+                rnd64() % (p.nb_samples - count) : 0;
+        t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        level = sdb_pyr_query(&p, first, count, VB_PIXELS, nodes);
+        t = sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+        if (level < 0)
+            goto out;
+        q_ns += t;
+        q_max = t > q_max ? t : q_max;
+        levels[level]++;
+    }
+    printf("query:    %u random zooms, avg %.1f us, max %.1f us, per level:", VB_QUERIES,
+           q_ns / 1e3 / VB_QUERIES, q_max / 1e3);
+    for (l = 0; l < p.nb_levels; l++)
+        printf(" %llu", (unsigned long long)levels[l]);
+    printf("\n");
+
+    /* the top node is the whole capture */
+    top = p.nodes[p.nb_levels - 1][0];
+    if (!vb_same(&top, &ref)) {
+        printf("check: top node %02x %02x %02x %02x %u, expected %02x %02x %02x %02x %u\n",
+               top.min, top.max, top.and_bits, top.or_bits, top.edges, ref.min, ref.max,
+               ref.and_bits, ref.or_bits, ref.edges);
+        goto out;
+    }
+    ret = vbench_check(path, &p);
+
+out:
+    if (ret)
+        printf("vbench failed\n");
+    sdb_pyr_free(&p);
+    sdb_pyr_free(&p2);
+    free(buf);
+    free(nodes);
+    if (!keep) {
+        unlink(path);
+        unlink(pyr_path);
+    }
+    return ret;
+}
+
+/********************************************************************************
+Triggers
+*********************************************************************************/
+typedef struct
+{
+    uint64_t count;         /* triggers printed at most */
+    uint64_t spans;         /* windows kept */
+    uint64_t span_end;
+} trig_ctx_t;
+
+static void trig_print(void *ctx, uint64_t pos)
+{
+    trig_ctx_t *tc = ctx;
+
+    if (tc->count) {
+        printf("trigger at sample %llu\n", (unsigned long long)pos);
+        tc->count--;
+    }
+}
+
+static int trig_span(void *ctx, uint64_t first, const uint8_t *samples, uint32_t n)
+{
+    trig_ctx_t *tc = ctx;
+
+    if (!tc->spans || first != tc->span_end)
+        tc->spans++;
+    tc->span_end = first + n;
+    return 0;
+}
+
+static int cmd_trig(const char *path, const char *spec, uint64_t count)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    sdb_trig_cond_t c;
+    sdb_trig_t t;
+    trig_ctx_t tc = { count, 0, 0 };
+    uint8_t *buf = NULL, *b;
+    const uint8_t *data;
+    uint32_t raw, max = 0;
+    uint64_t i, t0, scan_ns = 0;
+    int ret;
+
+    ret = spec ? sdb_trig_parse(&c, spec) : -EINVAL;
+    if (!ret)
+        ret = sdb_trig_init(&t, &c, trig_print, trig_span, &tc);
+    if (ret) {
+        printf("bad trigger %s\n", spec ? spec : "");
+        return -1;
+    }
+    if (open_reader(&r, path)) {
+        sdb_trig_free(&t);
+        return -1;
+    }
+    for (i = 0; i < r.nb_records && !ret; i++) {
+        ret = sdb_cap_reader_get(&r, i, &v);
+        if (ret)
+            break;
+        raw = sdb_comp_raw_size(&v);
+        data = v.data;
+        if (v.hdr->flags & SDB_CAP_REC_LZ4) {
+            if (raw > max) {
+                b = realloc(buf, raw);
+                if (!b) {
+                    ret = -ENOMEM;
+                    break;
+                }
+                buf = b;
+                max = raw;
+            }
+            if (sdb_comp_decode(&v, buf, max) != (int)raw) {
+                ret = -EIO;
+                break;
+            }
+            data = buf;
+        }
+        t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        ret = sdb_trig_process(&t, data, raw);
+        scan_ns += sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+    }
+    if (ret)
+        printf("record %llu: %s\n", (unsigned long long)i, strerror(-ret));
+    printf("%llu triggers, %llu windows, %llu of %llu samples kept (%.2f%%), scan %.1f MB/s\n",
+           (unsigned long long)t.triggers, (unsigned long long)tc.spans,
+           (unsigned long long)t.kept_samples, (unsigned long long)t.nb_samples,
+           t.nb_samples ? 100.0 * t.kept_samples / t.nb_samples : 0.0,
+           scan_ns ? t.nb_samples * 1e9 / 1048576.0 / scan_ns : 0.0);
+
+    free(buf);
+    sdb_trig_free(&t);
+    sdb_cap_reader_close(&r);
+    return ret ? -1 : 0;
+}
+
+/********************************************************************************
+Trigger benchmark
+*********************************************************************************/
+#define TB_MAX_TRIGGERS (1 << 20)
+
+static const char *const mTbSpecs[] = {
+    "edge=f2",                  /* start of a burst */
+    "edge=a2,pre=100000,post=5000", /* pre-trigger samples of several buffers */
+    "edge=r0,pattern=0x06/0x02",/* clock rising with data 1 in a burst */
+    "pattern=0x0f/0x0b",
+    "pulse=h3,min=900,max=1000",
+    "glitch=0xff,width=4",
+};
+
+static uint32_t tb_hash(uint64_t x)
+{
+    return (uint32_t)(x * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+/*
+ * An SPI-like bus: clock ch0 (4 samples per level) and data ch1 in bursts
+ * of 8192 samples every 65536 with chip select ch2 low, pulses of 800 to
+ * 1200 samples on ch3 every 4096, glitches of 1 or 2 samples on ch4 once
+ * in 100000, slow clocks on ch5 to ch7
+ */
+static void tb_gen(uint8_t *buf, uint64_t n)
+{
+    uint64_t s, g = ~0ull;
+    uint32_t h = 0, glitch = 0;
+    int burst;
+
+    for (s = 0; s < n; s++) {
+        if (s / 100000 != g) {
+            g = s / 100000;
+            h = tb_hash(g);
+            glitch = h % 99990;
+        }
+        burst = (s & 0xffff) < 8192;
+        buf[s] = (burst ? ((s >> 2) & 1) | (tb_hash(s >> 3) >> 31) << 1 : 1 << 2) |
+                 ((s & 4095) < 800 + tb_hash(s >> 12) % 400) << 3 |
+                 (s % 100000 >= glitch && s % 100000 < glitch + 1 + (h >> 31)) << 4 |
+                 ((s >> 12) & 1) << 5 | ((s >> 15) & 1) << 6 | ((s >> 18) & 1) << 7;
+    }
+}
+
+/* Sample by sample, the triggers of the whole data */
+static uint64_t tb_ref(const sdb_trig_cond_t *c, const uint8_t *s, uint64_t n, uint64_t *trig)
+{
+    uint64_t x, next = 0, nb = 0;
+    int64_t start = -1, last_edge[8];
+    uint8_t prev, e, bit = 1 << c->channel;
+    int hit, ch;
+
+    for (ch = 0; ch < 8; ch++)
+        last_edge[ch] = INT64_MIN / 2;
+    for (x = 0; x < n; x++) {
+        prev = x ? s[x - 1] : s[0];
+        hit = 0;
+        switch (c->type) {
+        case SDB_TRIG_EDGE:
+            hit = (s[x] & c->mask) == c->value &&
+                  ((s[x] & ~prev & c->rise) | (~s[x] & prev & c->fall));
+            break;
+        case SDB_TRIG_PATTERN:
+            hit = (s[x] & c->mask) == c->value && !(x && (prev & c->mask) == c->value);
+            break;
+        case SDB_TRIG_PULSE:
+            if (!((s[x] ^ prev) & bit))
+                break;
+            if (!(s[x] & bit) == !c->high) {
+                start = x;
+                break;
+            }
+            hit = start >= 0 && x - start >= c->min_width &&
+                  (!c->max_width || x - start <= c->max_width);
+            start = -1;
+            break;
+        case SDB_TRIG_GLITCH:
+            e = (s[x] ^ prev) & c->mask;
+            for (ch = 0; ch < 8; ch++) {
+                if (!(e & (1 << ch)))
+                    continue;
+                if ((int64_t)x - last_edge[ch] < c->width)
+                    hit = 1;
+                last_edge[ch] = x;
+            }
+            break;
+        }
+        if (hit && x >= next) {
+            if (nb < TB_MAX_TRIGGERS)
+                trig[nb] = x;
+            nb++;
+            next = x + c->holdoff;
+        }
+    }
+    return nb;
+}
+
+typedef struct
+{
+    const uint8_t *data;
+    uint64_t *trig;
+    uint64_t nb_trig;
+    uint64_t kept_end;      /* end of the samples kept so far */
+    uint64_t *spans;        /* first and end of the windows */
+    uint64_t nb_spans;
+    uint64_t bad;
+} tb_ctx_t;
+
+static void tb_trigger(void *ctx, uint64_t pos)
+{
+    tb_ctx_t *tc = ctx;
+
+    if (tc->nb_trig < TB_MAX_TRIGGERS)
+        tc->trig[tc->nb_trig] = pos;
+    tc->nb_trig++;
+}
+
+static int tb_keep(void *ctx, uint64_t first, const uint8_t *samples, uint32_t n)
+{
+    tb_ctx_t *tc = ctx;
+
+    if (memcmp(samples, tc->data + first, n) || (tc->nb_spans && first < tc->kept_end))
+        tc->bad++;
+    if (!tc->nb_spans || first != tc->kept_end) {
+        if (tc->nb_spans < TB_MAX_TRIGGERS)
+            tc->spans[2 * tc->nb_spans] = first;
+        tc->nb_spans++;
+    }
+    tc->kept_end = first + n;
+    if (tc->nb_spans <= TB_MAX_TRIGGERS)
+        tc->spans[2 * tc->nb_spans - 1] = tc->kept_end;
+    return 0;
+}
+
+/* Triggers and windows against the reference, in buffers of random sizes */
+static int tbench_check(const sdb_trig_cond_t *c, const uint8_t *data, uint64_t total,
+                        uint32_t size, uint64_t *ref, uint64_t *trig, uint64_t *spans)
+{
+    tb_ctx_t tc = { data, trig, 0, 0, spans, 0, 0 };
+    uint64_t nb_ref, i, k, first, end, nb = 0, bad = 0;
+    uint32_t n;
+    sdb_trig_t t;
+
+    nb_ref = tb_ref(c, data, total, ref);
+    if (sdb_trig_init(&t, c, tb_trigger, tb_keep, &tc))
+        return -1;
+    for (i = 0; i < total; i += n) {
+        n = 1 + rnd() % (2 * size);
+        if (rnd() % 8 == 0)
+            n = 1 + rnd() % 40;
+        if (n > total - i)
+            n = total - i;
+        sdb_trig_process(&t, data + i, n);
+    }
+    sdb_trig_free(&t);
+
+    if (tc.nb_trig != nb_ref)
+        bad++;
+    for (i = 0; i < nb_ref && i < tc.nb_trig && i < TB_MAX_TRIGGERS; i++)
+        bad += ref[i] != trig[i];
+    /* the windows of the reference triggers, merged */
+    for (i = 0; i < nb_ref && i < TB_MAX_TRIGGERS; i = k) {
+        first = ref[i] > c->pre ? ref[i] - c->pre : 0;
+        end = ref[i] + c->post;
+        for (k = i + 1; k < nb_ref && k < TB_MAX_TRIGGERS &&
+             (ref[k] > c->pre ? ref[k] - c->pre : 0) <= end; k++)
+            end = ref[k] + c->post;
+        if (end > total)
+            end = total;
+        if (nb < tc.nb_spans && (spans[2 * nb] != first || spans[2 * nb + 1] != end))
+            bad++;
+        nb++;
+    }
+    if (nb_ref <= TB_MAX_TRIGGERS && nb != tc.nb_spans)
+        bad++;
+    bad += tc.bad;
+    if (bad)
+        printf("check: %llu triggers, %llu expected, %llu windows, %llu expected, %llu bad\n",
+               (unsigned long long)tc.nb_trig, (unsigned long long)nb_ref,
+               (unsigned long long)tc.nb_spans, (unsigned long long)nb,
+               (unsigned long long)bad);
+    return bad ? -1 : 0;
+}
+
+static int tbench_run(const sdb_trig_cond_t *c, const uint8_t *data, uint64_t total,
+                      uint32_t size, int scalar, sdb_trig_t *t, uint64_t *ns)
+{
+    uint64_t i, t0;
+    int ret;
+
+    ret = sdb_trig_init(t, c, NULL, NULL, NULL);
+    if (ret)
+        return ret;
+    t->scalar = scalar;
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < total; i += size)
+        sdb_trig_process(t, data + i, total - i < size ? total - i : size);
+    *ns = sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+    sdb_trig_free(t);
+    return 0;
+}
+
+static int cmd_tbench(uint64_t total, uint32_t size)
+{
+    uint8_t *data = malloc(total);
+    uint64_t *ref = malloc(TB_MAX_TRIGGERS * sizeof(uint64_t));
+    uint64_t *trig = malloc(TB_MAX_TRIGGERS * sizeof(uint64_t));
+    uint64_t *spans = malloc(2 * TB_MAX_TRIGGERS * sizeof(uint64_t));
+    sdb_trig_cond_t c;
+    sdb_trig_t t;
+    uint64_t scalar_ns, simd_ns;
+    unsigned int k;
+    int ret = -1;
+
+    if (!data || !ref || !trig || !spans)
+        goto out;
+    tb_gen(data, total);
+    printf("%.0f MB of logic samples in %u KB buffers, %s\n", total / 1048576.0, size >> 10,
+           simd_impl_name());
+    printf("trigger                        scalar GB/s  simd GB/s  triggers   kept\n");
+    for (k = 0; k < sizeof(mTbSpecs) / sizeof(mTbSpecs[0]); k++) {
+        if (sdb_trig_parse(&c, mTbSpecs[k]) ||
+            tbench_run(&c, data, total, size, 1, &t, &scalar_ns) ||
+            tbench_run(&c, data, total, size, 0, &t, &simd_ns))
+            goto out;
+        printf("%-30s %9.2f %10.2f %9llu %5.1f%%\n", mTbSpecs[k], total / (double)scalar_ns,
+               total / (double)simd_ns, (unsigned long long)t.triggers,
+               100.0 * t.kept_samples / total);
+        if (tbench_check(&c, data, total, size, ref, trig, spans))
+            goto out;
+    }
+    printf("check: triggers and windows as sample by sample\n");
+    ret = 0;
+
+out:
+    if (ret)
+        printf("tbench failed\n");
+    free(data);
+    free(ref);
+    free(trig);
+    free(spans);
+    return ret;
+}
+
+/********************************************************************************
+Protocol decoders
+*********************************************************************************/
+typedef struct
+{
+    sdb_dec_t *d;
+    uint64_t count;         /* frames printed at most */
+} dec_ctx_t;
+
+static void dec_print(void *ctx, const sdb_dec_frame_t *f)
+{
+    dec_ctx_t *dc = ctx;
+    char line[SDB_DEC_LINE];
+
+    if (dc->count) {
+        sdb_dec_format(dc->d, f, line, sizeof(line));
+        printf("%s\n", line);
+        dc->count--;
+    }
+}
+
+static int cmd_decode(const char *path, const char *spec, uint64_t count)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    sdb_dec_cfg_t c;
+    sdb_dec_t *d = malloc(sizeof(*d));
+    dec_ctx_t dc = { d, count };
+    uint8_t *buf = NULL, *b;
+    const uint8_t *data;
+    uint32_t raw, max = 0;
+    uint64_t i, t0, dec_ns = 0;
+    int ret;
+
+    if (!d)
+        return -1;
+    ret = spec ? sdb_dec_parse(&c, spec) : -EINVAL;
+    if (!ret)
+        ret = sdb_dec_init(d, &c, dec_print, &dc);
+    if (ret) {
+        printf("bad decoder %s\n", spec ? spec : "");
+        free(d);
+        return -1;
+    }
+    if (open_reader(&r, path)) {
+        free(d);
+        return -1;
+    }
+    for (i = 0; i < r.nb_records && !ret; i++) {
+        ret = sdb_cap_reader_get(&r, i, &v);
+        if (ret)
+            break;
+        raw = sdb_comp_raw_size(&v);
+        data = v.data;
+        if (v.hdr->flags & SDB_CAP_REC_LZ4) {
+            if (raw > max) {
+                b = realloc(buf, raw);
+                if (!b) {
+                    ret = -ENOMEM;
+                    break;
+                }
+                buf = b;
+                max = raw;
+            }
+            if (sdb_comp_decode(&v, buf, max) != (int)raw) {
+                ret = -EIO;
+                break;
+            }
+            data = buf;
+        }
+        t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+        sdb_dec_process(d, data, raw);
+        dec_ns += sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+    }
+    if (ret)
+        printf("record %llu: %s\n", (unsigned long long)i, strerror(-ret));
+    printf("%llu frames, %llu errors, %llu edges of %llu samples, %.0f frames/s, "
+           "%.1f Msamples/s\n", (unsigned long long)d->frames, (unsigned long long)d->errors,
+           (unsigned long long)d->edges, (unsigned long long)d->nb_samples,
+           dec_ns ? d->frames * 1e9 / dec_ns : 0.0, dec_ns ? d->nb_samples * 1e3 / dec_ns : 0.0);
+
+    free(buf);
+    free(d);
+    sdb_cap_reader_close(&r);
+    return ret ? -1 : 0;
+}
+
+/********************************************************************************
+Decoder benchmark
+*********************************************************************************/
+#define DB_MARGIN   32768   /* samples of a transaction of the generators at most */
+#define DB_HALF     2       /* samples of a half clock period, SPI and I2C */
+
+/* Hand made vectors: the samples of channels 0 to 3, the frames decoded */
+typedef struct
+{
+    const char *spec;
+    const char *ch[4];
+    const char *frames;
+} db_golden_t;
+
+static const db_golden_t mDbGolden[] = {
+    /* 'K' (0x4b), 2 samples per bit */
+    { "uart=0,period=2",
+      { "11001111001100001100111" },
+      "2 21 data 0x4b 'K'\n" },
+    /* parity 1 instead of 0, stop bit low */
+    { "uart=0,period=2,parity=e",
+      { "1100111100110000110011001111" },
+      "2 23 data 0x4b 'K' framing error parity error\n" },
+    /* mode 0, 4 bits: 0xa/0x3, then 2 bits cut by the chip select */
+    { "spi=0/1/2/3,bits=4",
+      { "00101010100010100", "01100110000111100", "00000111100001100", "10000000001000001" },
+      "2 8 data 0x0a/0x03\n12 14 data 0x03/0x01 partial\n" },
+    /* address 0x50 write, 0x5a not acknowledged */
+    { "i2c=0/1",
+      { "110010101010101010101010101010101010101011", "100110011000000000000001100111100110011001" },
+      "1 1 start\n4 20 addr 0x50 write\n22 38 data 0x5a nack\n41 41 stop\n" },
+};
+
+typedef struct
+{
+    sdb_dec_t *d;
+    char text[1024];
+    size_t len;
+} db_text_t;
+
+static void db_append(void *ctx, const sdb_dec_frame_t *f)
+{
+    db_text_t *t = ctx;
+    char line[SDB_DEC_LINE];
+    int n = sdb_dec_format(t->d, f, line, sizeof(line));
+
+    if (t->len + n + 2 <= sizeof(t->text))
+        t->len += sprintf(t->text + t->len, "%s\n", line);
+}
+
+/* Each vector at once, sample by sample, by 3 samples */
+static int db_golden(sdb_dec_t *d)
+{
+    static const uint32_t steps[] = { 0, 1, 3 };
+    const db_golden_t *g;
+    db_text_t t;
+    sdb_dec_cfg_t c;
+    uint8_t s[64];
+    uint32_t k, n, i, j, step;
+    int bad = 0;
+
+    for (k = 0; k < sizeof(mDbGolden) / sizeof(mDbGolden[0]); k++) {
+        g = &mDbGolden[k];
+        n = strlen(g->ch[0]);
+        memset(s, 0, sizeof(s));
+        for (j = 0; j < 4; j++)
+            for (i = 0; g->ch[j] && i < n; i++)
+                s[i] |= (g->ch[j][i] == '1') << j;
+        for (j = 0; j < sizeof(steps) / sizeof(steps[0]); j++) {
+            if (sdb_dec_parse(&c, g->spec) || sdb_dec_init(d, &c, db_append, &t))
+                return -1;
+            t.d = d;
+            t.len = 0;
+            t.text[0] = 0;
+            step = steps[j] ? steps[j] : n;
+            for (i = 0; i < n; i += step)
+                sdb_dec_process(d, s + i, n - i < step ? n - i : step);
+            if (strcmp(t.text, g->frames)) {
+                printf("golden %s by %u: got\n%sexpected\n%s", g->spec, step, t.text, g->frames);
+                bad++;
+            }
+        }
+    }
+    return bad ? -1 : 0;
+}
+
+static const char *const mDbSpecs[] = {
+    "uart=0,period=8.68,parity=e",  /* 11.52 Mbaud at 100 MS/s */
+    "uart=0,period=868,bits=7,stop=2", /* 115200 baud: mostly idle */
+    "spi=0/1/2/3",
+    "spi=0/1/2/3,mode=1,bits=16",
+    "spi=0/1/-/3,mode=2,lsb=1",
+    "spi=0/1/2/-,mode=3",
+    "i2c=0/1",
+};
+
+typedef struct
+{
+    uint8_t *buf;
+    uint64_t n;
+    uint64_t x;             /* next sample */
+    sdb_dec_frame_t *frames;
+    uint64_t nb_frames;
+} db_gen_t;
+
+/* count samples of the channels v, noise on the channels 4 to 7 */
+static void db_put(db_gen_t *g, uint8_t v, uint64_t count)
+{
+    for (; count && g->x < g->n; count--, g->x++)
+        g->buf[g->x] = v | (tb_hash(g->x >> 6) & 0xf0);
+}
+
+static void db_frame(db_gen_t *g, uint64_t start, uint64_t end, uint8_t type, uint8_t flags,
+                     uint16_t data, uint16_t data2)
+{
+    sdb_dec_frame_t *f = &g->frames[g->nb_frames++];
+
+    memset(f, 0, sizeof(*f));
+    f->start = start;
+    f->end = end;
+    f->type = type;
+    f->flags = flags;
+    f->data = data;
+    f->data2 = data2;
+}
+
+/* Characters after 1 to 3 bits idle, a parity or a stop bit wrong once in 64 */
+static void db_gen_uart(db_gen_t *g, const sdb_dec_cfg_t *c)
+{
+    uint8_t rx = 1 << c->ch[0];
+    uint32_t par = c->parity != 'n', nb = 1 + c->bits + par + c->stop, k, data, bit, flags;
+    double p = c->period_q8 / 256.0;
+    uint64_t x0;
+
+    while (g->x + DB_MARGIN < g->n) {
+        db_put(g, rx, p + rnd() % (uint32_t)(2 * p));
+        x0 = g->x;
+        data = rnd() & ((1 << c->bits) - 1);
+        flags = 0;
+        if (par && rnd() % 64 == 0)
+            flags |= SDB_DEC_PARITY;
+        if (rnd() % 64 == 0)
+            flags |= SDB_DEC_FRAMING;
+        for (k = 0; k < nb; k++) {
+            if (k == 0)
+                bit = 0;
+            else if (k <= c->bits)
+                bit = data >> (k - 1) & 1;
+            else if (par && k == c->bits + 1)
+                bit = ((__builtin_popcount(data) + (c->parity == 'o')) & 1) ^
+                      !!(flags & SDB_DEC_PARITY);
+            else
+                bit = !((flags & SDB_DEC_FRAMING) && k == nb - c->stop);
+            db_put(g, bit ? rx : 0, x0 + llround((k + 1) * p) - g->x);
+        }
+        /* read in the middle of the last stop bit */
+        db_frame(g, x0, (x0 * 256 + c->period_q8 / 2 + (uint64_t)(nb - 1) * c->period_q8) >> 8,
+                 SDB_DEC_DATA, flags, data, 0);
+    }
+    db_put(g, rx, g->n - g->x);
+}
+
+/* Bursts of 1 to 8 words, the last one cut once in 16 when there is a chip select */
+static void db_gen_spi(db_gen_t *g, const sdb_dec_cfg_t *c)
+{
+    uint8_t clk = 1 << c->ch[0], mosi = 1 << c->ch[1];
+    uint8_t miso = c->ch[2] != SDB_DEC_NONE ? 1 << c->ch[2] : 0;
+    uint8_t cs = c->ch[3] != SDB_DEC_NONE ? 1 << c->ch[3] : 0;
+    uint8_t idle = c->mode & 2 ? clk : 0, v;
+    uint32_t words, w, k, i, nbits, d1, d2, mask = (1 << c->bits) - 1, flags;
+    uint64_t start = 0, end = 0;
+
+    while (g->x + DB_MARGIN < g->n) {
+        db_put(g, idle | cs, 1 + rnd() % 20);
+        db_put(g, idle, DB_HALF);
+        words = 1 + rnd() % 8;
+        for (w = 0; w < words; w++) {
+            d1 = (rnd() << 16 | rnd()) & mask;
+            d2 = miso ? (rnd() << 16 | rnd()) & mask : 0;
+            nbits = c->bits;
+            flags = 0;
+            if (cs && c->bits > 1 && w == words - 1 && rnd() % 16 == 0) {
+                nbits = 1 + rnd() % (c->bits - 1);
+                flags = SDB_DEC_PARTIAL;
+            }
+            /* the sampling edge in the middle of each bit, leading (CPHA 0) or trailing */
+            for (k = 0; k < nbits; k++) {
+                i = c->lsb ? k : c->bits - 1 - k;
+                v = (d1 >> i & 1 ? mosi : 0) | (d2 >> i & 1 ? miso : 0);
+                db_put(g, v | (c->mode & 1 ? idle ^ clk : idle), DB_HALF);
+                if (!k)
+                    start = g->x;
+                end = g->x;
+                db_put(g, v | (c->mode & 1 ? idle : idle ^ clk), DB_HALF);
+            }
+            if (nbits < c->bits) {
+                d1 = c->lsb ? d1 & ((1 << nbits) - 1) : d1 >> (c->bits - nbits);
+                d2 = c->lsb ? d2 & ((1 << nbits) - 1) : d2 >> (c->bits - nbits);
+            }
+            db_frame(g, start, end, SDB_DEC_DATA, flags, d1, d2);
+            if (flags)
+                break;
+        }
+        db_put(g, idle, DB_HALF);
+    }
+    db_put(g, idle | cs, g->n - g->x);
+}
+
+/* SCL falls, SDA follows, SCL high for 2 half periods: returns the rise */
+static uint64_t db_i2c_bit(db_gen_t *g, const sdb_dec_cfg_t *c, uint8_t *sda, int b)
+{
+    uint8_t scl = 1 << c->ch[0], v = b ? 1 << c->ch[1] : 0;
+    uint64_t rise;
+
+    db_put(g, *sda, 1);
+    db_put(g, v, DB_HALF - 1);
+    rise = g->x;
+    db_put(g, scl | v, 2 * DB_HALF);
+    *sda = v;
+    return rise;
+}
+
+/* Byte and acknowledge bit, NACK once in 8 */
+static void db_i2c_byte(db_gen_t *g, const sdb_dec_cfg_t *c, uint8_t *sda, uint8_t type,
+                        uint32_t value)
+{
+    uint64_t start = 0, end;
+    uint32_t k, nack = rnd() % 8 == 0;
+
+    for (k = 0; k < 8; k++) {
+        end = db_i2c_bit(g, c, sda, value >> (7 - k) & 1);
+        if (!k)
+            start = end;
+    }
+    end = db_i2c_bit(g, c, sda, nack);
+    if (type == SDB_DEC_ADDR)
+        db_frame(g, start, end, type, (nack ? SDB_DEC_NACK : 0) | (value & 1 ? SDB_DEC_READ : 0),
+                 value >> 1, 0);
+    else
+        db_frame(g, start, end, type, nack ? SDB_DEC_NACK : 0, value, 0);
+}
+
+/* Transactions of an address and 0 to 6 bytes, a repeated start once in 8 */
+static void db_gen_i2c(db_gen_t *g, const sdb_dec_cfg_t *c)
+{
+    uint8_t scl = 1 << c->ch[0], sda_bit = 1 << c->ch[1], sda;
+    uint32_t k, nb, restart;
+
+    while (g->x + DB_MARGIN < g->n) {
+        db_put(g, scl | sda_bit, 1 + rnd() % 16);
+        db_frame(g, g->x, g->x, SDB_DEC_START, 0, 0, 0);
+        db_put(g, scl, DB_HALF);
+        sda = 0;
+        do {
+            db_i2c_byte(g, c, &sda, SDB_DEC_ADDR, rnd() & 0xff);
+            nb = rnd() % 7;
+            for (k = 0; k < nb; k++)
+                db_i2c_byte(g, c, &sda, SDB_DEC_DATA, rnd() & 0xff);
+            restart = rnd() % 8 == 0;
+            if (restart) {
+                db_i2c_bit(g, c, &sda, 1);
+                db_frame(g, g->x, g->x, SDB_DEC_START, SDB_DEC_RESTART, 0, 0);
+                db_put(g, scl, DB_HALF);
+                sda = 0;
+            }
+        } while (restart);
+        db_i2c_bit(g, c, &sda, 0);
+        db_frame(g, g->x, g->x, SDB_DEC_STOP, 0, 0, 0);
+        db_put(g, scl | sda_bit, 1);
+    }
+    db_put(g, scl | sda_bit, g->n - g->x);
+}
+
+/* Signals of the config and their frames */
+static void db_gen(db_gen_t *g, const sdb_dec_cfg_t *c)
+{
+    g->x = 0;
+    g->nb_frames = 0;
+    if (c->proto == SDB_DEC_UART)
+        db_gen_uart(g, c);
+    else if (c->proto == SDB_DEC_SPI)
+        db_gen_spi(g, c);
+    else
+        db_gen_i2c(g, c);
+}
+
+typedef struct
+{
+    const sdb_dec_frame_t *ref;
+    uint64_t nb_ref;
+    uint64_t nb;
+    uint64_t bad;
+} db_ctx_t;
+
+static void db_check_frame(void *ctx, const sdb_dec_frame_t *f)
+{
+    db_ctx_t *dc = ctx;
+    const sdb_dec_frame_t *r = &dc->ref[dc->nb];
+
+    if (dc->nb >= dc->nb_ref || f->start != r->start || f->end != r->end ||
+        f->type != r->type || f->flags != r->flags || f->data != r->data ||
+        f->data2 != r->data2) {
+        if (dc->bad++ < 4)
+            printf("frame %llu: %llu %llu type %u flags 0x%02x 0x%x/0x%x\n",
+                   (unsigned long long)dc->nb, (unsigned long long)f->start,
+                   (unsigned long long)f->end, f->type, f->flags, f->data, f->data2);
+    }
+    dc->nb++;
+}
+
+/* Frames against the generated ones, in buffers of random sizes */
+static int dbench_check(const sdb_dec_cfg_t *c, const db_gen_t *g, uint32_t size, sdb_dec_t *d)
+{
+    db_ctx_t dc = { g->frames, g->nb_frames, 0, 0 };
+    uint64_t i;
+    uint32_t n;
+
+    if (sdb_dec_init(d, c, db_check_frame, &dc))
+        return -1;
+    for (i = 0; i < g->n; i += n) {
+        n = 1 + rnd() % (2 * size);
+        if (rnd() % 8 == 0)
+            n = 1 + rnd() % 40;
+        if (n > g->n - i)
+            n = g->n - i;
+        sdb_dec_process(d, g->buf + i, n);
+    }
+    if (dc.nb != dc.nb_ref || dc.bad) {
+        printf("check: %llu frames, %llu expected, %llu bad\n", (unsigned long long)dc.nb,
+               (unsigned long long)dc.nb_ref, (unsigned long long)dc.bad);
+        return -1;
+    }
+    return 0;
+}
+
+static int dbench_run(const sdb_dec_cfg_t *c, const uint8_t *data, uint64_t total,
+                      uint32_t size, int scalar, sdb_dec_t *d, uint64_t *ns)
+{
+    uint64_t i, t0;
+    int ret;
+
+    ret = sdb_dec_init(d, c, NULL, NULL);
+    if (ret)
+        return ret;
+    d->scalar = scalar;
+    t0 = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < total; i += size)
+        sdb_dec_process(d, data + i, total - i < size ? total - i : size);
+    *ns = sdb_cap_now_ns(CLOCK_MONOTONIC) - t0;
+    return 0;
+}
+
+static int cmd_dbench(uint64_t total, uint32_t size)
+{
+    db_gen_t g = { malloc(total), total, 0, NULL, 0 };
+    sdb_dec_t *d = malloc(sizeof(*d));
+    sdb_dec_cfg_t c;
+    uint64_t scalar_ns, simd_ns;
+    unsigned int k;
+    int ret = -1;
+
+    /* a frame every 32 samples at most: an 8 bit SPI word */
+    g.frames = malloc((total / 32 + 1) * sizeof(sdb_dec_frame_t));
+    if (!g.buf || !g.frames || !d || total < 2 * DB_MARGIN)
+        goto out;
+    if (db_golden(d))
+        goto out;
+    printf("golden vectors decoded\n");
+    printf("%.0f MB of logic samples in %u KB buffers, %s\n", total / 1048576.0, size >> 10,
+           simd_impl_name());
+    printf("decoder                             frames  edge"
+           "s/sample  scalar MS/s  frames/s  simd MS/s  frames/s\n");
+    for (k = 0; k < sizeof(mDbSpecs) / sizeof(mDbSpecs[0]); k++) {
+        if (sdb_dec_parse(&c, mDbSpecs[k]))
+            goto out;
+        db_gen(&g, &c);
+        if (dbench_run(&c, g.buf, total, size, 1, d, &scalar_ns) ||
+            dbench_run(&c, g.buf, total, size, 0, d, &simd_ns))
+            goto out;
+        printf("%-32s %9llu %13.3f %12.1f %9.3g %10.1f %9.3g\n", mDbSpecs[k],
+               (unsigned long long)d->frames, (double)d->edges / total,
+               total * 1e3 / scalar_ns, d->frames * 1e9 / scalar_ns,
+               total * 1e3 / simd_ns, d->frames * 1e9 / simd_ns);
+        if (dbench_check(&c, &g, size, d))
+            goto out;
+    }
+    printf("check: frames as generated, in buffers of random sizes\n");
+    ret = 0;
+
+out:
+    if (ret)
+        printf("dbench failed\n");
+    free(g.buf);
+    free(g.frames);
+    free(d);
+    return ret;
+}
+
+static void usage(char *prog)
+{
+    printf("Usage : \n");
+    printf("%s info <file>\n", prog);
+    printf("%s dump <file> [-s <seq> | -t <ms>] [-n <count>]\n", prog);
+    printf("  -s: first record of sequence number seq\n");
+    printf("  -t: first record at or after ms from the start\n");
+    printf("  -n: number of records (default 20)\n");
+    printf("%s verify <file>\n", prog);
+    printf("%s bench [-g <GB>] [-k <KB>] [-d <dir>] [-r <reads>] [-K]\n", prog);
+    printf("  -g: size written (default 1)\n");
+    printf("  -k: buffer size (default 4)\n");
+    printf("  -d: directory of the files (default .)\n");
+    printf("  -r: random reads (default 100000)\n");
+    printf("  -K: keep the files\n");
+    printf("%s zbench [-m <MB>] [-k <KB>] [-d <dir>] [-w <workers>] [-z <width>] [-K]\n", prog);
+    printf("  -m: size written through the pool (default 256)\n");
+    printf("  -w: most workers tried, doubling from 0 (inline) (default 4)\n");
+    printf("  -z: delta sample bytes 0, 1, 2 or 4 (default 2)\n");
+    printf("%s pbench [-m <MB>] [-k <KB>] [-d <dir>] [-w <threads>] [-z <width>] [-K]\n", prog);
+    printf("  -w: most threads per parallel stage, doubling from 1 (default 4)\n");
+    printf("%s sbench [-m <MB>] [-k <KB>] [-R <MB/s>] [-c <clients>] [-u] [-l <us>]\n", prog);
+    printf("  -k: buffer size (default 64)\n");
+    printf("  -R: rate of the source, 0: as fast as the clients (default 0)\n");
+    printf("  -c: clients (default 4)\n");
+    printf("  -u: udp clients instead of tcp\n");
+    printf("  -l: delay of client 0 after each buffer (default 200)\n");
+    printf("%s view <file> [-o <first>] [-e <end>] [-x <pixels>]\n", prog);
+    printf("  -o, -e: range of samples (default the whole capture)\n");
+    printf("  -x: columns (default 100)\n");
+    printf("%s vbench [-g <GB>] [-k <KB>] [-d <dir>] [-K]\n", prog);
+    printf("  -g: size of the capture (default 1)\n");
+    printf("  -k: buffer size (default 64)\n");
+    printf("%s trig <file> -T <spec> [-n <count>]\n", prog);
+    printf("  -T: trigger, see sdb_trigger.h, e.g. edge=r0,pattern=0x04/0,pre=256,post=4096\n");
+    printf("  -n: triggers printed (default 20)\n");
+    printf("%s tbench [-m <MB>] [-k <KB>]\n", prog);
+    printf("  -m: size of the signals (default 256)\n");
+    printf("  -k: buffer size (default 64)\n");
+    printf("%s decode <file> -P <spec> [-n <count>]\n", prog);
+    printf("  -P: decoder, see sdb_decode.h, e.g. uart=0,period=868 or spi=0/1/2/3,mode=3\n");
+    printf("  -n: frames printed (default 20)\n");
+    printf("%s dbench [-m <MB>] [-k <KB>]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    double gb = 1, mb = 256, t_ms = -1, rate_mb = 0;
+    uint32_t kb = 0, nb_reads = 100000, lag_us = 200, pixels = 100;
+    uint64_t count = 20, first = 0, end = 0;
+    int64_t seq = -1;
+    const char *dir = ".", *spec = NULL, *dec_spec = NULL;
+    char *cmd;
+    int opt, keep = 0, workers = 4, width = 2, nb_clients = 4, udp = 0;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return -1;
+    }
+    cmd = argv[1];
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+
+    while ((opt = getopt(argc, argv, "s:t:n:g:m:k:d:r:w:z:R:c:ul:o:e:x:T:P:Kh")) != -1) {
+        switch (opt) {
+        case 's':
+            seq = strtoll(optarg, NULL, 0);
+            break;
+        case 't':
+            t_ms = atof(optarg);
+            break;
+        case 'n':
+            count = strtoull(optarg, NULL, 0);
+            break;
+        case 'g':
+            gb = atof(optarg);
+            break;
+        case 'm':
+            mb = atof(optarg);
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            break;
+        case 'z':
+            width = atoi(optarg);
+            break;
+        case 'k':
+            kb = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'r':
+            nb_reads = strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            rate_mb = atof(optarg);
+            break;
+        case 'c':
+            nb_clients = atoi(optarg);
+            break;
+        case 'u':
+            udp = 1;
+            break;
+        case 'l':
+            lag_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            first = strtoull(optarg, NULL, 0);
+            break;
+        case 'e':
+            end = strtoull(optarg, NULL, 0);
+            break;
+        case 'x':
+            pixels = strtoul(optarg, NULL, 0);
+            break;
+        case 'T':
+            spec = optarg;
+            break;
+        case 'P':
+            dec_spec = optarg;
+            break;
+        case 'K':
+            keep = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (!strcmp(cmd, "sbench")) {
+        if (mb <= 0 || rate_mb < 0 || nb_clients < 1 || nb_clients > SDB_STREAM_MAX_CLIENTS) {
+            usage(argv[0]);
+            return -1;
+        }
+        return cmd_sbench((uint64_t)(mb * 1048576.0), (kb ? kb : 64) << 10, rate_mb, nb_clients,
+                          udp, lag_us);
+    }
+    if (!strcmp(cmd, "vbench")) {
+        if (gb <= 0) {
+            usage(argv[0]);
+            return -1;
+        }
+        return cmd_vbench((uint64_t)(gb * 1073741824.0), (kb ? kb : 64) << 10, dir, keep);
+    }
+    if (!strcmp(cmd, "tbench")) {
+        if (mb <= 0) {
+            usage(argv[0]);
+            return -1;
+        }
+        return cmd_tbench((uint64_t)(mb * 1048576.0), (kb ? kb : 64) << 10);
+    }
+    if (!strcmp(cmd, "dbench")) {
+        if (mb <= 0) {
+            usage(argv[0]);
+            return -1;
+        }
+        return cmd_dbench((uint64_t)(mb * 1048576.0), (kb ? kb : 64) << 10);
+    }
+    if (!kb)
+        kb = 4;
+    if (!strcmp(cmd, "bench")) {
+        if (gb <= 0 || !kb || !nb_reads) {
+            usage(argv[0]);
+            return -1;
+        }
+        return cmd_bench((uint64_t)(gb * 1073741824.0), kb << 10, dir, nb_reads, keep);
+    }
+    if (!strcmp(cmd, "zbench") || !strcmp(cmd, "pbench")) {
+        if (mb <= 0 || !kb || workers < 0 || (width != 0 && width != 1 && width != 2 &&
+                                              width != 4)) {
+            usage(argv[0]);
+            return -1;
+        }
+        if (cmd[0] == 'p')
+            return cmd_pbench((uint64_t)(mb * 1048576.0), kb << 10, dir, workers, width, keep);
+        return cmd_zbench((uint64_t)(mb * 1048576.0), kb << 10, dir, workers, width, keep);
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (!strcmp(cmd, "info"))
+        return cmd_info(argv[optind]);
+    if (!strcmp(cmd, "dump"))
+        return cmd_dump(argv[optind], seq, t_ms, count);
+    if (!strcmp(cmd, "verify"))
+        return cmd_verify(argv[optind]);
+    if (!strcmp(cmd, "view")) {
+        if (!pixels) {
+            usage(argv[0]);
+            return -1;
+        }
+        return cmd_view(argv[optind], first, end, pixels);
+    }
+    if (!strcmp(cmd, "trig"))
+        return cmd_trig(argv[optind], spec, count);
+    if (!strcmp(cmd, "decode"))
+        return cmd_decode(argv[optind], dec_spec, count);
+
+    usage(argv[0]);
+    return -1;
+}
@@ -0,0 +1,403 @@
+/*
+ * sdb_capture.c
+ * Writer and memory-mapped reader of the capture files, see sdb_capture.h.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sdb_capture.h"
+
+#define WRITE_BUF_SIZE  (1 << 20)
+#define IDX_MIN         4096
+/* window mapped at once when the file does not fit in the address space */
+#define MAP_WINDOW      (256 << 20)
+
+static uint32_t mCrcTab[8][256];
+static int mCrcInit;
+
+static void crc32_init(void)
+{
+    uint32_t i, j, c;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++)
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        mCrcTab[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+        for (j = 1; j < 8; j++)
+            mCrcTab[j][i] = mCrcTab[0][mCrcTab[j - 1][i] & 0xff] ^ (mCrcTab[j - 1][i] >> 8);
+    mCrcInit = 1;
+}
+
+/* crc32 (IEEE 802.3), slicing by 8: start with crc = 0 */
+uint32_t sdb_cap_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t lo, hi;
+
+    if (!mCrcInit)
+        crc32_init();
+
+    crc = ~crc;
+    while (len >= 8) {
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = mCrcTab[7][lo & 0xff] ^ mCrcTab[6][(lo >> 8) & 0xff] ^
+              mCrcTab[5][(lo >> 16) & 0xff] ^ mCrcTab[4][lo >> 24] ^
+              mCrcTab[3][hi & 0xff] ^ mCrcTab[2][(hi >> 8) & 0xff] ^
+              mCrcTab[1][(hi >> 16) & 0xff] ^ mCrcTab[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = mCrcTab[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint64_t sdb_cap_now_ns(int clock_id)
+{
+    struct timespec ts;
+
+    clock_gettime(clock_id, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t pad_size(uint32_t size)
+{
+    return (SDB_CAP_ALIGN - (size & (SDB_CAP_ALIGN - 1))) & (SDB_CAP_ALIGN - 1);
+}
+
+/********************************************************************************
+Writer
+*********************************************************************************/
+int sdb_cap_writer_open(sdb_cap_writer_t *w, const char *path)
+{
+    sdb_cap_hdr_t hdr;
+
+    memset(w, 0, sizeof(*w));
+    w->f = fopen(path, "wb");
+    if (!w->f)
+        return -errno;
+    setvbuf(w->f, NULL, _IOFBF, WRITE_BUF_SIZE);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SDB_CAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = SDB_CAP_VERSION;
+    hdr.hdr_size = sizeof(hdr);
+    hdr.start_real_ns = sdb_cap_now_ns(CLOCK_REALTIME);
+    hdr.start_mono_ns = sdb_cap_now_ns(CLOCK_MONOTONIC);
+    if (fwrite(&hdr, sizeof(hdr), 1, w->f) != 1) {
+        fclose(w->f);
+        w->f = NULL;
+        return -EIO;
+    }
+    w->offset = sizeof(hdr);
+    return 0;
+}
+
+int sdb_cap_writer_append(sdb_cap_writer_t *w, uint16_t buffer_id, uint64_t ts_ns,
+                          const void *data, uint32_t size)
+{
+    return sdb_cap_writer_append_rec(w, buffer_id, 0, ts_ns, data, size);
+}
+
+int sdb_cap_writer_append_rec(sdb_cap_writer_t *w, uint16_t buffer_id, uint16_t flags,
+                              uint64_t ts_ns, const void *data, uint32_t size)
+{
+    static const uint8_t zero[SDB_CAP_ALIGN];
+    sdb_cap_rec_t rec;
+    sdb_cap_idx_t *idx;
+    uint32_t pad = pad_size(size);
+
+    if (w->nb_idx == w->max_idx) {
+        w->max_idx = w->max_idx ? w->max_idx * 2 : IDX_MIN;
+        idx = realloc(w->idx, w->max_idx * sizeof(*idx));
+        if (!idx)
+            return -ENOMEM;
+        w->idx = idx;
+    }
+
+    rec.magic = SDB_CAP_REC_MAGIC;
+    rec.size = size;
+    rec.seq = w->seq;
+    rec.ts_ns = ts_ns;
+    rec.crc = sdb_cap_crc32(0, data, size);
+    rec.buffer_id = buffer_id;
+    rec.flags = flags;
+    if (fwrite(&rec, sizeof(rec), 1, w->f) != 1 ||
+        fwrite(data, 1, size, w->f) != size ||
+        fwrite(zero, 1, pad, w->f) != pad)
+        return -EIO;
+
+    idx = &w->idx[w->nb_idx++];
+    idx->seq = w->seq++;
+    idx->ts_ns = ts_ns;
+    idx->offset = w->offset;
+    w->offset += sizeof(rec) + size + pad;
+    w->bytes += size;
+    return 0;
+}
+
+int sdb_cap_writer_close(sdb_cap_writer_t *w)
+{
+    sdb_cap_trailer_t trailer;
+    int ret = 0;
+
+    if (!w->f)
+        return 0;
+
+    memset(&trailer, 0, sizeof(trailer));
+    memcpy(trailer.magic, SDB_CAP_IDX_MAGIC, sizeof(trailer.magic));
+    trailer.idx_offset = w->offset;
+    trailer.nb_records = w->nb_idx;
+    trailer.idx_crc = sdb_cap_crc32(0, w->idx, w->nb_idx * sizeof(*w->idx));
+    if (fwrite(w->idx, sizeof(*w->idx), w->nb_idx, w->f) != w->nb_idx ||
+        fwrite(&trailer, sizeof(trailer), 1, w->f) != 1)
+        ret = -EIO;
+    if (fflush(w->f) || fsync(fileno(w->f)))
+        ret = -errno;
+    if (fclose(w->f))
+        ret = -errno;
+
+    free(w->idx);
+    w->idx = NULL;
+    w->f = NULL;
+    return ret;
+}
+
+/********************************************************************************
+Reader
+*********************************************************************************/
+static int read_at(int fd, void *buf, size_t len, uint64_t off)
+{
+    ssize_t n;
+
+    while (len) {
+        n = pread(fd, buf, len, off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n < 0 ? -errno : -EIO;
+        buf = (uint8_t *)buf + n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+/* Index of the trailer, 0 if the file has a valid one */
+static int load_index(sdb_cap_reader_t *r)
+{
+    sdb_cap_trailer_t trailer;
+    uint64_t idx_size;
+
+    if (r->file_size < r->hdr.hdr_size + sizeof(trailer))
+        return -1;
+    if (read_at(r->fd, &trailer, sizeof(trailer), r->file_size - sizeof(trailer)))
+        return -1;
+    if (memcmp(trailer.magic, SDB_CAP_IDX_MAGIC, sizeof(trailer.magic)))
+        return -1;
+
+    idx_size = trailer.nb_records * sizeof(sdb_cap_idx_t);
+    if (trailer.nb_records > r->file_size / sizeof(sdb_cap_idx_t) ||
+        trailer.idx_offset + idx_size + sizeof(trailer) != r->file_size)
+        return -1;
+
+    r->idx = malloc(idx_size ? idx_size : 1);
+    if (!r->idx)
+        return -1;
+    if (read_at(r->fd, r->idx, idx_size, trailer.idx_offset) ||
+        sdb_cap_crc32(0, r->idx, idx_size) != trailer.idx_crc) {
+        free(r->idx);
+        r->idx = NULL;
+        return -1;
+    }
+    r->nb_records = trailer.nb_records;
+    r->indexed = 1;
+    return 0;
+}
+
+/* Index of the records up to the first invalid one, for files without trailer */
+static int rebuild_index(sdb_cap_reader_t *r)
+{
+    uint64_t off = r->hdr.hdr_size, max = 0, end;
+    sdb_cap_rec_t rec;
+    sdb_cap_idx_t *idx;
+
+    r->nb_records = 0;
+    while (off + sizeof(rec) <= r->file_size) {
+        if (read_at(r->fd, &rec, sizeof(rec), off) || rec.magic != SDB_CAP_REC_MAGIC)
+            break;
+        end = off + sizeof(rec) + rec.size + pad_size(rec.size);
+        if (end > r->file_size)
+            break;
+        if (r->nb_records == max) {
+            max = max ? max * 2 : IDX_MIN;
+            idx = realloc(r->idx, max * sizeof(*idx));
+            if (!idx)
+                return -ENOMEM;
+            r->idx = idx;
+        }
+        r->idx[r->nb_records].seq = rec.seq;
+        r->idx[r->nb_records].ts_ns = rec.ts_ns;
+        r->idx[r->nb_records].offset = off;
+        r->nb_records++;
+        off = end;
+    }
+    r->indexed = 0;
+    return 0;
+}
+
+int sdb_cap_reader_open(sdb_cap_reader_t *r, const char *path)
+{
+    struct stat st;
+    int ret;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0)
+        return -errno;
+    if (fstat(r->fd, &st)) {
+        ret = -errno;
+        goto err;
+    }
+    r->file_size = st.st_size;
+
+    ret = read_at(r->fd, &r->hdr, sizeof(r->hdr), 0);
+    if (ret)
+        goto err;
+    if (memcmp(r->hdr.magic, SDB_CAP_MAGIC, sizeof(r->hdr.magic)) ||
+        r->hdr.version != SDB_CAP_VERSION || r->hdr.hdr_size < sizeof(r->hdr)) {
+        ret = -EINVAL;
+        goto err;
+    }
+
+    if (load_index(r)) {
+        ret = rebuild_index(r);
+        if (ret)
+            goto err;
+    }
+
+    /* the whole file on 64-bit, a sliding window otherwise */
+    r->window = sizeof(void *) >= 8 || r->file_size <= MAP_WINDOW ? r->file_size : MAP_WINDOW;
+    return 0;
+
+err:
+    free(r->idx);
+    close(r->fd);
+    r->idx = NULL;
+    r->fd = -1;
+    return ret;
+}
+
+void sdb_cap_reader_close(sdb_cap_reader_t *r)
+{
+    if (r->map)
+        munmap(r->map, r->map_len);
+    free(r->idx);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+/* Map [off, off + len) of the file, returns its address */
+static const uint8_t *map_range(sdb_cap_reader_t *r, uint64_t off, size_t len)
+{
+    uint64_t page = sysconf(_SC_PAGESIZE), base;
+    size_t map_len;
+    void *map;
+
+    if (r->map && off >= r->map_off && off + len <= r->map_off + r->map_len)
+        return r->map + (off - r->map_off);
+
+    base = off & ~(page - 1);
+    map_len = r->window > off + len - base ? r->window : off + len - base;
+    if (base + map_len > r->file_size)
+        map_len = r->file_size - base;
+
+    if (r->map)
+        munmap(r->map, r->map_len);
+    r->map = NULL;
+    map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, r->fd, base);
+    if (map == MAP_FAILED)
+        return NULL;
+    r->map = map;
+    r->map_off = base;
+    r->map_len = map_len;
+    return r->map + (off - base);
+}
+
+int sdb_cap_reader_get(sdb_cap_reader_t *r, uint64_t i, sdb_cap_view_t *v)
+{
+    uint64_t off;
+    const uint8_t *p;
+    uint32_t size;
+
+    if (i >= r->nb_records)
+        return -ERANGE;
+
+    off = r->idx[i].offset;
+    p = map_range(r, off, sizeof(sdb_cap_rec_t));
+    if (!p)
+        return -errno;
+    size = ((const sdb_cap_rec_t *)p)->size;
+    if (((const sdb_cap_rec_t *)p)->magic != SDB_CAP_REC_MAGIC ||
+        off + sizeof(sdb_cap_rec_t) + size > r->file_size)
+        return -EINVAL;
+
+    /* the payload may be past the window */
+    p = map_range(r, off, sizeof(sdb_cap_rec_t) + size);
+    if (!p)
+        return -errno;
+    v->hdr = (const sdb_cap_rec_t *)p;
+    v->data = p + sizeof(sdb_cap_rec_t);
+    return 0;
+}
+
+int64_t sdb_cap_reader_find_seq(const sdb_cap_reader_t *r, uint64_t seq)
+{
+    uint64_t lo = 0, hi = r->nb_records, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (r->idx[mid].seq < seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < r->nb_records && r->idx[lo].seq == seq ? (int64_t)lo : -1;
+}
+
+int64_t sdb_cap_reader_find_time(const sdb_cap_reader_t *r, uint64_t ts_ns)
+{
+    uint64_t lo = 0, hi = r->nb_records, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (r->idx[mid].ts_ns < ts_ns)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < r->nb_records ? (int64_t)lo : -1;
+}
+
+int sdb_cap_check(const sdb_cap_view_t *v)
+{
+    return sdb_cap_crc32(0, v->data, v->hdr->size) == v->hdr->crc;
+}
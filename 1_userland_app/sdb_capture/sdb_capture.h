@@ -0,0 +1,128 @@
+/*
+ * sdb_capture.h
+ * Capture file of the rpmsg_sdb buffers.
+ *
+ * Layout, little endian as written by the host:
+ *   file header    sdb_cap_hdr_t
+ *   records        sdb_cap_rec_t + payload, padded to 8 bytes
+ *   index          sdb_cap_idx_t per record
+ *   trailer        sdb_cap_trailer_t, last bytes of the file
+ *
+ * Records are appended as they come, the index and the trailer are
+ * written by sdb_cap_writer_close(). A file without trailer (recording
+ * killed) is still readable: the reader rebuilds the index by walking
+ * the records and stops at the first truncated or corrupted one.
+ *
+ * The reader maps the file and finds a record by number, sequence or
+ * time with a binary search in the index. On 32-bit targets a file
+ * larger than the address space is mapped through a sliding window.
+ */
+
+#ifndef SDB_CAPTURE_H
+#define SDB_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define SDB_CAP_MAGIC       "SDBCAP01"
+#define SDB_CAP_REC_MAGIC   0x43455253 /* "SREC" */
+#define SDB_CAP_IDX_MAGIC   "SDBIDX01"
+#define SDB_CAP_VERSION     1
+#define SDB_CAP_ALIGN       8
+
+typedef struct
+{
+    char magic[8];          /* SDB_CAP_MAGIC */
+    uint32_t version;
+    uint32_t hdr_size;      /* sizeof(sdb_cap_hdr_t), records start here */
+    uint64_t start_real_ns; /* CLOCK_REALTIME at creation */
+    uint64_t start_mono_ns; /* CLOCK_MONOTONIC at creation, base of the record ts_ns */
+    uint32_t flags;
+    uint32_t reserved[7];
+} sdb_cap_hdr_t;
+
+typedef struct
+{
+    uint32_t magic;         /* SDB_CAP_REC_MAGIC */
+    uint32_t size;          /* payload bytes, without padding */
+    uint64_t seq;           /* record number since the start of the capture */
+    uint64_t ts_ns;         /* CLOCK_MONOTONIC of the buffer completion */
+    uint32_t crc;           /* crc32 of the payload */
+    uint16_t buffer_id;     /* rpmsg_sdb buffer index */
+    uint16_t flags;         /* encoding, 0: raw, see sdb_compress.h */
+} sdb_cap_rec_t;
+
+typedef struct
+{
+    uint64_t seq;
+    uint64_t ts_ns;
+    uint64_t offset;        /* of the sdb_cap_rec_t in the file */
+} sdb_cap_idx_t;
+
+typedef struct
+{
+    char magic[8];          /* SDB_CAP_IDX_MAGIC */
+    uint64_t idx_offset;
+    uint64_t nb_records;
+    uint32_t idx_crc;       /* crc32 of the index */
+    uint32_t reserved;
+} sdb_cap_trailer_t;
+
+typedef struct
+{
+    FILE *f;
+    uint64_t offset;        /* end of the last record */
+    uint64_t seq;
+    sdb_cap_idx_t *idx;
+    uint64_t nb_idx, max_idx;
+    uint64_t bytes;         /* payload bytes, as stored */
+} sdb_cap_writer_t;
+
+typedef struct
+{
+    int fd;
+    uint64_t file_size;
+    sdb_cap_hdr_t hdr;
+    sdb_cap_idx_t *idx;
+    uint64_t nb_records;
+    int indexed;            /* 1: trailer index, 0: rebuilt by a scan */
+
+    /* mapped window of the file */
+    uint8_t *map;
+    uint64_t map_off;
+    size_t map_len;
+    size_t window;
+} sdb_cap_reader_t;
+
+/* Record returned by the reader, valid until the next call on the reader */
+typedef struct
+{
+    const sdb_cap_rec_t *hdr;
+    const uint8_t *data;
+} sdb_cap_view_t;
+
+uint32_t sdb_cap_crc32(uint32_t crc, const void *data, size_t len);
+uint64_t sdb_cap_now_ns(int clock_id);
+
+/* Writer, returns 0 or -errno */
+int sdb_cap_writer_open(sdb_cap_writer_t *w, const char *path);
+int sdb_cap_writer_append(sdb_cap_writer_t *w, uint16_t buffer_id, uint64_t ts_ns,
+                          const void *data, uint32_t size);
+/* Record already encoded, flags of sdb_compress.h */
+int sdb_cap_writer_append_rec(sdb_cap_writer_t *w, uint16_t buffer_id, uint16_t flags,
+                              uint64_t ts_ns, const void *data, uint32_t size);
+int sdb_cap_writer_close(sdb_cap_writer_t *w);
+
+/* Reader, returns 0 or -errno */
+int sdb_cap_reader_open(sdb_cap_reader_t *r, const char *path);
+void sdb_cap_reader_close(sdb_cap_reader_t *r);
+int sdb_cap_reader_get(sdb_cap_reader_t *r, uint64_t i, sdb_cap_view_t *v);
+/* Record number of seq, -1 if absent */
+int64_t sdb_cap_reader_find_seq(const sdb_cap_reader_t *r, uint64_t seq);
+/* First record at or after ts_ns, -1 if none */
+int64_t sdb_cap_reader_find_time(const sdb_cap_reader_t *r, uint64_t ts_ns);
+/* 1 if the payload matches its crc */
+int sdb_cap_check(const sdb_cap_view_t *v);
+
+#endif /* SDB_CAPTURE_H */
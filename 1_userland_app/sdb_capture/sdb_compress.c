@@ -0,0 +1,556 @@
+/*
+ * sdb_compress.c
+ * Delta filter, LZ4 block codec and compression pool, see sdb_compress.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sdb_compress.h"
+
+/* LZ4 block format */
+#define MINMATCH        4
+#define LASTLITERALS    5   /* the block ends with literals */
+#define MFLIMIT         12  /* no match starts in the last bytes */
+#define MAX_DISTANCE    65535
+#define HASH_LOG        12
+/* search step grows by one every 2^SKIP_TRIGGER bytes without match */
+#define SKIP_TRIGGER    6
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/* Bytes equal from p and q, p stops at limit */
+static const uint8_t *match_end(const uint8_t *p, const uint8_t *q, const uint8_t *limit)
+{
+    uint64_t x;
+
+    while (p + 8 <= limit) {
+        x = read64(p) ^ read64(q);
+        if (x)
+            return p + (__builtin_ctzll(x) >> 3); /* little endian */
+        p += 8;
+        q += 8;
+    }
+    while (p < limit && *p == *q) {
+        p++;
+        q++;
+    }
+    return p;
+}
+
+static uint8_t *put_len(uint8_t *op, uint32_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+/* lit literals then a match of mlen bytes at off, mlen 0 for the last literals */
+static uint8_t *put_seq(uint8_t *op, const uint8_t *oend, const uint8_t *lit_ptr,
+                        uint32_t lit, uint32_t off, uint32_t mlen)
+{
+    uint8_t *token = op;
+
+    if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit + 2 + mlen / 255 + 1)
+        return NULL;
+    op++;
+    *token = (lit >= 15 ? 15 : lit) << 4;
+    if (lit >= 15)
+        op = put_len(op, lit - 15);
+    memcpy(op, lit_ptr, lit);
+    op += lit;
+    if (!mlen)
+        return op;
+
+    *op++ = off;
+    *op++ = off >> 8;
+    mlen -= MINMATCH;
+    *token |= mlen >= 15 ? 15 : mlen;
+    if (mlen >= 15)
+        op = put_len(op, mlen - 15);
+    return op;
+}
+
+/* Returns the block size, 0 if it does not fit in cap */
+int sdb_lz4_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+    uint32_t table[1 << HASH_LOG];
+    const uint8_t *ip = src, *anchor = src, *ref, *end = src + len;
+    const uint8_t *mflimit, *matchlimit, *mend;
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + cap;
+    uint32_t v, h;
+
+    if (len > MFLIMIT) {
+        mflimit = end - MFLIMIT;
+        matchlimit = end - LASTLITERALS;
+        memset(table, 0, sizeof(table));
+        ip++;
+        while (ip < mflimit) {
+            v = read32(ip);
+            h = hash4(v);
+            ref = src + table[h];
+            table[h] = ip - src;
+            if (ip - ref > MAX_DISTANCE || read32(ref) != v) {
+                ip += 1 + ((ip - anchor) >> SKIP_TRIGGER);
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            mend = match_end(ip + MINMATCH, ref + MINMATCH, matchlimit);
+            op = put_seq(op, oend, anchor, ip - anchor, ip - ref, mend - ip);
+            if (!op)
+                return 0;
+            table[hash4(read32(mend - 2))] = mend - 2 - src;
+            ip = anchor = mend;
+        }
+    }
+
+    op = put_seq(op, oend, anchor, end - anchor, 0, 0);
+    return op ? op - dst : 0;
+}
+
+/* Returns the decoded size, -1 if the block is corrupted or larger than cap */
+int sdb_lz4_decompress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+    const uint8_t *ip = src, *iend = src + len, *ref;
+    uint8_t *op = dst, *oend = dst + cap;
+    uint32_t token, lit, mlen, off, b;
+
+    while (ip < iend) {
+        token = *ip++;
+        lit = token >> 4;
+        if (lit == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > (uint32_t)(iend - ip) || lit > (uint32_t)(oend - op))
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        off = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (!off || off > (uint32_t)(op - dst))
+            return -1;
+        mlen = token & 15;
+        if (mlen == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                mlen += b;
+            } while (b == 255);
+        }
+        mlen += MINMATCH;
+        if (mlen > (uint32_t)(oend - op))
+            return -1;
+
+        ref = op - off;
+        if (off >= mlen) {
+            memcpy(op, ref, mlen);
+        } else if (off == 1) {
+            memset(op, *ref, mlen);
+        } else {
+            /* overlapping: repeats the last off bytes, doubling the copy each time */
+            for (b = 0; b < mlen; b += lit) {
+                lit = off + b < mlen - b ? off + b : mlen - b;
+                memcpy(op + b, ref, lit);
+            }
+        }
+        op += mlen;
+    }
+    return op - dst;
+}
+
+void sdb_delta_encode(const uint8_t *src, uint8_t *dst, uint32_t len, int width)
+{
+    uint32_t i, n = width ? len / width * width : 0;
+    uint16_t p16 = 0, x16;
+    uint32_t p32 = 0, x32;
+    uint8_t p8 = 0;
+
+    switch (width) {
+    case 1:
+        for (i = 0; i < n; i++) {
+            dst[i] = src[i] - p8;
+            p8 = src[i];
+        }
+        break;
+    case 2:
+        for (i = 0; i < n; i += 2) {
+            memcpy(&x16, src + i, 2);
+            p16 = x16 - p16;
+            memcpy(dst + i, &p16, 2);
+            p16 = x16;
+        }
+        break;
+    case 4:
+        for (i = 0; i < n; i += 4) {
+            memcpy(&x32, src + i, 4);
+            p32 = x32 - p32;
+            memcpy(dst + i, &p32, 4);
+            p32 = x32;
+        }
+        break;
+    default:
+        n = 0;
+        break;
+    }
+    /* incomplete last sample */
+    memcpy(dst + n, src + n, len - n);
+}
+
+void sdb_delta_decode(uint8_t *buf, uint32_t len, int width)
+{
+    uint32_t i, n = width ? len / width * width : 0;
+    uint16_t p16 = 0, x16;
+    uint32_t p32 = 0, x32;
+    uint8_t p8 = 0;
+
+    switch (width) {
+    case 1:
+        for (i = 0; i < n; i++)
+            buf[i] = p8 += buf[i];
+        break;
+    case 2:
+        for (i = 0; i < n; i += 2) {
+            memcpy(&x16, buf + i, 2);
+            p16 += x16;
+            memcpy(buf + i, &p16, 2);
+        }
+        break;
+    case 4:
+        for (i = 0; i < n; i += 4) {
+            memcpy(&x32, buf + i, 4);
+            p32 += x32;
+            memcpy(buf + i, &p32, 4);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+uint32_t sdb_comp_encode(const uint8_t *src, uint32_t size, int delta_width,
+                         uint8_t *tmp, uint8_t *dst, uint16_t *flags)
+{
+    const uint8_t *in = src;
+    int n;
+
+    /* the payload must be at least one byte smaller than the buffer */
+    if (size <= sizeof(uint32_t) + 1)
+        return 0;
+    if (delta_width) {
+        sdb_delta_encode(src, tmp, size, delta_width);
+        in = tmp;
+    }
+    n = sdb_lz4_compress(in, size, dst + sizeof(uint32_t), size - sizeof(uint32_t) - 1);
+    if (!n)
+        return 0;
+
+    memcpy(dst, &size, sizeof(uint32_t));
+    *flags = SDB_CAP_REC_LZ4 | delta_width << SDB_CAP_REC_DELTA_SHIFT;
+    return n + sizeof(uint32_t);
+}
+
+uint32_t sdb_comp_raw_size(const sdb_cap_view_t *v)
+{
+    uint32_t size;
+
+    if (!(v->hdr->flags & SDB_CAP_REC_LZ4))
+        return v->hdr->size;
+    if (v->hdr->size < sizeof(uint32_t))
+        return 0;
+    memcpy(&size, v->data, sizeof(uint32_t));
+    return size;
+}
+
+int sdb_comp_decode(const sdb_cap_view_t *v, uint8_t *out, uint32_t cap)
+{
+    uint32_t size = sdb_comp_raw_size(v);
+    int width = (v->hdr->flags & SDB_CAP_REC_DELTA) >> SDB_CAP_REC_DELTA_SHIFT;
+
+    if (size > cap)
+        return -1;
+    if (!(v->hdr->flags & SDB_CAP_REC_LZ4)) {
+        memcpy(out, v->data, size);
+        return size;
+    }
+    if (v->hdr->size < sizeof(uint32_t) ||
+        sdb_lz4_decompress(v->data + sizeof(uint32_t), v->hdr->size - sizeof(uint32_t),
+                           out, size) != (int)size)
+        return -1;
+    if (width)
+        sdb_delta_decode(out, size, width);
+    return size;
+}
+
+/********************************************************************************
+Pool
+*********************************************************************************/
+static void slot_encode(sdb_comp_pool_t *p, sdb_comp_slot_t *s, const uint8_t *data)
+{
+    uint64_t t0 = sdb_cap_now_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    s->flags = 0;
+    s->out_size = sdb_comp_encode(data, s->size, p->delta_width, s->tmp, s->out, &s->flags);
+    t0 = sdb_cap_now_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+
+    pthread_mutex_lock(&p->lock);
+    p->stats.cpu_ns += t0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void slot_write(sdb_comp_pool_t *p, sdb_comp_slot_t *s, const uint8_t *data)
+{
+    uint32_t size = s->out_size ? s->out_size : s->size;
+    int ret;
+
+    ret = sdb_cap_writer_append_rec(p->w, s->buffer_id, s->flags, s->ts_ns,
+                                    s->out_size ? s->out : data, size);
+
+    pthread_mutex_lock(&p->lock);
+    p->stats.records++;
+    p->stats.raw_bytes += s->size;
+    p->stats.stored_bytes += size;
+    if (!s->out_size)
+        p->stats.raw_fallbacks++;
+    if (ret && !p->stats.error)
+        p->stats.error = ret;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *worker_thread(void *arg)
+{
+    sdb_comp_pool_t *p = arg;
+    sdb_comp_slot_t *s;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stop && p->next == p->tail)
+            pthread_cond_wait(&p->cv_job, &p->lock);
+        if (p->next == p->tail)
+            break;
+        s = &p->slots[p->next++ % p->nb_slots];
+        pthread_mutex_unlock(&p->lock);
+
+        slot_encode(p, s, s->data);
+
+        pthread_mutex_lock(&p->lock);
+        s->state = SLOT_DONE;
+        pthread_cond_signal(&p->cv_done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Appends the buffers in submission order, whatever worker finished first */
+static void *writer_thread(void *arg)
+{
+    sdb_comp_pool_t *p = arg;
+    sdb_comp_slot_t *s;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        s = &p->slots[p->head % p->nb_slots];
+        if (p->head == p->tail) {
+            if (p->stop)
+                break;
+            pthread_cond_wait(&p->cv_done, &p->lock);
+            continue;
+        }
+        if (s->state != SLOT_DONE) {
+            pthread_cond_wait(&p->cv_done, &p->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        slot_write(p, s, s->data);
+
+        pthread_mutex_lock(&p->lock);
+        s->state = SLOT_FREE;
+        p->head++;
+        pthread_cond_signal(&p->cv_free);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void pool_free(sdb_comp_pool_t *p)
+{
+    uint32_t i;
+
+    if (p->slots) {
+        for (i = 0; i < p->nb_slots; i++) {
+            free(p->slots[i].data);
+            free(p->slots[i].tmp);
+            free(p->slots[i].out);
+        }
+    }
+    free(p->slots);
+    free(p->workers);
+    p->slots = NULL;
+    p->workers = NULL;
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cv_job);
+    pthread_cond_destroy(&p->cv_done);
+    pthread_cond_destroy(&p->cv_free);
+}
+
+int sdb_comp_pool_start(sdb_comp_pool_t *p, sdb_cap_writer_t *w, int nb_workers,
+                        int delta_width, uint32_t max_size, uint32_t nb_slots)
+{
+    sdb_comp_slot_t *s;
+    uint32_t i;
+    int ret;
+
+    memset(p, 0, sizeof(*p));
+    if (nb_workers < 0 || (delta_width != 0 && delta_width != 1 &&
+                           delta_width != 2 && delta_width != 4))
+        return -EINVAL;
+
+    p->w = w;
+    p->delta_width = delta_width;
+    p->max_size = max_size;
+    /* inline: one slot for the scratch buffers, the data is not copied */
+    p->nb_slots = nb_workers ? (nb_slots ? nb_slots : 1) : 1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cv_job, NULL);
+    pthread_cond_init(&p->cv_done, NULL);
+    pthread_cond_init(&p->cv_free, NULL);
+
+    p->slots = calloc(p->nb_slots, sizeof(*p->slots));
+    if (!p->slots)
+        goto nomem;
+    for (i = 0; i < p->nb_slots; i++) {
+        s = &p->slots[i];
+        s->tmp = malloc(max_size);
+        s->out = malloc(max_size);
+        if (nb_workers)
+            s->data = malloc(max_size);
+        if (!s->tmp || !s->out || (nb_workers && !s->data))
+            goto nomem;
+    }
+    if (!nb_workers)
+        return 0;
+
+    p->workers = calloc(nb_workers, sizeof(*p->workers));
+    if (!p->workers)
+        goto nomem;
+    ret = pthread_create(&p->writer, NULL, writer_thread, p);
+    if (ret) {
+        pool_free(p);
+        return -ret;
+    }
+    for (i = 0; i < (uint32_t)nb_workers; i++) {
+        ret = pthread_create(&p->workers[i], NULL, worker_thread, p);
+        if (ret) {
+            sdb_comp_pool_stop(p);
+            return -ret;
+        }
+        p->nb_workers++;
+    }
+    return 0;
+
+nomem:
+    pool_free(p);
+    return -ENOMEM;
+}
+
+int sdb_comp_pool_submit(sdb_comp_pool_t *p, uint16_t buffer_id, uint64_t ts_ns,
+                         const void *data, uint32_t size)
+{
+    sdb_comp_slot_t *s;
+    int ret;
+
+    if (size > p->max_size)
+        return -EINVAL;
+
+    if (!p->workers) {
+        s = &p->slots[0];
+        s->buffer_id = buffer_id;
+        s->ts_ns = ts_ns;
+        s->size = size;
+        slot_encode(p, s, data);
+        slot_write(p, s, data);
+        return p->stats.error;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (p->tail - p->head == p->nb_slots) {
+        p->stats.stalls++;
+        while (p->tail - p->head == p->nb_slots)
+            pthread_cond_wait(&p->cv_free, &p->lock);
+    }
+    /* only this thread advances tail, the slot stays ours until then */
+    s = &p->slots[p->tail % p->nb_slots];
+    pthread_mutex_unlock(&p->lock);
+
+    s->buffer_id = buffer_id;
+    s->ts_ns = ts_ns;
+    s->size = size;
+    memcpy(s->data, data, size);
+
+    pthread_mutex_lock(&p->lock);
+    s->state = SLOT_FILLED;
+    p->tail++;
+    pthread_cond_signal(&p->cv_job);
+    ret = p->stats.error;
+    pthread_mutex_unlock(&p->lock);
+    return ret;
+}
+
+void sdb_comp_pool_stop(sdb_comp_pool_t *p)
+{
+    int i;
+
+    if (p->workers) {
+        pthread_mutex_lock(&p->lock);
+        p->stop = 1;
+        pthread_cond_broadcast(&p->cv_job);
+        pthread_cond_broadcast(&p->cv_done);
+        pthread_mutex_unlock(&p->lock);
+        for (i = 0; i < p->nb_workers; i++)
+            pthread_join(p->workers[i], NULL);
+        pthread_join(p->writer, NULL);
+    }
+    pool_free(p);
+}
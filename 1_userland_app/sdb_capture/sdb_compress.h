@@ -0,0 +1,115 @@
+/*
+ * sdb_compress.h
+ * Optional compression of the capture records: delta filter and LZ4.
+ *
+ * The delta filter replaces each sample (1, 2 or 4 bytes, little endian)
+ * by its difference with the previous one, so slowly varying signals
+ * become runs of small values that LZ4 compresses well. The codec writes
+ * the LZ4 block format (any LZ4 decoder reads it) and needs no library.
+ *
+ * A compressed record has SDB_CAP_REC_LZ4 in its flags, the delta width
+ * in SDB_CAP_REC_DELTA and its payload is the raw size (uint32_t)
+ * followed by the LZ4 block; the record crc covers the stored payload.
+ * A buffer that does not shrink is stored raw, flags 0.
+ *
+ * The pool compresses the buffers on worker threads and a writer thread
+ * appends them to the capture file in submission order.
+ */
+
+#ifndef SDB_COMPRESS_H
+#define SDB_COMPRESS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sdb_capture.h"
+
+#define SDB_CAP_REC_LZ4         0x0001
+#define SDB_CAP_REC_DELTA_SHIFT 1
+#define SDB_CAP_REC_DELTA       (0x7 << SDB_CAP_REC_DELTA_SHIFT) /* sample bytes, 0: none */
+
+/* Worst case size of the LZ4 block of len bytes */
+#define SDB_LZ4_BOUND(len)      ((len) + (len) / 255 + 16)
+
+int sdb_lz4_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap);
+int sdb_lz4_decompress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap);
+
+void sdb_delta_encode(const uint8_t *src, uint8_t *dst, uint32_t len, int width);
+void sdb_delta_decode(uint8_t *buf, uint32_t len, int width);
+
+/*
+ * Encode a buffer as a record payload in dst, tmp holds the delta; both
+ * are size bytes. Returns the payload size and sets flags, or returns 0
+ * when the payload would not be smaller and the buffer is stored raw.
+ */
+uint32_t sdb_comp_encode(const uint8_t *src, uint32_t size, int delta_width,
+                         uint8_t *tmp, uint8_t *dst, uint16_t *flags);
+
+/* Raw size of a record */
+uint32_t sdb_comp_raw_size(const sdb_cap_view_t *v);
+/* Decode a record in out (sdb_comp_raw_size() bytes), returns its size or -1 */
+int sdb_comp_decode(const sdb_cap_view_t *v, uint8_t *out, uint32_t cap);
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_FILLED,    /* waiting for a worker */
+    SLOT_DONE,      /* waiting for the writer */
+} sdb_comp_slot_state_t;
+
+typedef struct
+{
+    sdb_comp_slot_state_t state;
+    uint16_t buffer_id;
+    uint16_t flags;
+    uint64_t ts_ns;
+    uint32_t size;          /* raw bytes in data */
+    uint32_t out_size;      /* stored bytes in out, 0: store data */
+    uint8_t *data;
+    uint8_t *tmp;
+    uint8_t *out;
+} sdb_comp_slot_t;
+
+typedef struct
+{
+    uint64_t records;
+    uint64_t raw_bytes;
+    uint64_t stored_bytes;
+    uint64_t raw_fallbacks; /* records stored raw */
+    uint64_t cpu_ns;        /* thread CPU time spent encoding */
+    uint64_t stalls;        /* submissions that waited for a free slot */
+    int error;              /* first write error */
+} sdb_comp_stats_t;
+
+typedef struct
+{
+    sdb_cap_writer_t *w;
+    int delta_width;
+    uint32_t max_size;
+    int nb_workers;         /* 0: encode and write in sdb_comp_pool_submit() */
+    uint32_t nb_slots;
+    sdb_comp_slot_t *slots;
+    uint64_t head;          /* next slot to write */
+    uint64_t next;          /* next slot to encode */
+    uint64_t tail;          /* next slot to fill */
+    int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cv_job;
+    pthread_cond_t cv_done;
+    pthread_cond_t cv_free;
+    pthread_t *workers;
+    pthread_t writer;
+
+    sdb_comp_stats_t stats;
+} sdb_comp_pool_t;
+
+/* Returns 0 or -errno */
+int sdb_comp_pool_start(sdb_comp_pool_t *p, sdb_cap_writer_t *w, int nb_workers,
+                        int delta_width, uint32_t max_size, uint32_t nb_slots);
+/* Copies data, blocks while all the slots are in use */
+int sdb_comp_pool_submit(sdb_comp_pool_t *p, uint16_t buffer_id, uint64_t ts_ns,
+                         const void *data, uint32_t size);
+/* Writes the pending buffers and stops the threads */
+void sdb_comp_pool_stop(sdb_comp_pool_t *p);
+
+#endif /* SDB_COMPRESS_H */
@@ -0,0 +1,384 @@
+/*
+ * sdb_decode.c
+ * Protocol decoders of the captured logic samples, see sdb_decode.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "sdb_decode.h"
+
+#define BIT(d, i) (1 << (d)->c.ch[i])
+#define HAS(d, i) ((d)->c.ch[i] != SDB_DEC_NONE)
+
+static void emit(sdb_dec_t *d, const sdb_dec_frame_t *f)
+{
+    d->frames++;
+    if (f->flags & SDB_DEC_ERRORS)
+        d->errors++;
+    if (d->on_frame)
+        d->on_frame(d->ctx, f);
+}
+
+/* Edge or condition of the I2C: start = end */
+static void emit_at(sdb_dec_t *d, uint64_t pos, uint8_t type, uint8_t flags)
+{
+    sdb_dec_frame_t f = { pos, pos, type, flags, 0, 0 };
+
+    emit(d, &f);
+}
+
+/* UART, state 1: in a frame. Bits read up to sample end, rx at d->level */
+static void uart_read_to(sdb_dec_t *d, uint64_t end)
+{
+    uint32_t bits = d->c.bits, par = d->c.parity != 'n', k, ones;
+
+    while (d->state && (d->next_q8 >> 8) < end) {
+        k = d->nbits++;
+        if (k == 0) {
+            /* a glitch, not a start bit */
+            if (d->level) {
+                d->state = 0;
+                break;
+            }
+        } else if (k <= bits) {
+            d->shift |= (uint32_t)d->level << (k - 1);
+        } else if (par && k == bits + 1) {
+            d->par = d->level;
+        } else if (!d->level) {
+            d->f.flags |= SDB_DEC_FRAMING;
+        }
+        if (d->nbits == 1 + bits + par + d->c.stop) {
+            if (par) {
+                ones = __builtin_popcount(d->shift) + d->par;
+                if ((ones & 1) != (d->c.parity == 'o'))
+                    d->f.flags |= SDB_DEC_PARITY;
+            }
+            d->f.end = d->next_q8 >> 8;
+            d->f.data = d->shift;
+            emit(d, &d->f);
+            d->state = 0;
+        }
+        d->next_q8 += d->c.period_q8;
+    }
+}
+
+static void uart_edge(sdb_dec_t *d, uint64_t pos, uint8_t prev, uint8_t s)
+{
+    uart_read_to(d, pos);
+    d->level = !!(s & BIT(d, 0));
+    if (d->state || d->level)
+        return;
+    /* start bit, read in its middle */
+    memset(&d->f, 0, sizeof(d->f));
+    d->f.start = pos;
+    d->state = 1;
+    d->nbits = 0;
+    d->shift = 0;
+    d->next_q8 = (pos << 8) + d->c.period_q8 / 2;
+}
+
+/* SPI, state 1: selected */
+static void spi_edge(sdb_dec_t *d, uint64_t pos, uint8_t prev, uint8_t s)
+{
+    uint8_t ch = prev ^ s, cs = HAS(d, 3) ? BIT(d, 3) : 0, clk = BIT(d, 0);
+    uint32_t b, b2;
+    /* modes 0 and 3 on the rising edge, 1 and 2 on the falling one */
+    int rising = (d->c.mode >> 1) == (d->c.mode & 1);
+
+    if ((ch & cs) && !(s & cs)) {
+        d->state = 1;
+        d->nbits = 0;
+    }
+    if ((ch & clk) && d->state && !(s & clk) == !rising) {
+        b = !!(s & BIT(d, 1));
+        b2 = HAS(d, 2) && (s & BIT(d, 2));
+        if (!d->nbits) {
+            memset(&d->f, 0, sizeof(d->f));
+            d->f.start = pos;
+            d->shift = 0;
+            d->shift2 = 0;
+        }
+        if (d->c.lsb) {
+            d->shift |= b << d->nbits;
+            d->shift2 |= b2 << d->nbits;
+        } else {
+            d->shift = d->shift << 1 | b;
+            d->shift2 = d->shift2 << 1 | b2;
+        }
+        d->f.end = pos;
+        if (++d->nbits == d->c.bits) {
+            d->f.data = d->shift;
+            d->f.data2 = d->shift2;
+            emit(d, &d->f);
+            d->nbits = 0;
+        }
+    }
+    if ((ch & cs) && (s & cs)) {
+        if (d->nbits) {
+            d->f.data = d->shift;
+            d->f.data2 = d->shift2;
+            d->f.flags |= SDB_DEC_PARTIAL;
+            emit(d, &d->f);
+        }
+        d->state = 0;
+        d->nbits = 0;
+    }
+}
+
+/* I2C, state 1: address byte next, 2: data bytes */
+static void i2c_edge(sdb_dec_t *d, uint64_t pos, uint8_t prev, uint8_t s)
+{
+    uint8_t ch = prev ^ s, scl = BIT(d, 0), sda = BIT(d, 1);
+    uint32_t b;
+
+    if (!(ch & scl) && (s & scl)) {
+        /*
+         * SDA with SCL high: the conditions. The bit of the SCL rise
+         * before is theirs, a byte going on beyond it is cut
+         */
+        if (d->state && d->nbits > 1) {
+            d->f.data = d->shift >> 1;
+            d->f.flags |= SDB_DEC_PARTIAL;
+            emit(d, &d->f);
+        }
+        if (!(s & sda)) {
+            emit_at(d, pos, SDB_DEC_START, d->state ? SDB_DEC_RESTART : 0);
+            d->state = 1;
+        } else {
+            if (d->state)
+                emit_at(d, pos, SDB_DEC_STOP, 0);
+            d->state = 0;
+        }
+        d->nbits = 0;
+        return;
+    }
+    if (!(ch & scl) || !(s & scl) || !d->state)
+        return;
+
+    b = !!(s & sda);
+    if (!d->nbits) {
+        memset(&d->f, 0, sizeof(d->f));
+        d->f.start = pos;
+        d->f.type = d->state == 1 ? SDB_DEC_ADDR : SDB_DEC_DATA;
+        d->shift = 0;
+    }
+    d->f.end = pos;
+    if (d->nbits++ < 8) {
+        d->shift = d->shift << 1 | b;
+        return;
+    }
+    /* acknowledge bit */
+    if (b)
+        d->f.flags |= SDB_DEC_NACK;
+    if (d->state == 1) {
+        d->f.data = d->shift >> 1;
+        if (d->shift & 1)
+            d->f.flags |= SDB_DEC_READ;
+    } else {
+        d->f.data = d->shift;
+    }
+    emit(d, &d->f);
+    d->state = 2;
+    d->nbits = 0;
+}
+
+static void on_edge(sdb_dec_t *d, uint64_t pos, uint8_t prev, uint8_t s)
+{
+    switch (d->c.proto) {
+    case SDB_DEC_UART:
+        uart_edge(d, pos, prev, s);
+        break;
+    case SDB_DEC_SPI:
+        spi_edge(d, pos, prev, s);
+        break;
+    default:
+        i2c_edge(d, pos, prev, s);
+        break;
+    }
+}
+
+int sdb_dec_init(sdb_dec_t *d, const sdb_dec_cfg_t *c, sdb_dec_fn_t on_frame, void *ctx)
+{
+    uint32_t i, nb = c->proto == SDB_DEC_UART ? 1 : c->proto == SDB_DEC_SPI ? 4 : 2;
+
+    memset(d, 0, sizeof(*d));
+    if (c->proto > SDB_DEC_I2C)
+        return -EINVAL;
+    /* the channels of the protocol, the optional ones of SPI can be SDB_DEC_NONE */
+    for (i = 0; i < nb; i++) {
+        if (c->ch[i] == SDB_DEC_NONE && c->proto == SDB_DEC_SPI && i >= 2)
+            continue;
+        if (c->ch[i] > 7 || (d->mask & (1 << c->ch[i])))
+            return -EINVAL;
+        d->mask |= 1 << c->ch[i];
+    }
+    if ((c->proto == SDB_DEC_UART &&
+         (c->period_q8 < 2 * 256 || c->bits < 5 || c->bits > 9 || !strchr("neo", c->parity) ||
+          !c->parity || c->stop < 1 || c->stop > 2)) ||
+        (c->proto == SDB_DEC_SPI && (c->bits < 1 || c->bits > 16 || c->mode > 3)))
+        return -EINVAL;
+    /* MOSI and MISO are read, not followed */
+    if (c->proto == SDB_DEC_SPI)
+        d->mask = (1 << c->ch[0]) | (c->ch[3] != SDB_DEC_NONE ? 1 << c->ch[3] : 0);
+    d->c = *c;
+    d->on_frame = on_frame;
+    d->ctx = ctx;
+    return 0;
+}
+
+void sdb_dec_process(sdb_dec_t *d, const uint8_t *s, uint32_t n)
+{
+    size_t i = 0, k, cnt, j;
+    uint8_t prev;
+
+    if (!n)
+        return;
+    /* no edge before the first sample: the state from there */
+    if (!d->nb_samples) {
+        d->last = s[0];
+        d->level = !!(s[0] & BIT(d, 0));
+        if (d->c.proto == SDB_DEC_SPI)
+            d->state = !HAS(d, 3) || !(s[0] & BIT(d, 3));
+    }
+
+    prev = d->last;
+    while (i < n) {
+        if (d->scalar)
+            cnt = scalar_edges_u8(s + i, n - i, prev, d->mask, d->pos, SDB_DEC_EDGES);
+        else
+            cnt = simd_edges_u8(s + i, n - i, prev, d->mask, d->pos, SDB_DEC_EDGES);
+        for (k = 0; k < cnt; k++) {
+            j = i + d->pos[k];
+            on_edge(d, d->nb_samples + j, j ? s[j - 1] : d->last, s[j]);
+        }
+        d->edges += cnt;
+        if (cnt < SDB_DEC_EDGES)
+            break;
+        i += d->pos[cnt - 1] + 1;
+        prev = s[i - 1];
+    }
+    /* the bits of the UART up to the end of the buffer */
+    if (d->c.proto == SDB_DEC_UART)
+        uart_read_to(d, d->nb_samples + n);
+
+    d->last = s[n - 1];
+    d->nb_samples += n;
+}
+
+/* <ch>, '-' for none if opt */
+static int parse_channel(const char *v, int opt, uint8_t *ch)
+{
+    if (opt && !strcmp(v, "-")) {
+        *ch = SDB_DEC_NONE;
+        return 0;
+    }
+    if (v[0] < '0' || v[0] > '7' || v[1])
+        return -1;
+    *ch = v[0] - '0';
+    return 0;
+}
+
+/* nb channels separated by '/', the ones from opt on optional */
+static int parse_channels(char *v, uint8_t *ch, int nb, int opt)
+{
+    char *save = NULL, *t;
+    int i;
+
+    for (i = 0, t = strtok_r(v, "/", &save); t; i++, t = strtok_r(NULL, "/", &save))
+        if (i == nb || parse_channel(t, i >= opt, &ch[i]))
+            return -1;
+    return i == nb ? 0 : -1;
+}
+
+int sdb_dec_parse(sdb_dec_cfg_t *c, const char *spec)
+{
+    char buf[256], *key, *v, *save = NULL, *end;
+    int proto = -1;
+    double period;
+    long n;
+
+    if (strlen(spec) >= sizeof(buf))
+        return -EINVAL;
+    strcpy(buf, spec);
+    memset(c, 0, sizeof(*c));
+    memset(c->ch, SDB_DEC_NONE, sizeof(c->ch));
+    c->bits = 8;
+    c->parity = 'n';
+    c->stop = 1;
+
+    for (key = strtok_r(buf, ",", &save); key; key = strtok_r(NULL, ",", &save)) {
+        v = strchr(key, '=');
+        if (!v)
+            return -EINVAL;
+        *v++ = 0;
+        if (proto < 0 && !strcmp(key, "uart")) {
+            proto = SDB_DEC_UART;
+            if (parse_channels(v, c->ch, 1, 1))
+                return -EINVAL;
+        } else if (proto < 0 && !strcmp(key, "spi")) {
+            proto = SDB_DEC_SPI;
+            if (parse_channels(v, c->ch, 4, 2))
+                return -EINVAL;
+        } else if (proto < 0 && !strcmp(key, "i2c")) {
+            proto = SDB_DEC_I2C;
+            if (parse_channels(v, c->ch, 2, 2))
+                return -EINVAL;
+        } else if (!strcmp(key, "period")) {
+            period = strtod(v, &end);
+            if (end == v || *end || period < 2 || period > 1e6)
+                return -EINVAL;
+            c->period_q8 = lround(period * 256);
+        } else if (!strcmp(key, "parity")) {
+            if (!v[0] || v[1] || !strchr("neo", v[0]))
+                return -EINVAL;
+            c->parity = v[0];
+        } else {
+            n = strtol(v, &end, 0);
+            if (end == v || *end || n < 0 || n > 16)
+                return -EINVAL;
+            if (!strcmp(key, "bits"))
+                c->bits = n;
+            else if (!strcmp(key, "stop"))
+                c->stop = n;
+            else if (!strcmp(key, "mode"))
+                c->mode = n;
+            else if (!strcmp(key, "lsb"))
+                c->lsb = !!n;
+            else
+                return -EINVAL;
+        }
+    }
+    if (proto < 0 || (proto == SDB_DEC_UART && !c->period_q8))
+        return -EINVAL;
+    c->proto = proto;
+    return 0;
+}
+
+int sdb_dec_format(const sdb_dec_t *d, const sdb_dec_frame_t *f, char *buf, size_t size)
+{
+    static const char *const types[] = { "data", "addr", "start", "stop" };
+    int n;
+
+    n = snprintf(buf, size, "%llu %llu %s", (unsigned long long)f->start,
+                 (unsigned long long)f->end, types[f->type & 3]);
+    if (f->type == SDB_DEC_ADDR)
+        n += snprintf(buf + n, size - n, " 0x%02x %s", f->data,
+                      f->flags & SDB_DEC_READ ? "read" : "write");
+    else if (f->type == SDB_DEC_DATA && d->c.proto == SDB_DEC_SPI && HAS(d, 2))
+        n += snprintf(buf + n, size - n, " 0x%02x/0x%02x", f->data, f->data2);
+    else if (f->type == SDB_DEC_DATA)
+        n += snprintf(buf + n, size - n, " 0x%02x", f->data);
+    if (f->type == SDB_DEC_DATA && d->c.proto == SDB_DEC_UART && f->data >= 0x20 && f->data < 0x7f)
+        n += snprintf(buf + n, size - n, " '%c'", f->data);
+    n += snprintf(buf + n, size - n, "%s%s%s%s%s", f->flags & SDB_DEC_RESTART ? " restart" : "",
+                  f->flags & SDB_DEC_NACK ? " nack" : "",
+                  f->flags & SDB_DEC_PARTIAL ? " partial" : "",
+                  f->flags & SDB_DEC_FRAMING ? " framing error" : "",
+                  f->flags & SDB_DEC_PARITY ? " parity error" : "");
+    return n;
+}
@@ -0,0 +1,127 @@
+/*
+ * sdb_decode.h
+ * Protocol decoders of the captured logic samples: UART, SPI and I2C.
+ *
+ * A sample is a byte of the buffers, 8 logic channels. The edges of the
+ * channels of the decoder are extracted first by the search of neon/
+ * (simd_edges_u8: NEON, SSE2 or scalar), the samples without any are
+ * skipped 16 at a time; a state machine per protocol then runs over the
+ * edges only, its cost goes with the transitions and not the samples:
+ *   SDB_DEC_UART   idle high, a start bit, 5 to 9 data bits LSB first, no,
+ *                  even or odd parity, 1 or 2 stop bits. Each bit is read
+ *                  in its middle, from the falling edge of the start bit,
+ *                  period: samples per bit.
+ *   SDB_DEC_SPI    clock, MOSI, MISO and chip select low, the last two
+ *                  optional, modes 0 to 3, words of 1 to 16 bits MSB or
+ *                  LSB first. The data are read at the sample of the
+ *                  sampling edge of the clock.
+ *   SDB_DEC_I2C    SCL, SDA: start, repeated start and stop conditions,
+ *                  address and data bytes, their acknowledge bit, all the
+ *                  bits read at the sample of the rising edge of SCL.
+ * The state goes on across the buffers, so the decoder runs as each one
+ * completes. The frames go in order to the callback, numbered in samples
+ * from 0 at the first sample processed.
+ *
+ * Spec of sdb_dec_parse(), comma separated:
+ *   uart=<rx>,period=<samples per bit, e.g. 8.68>   bits=8, parity=n|e|o, stop=1
+ *   spi=<clk>/<mosi>/<miso|->/<cs|->                mode=0, bits=8, lsb=0
+ *   i2c=<scl>/<sda>
+ * e.g. "uart=0,period=100,parity=e" or "spi=4/5/6/7,mode=3".
+ */
+
+#ifndef SDB_DECODE_H
+#define SDB_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "simd_kernels.h"
+
+#define SDB_DEC_NONE        0xff    /* channel not used */
+#define SDB_DEC_EDGES       4096    /* edges extracted at a time */
+#define SDB_DEC_LINE        128     /* bytes of a formatted frame at most */
+
+typedef enum {
+    SDB_DEC_UART = 0,
+    SDB_DEC_SPI,
+    SDB_DEC_I2C,
+} sdb_dec_proto_t;
+
+typedef enum {
+    SDB_DEC_DATA = 0,       /* UART character, SPI word, I2C data byte */
+    SDB_DEC_ADDR,           /* I2C address */
+    SDB_DEC_START,          /* I2C start or repeated start condition */
+    SDB_DEC_STOP,           /* I2C stop condition */
+} sdb_dec_type_t;
+
+/* Flags of the frames */
+#define SDB_DEC_FRAMING     0x01    /* UART: a stop bit low */
+#define SDB_DEC_PARITY      0x02    /* UART: parity bit wrong */
+#define SDB_DEC_NACK        0x04    /* I2C: not acknowledged */
+#define SDB_DEC_PARTIAL     0x08    /* SPI, I2C: cut by the chip select or a condition */
+#define SDB_DEC_READ        0x10    /* I2C address: read */
+#define SDB_DEC_RESTART     0x20    /* I2C start: repeated */
+#define SDB_DEC_ERRORS      (SDB_DEC_FRAMING | SDB_DEC_PARITY | SDB_DEC_PARTIAL)
+
+typedef struct
+{
+    uint64_t start;         /* UART: start edge, SPI, I2C: first bit */
+    uint64_t end;           /* last bit */
+    uint8_t type;           /* sdb_dec_type_t */
+    uint8_t flags;
+    uint16_t data;          /* UART, SPI MOSI, I2C byte or 7 bit address */
+    uint16_t data2;         /* SPI MISO */
+} sdb_dec_frame_t;
+
+typedef struct
+{
+    sdb_dec_proto_t proto;
+    uint8_t ch[4];          /* UART: rx; SPI: clk, mosi, miso, cs; I2C: scl, sda */
+    uint32_t period_q8;     /* UART: samples per bit, 1/256, 2 at least */
+    uint8_t bits;           /* UART: 5 to 9, SPI: 1 to 16 */
+    char parity;            /* UART: 'n', 'e' or 'o' */
+    uint8_t stop;           /* UART: 1 or 2 */
+    uint8_t mode;           /* SPI: CPOL << 1 | CPHA */
+    uint8_t lsb;            /* SPI: LSB first */
+} sdb_dec_cfg_t;
+
+/* Frame decoded */
+typedef void (*sdb_dec_fn_t)(void *ctx, const sdb_dec_frame_t *f);
+
+typedef struct
+{
+    sdb_dec_cfg_t c;
+    sdb_dec_fn_t on_frame;
+    void *ctx;
+    int scalar;             /* scalar edges, for the benchmarks */
+    uint8_t mask;           /* channels of the edges */
+
+    uint64_t nb_samples;    /* processed */
+    uint8_t last;           /* last sample processed */
+    int state;              /* 0: idle, then per protocol */
+    sdb_dec_frame_t f;      /* frame going on */
+    uint32_t nbits;         /* bits of the frame read */
+    uint32_t shift, shift2;
+    uint64_t next_q8;       /* UART: next bit to read, 1/256 sample */
+    uint8_t level;          /* UART: rx since the last edge */
+    uint8_t par;            /* UART: parity bit */
+    uint32_t pos[SDB_DEC_EDGES];
+
+    uint64_t frames;
+    uint64_t errors;        /* frames with a flag of SDB_DEC_ERRORS */
+    uint64_t edges;
+} sdb_dec_t;
+
+/* Returns 0 or -EINVAL; on_frame can be NULL */
+int sdb_dec_init(sdb_dec_t *d, const sdb_dec_cfg_t *c, sdb_dec_fn_t on_frame, void *ctx);
+
+/* Samples following the ones already processed */
+void sdb_dec_process(sdb_dec_t *d, const uint8_t *samples, uint32_t n);
+
+/* Config of a spec, see above. Returns 0 or -EINVAL */
+int sdb_dec_parse(sdb_dec_cfg_t *c, const char *spec);
+
+/* Text of a frame, e.g. "1200 1968 data 0x41 'A'", size: SDB_DEC_LINE */
+int sdb_dec_format(const sdb_dec_t *d, const sdb_dec_frame_t *f, char *buf, size_t size);
+
+#endif /* SDB_DECODE_H */
@@ -0,0 +1,420 @@
+/*
+ * sdb_pipeline.c
+ * Stages, queues and metrics of the processing pipeline, see sdb_pipeline.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sdb_capture.h"
+#include "sdb_pipeline.h"
+
+/* waits spin first, then yield, then sleep */
+#define SPIN_LOOPS  64
+#define YIELD_LOOPS 128
+#define SLEEP_NS    50000
+
+static void backoff(unsigned *n)
+{
+    struct timespec ts = { 0, SLEEP_NS };
+
+    if (++*n < SPIN_LOOPS)
+        return;
+    if (*n < YIELD_LOOPS)
+        sched_yield();
+    else
+        nanosleep(&ts, NULL);
+}
+
+static uint64_t now_ns(void)
+{
+    return sdb_cap_now_ns(CLOCK_MONOTONIC);
+}
+
+/********************************************************************************
+Queue: bounded MPMC ring, each cell carries the turn it is ready for
+*********************************************************************************/
+int sdb_pipe_queue_init(sdb_pipe_queue_t *q, uint32_t size)
+{
+    size_t i, n = 1;
+
+    while (n < size)
+        n <<= 1;
+    q->cells = malloc(n * sizeof(*q->cells));
+    if (!q->cells)
+        return -ENOMEM;
+    for (i = 0; i < n; i++)
+        atomic_init(&q->cells[i].seq, i);
+    q->mask = n - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return 0;
+}
+
+void sdb_pipe_queue_free(sdb_pipe_queue_t *q)
+{
+    free(q->cells);
+    q->cells = NULL;
+}
+
+int sdb_pipe_queue_push(sdb_pipe_queue_t *q, sdb_pipe_buf_t *b)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    sdb_pipe_cell_t *c;
+    intptr_t dif;
+
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+        dif = (intptr_t)atomic_load_explicit(&c->seq, memory_order_acquire) - (intptr_t)pos;
+        if (!dif) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return -EAGAIN;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    c->buf = b;
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+sdb_pipe_buf_t *sdb_pipe_queue_pop(sdb_pipe_queue_t *q)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    sdb_pipe_cell_t *c;
+    sdb_pipe_buf_t *b;
+    intptr_t dif;
+
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+        dif = (intptr_t)atomic_load_explicit(&c->seq, memory_order_acquire) -
+              (intptr_t)(pos + 1);
+        if (!dif) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+    b = c->buf;
+    atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+    return b;
+}
+
+uint32_t sdb_pipe_queue_depth(sdb_pipe_queue_t *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    return head > tail ? head - tail : 0;
+}
+
+/********************************************************************************
+Stages
+*********************************************************************************/
+static void metric_max(atomic_uint_fast64_t *m, uint64_t v)
+{
+    uint_fast64_t cur = atomic_load_explicit(m, memory_order_relaxed);
+
+    while (v > cur && !atomic_compare_exchange_weak_explicit(m, &cur, v, memory_order_relaxed,
+                                                             memory_order_relaxed))
+        ;
+}
+
+/* Next stage or back to the pool */
+static void forward(sdb_pipe_t *p, sdb_pipe_stage_t *st, sdb_pipe_buf_t *b)
+{
+    sdb_pipe_stage_t *next = st + 1;
+    unsigned n = 0;
+    uint64_t t0;
+
+    if (next == &p->stages[p->nb_stages]) {
+        sdb_pipe_queue_push(&p->free, b); /* never full: holds every handle */
+        atomic_fetch_sub(&p->in_flight, 1);
+        return;
+    }
+    if (!sdb_pipe_queue_push(&next->in, b))
+        return;
+
+    atomic_fetch_add_explicit(&st->m.full, 1, memory_order_relaxed);
+    t0 = now_ns();
+    while (sdb_pipe_queue_push(&next->in, b))
+        backoff(&n);
+    atomic_fetch_add_explicit(&st->m.blocked_ns, now_ns() - t0, memory_order_relaxed);
+}
+
+static void stage_run(sdb_pipe_t *p, sdb_pipe_stage_t *st, sdb_pipe_buf_t *b)
+{
+    uint64_t t0 = now_ns();
+    int ret, none = 0;
+
+    ret = st->fn(st->ctx, b);
+    if (ret < 0)
+        atomic_compare_exchange_strong(&p->error, &none, ret);
+    atomic_fetch_add_explicit(&st->m.busy_ns, now_ns() - t0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->m.buffers, 1, memory_order_relaxed);
+    forward(p, st, b);
+}
+
+static void *stage_thread(void *arg)
+{
+    sdb_pipe_thread_t *th = arg;
+    sdb_pipe_stage_t *st = th->st;
+    sdb_pipe_t *p = st->p;
+    sdb_pipe_buf_t *b;
+    cpu_set_t set;
+    uint64_t t0;
+    uint32_t depth;
+    unsigned n;
+
+    if (th->cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(th->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+            printf("pipeline %s: cannot pin to cpu %d\n", st->name, th->cpu);
+    }
+
+    for (;;) {
+        n = 0;
+        t0 = now_ns();
+        depth = sdb_pipe_queue_depth(&st->in);
+        while (!(b = sdb_pipe_queue_pop(&st->in))) {
+            if (atomic_load(&p->stop))
+                return NULL;
+            backoff(&n);
+            depth = 0;
+        }
+        atomic_fetch_add_explicit(&st->m.wait_ns, now_ns() - t0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&st->m.occ_sum, depth, memory_order_relaxed);
+        metric_max(&st->m.occ_max, depth);
+
+        if (!st->ordered) {
+            stage_run(p, st, b);
+            continue;
+        }
+        /* no collision: at most nb_bufs handles are in flight */
+        st->pending[b->seq % p->nb_bufs] = b;
+        while ((b = st->pending[st->next_seq % p->nb_bufs]) && b->seq == st->next_seq) {
+            st->pending[st->next_seq % p->nb_bufs] = NULL;
+            st->next_seq++;
+            stage_run(p, st, b);
+        }
+    }
+}
+
+/********************************************************************************
+Pipeline
+*********************************************************************************/
+int sdb_pipe_init(sdb_pipe_t *p, uint32_t nb_bufs, uint32_t buf_size)
+{
+    uint32_t i;
+
+    memset(p, 0, sizeof(*p));
+    if (!nb_bufs)
+        return -EINVAL;
+    p->nb_bufs = nb_bufs;
+    p->bufs = calloc(nb_bufs, sizeof(*p->bufs));
+    if (!p->bufs || sdb_pipe_queue_init(&p->free, nb_bufs))
+        goto nomem;
+    for (i = 0; i < nb_bufs; i++) {
+        p->bufs[i].cap = buf_size;
+        p->bufs[i].data = malloc(buf_size);
+        p->bufs[i].out = malloc(buf_size);
+        p->bufs[i].tmp = malloc(buf_size);
+        if (!p->bufs[i].data || !p->bufs[i].out || !p->bufs[i].tmp)
+            goto nomem;
+        sdb_pipe_queue_push(&p->free, &p->bufs[i]);
+    }
+    return 0;
+
+nomem:
+    sdb_pipe_free(p);
+    return -ENOMEM;
+}
+
+int sdb_pipe_add_stage(sdb_pipe_t *p, const char *name, sdb_pipe_fn_t fn, void *ctx,
+                       int nb_threads, int cpu, int ordered, uint32_t depth)
+{
+    sdb_pipe_stage_t *st = &p->stages[p->nb_stages];
+
+    if (p->started || p->nb_stages == SDB_PIPE_MAX_STAGES || nb_threads < 1 ||
+        (ordered && nb_threads > 1))
+        return -EINVAL;
+
+    st->name = name;
+    st->fn = fn;
+    st->ctx = ctx;
+    st->nb_threads = nb_threads;
+    st->cpu = cpu;
+    st->ordered = ordered;
+    st->p = p;
+    if (sdb_pipe_queue_init(&st->in, depth ? depth : 1))
+        return -ENOMEM;
+    if (ordered) {
+        st->pending = calloc(p->nb_bufs, sizeof(*st->pending));
+        if (!st->pending) {
+            sdb_pipe_queue_free(&st->in);
+            return -ENOMEM;
+        }
+    }
+    p->nb_stages++;
+    return 0;
+}
+
+int sdb_pipe_start(sdb_pipe_t *p)
+{
+    long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    sdb_pipe_stage_t *st;
+    int i, j, ret;
+
+    if (!p->nb_stages || p->started)
+        return -EINVAL;
+    p->started = 1;
+    for (i = 0; i < p->nb_stages; i++) {
+        st = &p->stages[i];
+        st->threads = calloc(st->nb_threads, sizeof(*st->threads));
+        if (!st->threads) {
+            sdb_pipe_stop(p);
+            return -ENOMEM;
+        }
+        for (j = 0; j < st->nb_threads; j++) {
+            st->threads[j].st = st;
+            st->threads[j].cpu = st->cpu < 0 ? -1 : (st->cpu + j) % (nb_cpus > 0 ? nb_cpus : 1);
+            ret = pthread_create(&st->threads[j].tid, NULL, stage_thread, &st->threads[j]);
+            if (ret) {
+                st->nb_threads = j;
+                sdb_pipe_stop(p);
+                return -ret;
+            }
+        }
+    }
+    return 0;
+}
+
+sdb_pipe_buf_t *sdb_pipe_get(sdb_pipe_t *p)
+{
+    sdb_pipe_buf_t *b = sdb_pipe_queue_pop(&p->free);
+    unsigned n = 0;
+    uint64_t t0;
+
+    if (b)
+        return b;
+    p->src_full++;
+    t0 = now_ns();
+    while (!(b = sdb_pipe_queue_pop(&p->free)))
+        backoff(&n);
+    p->src_blocked_ns += now_ns() - t0;
+    return b;
+}
+
+void sdb_pipe_put(sdb_pipe_t *p, sdb_pipe_buf_t *b)
+{
+    unsigned n = 0;
+    uint64_t t0;
+
+    b->seq = p->next_seq++;
+    p->src_buffers++;
+    atomic_fetch_add(&p->in_flight, 1);
+    if (!sdb_pipe_queue_push(&p->stages[0].in, b))
+        return;
+    p->src_full++;
+    t0 = now_ns();
+    while (sdb_pipe_queue_push(&p->stages[0].in, b))
+        backoff(&n);
+    p->src_blocked_ns += now_ns() - t0;
+}
+
+void sdb_pipe_stop(sdb_pipe_t *p)
+{
+    sdb_pipe_stage_t *st;
+    unsigned n = 0;
+    int i, j;
+
+    if (!p->started)
+        return;
+    /* every stage still has its threads: the handles come back */
+    for (i = 0; i < p->nb_stages; i++)
+        if (!p->stages[i].threads || p->stages[i].nb_threads < 1)
+            break;
+    if (i == p->nb_stages) {
+        while (atomic_load(&p->in_flight))
+            backoff(&n);
+    }
+
+    atomic_store(&p->stop, 1);
+    for (i = 0; i < p->nb_stages; i++) {
+        st = &p->stages[i];
+        for (j = 0; st->threads && j < st->nb_threads; j++)
+            pthread_join(st->threads[j].tid, NULL);
+        free(st->threads);
+        st->threads = NULL;
+    }
+    p->started = 0;
+}
+
+void sdb_pipe_free(sdb_pipe_t *p)
+{
+    uint32_t i;
+    int s;
+
+    sdb_pipe_stop(p);
+    for (s = 0; s < p->nb_stages; s++) {
+        sdb_pipe_queue_free(&p->stages[s].in);
+        free(p->stages[s].pending);
+        p->stages[s].pending = NULL;
+    }
+    p->nb_stages = 0;
+    if (p->bufs) {
+        for (i = 0; i < p->nb_bufs; i++) {
+            free(p->bufs[i].data);
+            free(p->bufs[i].out);
+            free(p->bufs[i].tmp);
+        }
+    }
+    free(p->bufs);
+    p->bufs = NULL;
+    sdb_pipe_queue_free(&p->free);
+}
+
+void sdb_pipe_print(sdb_pipe_t *p, FILE *f, uint64_t elapsed_ns)
+{
+    double t = elapsed_ns ? (double)elapsed_ns : 1.0;
+    sdb_pipe_stage_t *st;
+    uint64_t nb;
+    int i;
+
+    fprintf(f, "stage       thr  buffers  busy%%  wait%% block%%     full  q avg  q max\n");
+    fprintf(f, "%-10s %4s %8llu %6s %6s %6.1f %8llu %6s %6s\n", "source", "-",
+            (unsigned long long)p->src_buffers, "-", "-", 100.0 * p->src_blocked_ns / t,
+            (unsigned long long)p->src_full, "-", "-");
+    for (i = 0; i < p->nb_stages; i++) {
+        st = &p->stages[i];
+        nb = atomic_load(&st->m.buffers);
+        /* per thread of the stage */
+        fprintf(f, "%-10s %4d %8llu %6.1f %6.1f %6.1f %8llu %6.2f %6llu\n", st->name,
+                st->nb_threads, (unsigned long long)nb,
+                100.0 * atomic_load(&st->m.busy_ns) / t / st->nb_threads,
+                100.0 * atomic_load(&st->m.wait_ns) / t / st->nb_threads,
+                100.0 * atomic_load(&st->m.blocked_ns) / t / st->nb_threads,
+                (unsigned long long)atomic_load(&st->m.full),
+                nb ? (double)atomic_load(&st->m.occ_sum) / nb : 0.0,
+                (unsigned long long)atomic_load(&st->m.occ_max));
+    }
+}
@@ -0,0 +1,144 @@
+/*
+ * sdb_pipeline.h
+ * Processing pipeline of the captured buffers.
+ *
+ * The source (the completion of an rpmsg_sdb buffer) takes a handle from
+ * a fixed pool, fills it and puts it in the pipeline. Each stage runs its
+ * function on the handles on one or more threads, pinned to CPUs if asked,
+ * and passes them to the next stage; after the last one the handle goes
+ * back to the pool. Only handles travel: the data is never copied.
+ *
+ * Stages are connected by bounded lock-free queues. A full queue blocks
+ * the stage before it and an empty pool blocks the source, so a slow
+ * stage slows the source down instead of growing memory. The threads
+ * spin, yield then sleep while they wait.
+ *
+ * A stage with several threads completes the handles out of order, an
+ * ordered stage (one thread) sees them again in the order of the source,
+ * as the capture writer needs.
+ */
+
+#ifndef SDB_PIPELINE_H
+#define SDB_PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define SDB_PIPE_MAX_STAGES 8
+#define SDB_PIPE_CACHE_LINE 64
+
+typedef struct
+{
+    uint8_t *data;
+    uint32_t size;          /* bytes in data */
+    uint32_t cap;           /* bytes allocated in data, out and tmp */
+    uint8_t *out;           /* second buffer for the stages that transform */
+    uint8_t *tmp;           /* scratch of the stage functions */
+    uint32_t out_size;      /* bytes in out, 0: the result is data */
+    uint16_t buffer_id;
+    uint16_t flags;
+    uint32_t crc;
+    uint64_t seq;           /* set by sdb_pipe_put() */
+    uint64_t ts_ns;
+} sdb_pipe_buf_t;
+
+typedef struct
+{
+    atomic_size_t seq;
+    sdb_pipe_buf_t *buf;
+} sdb_pipe_cell_t;
+
+/* Bounded multi-producer multi-consumer queue of handles */
+typedef struct
+{
+    sdb_pipe_cell_t *cells;
+    size_t mask;
+    _Alignas(SDB_PIPE_CACHE_LINE) atomic_size_t head;   /* next push */
+    _Alignas(SDB_PIPE_CACHE_LINE) atomic_size_t tail;   /* next pop */
+} sdb_pipe_queue_t;
+
+/* Returns 0 or a negative errno, the stage goes on with the next buffer */
+typedef int (*sdb_pipe_fn_t)(void *ctx, sdb_pipe_buf_t *b);
+
+typedef struct
+{
+    atomic_uint_fast64_t buffers;
+    atomic_uint_fast64_t busy_ns;    /* in the stage function */
+    atomic_uint_fast64_t wait_ns;    /* input queue empty */
+    atomic_uint_fast64_t blocked_ns; /* output queue full: back-pressure */
+    atomic_uint_fast64_t full;       /* pushes that found the output full */
+    atomic_uint_fast64_t occ_sum;    /* input queue depth seen at each pop */
+    atomic_uint_fast64_t occ_max;
+} sdb_pipe_metrics_t;
+
+struct sdb_pipe;
+
+typedef struct
+{
+    pthread_t tid;
+    struct sdb_pipe_stage *st;
+    int cpu;                /* -1: not pinned */
+} sdb_pipe_thread_t;
+
+typedef struct sdb_pipe_stage
+{
+    const char *name;
+    sdb_pipe_fn_t fn;
+    void *ctx;
+    int nb_threads;
+    int cpu;                /* first CPU, the threads take the next ones; -1: any */
+    int ordered;
+    struct sdb_pipe *p;
+    sdb_pipe_queue_t in;
+    sdb_pipe_thread_t *threads;
+    sdb_pipe_buf_t **pending;   /* ordered: handles ahead of next_seq */
+    uint64_t next_seq;
+    sdb_pipe_metrics_t m;
+} sdb_pipe_stage_t;
+
+typedef struct sdb_pipe
+{
+    sdb_pipe_stage_t stages[SDB_PIPE_MAX_STAGES];
+    int nb_stages;
+    sdb_pipe_buf_t *bufs;
+    uint32_t nb_bufs;
+    sdb_pipe_queue_t free;
+    uint64_t next_seq;
+    atomic_uint_fast64_t in_flight;
+    atomic_int stop;
+    atomic_int error;       /* first stage error */
+    int started;
+
+    /* source */
+    uint64_t src_buffers;
+    uint64_t src_blocked_ns;    /* no free handle */
+    uint64_t src_full;
+} sdb_pipe_t;
+
+int sdb_pipe_queue_init(sdb_pipe_queue_t *q, uint32_t size);
+void sdb_pipe_queue_free(sdb_pipe_queue_t *q);
+/* Non blocking, return 0 or -EAGAIN */
+int sdb_pipe_queue_push(sdb_pipe_queue_t *q, sdb_pipe_buf_t *b);
+sdb_pipe_buf_t *sdb_pipe_queue_pop(sdb_pipe_queue_t *q);
+uint32_t sdb_pipe_queue_depth(sdb_pipe_queue_t *q);
+
+/* nb_bufs handles of buf_size bytes, returns 0 or -errno */
+int sdb_pipe_init(sdb_pipe_t *p, uint32_t nb_bufs, uint32_t buf_size);
+/* In pipeline order before sdb_pipe_start(), depth: input queue size */
+int sdb_pipe_add_stage(sdb_pipe_t *p, const char *name, sdb_pipe_fn_t fn, void *ctx,
+                       int nb_threads, int cpu, int ordered, uint32_t depth);
+int sdb_pipe_start(sdb_pipe_t *p);
+
+/* Source side, from one thread: a free handle (blocks), then into the first stage */
+sdb_pipe_buf_t *sdb_pipe_get(sdb_pipe_t *p);
+void sdb_pipe_put(sdb_pipe_t *p, sdb_pipe_buf_t *b);
+
+/* Waits for the handles in flight then stops the threads */
+void sdb_pipe_stop(sdb_pipe_t *p);
+void sdb_pipe_free(sdb_pipe_t *p);
+/* Metrics over elapsed_ns */
+void sdb_pipe_print(sdb_pipe_t *p, FILE *f, uint64_t elapsed_ns);
+
+#endif /* SDB_PIPELINE_H */
@@ -0,0 +1,340 @@
+/*
+ * sdb_pyramid.c
+ * Decimation pyramid of the captured samples, see sdb_pyramid.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "sdb_capture.h"
+#include "sdb_compress.h"
+#include "sdb_pyramid.h"
+#include "simd_kernels.h"
+
+#define NODES_MIN 64
+
+static const sdb_pyr_node_t mEmpty = { 0xff, 0, 0xff, 0, 0 };
+
+void sdb_pyr_merge(sdb_pyr_node_t *dst, const sdb_pyr_node_t *src)
+{
+    uint64_t edges = (uint64_t)dst->edges + src->edges;
+
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    dst->and_bits &= src->and_bits;
+    dst->or_bits |= src->or_bits;
+    dst->edges = edges > UINT32_MAX ? UINT32_MAX : edges;
+}
+
+static void from_summary(sdb_pyr_node_t *n, const simd_summary_u8_t *s)
+{
+    n->min = s->min;
+    n->max = s->max;
+    n->and_bits = s->and_bits;
+    n->or_bits = s->or_bits;
+    n->edges = s->edges > UINT32_MAX ? UINT32_MAX : s->edges;
+}
+
+/* Called with the lock held, as the functions below up to the entry points */
+static void reset(sdb_pyr_t *p)
+{
+    uint32_t l;
+
+    for (l = 0; l < SDB_PYR_MAX_LEVELS; l++) {
+        free(p->nodes[l]);
+        p->nodes[l] = NULL;
+        p->nb_nodes[l] = 0;
+        p->max_nodes[l] = 0;
+    }
+    p->nb_levels = 0;
+    p->nb_samples = 0;
+    p->last = 0;
+}
+
+static int grow(sdb_pyr_t *p, uint32_t l, uint64_t nb)
+{
+    sdb_pyr_node_t *n;
+    uint64_t max = p->max_nodes[l] ? p->max_nodes[l] : NODES_MIN;
+
+    if (nb <= p->max_nodes[l])
+        return 0;
+    while (max < nb)
+        max *= 2;
+    n = realloc(p->nodes[l], max * sizeof(*n));
+    if (!n)
+        return -ENOMEM;
+    p->nodes[l] = n;
+    p->max_nodes[l] = max;
+    return 0;
+}
+
+/* Merges again the nodes above the level 0 ones from first on */
+static int update_levels(sdb_pyr_t *p, uint64_t first)
+{
+    sdb_pyr_node_t *n;
+    uint64_t k, c, nb;
+    uint32_t l, f = p->fanout;
+
+    for (l = 0; p->nb_nodes[l] > 1; l++) {
+        if (l + 1 == SDB_PYR_MAX_LEVELS)
+            return -EOVERFLOW;
+        nb = (p->nb_nodes[l] + f - 1) / f;
+        if (grow(p, l + 1, nb))
+            return -ENOMEM;
+        p->nb_nodes[l + 1] = nb;
+        for (k = first / f; k < nb; k++) {
+            n = &p->nodes[l + 1][k];
+            *n = mEmpty;
+            for (c = k * f; c < (k + 1) * f && c < p->nb_nodes[l]; c++)
+                sdb_pyr_merge(n, &p->nodes[l][c]);
+        }
+        first /= f;
+    }
+    p->nb_levels = p->nb_nodes[0] ? l + 1 : 0;
+    return 0;
+}
+
+void sdb_pyr_init(sdb_pyr_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->base = SDB_PYR_BASE;
+    p->fanout = SDB_PYR_FANOUT;
+    pthread_mutex_init(&p->lock, NULL);
+}
+
+void sdb_pyr_free(sdb_pyr_t *p)
+{
+    reset(p);
+    pthread_mutex_destroy(&p->lock);
+}
+
+int sdb_pyr_append(sdb_pyr_t *p, const uint8_t *samples, uint64_t n)
+{
+    simd_summary_u8_t s;
+    sdb_pyr_node_t node;
+    uint64_t i = 0, off, len, first;
+    int ret = 0, ret2;
+
+    if (!n)
+        return 0;
+
+    pthread_mutex_lock(&p->lock);
+    /* the node of the next sample, the last one if it is not full */
+    first = p->nb_samples / p->base;
+    while (i < n) {
+        off = p->nb_samples % p->base;
+        len = p->base - off < n - i ? p->base - off : n - i;
+        if (!off) {
+            ret = grow(p, 0, p->nb_nodes[0] + 1);
+            if (ret)
+                break;
+            p->nodes[0][p->nb_nodes[0]++] = mEmpty;
+        }
+        simd_summary_u8(samples + i, len, p->nb_samples ? p->last : samples[i], &s);
+        from_summary(&node, &s);
+        sdb_pyr_merge(&p->nodes[0][p->nb_nodes[0] - 1], &node);
+        p->last = samples[i + len - 1];
+        p->nb_samples += len;
+        i += len;
+    }
+    /* consistent up to the samples taken */
+    ret2 = update_levels(p, first);
+    pthread_mutex_unlock(&p->lock);
+
+    return ret ? ret : ret2;
+}
+
+int sdb_pyr_query(sdb_pyr_t *p, uint64_t first, uint64_t count, uint32_t pixels,
+                  sdb_pyr_node_t *out)
+{
+    uint64_t span, k, end;
+    uint32_t i, l;
+
+    if (!pixels || !count || first + count < first)
+        return -EINVAL;
+
+    pthread_mutex_lock(&p->lock);
+    if (first + count > p->nb_samples) {
+        pthread_mutex_unlock(&p->lock);
+        return -EINVAL;
+    }
+    if (count / pixels < p->base) {
+        pthread_mutex_unlock(&p->lock);
+        return -ERANGE;
+    }
+    /* the coarsest level with a node per pixel at least */
+    span = p->base;
+    for (l = 0; l + 1 < p->nb_levels && span * p->fanout <= count / pixels; l++)
+        span *= p->fanout;
+
+    k = first / span;
+    for (i = 0; i < pixels; i++) {
+        out[i] = mEmpty;
+        /* end of the pixel, without overflow */
+        end = first + count / pixels * (i + 1) + count % pixels * (i + 1) / pixels;
+        for (; k * span < end; k++)
+            sdb_pyr_merge(&out[i], &p->nodes[l][k]);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return l;
+}
+
+void sdb_pyr_summarize(const uint8_t *samples, uint64_t n, uint8_t prev, uint32_t pixels,
+                       sdb_pyr_node_t *out)
+{
+    simd_summary_u8_t s;
+    uint64_t start = 0, end;
+    uint32_t i;
+
+    for (i = 0; i < pixels; i++) {
+        end = n / pixels * (i + 1) + n % pixels * (i + 1) / pixels;
+        simd_summary_u8(samples + start, end - start, start ? samples[start - 1] : prev, &s);
+        from_summary(&out[i], &s);
+        start = end;
+    }
+}
+
+int sdb_pyr_save(sdb_pyr_t *p, const char *path)
+{
+    sdb_pyr_hdr_t hdr;
+    FILE *f;
+    uint32_t l;
+    int ret = 0;
+
+    pthread_mutex_lock(&p->lock);
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SDB_PYR_MAGIC, sizeof(hdr.magic));
+    hdr.version = SDB_PYR_VERSION;
+    hdr.hdr_size = sizeof(hdr);
+    hdr.base = p->base;
+    hdr.fanout = p->fanout;
+    hdr.nb_levels = p->nb_levels;
+    hdr.nb_samples = p->nb_samples;
+    hdr.last = p->last;
+    for (l = 0; l < p->nb_levels; l++) {
+        hdr.nb_nodes[l] = p->nb_nodes[l];
+        hdr.crc = sdb_cap_crc32(hdr.crc, p->nodes[l], p->nb_nodes[l] * sizeof(sdb_pyr_node_t));
+    }
+
+    f = fopen(path, "wb");
+    if (!f) {
+        pthread_mutex_unlock(&p->lock);
+        return -errno;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+        ret = -EIO;
+    for (l = 0; l < p->nb_levels && !ret; l++)
+        if (fwrite(p->nodes[l], sizeof(sdb_pyr_node_t), p->nb_nodes[l], f) != p->nb_nodes[l])
+            ret = -EIO;
+    if (fflush(f) || fsync(fileno(f)))
+        ret = -errno;
+    if (fclose(f))
+        ret = -errno;
+    pthread_mutex_unlock(&p->lock);
+
+    return ret;
+}
+
+int sdb_pyr_load(sdb_pyr_t *p, const char *path)
+{
+    sdb_pyr_hdr_t hdr;
+    FILE *f;
+    uint64_t nb;
+    uint32_t l, crc = 0;
+    int ret = 0;
+
+    f = fopen(path, "rb");
+    if (!f)
+        return -errno;
+
+    pthread_mutex_lock(&p->lock);
+    reset(p);
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, SDB_PYR_MAGIC, sizeof(hdr.magic)) || hdr.version != SDB_PYR_VERSION ||
+        hdr.hdr_size != sizeof(hdr) || !hdr.base || hdr.fanout < 2 ||
+        hdr.nb_levels > SDB_PYR_MAX_LEVELS)
+        ret = -EINVAL;
+    /* each level as the samples give it */
+    nb = ret ? 0 : (hdr.nb_samples + hdr.base - 1) / hdr.base;
+    for (l = 0; l < hdr.nb_levels && !ret; l++) {
+        if (hdr.nb_nodes[l] != nb || (l + 1 == hdr.nb_levels) != (nb == 1)) {
+            ret = -EINVAL;
+            break;
+        }
+        ret = grow(p, l, nb);
+        if (!ret && fread(p->nodes[l], sizeof(sdb_pyr_node_t), nb, f) != nb)
+            ret = -EIO;
+        if (ret)
+            break;
+        p->nb_nodes[l] = nb;
+        crc = sdb_cap_crc32(crc, p->nodes[l], nb * sizeof(sdb_pyr_node_t));
+        nb = (nb + hdr.fanout - 1) / hdr.fanout;
+    }
+    if (!ret && (crc != hdr.crc || (!hdr.nb_levels && hdr.nb_samples)))
+        ret = -EINVAL;
+    if (ret) {
+        reset(p);
+    } else {
+        p->base = hdr.base;
+        p->fanout = hdr.fanout;
+        p->nb_levels = hdr.nb_levels;
+        p->nb_samples = hdr.nb_samples;
+        p->last = hdr.last;
+    }
+    pthread_mutex_unlock(&p->lock);
+    fclose(f);
+
+    return ret;
+}
+
+int sdb_pyr_build(sdb_pyr_t *p, const char *cap_path)
+{
+    sdb_cap_reader_t r;
+    sdb_cap_view_t v;
+    uint8_t *buf = NULL, *b;
+    uint32_t size, max = 0;
+    uint64_t i;
+    int ret;
+
+    ret = sdb_cap_reader_open(&r, cap_path);
+    if (ret)
+        return ret;
+
+    pthread_mutex_lock(&p->lock);
+    reset(p);
+    pthread_mutex_unlock(&p->lock);
+    for (i = 0; i < r.nb_records && !ret; i++) {
+        ret = sdb_cap_reader_get(&r, i, &v);
+        if (ret)
+            break;
+        if (!(v.hdr->flags & SDB_CAP_REC_LZ4)) {
+            ret = sdb_pyr_append(p, v.data, v.hdr->size);
+            continue;
+        }
+        size = sdb_comp_raw_size(&v);
+        if (size > max) {
+            b = realloc(buf, size);
+            if (!b) {
+                ret = -ENOMEM;
+                break;
+            }
+            buf = b;
+            max = size;
+        }
+        if (sdb_comp_decode(&v, buf, size) != (int)size)
+            ret = -EIO;
+        else
+            ret = sdb_pyr_append(p, buf, size);
+    }
+    free(buf);
+    sdb_cap_reader_close(&r);
+
+    return ret;
+}
@@ -0,0 +1,107 @@
+/*
+ * sdb_pyramid.h
+ * Decimation pyramid of the captured samples, for the zoomed out views.
+ *
+ * A sample is a byte of the buffers, 8 logic channels. Level 0 has a node
+ * per base samples, each level above a node per fanout nodes of the one
+ * below, up to a single node. A node holds the min and max sample, the
+ * channels high in all its samples (and) or in one at least (or), and
+ * the edges: samples different from the one before. The last node of a
+ * level covers the samples left and changes while the capture grows.
+ *
+ * sdb_pyr_append() is called as each buffer completes: the level 0 nodes
+ * are SIMD summaries of the samples (simd_summary_u8 of neon/), the nodes
+ * above them are merged again. The pyramid can be queried meanwhile from
+ * another thread.
+ *
+ * A query gives a node per pixel over a range of samples, merged from the
+ * coarsest level with a node per pixel at least: O(pixels * fanout) at
+ * any zoom. Zooms finer than base samples per pixel need the samples,
+ * sdb_pyr_summarize() then gives the same nodes from them.
+ *
+ * Stored next to the capture (<capture>.pyr), little endian:
+ *   header     sdb_pyr_hdr_t
+ *   nodes      sdb_pyr_node_t, level 0 first
+ * The file is written by sdb_pyr_save() once the capture is closed; when
+ * it is missing or stale, sdb_pyr_build() makes it again from the capture.
+ */
+
+#ifndef SDB_PYRAMID_H
+#define SDB_PYRAMID_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define SDB_PYR_MAGIC       "SDBPYR01"
+#define SDB_PYR_VERSION     1
+#define SDB_PYR_BASE        1024    /* samples per level 0 node */
+#define SDB_PYR_FANOUT      8
+#define SDB_PYR_MAX_LEVELS  16
+
+typedef struct
+{
+    uint8_t min;
+    uint8_t max;
+    uint8_t and_bits;
+    uint8_t or_bits;
+    uint32_t edges;         /* saturates, beyond 4G samples of a toggling signal */
+} sdb_pyr_node_t;
+
+typedef struct
+{
+    char magic[8];          /* SDB_PYR_MAGIC */
+    uint32_t version;
+    uint32_t hdr_size;      /* sizeof(sdb_pyr_hdr_t), nodes start here */
+    uint32_t base;
+    uint32_t fanout;
+    uint32_t nb_levels;
+    uint32_t crc;           /* crc32 of the nodes */
+    uint64_t nb_samples;
+    uint8_t last;           /* last sample, the edge of the next one */
+    uint8_t reserved[7];
+    uint64_t nb_nodes[SDB_PYR_MAX_LEVELS];
+} sdb_pyr_hdr_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;   /* append and queries */
+    uint32_t base;
+    uint32_t fanout;
+    uint32_t nb_levels;
+    uint64_t nb_samples;
+    uint8_t last;
+    sdb_pyr_node_t *nodes[SDB_PYR_MAX_LEVELS];
+    uint64_t nb_nodes[SDB_PYR_MAX_LEVELS];
+    uint64_t max_nodes[SDB_PYR_MAX_LEVELS];
+} sdb_pyr_t;
+
+/* Empty pyramid with SDB_PYR_BASE and SDB_PYR_FANOUT */
+void sdb_pyr_init(sdb_pyr_t *p);
+void sdb_pyr_free(sdb_pyr_t *p);
+
+/* Samples following the ones already there, returns 0 or -ENOMEM */
+int sdb_pyr_append(sdb_pyr_t *p, const uint8_t *samples, uint64_t n);
+
+/*
+ * A node per pixel over the count samples from first; a node goes to the
+ * pixel of its first sample, so the pixels at both ends include whole
+ * nodes reaching out of the range. Returns the level of the nodes, -ERANGE
+ * when the zoom needs the samples or -EINVAL.
+ */
+int sdb_pyr_query(sdb_pyr_t *p, uint64_t first, uint64_t count, uint32_t pixels,
+                  sdb_pyr_node_t *out);
+
+/* A node per pixel of n samples, prev: the sample before (samples[0] for none) */
+void sdb_pyr_summarize(const uint8_t *samples, uint64_t n, uint8_t prev, uint32_t pixels,
+                       sdb_pyr_node_t *out);
+
+/* Merge of src into dst, src coming after dst */
+void sdb_pyr_merge(sdb_pyr_node_t *dst, const sdb_pyr_node_t *src);
+
+/* Returns 0 or -errno */
+int sdb_pyr_save(sdb_pyr_t *p, const char *path);
+int sdb_pyr_load(sdb_pyr_t *p, const char *path);
+/* From the records of a capture file, compressed or not */
+int sdb_pyr_build(sdb_pyr_t *p, const char *cap_path);
+
+#endif /* SDB_PYRAMID_H */
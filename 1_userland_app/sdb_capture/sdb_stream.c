@@ -0,0 +1,655 @@
+/*
+ * sdb_stream.c
+ * Streaming of the captured buffers to TCP and UDP clients, see sdb_stream.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+
+#include "sdb_capture.h"
+#include "sdb_stream.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+#define POLL_MS 100
+
+static uint64_t now_ns(void)
+{
+    return sdb_cap_now_ns(CLOCK_MONOTONIC);
+}
+
+static void wake(sdb_stream_t *s)
+{
+    uint64_t one = 1;
+
+    if (write(s->efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("sdb_stream wake");
+}
+
+/* Called with the lock held, as every function below up to the thread */
+static void unref(sdb_stream_t *s, uint32_t slot)
+{
+    sdb_stream_slot_t *sl = &s->slots[slot];
+
+    if (--sl->refs)
+        return;
+    sl->used = 0;
+    pthread_cond_broadcast(&s->cond);
+}
+
+static uint32_t nb_dgrams(uint32_t size)
+{
+    return size ? (size + SDB_STREAM_DGRAM - 1) / SDB_STREAM_DGRAM : 1;
+}
+
+static void remove_queued(sdb_stream_t *s, sdb_stream_client_t *c, uint32_t i)
+{
+    unref(s, c->queue[i]);
+    c->nb_queued--;
+    memmove(&c->queue[i], &c->queue[i + 1], (c->nb_queued - i) * sizeof(c->queue[0]));
+}
+
+/*
+ * graceful: the data already sent still goes out (stop), otherwise the
+ * connection is reset so that the kernel lets the buffers go at once
+ */
+static void close_client(sdb_stream_t *s, sdb_stream_client_t *c, int graceful)
+{
+    struct linger lg = { 1, 0 };
+    uint32_t i;
+
+    if (!graceful)
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(c->fd);
+    c->fd = -1;
+    while (c->nb_queued)
+        remove_queued(s, c, c->nb_queued - 1);
+    for (i = 0; i < c->nb_sent; i++)
+        unref(s, c->sent[i].slot);
+    c->nb_sent = 0;
+    pthread_cond_broadcast(&s->cond);
+}
+
+static sdb_stream_client_t *new_client(sdb_stream_t *s, int fd, int udp,
+                                       sdb_stream_policy_t policy, const char *name)
+{
+    sdb_stream_client_t *c = NULL;
+    int i, one = 1;
+
+    for (i = 0; i < SDB_STREAM_MAX_CLIENTS; i++)
+        if (s->clients[i].fd < 0) {
+            c = &s->clients[i];
+            break;
+        }
+    if (!c)
+        return NULL;
+
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->udp = udp;
+    c->policy = policy;
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->zerocopy = s->zerocopy &&
+                  !setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+    return c;
+}
+
+/* The buffers of c whose zerocopy sends have all completed */
+static void release_sent(sdb_stream_t *s, sdb_stream_client_t *c)
+{
+    while (c->nb_sent && (int32_t)(c->zc_done - c->sent[0].zc_end) >= 0) {
+        unref(s, c->sent[0].slot);
+        c->nb_sent--;
+        memmove(&c->sent[0], &c->sent[1], c->nb_sent * sizeof(c->sent[0]));
+    }
+}
+
+static void sent(sdb_stream_t *s, sdb_stream_client_t *c)
+{
+    uint32_t slot = c->queue[0];
+
+    c->nb_queued--;
+    memmove(&c->queue[0], &c->queue[1], c->nb_queued * sizeof(c->queue[0]));
+    c->done = 0;
+    c->buffers++;
+    if (!c->zerocopy) {
+        unref(s, slot);
+        return;
+    }
+    c->sent[c->nb_sent].slot = slot;
+    c->sent[c->nb_sent].zc_end = c->zc_sends;
+    c->nb_sent++;
+    /* copied by the fallback, nothing to wait for */
+    release_sent(s, c);
+}
+
+/* Returns the bytes sent, -EAGAIN or -errno */
+static ssize_t send_iov(sdb_stream_client_t *c, struct iovec *iov, int nb)
+{
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = nb };
+    ssize_t n;
+
+    if (c->zerocopy) {
+        n = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (n >= 0) {
+            c->zc_sends++;
+            return n;
+        }
+        /*
+         * ENOBUFS: out of locked memory for the pages in flight, copy this
+         * one. EFAULT: pages that cannot be pinned, as a remap_pfn_range()
+         * mapping of rpmsg_sdb, copy from now on.
+         */
+        if (errno == EFAULT)
+            c->zerocopy = 0;
+        else if (errno != ENOBUFS)
+            return -errno;
+        c->zc_fallbacks++;
+    }
+    n = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    return n >= 0 ? n : -errno;
+}
+
+/* Sends until the socket is full, returns 0 or -errno */
+static int send_client(sdb_stream_t *s, sdb_stream_client_t *c)
+{
+    sdb_stream_slot_t *sl;
+    struct iovec iov[2];
+    uint32_t hdr = sizeof(sdb_stream_hdr_t), frame, off;
+    ssize_t n;
+
+    /* the completions are needed before more buffers go */
+    while (c->nb_queued && c->nb_sent < s->max_queue) {
+        sl = &s->slots[c->queue[0]];
+        if (c->udp) {
+            off = c->done * SDB_STREAM_DGRAM;
+            iov[0].iov_base = &sl->hdrs[c->done];
+            iov[0].iov_len = hdr;
+            iov[1].iov_base = (void *)(sl->data + off);
+            iov[1].iov_len = sl->size - off < SDB_STREAM_DGRAM ? sl->size - off : SDB_STREAM_DGRAM;
+            n = send_iov(c, iov, 2);
+            /* an earlier datagram found no one listening: not an error here */
+            if (n == -ECONNREFUSED)
+                continue;
+            if (n < 0)
+                return n == -EAGAIN ? 0 : (int)n;
+            c->bytes += n;
+            if (++c->done == nb_dgrams(sl->size))
+                sent(s, c);
+            continue;
+        }
+
+        frame = hdr + sl->size;
+        if (c->done < hdr) {
+            iov[0].iov_base = (uint8_t *)&sl->hdrs[0] + c->done;
+            iov[0].iov_len = hdr - c->done;
+            iov[1].iov_base = (void *)sl->data;
+            iov[1].iov_len = sl->size;
+            n = send_iov(c, iov, 2);
+        } else {
+            iov[0].iov_base = (void *)(sl->data + c->done - hdr);
+            iov[0].iov_len = frame - c->done;
+            n = send_iov(c, iov, 1);
+        }
+        if (n < 0)
+            return n == -EAGAIN ? 0 : (int)n;
+        c->bytes += n;
+        c->done += n;
+        if (c->done == frame)
+            sent(s, c);
+    }
+    return 0;
+}
+
+/* Zerocopy completions of the error queue, returns 0 or -errno */
+static int read_completions(sdb_stream_t *s, sdb_stream_client_t *c)
+{
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+    socklen_t len = sizeof(int);
+    int err = 0;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(c->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                continue;
+            serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                return serr->ee_errno ? -(int)serr->ee_errno : -EIO;
+            /* ids ee_info..ee_data, in order on a socket */
+            c->zc_done = serr->ee_data + 1;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                c->zc_copied += serr->ee_data - serr->ee_info + 1;
+        }
+    }
+    if (errno != EAGAIN)
+        return -errno;
+    /* reading it clears it, the ICMP errors of UDP are ignored */
+    if (!getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) && err && !c->udp)
+        return -err;
+
+    release_sent(s, c);
+    return 0;
+}
+
+/* Policy chosen by a TCP client, returns 0 or -errno when it left */
+static int read_client(sdb_stream_client_t *c)
+{
+    char buf[16];
+    ssize_t n, i;
+
+    n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n == 0)
+        return -ECONNRESET;
+    if (n < 0)
+        return errno == EAGAIN ? 0 : -errno;
+    for (i = 0; i < n; i++) {
+        if (buf[i] == 'B')
+            c->policy = SDB_STREAM_BLOCK;
+        else if (buf[i] == 'L')
+            c->policy = SDB_STREAM_LATEST;
+    }
+    return 0;
+}
+
+static void accept_client(sdb_stream_t *s)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    char name[32];
+    int fd;
+
+    fd = accept4(s->lfd, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    snprintf(name, sizeof(name), "tcp %s:%u", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    if (!new_client(s, fd, 0, s->policy, name))
+        close(fd);
+}
+
+static void *stream_thread(void *arg)
+{
+    sdb_stream_t *s = arg;
+    struct pollfd fds[SDB_STREAM_MAX_CLIENTS + 2];
+    sdb_stream_client_t *map[SDB_STREAM_MAX_CLIENTS + 2];
+    sdb_stream_client_t *c;
+    uint64_t val;
+    int i, n, ret;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->running) {
+        n = 0;
+        fds[n].fd = s->efd;
+        fds[n++].events = POLLIN;
+        if (s->lfd >= 0) {
+            fds[n].fd = s->lfd;
+            fds[n++].events = POLLIN;
+        }
+        for (i = 0; i < SDB_STREAM_MAX_CLIENTS; i++) {
+            c = &s->clients[i];
+            if (c->fd < 0)
+                continue;
+            map[n] = c;
+            fds[n].fd = c->fd;
+            /* POLLERR: completions in the error queue */
+            fds[n++].events = (c->udp ? 0 : POLLIN) |
+                              (c->nb_queued && c->nb_sent < s->max_queue ? POLLOUT : 0);
+        }
+
+        pthread_mutex_unlock(&s->lock);
+        ret = poll(fds, n, POLL_MS);
+        pthread_mutex_lock(&s->lock);
+        if (ret <= 0)
+            continue;
+
+        if (fds[0].revents & POLLIN) {
+            if (read(s->efd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+                perror("sdb_stream eventfd");
+        }
+        i = 1;
+        if (s->lfd >= 0) {
+            if (fds[1].revents & POLLIN)
+                accept_client(s);
+            i = 2;
+        }
+        for (; i < n; i++) {
+            c = map[i];
+            ret = 0;
+            if (fds[i].revents & POLLERR)
+                ret = read_completions(s, c);
+            if (!ret && (fds[i].revents & POLLIN))
+                ret = read_client(c);
+            if (!ret && (fds[i].revents & POLLHUP) && !c->udp)
+                ret = -ECONNRESET;
+            if (!ret && c->nb_queued)
+                ret = send_client(s, c);
+            if (ret) {
+                fprintf(stderr, "sdb_stream: %s: %s, closed\n", c->name, strerror(-ret));
+                close_client(s, c, 0);
+            }
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+int sdb_stream_init(sdb_stream_t *s, uint32_t nb_slots, uint32_t max_size, uint32_t max_queue,
+                    sdb_stream_policy_t policy, int zerocopy)
+{
+    uint32_t i;
+
+    memset(s, 0, sizeof(*s));
+    s->lfd = -1;
+    s->efd = -1;
+    for (i = 0; i < SDB_STREAM_MAX_CLIENTS; i++)
+        s->clients[i].fd = -1;
+    if (!nb_slots || !max_queue || max_queue > SDB_STREAM_MAX_QUEUE)
+        return -EINVAL;
+
+    s->nb_slots = nb_slots;
+    s->max_size = max_size;
+    s->max_queue = max_queue;
+    s->policy = policy;
+    s->zerocopy = zerocopy;
+    s->slots = calloc(nb_slots, sizeof(*s->slots));
+    if (!s->slots)
+        return -ENOMEM;
+    for (i = 0; i < nb_slots; i++) {
+        s->slots[i].hdrs = calloc(nb_dgrams(max_size), sizeof(sdb_stream_hdr_t));
+        if (!s->slots[i].hdrs) {
+            sdb_stream_free(s);
+            return -ENOMEM;
+        }
+    }
+    s->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->efd < 0) {
+        sdb_stream_free(s);
+        return -errno;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    return 0;
+}
+
+int sdb_stream_listen(sdb_stream_t *s, uint16_t port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY),
+                                .sin_port = htons(port) };
+    socklen_t len = sizeof(addr);
+    int one = 1, ret;
+
+    s->lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->lfd < 0)
+        return -errno;
+    setsockopt(s->lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(s->lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(s->lfd, SDB_STREAM_MAX_CLIENTS) ||
+        getsockname(s->lfd, (struct sockaddr *)&addr, &len)) {
+        ret = -errno;
+        close(s->lfd);
+        s->lfd = -1;
+        return ret;
+    }
+    return ntohs(addr.sin_port);
+}
+
+int sdb_stream_add_udp(sdb_stream_t *s, const char *host, uint16_t port,
+                       sdb_stream_policy_t policy)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM }, *res;
+    char name[32];
+    int fd, ret;
+
+    if (getaddrinfo(host, NULL, &hints, &res))
+        return -EHOSTUNREACH;
+    addr.sin_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        ret = -errno;
+        close(fd);
+        return ret;
+    }
+    snprintf(name, sizeof(name), "udp %s:%u", host, port);
+    pthread_mutex_lock(&s->lock);
+    ret = new_client(s, fd, 1, policy, name) ? 0 : -ENOSPC;
+    pthread_mutex_unlock(&s->lock);
+    if (ret)
+        close(fd);
+    wake(s);
+    return ret;
+}
+
+int sdb_stream_start(sdb_stream_t *s)
+{
+    int ret;
+
+    s->running = 1;
+    ret = pthread_create(&s->tid, NULL, stream_thread, s);
+    if (ret) {
+        s->running = 0;
+        return -ret;
+    }
+    return 0;
+}
+
+static sdb_stream_slot_t *get_slot(sdb_stream_t *s)
+{
+    uint32_t i;
+
+    for (;;) {
+        for (i = 0; i < s->nb_slots; i++)
+            if (!s->slots[i].used)
+                return &s->slots[i];
+        s->slot_waits++;
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+}
+
+/* Room in the queue of c for the slot, returns 0 if it is not queued there */
+static int make_room(sdb_stream_t *s, sdb_stream_client_t *c)
+{
+    uint64_t t0;
+    uint32_t first;
+
+    if (c->nb_queued < s->max_queue)
+        return 1;
+    if (c->policy == SDB_STREAM_LATEST) {
+        c->drops++;
+        /* the first one may be on the way */
+        first = c->done ? 1 : 0;
+        if (c->nb_queued <= first)
+            return 0;
+        remove_queued(s, c, first);
+        return 1;
+    }
+
+    t0 = now_ns();
+    while (c->fd >= 0 && c->nb_queued >= s->max_queue && s->running)
+        pthread_cond_wait(&s->cond, &s->lock);
+    s->blocked_ns += now_ns() - t0;
+    return c->fd >= 0 && c->nb_queued < s->max_queue;
+}
+
+int64_t sdb_stream_publish(sdb_stream_t *s, uint16_t buffer_id, const void *data, uint32_t size,
+                           uint64_t ts_ns)
+{
+    sdb_stream_slot_t *sl;
+    sdb_stream_client_t *c;
+    uint32_t i, slot;
+    int64_t seq;
+
+    if (size > s->max_size)
+        return -EMSGSIZE;
+
+    pthread_mutex_lock(&s->lock);
+    sl = get_slot(s);
+    slot = sl - s->slots;
+    seq = s->next_seq++;
+    sl->used = 1;
+    sl->refs = 1;
+    sl->data = data;
+    sl->size = size;
+    sl->seq = seq;
+    for (i = 0; i < nb_dgrams(size); i++) {
+        sl->hdrs[i].magic = SDB_STREAM_MAGIC;
+        sl->hdrs[i].buffer_id = buffer_id;
+        sl->hdrs[i].flags = 0;
+        sl->hdrs[i].size = size;
+        sl->hdrs[i].offset = i * SDB_STREAM_DGRAM;
+        sl->hdrs[i].seq = seq;
+        sl->hdrs[i].ts_ns = ts_ns;
+    }
+    s->published++;
+
+    for (i = 0; i < SDB_STREAM_MAX_CLIENTS; i++) {
+        c = &s->clients[i];
+        if (c->fd < 0 || !make_room(s, c))
+            continue;
+        c->queue[c->nb_queued++] = slot;
+        sl->refs++;
+    }
+    unref(s, slot);
+    pthread_mutex_unlock(&s->lock);
+    wake(s);
+
+    return seq;
+}
+
+void sdb_stream_wait(sdb_stream_t *s, int64_t seq)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&s->lock);
+    for (i = 0; i < s->nb_slots; i++) {
+        if (s->slots[i].used && s->slots[i].seq == (uint64_t)seq) {
+            while (s->slots[i].used && s->slots[i].seq == (uint64_t)seq)
+                pthread_cond_wait(&s->cond, &s->lock);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void sdb_stream_drain(sdb_stream_t *s)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&s->lock);
+    for (i = 0; i < s->nb_slots; i++)
+        while (s->slots[i].used)
+            pthread_cond_wait(&s->cond, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+}
+
+uint32_t sdb_stream_nb_clients(sdb_stream_t *s)
+{
+    uint32_t i, n = 0;
+
+    pthread_mutex_lock(&s->lock);
+    for (i = 0; i < SDB_STREAM_MAX_CLIENTS; i++)
+        if (s->clients[i].fd >= 0)
+            n++;
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+void sdb_stream_stop(sdb_stream_t *s)
+{
+    uint32_t i;
+
+    if (s->running) {
+        pthread_mutex_lock(&s->lock);
+        s->running = 0;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        wake(s);
+        pthread_join(s->tid, NULL);
+    }
+    pthread_mutex_lock(&s->lock);
+    for (i = 0; i < SDB_STREAM_MAX_CLIENTS; i++)
+        if (s->clients[i].fd >= 0)
+            close_client(s, &s->clients[i], 1);
+    pthread_mutex_unlock(&s->lock);
+    if (s->lfd >= 0)
+        close(s->lfd);
+    s->lfd = -1;
+}
+
+void sdb_stream_free(sdb_stream_t *s)
+{
+    uint32_t i;
+
+    if (s->efd >= 0) {
+        sdb_stream_stop(s);
+        close(s->efd);
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+    }
+    s->efd = -1;
+    for (i = 0; s->slots && i < s->nb_slots; i++)
+        free(s->slots[i].hdrs);
+    free(s->slots);
+    s->slots = NULL;
+}
+
+void sdb_stream_print(sdb_stream_t *s, FILE *f, uint64_t elapsed_ns)
+{
+    double t = elapsed_ns ? elapsed_ns / 1e9 : 1.0;
+    sdb_stream_client_t *c;
+    int i;
+
+    fprintf(f, "stream: %llu buffers published, %llu slot waits, blocked %.1f%%\n",
+            (unsigned long long)s->published, (unsigned long long)s->slot_waits,
+            100.0 * s->blocked_ns / 1e9 / t);
+    fprintf(f, "client                  policy zc  buffers    MB/s    drops zc copied fallback\n");
+    for (i = 0; i < SDB_STREAM_MAX_CLIENTS; i++) {
+        c = &s->clients[i];
+        if (!c->buffers && !c->drops)
+            continue;
+        fprintf(f, "%-23s %6s %2s %8llu %7.1f %8llu %9llu %8llu\n", c->name,
+                c->policy == SDB_STREAM_BLOCK ? "block" : "latest", c->zerocopy ? "y" : "n",
+                (unsigned long long)c->buffers, c->bytes / 1048576.0 / t,
+                (unsigned long long)c->drops, (unsigned long long)c->zc_copied,
+                (unsigned long long)c->zc_fallbacks);
+    }
+}
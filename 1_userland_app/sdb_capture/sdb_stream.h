@@ -0,0 +1,155 @@
+/*
+ * sdb_stream.h
+ * Live streaming of the captured buffers to network clients.
+ *
+ * The producer publishes a buffer it owns, e.g. an rpmsg_sdb mapping: it
+ * is sent from there to every client, without a copy, and held until the
+ * kernel is done with it. With MSG_ZEROCOPY that is the completion of the
+ * last send of the buffer on every client, read from the error queue of
+ * the sockets, not the return of the send. The producer must not modify
+ * a buffer before sdb_stream_wait() returns for it. Without MSG_ZEROCOPY
+ * (zerocopy 0 or refused by the kernel, e.g. for pages it cannot pin) the
+ * data is copied by the send, straight from the buffer.
+ *
+ * TCP clients connect to the port of sdb_stream_listen(), each buffer is
+ * a sdb_stream_hdr_t then the data. UDP destinations are added by the
+ * producer, each datagram is a header then up to SDB_STREAM_DGRAM bytes
+ * of the buffer at hdr.offset.
+ *
+ * Each client has a queue of max_queue buffers to send. When it is full
+ * a publish either waits for the client (SDB_STREAM_BLOCK: back-pressure
+ * on the producer) or drops the oldest buffer not started for the client
+ * (SDB_STREAM_LATEST), the new one if they are all started. A TCP client
+ * picks its policy by sending 'B' or 'L'. A client that leaves or fails
+ * is reset, what it still had to send is dropped. Besides its queue, a
+ * client holds max_queue buffers at most sent and not completed yet: on
+ * loopback they complete once the receiver has read them.
+ *
+ * One thread accepts the clients, sends and reads the completions. The
+ * buffers are published from one thread.
+ */
+
+#ifndef SDB_STREAM_H
+#define SDB_STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#define SDB_STREAM_MAGIC        0x4d525453  /* "STRM" */
+#define SDB_STREAM_MAX_CLIENTS  16
+#define SDB_STREAM_MAX_QUEUE    64
+#define SDB_STREAM_DGRAM        8192        /* data bytes of a datagram at most */
+
+/* Before each buffer (TCP) or datagram (UDP), little endian */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t buffer_id;
+    uint16_t flags;
+    uint32_t size;          /* bytes of the buffer */
+    uint32_t offset;        /* UDP: of the datagram data in the buffer, TCP: 0 */
+    uint64_t seq;           /* publish order, gaps are drops */
+    uint64_t ts_ns;
+} sdb_stream_hdr_t;
+
+typedef enum {
+    SDB_STREAM_LATEST = 0,
+    SDB_STREAM_BLOCK,
+} sdb_stream_policy_t;
+
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t refs;          /* clients holding it, +1 during the publish */
+    uint64_t seq;
+    sdb_stream_hdr_t *hdrs; /* one per datagram, the first one for TCP */
+    int used;
+} sdb_stream_slot_t;
+
+typedef struct
+{
+    uint32_t slot;
+    uint32_t zc_end;        /* zerocopy sends once the buffer is sent */
+} sdb_stream_sent_t;
+
+typedef struct
+{
+    int fd;                 /* -1: free entry */
+    int udp;
+    int zerocopy;
+    sdb_stream_policy_t policy;
+    char name[32];
+
+    uint32_t queue[SDB_STREAM_MAX_QUEUE];   /* to send, the first may be started */
+    uint32_t nb_queued;
+    uint32_t done;          /* of the first one: TCP bytes, UDP datagrams */
+    sdb_stream_sent_t sent[SDB_STREAM_MAX_QUEUE]; /* waiting for their completion */
+    uint32_t nb_sent;
+    uint32_t zc_sends;      /* sends with MSG_ZEROCOPY, ids of the completions */
+    uint32_t zc_done;       /* sends completed */
+
+    uint64_t buffers;
+    uint64_t bytes;
+    uint64_t drops;
+    uint64_t zc_copied;     /* sends the kernel copied anyway, e.g. loopback */
+    uint64_t zc_fallbacks;  /* sends copied: zerocopy budget ran out, pages not pinned */
+} sdb_stream_client_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    /* a slot released, room in a queue */
+    pthread_t tid;
+    int lfd;                /* TCP listening socket, -1 if none */
+    int efd;                /* wakes the thread up */
+    int running;
+    int zerocopy;
+    uint32_t max_queue;
+    sdb_stream_policy_t policy;
+
+    sdb_stream_slot_t *slots;
+    uint32_t nb_slots;
+    uint32_t max_size;
+    uint64_t next_seq;
+    sdb_stream_client_t clients[SDB_STREAM_MAX_CLIENTS];
+
+    uint64_t published;
+    uint64_t slot_waits;    /* all the slots held */
+    uint64_t blocked_ns;    /* waiting for SDB_STREAM_BLOCK clients */
+} sdb_stream_t;
+
+/*
+ * nb_slots buffers of max_size bytes at most published and not released,
+ * max_queue (<= SDB_STREAM_MAX_QUEUE) per client; policy: the default of
+ * the TCP clients. Returns 0 or -errno.
+ */
+int sdb_stream_init(sdb_stream_t *s, uint32_t nb_slots, uint32_t max_size, uint32_t max_queue,
+                    sdb_stream_policy_t policy, int zerocopy);
+/* TCP clients on port, 0: any. Returns the port or -errno */
+int sdb_stream_listen(sdb_stream_t *s, uint16_t port);
+/* Datagrams to host:port, returns 0 or -errno */
+int sdb_stream_add_udp(sdb_stream_t *s, const char *host, uint16_t port,
+                       sdb_stream_policy_t policy);
+int sdb_stream_start(sdb_stream_t *s);
+
+/*
+ * Queues the buffer for every client, waiting for a free slot and for
+ * the SDB_STREAM_BLOCK clients. Returns its sequence number or -errno.
+ */
+int64_t sdb_stream_publish(sdb_stream_t *s, uint16_t buffer_id, const void *data, uint32_t size,
+                           uint64_t ts_ns);
+/* Waits until the buffer of seq is released: sent and completed or dropped everywhere */
+void sdb_stream_wait(sdb_stream_t *s, int64_t seq);
+/* Waits until all the buffers are released */
+void sdb_stream_drain(sdb_stream_t *s);
+uint32_t sdb_stream_nb_clients(sdb_stream_t *s);
+
+/* Stops the thread and closes the clients, the buffers not sent are dropped */
+void sdb_stream_stop(sdb_stream_t *s);
+void sdb_stream_free(sdb_stream_t *s);
+void sdb_stream_print(sdb_stream_t *s, FILE *f, uint64_t elapsed_ns);
+
+#endif /* SDB_STREAM_H */
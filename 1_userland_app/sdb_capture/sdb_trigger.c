@@ -0,0 +1,339 @@
+/*
+ * sdb_trigger.c
+ * Trigger engine over the captured logic samples, see sdb_trigger.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sdb_trigger.h"
+
+static size_t find_u8(sdb_trig_t *t, const uint8_t *src, size_t n, uint8_t prev,
+                      const simd_match_u8_t *m)
+{
+    return t->scalar ? scalar_find_u8(src, n, prev, m) : simd_find_u8(src, n, prev, m);
+}
+
+/* Sample before s[i] */
+static uint8_t prev_of(sdb_trig_t *t, const uint8_t *s, size_t i)
+{
+    return i ? s[i - 1] : t->last;
+}
+
+static size_t find_edge(sdb_trig_t *t, const uint8_t *s, size_t n, size_t i)
+{
+    simd_match_u8_t m = { t->c.mask, t->c.value, t->c.rise, t->c.fall, 0 };
+
+    return i + find_u8(t, s + i, n - i, prev_of(t, s, i), &m);
+}
+
+/* Out of the pattern first if the sample before matches */
+static size_t find_pattern(sdb_trig_t *t, const uint8_t *s, size_t n, size_t i)
+{
+    simd_match_u8_t m = { t->c.mask, t->c.value, 0, 0, 1 };
+    uint8_t prev = prev_of(t, s, i);
+
+    if ((t->nb_samples || i) && (prev & m.mask) == m.value) {
+        i += find_u8(t, s + i, n - i, prev, &m);
+        if (i == n)
+            return n;
+    }
+    m.invert = 0;
+    return i + find_u8(t, s + i, n - i, prev_of(t, s, i), &m);
+}
+
+/* Every edge of the channel, the holdoff applies to the ends of the pulses */
+static size_t find_pulse(sdb_trig_t *t, const uint8_t *s, size_t n, size_t i)
+{
+    uint8_t bit = 1 << t->c.channel;
+    simd_match_u8_t m = { 0, 0, bit, bit, 0 };
+    uint64_t pos, width;
+
+    for (; i < n; i++) {
+        i += find_u8(t, s + i, n - i, prev_of(t, s, i), &m);
+        if (i == n)
+            break;
+        pos = t->nb_samples + i;
+        if (!(s[i] & bit) == !t->c.high) {
+            t->pulse_start = pos;
+            continue;
+        }
+        if (t->pulse_start < 0)
+            continue;
+        width = pos - t->pulse_start;
+        t->pulse_start = -1;
+        if (width >= t->c.min_width && (!t->c.max_width || width <= t->c.max_width) &&
+            pos >= t->next)
+            return i;
+    }
+    return n;
+}
+
+/* The first samples of the buffer after the last ones of the previous buffers */
+static size_t find_glitch(sdb_trig_t *t, const uint8_t *s, size_t n, size_t i)
+{
+    uint8_t st[2 * SIMD_GLITCH_MAX];
+    uint32_t w = t->c.width;
+    size_t k, j;
+
+    if (i < w) {
+        k = n < w ? n : w;
+        memcpy(st, t->hist, SIMD_GLITCH_MAX);
+        memcpy(st + SIMD_GLITCH_MAX, s, k);
+        j = scalar_find_glitch_u8(st, SIMD_GLITCH_MAX + k, SIMD_GLITCH_MAX + i, t->c.mask, w);
+        if (j < SIMD_GLITCH_MAX + k)
+            return j - SIMD_GLITCH_MAX;
+        if (k == n)
+            return n;
+        i = k;
+    }
+    if (t->scalar)
+        return scalar_find_glitch_u8(s, n, i, t->c.mask, w);
+    return simd_find_glitch_u8(s, n, i, t->c.mask, w);
+}
+
+/* Index of the next trigger from s[i], n if none */
+static size_t find_next(sdb_trig_t *t, const uint8_t *s, size_t n, size_t i)
+{
+    if (t->c.type != SDB_TRIG_PULSE && t->next > t->nb_samples + i) {
+        if (t->next - t->nb_samples >= n)
+            return n;
+        i = t->next - t->nb_samples;
+    }
+    switch (t->c.type) {
+    case SDB_TRIG_EDGE:
+        return find_edge(t, s, n, i);
+    case SDB_TRIG_PATTERN:
+        return find_pattern(t, s, n, i);
+    case SDB_TRIG_PULSE:
+        return find_pulse(t, s, n, i);
+    default:
+        return find_glitch(t, s, n, i);
+    }
+}
+
+/* Samples of the window open up to sample end, s: the buffer from sample base */
+static int keep_to(sdb_trig_t *t, const uint8_t *s, uint64_t base, uint64_t end)
+{
+    uint64_t from = t->kept, x, len;
+    int ret;
+
+    if (end > t->win_end)
+        end = t->win_end;
+    if (from >= end)
+        return 0;
+    /* from the ring before the buffer, in 2 parts when it wraps */
+    for (x = from; x < base && x < end; x += len) {
+        len = t->c.pre - x % t->c.pre;
+        if (len > base - x)
+            len = base - x;
+        if (len > end - x)
+            len = end - x;
+        if (t->keep) {
+            ret = t->keep(t->ctx, x, t->ring + x % t->c.pre, len);
+            if (ret)
+                return ret;
+        }
+    }
+    if (x < end && t->keep) {
+        ret = t->keep(t->ctx, x, s + (x - base), end - x);
+        if (ret)
+            return ret;
+    }
+    t->kept_samples += end - from;
+    t->kept = end;
+    return 0;
+}
+
+/* Last samples processed: the ring and the history of the glitches */
+static void save_tail(sdb_trig_t *t, const uint8_t *s, uint32_t n)
+{
+    uint64_t x, end = t->nb_samples + n, len;
+    uint32_t k = n < SIMD_GLITCH_MAX ? n : SIMD_GLITCH_MAX;
+
+    if (t->c.pre) {
+        x = n > t->c.pre ? end - t->c.pre : t->nb_samples;
+        for (; x < end; x += len) {
+            len = t->c.pre - x % t->c.pre;
+            if (len > end - x)
+                len = end - x;
+            memcpy(t->ring + x % t->c.pre, s + (x - t->nb_samples), len);
+        }
+    }
+    memmove(t->hist, t->hist + k, SIMD_GLITCH_MAX - k);
+    memcpy(t->hist + SIMD_GLITCH_MAX - k, s + n - k, k);
+    t->last = s[n - 1];
+}
+
+int sdb_trig_init(sdb_trig_t *t, const sdb_trig_cond_t *c, sdb_trig_fn_t on_trigger,
+                  sdb_trig_keep_fn_t keep, void *ctx)
+{
+    memset(t, 0, sizeof(*t));
+    if (c->type > SDB_TRIG_GLITCH || !c->post || !c->holdoff ||
+        (c->type == SDB_TRIG_EDGE && !(c->rise | c->fall)) ||
+        (c->type == SDB_TRIG_PULSE && (c->channel > 7 || !c->min_width ||
+                                       (c->max_width && c->max_width < c->min_width))) ||
+        (c->type == SDB_TRIG_GLITCH && (!c->mask || c->width < 2 || c->width > SIMD_GLITCH_MAX)))
+        return -EINVAL;
+    if (c->pre) {
+        t->ring = malloc(c->pre);
+        if (!t->ring)
+            return -ENOMEM;
+    }
+    t->c = *c;
+    t->on_trigger = on_trigger;
+    t->keep = keep;
+    t->ctx = ctx;
+    t->pulse_start = -1;
+    return 0;
+}
+
+void sdb_trig_free(sdb_trig_t *t)
+{
+    free(t->ring);
+    t->ring = NULL;
+}
+
+int sdb_trig_process(sdb_trig_t *t, const uint8_t *s, uint32_t n)
+{
+    uint64_t base = t->nb_samples, pos, start;
+    size_t i = 0, j;
+    int ret = 0;
+
+    if (!n)
+        return 0;
+    /* no edge before the first sample */
+    if (!base) {
+        memset(t->hist, s[0], SIMD_GLITCH_MAX);
+        t->last = s[0];
+    }
+
+    while (i < n) {
+        j = find_next(t, s, n, i);
+        if (j >= n)
+            break;
+        pos = base + j;
+        t->triggers++;
+        if (t->on_trigger)
+            t->on_trigger(t->ctx, pos);
+        /* the window open up to the trigger, then the new one from pos - pre */
+        ret = keep_to(t, s, base, pos);
+        if (ret)
+            break;
+        start = pos > t->c.pre ? pos - t->c.pre : 0;
+        if (start > t->kept)
+            t->kept = start;
+        t->win_end = pos + t->c.post;
+        t->next = pos + t->c.holdoff;
+        i = j + 1;
+    }
+    if (!ret)
+        ret = keep_to(t, s, base, base + n);
+
+    save_tail(t, s, n);
+    t->nb_samples += n;
+    return ret;
+}
+
+/* <letter><ch>, letter: index in letters */
+static int parse_channel(const char *v, const char *letters, int *letter)
+{
+    const char *l = strchr(letters, v[0]);
+
+    if (!v[0] || !l || v[1] < '0' || v[1] > '7' || v[2])
+        return -1;
+    *letter = l - letters;
+    return v[1] - '0';
+}
+
+static int parse_u64(const char *v, uint64_t *out)
+{
+    char *end;
+
+    *out = strtoull(v, &end, 0);
+    return end == v || *end ? -1 : 0;
+}
+
+int sdb_trig_parse(sdb_trig_cond_t *c, const char *spec)
+{
+    char buf[256], *key, *v, *save = NULL;
+    int edge = 0, pattern = 0, pulse = 0, glitch = 0, holdoff = 0, ch, l;
+    unsigned int mask, value;
+    uint64_t n;
+
+    if (strlen(spec) >= sizeof(buf))
+        return -EINVAL;
+    strcpy(buf, spec);
+    memset(c, 0, sizeof(*c));
+    c->pre = SDB_TRIG_PRE;
+    c->post = SDB_TRIG_POST;
+    c->width = SDB_TRIG_WIDTH;
+
+    for (key = strtok_r(buf, ",", &save); key; key = strtok_r(NULL, ",", &save)) {
+        v = strchr(key, '=');
+        if (!v)
+            return -EINVAL;
+        *v++ = 0;
+        if (!strcmp(key, "edge")) {
+            ch = parse_channel(v, "rfa", &l);
+            if (ch < 0)
+                return -EINVAL;
+            if (l != 1)
+                c->rise |= 1 << ch;
+            if (l != 0)
+                c->fall |= 1 << ch;
+            edge = 1;
+        } else if (!strcmp(key, "pattern")) {
+            if (sscanf(v, "%i/%i", &mask, &value) != 2 || mask > 0xff || (value & ~mask))
+                return -EINVAL;
+            c->mask = mask;
+            c->value = value;
+            pattern = 1;
+        } else if (!strcmp(key, "pulse")) {
+            ch = parse_channel(v, "lh", &l);
+            if (ch < 0)
+                return -EINVAL;
+            c->channel = ch;
+            c->high = l;
+            pulse = 1;
+        } else if (!strcmp(key, "glitch")) {
+            if (parse_u64(v, &n) || !n || n > 0xff)
+                return -EINVAL;
+            c->mask = n;
+            glitch = 1;
+        } else {
+            if (parse_u64(v, &n))
+                return -EINVAL;
+            if (!strcmp(key, "min") && n <= UINT32_MAX)
+                c->min_width = n;
+            else if (!strcmp(key, "max") && n <= UINT32_MAX)
+                c->max_width = n;
+            else if (!strcmp(key, "width") && n <= SIMD_GLITCH_MAX)
+                c->width = n;
+            else if (!strcmp(key, "pre"))
+                c->pre = n;
+            else if (!strcmp(key, "post"))
+                c->post = n;
+            else if (!strcmp(key, "holdoff")) {
+                c->holdoff = n;
+                holdoff = 1;
+            } else
+                return -EINVAL;
+        }
+    }
+
+    /* one condition, the pattern qualifies the edges */
+    if (edge + pulse + glitch > 1 || (pattern && (pulse || glitch)) ||
+        !(edge || pattern || pulse || glitch))
+        return -EINVAL;
+    c->type = edge ? SDB_TRIG_EDGE : pattern ? SDB_TRIG_PATTERN :
+              pulse ? SDB_TRIG_PULSE : SDB_TRIG_GLITCH;
+    if (pulse && !c->min_width)
+        c->min_width = 1;
+    if (!holdoff)
+        c->holdoff = c->post;
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * sdb_trigger.h
+ * Trigger engine over the captured logic samples.
+ *
+ * A sample is a byte of the buffers, 8 logic channels. Each completed
+ * buffer is scanned for the trigger condition by the searches of neon/
+ * (simd_find_u8, simd_find_glitch_u8: NEON, SSE2 or scalar):
+ *   SDB_TRIG_EDGE      a channel of rise going high or of fall going low,
+ *                      while (s & mask) == value
+ *   SDB_TRIG_PATTERN   (s & mask) == value becoming true, at the first
+ *                      sample if it is true there
+ *   SDB_TRIG_PULSE     end of a pulse of channel, high or low, of
+ *                      min_width to max_width samples
+ *   SDB_TRIG_GLITCH    end of a pulse shorter than width samples on a
+ *                      channel of mask
+ * The conditions go on across the buffers. After a trigger at pos, the
+ * next one is at pos + holdoff at least.
+ *
+ * A trigger at pos keeps the samples from pos - pre to pos + post, the
+ * windows that overlap are merged. The samples before the buffer come
+ * from a copy of the last pre samples processed, the buffers themselves
+ * are not held after sdb_trig_process(). The kept samples go in order
+ * to the keep callback, numbered from 0 at the first sample processed.
+ *
+ * Spec of sdb_trig_parse(), comma separated, numbers in C notation:
+ *   edge=r<ch>|f<ch>|a<ch>     rising, falling or any edge, can be repeated
+ *   pattern=<mask>/<value>     alone: SDB_TRIG_PATTERN, else the qualifier
+ *   pulse=h<ch>|l<ch>          with min=<samples> max=<samples, 0: any>
+ *   glitch=<mask>              with width=<samples> (default 4)
+ *   pre=, post=, holdoff=      samples (default 1024, 4096, post)
+ * e.g. "edge=f2,pre=256,post=65536" or "pulse=h3,min=900,max=1100".
+ */
+
+#ifndef SDB_TRIGGER_H
+#define SDB_TRIGGER_H
+
+#include <stdint.h>
+
+#include "simd_kernels.h"
+
+#define SDB_TRIG_PRE        1024
+#define SDB_TRIG_POST       4096
+#define SDB_TRIG_WIDTH      4
+
+typedef enum {
+    SDB_TRIG_EDGE = 0,
+    SDB_TRIG_PATTERN,
+    SDB_TRIG_PULSE,
+    SDB_TRIG_GLITCH,
+} sdb_trig_type_t;
+
+typedef struct
+{
+    sdb_trig_type_t type;
+    uint8_t mask;           /* pattern, qualifier of the edges, channels of the glitches */
+    uint8_t value;
+    uint8_t rise;           /* edge: channels */
+    uint8_t fall;
+    uint8_t channel;        /* pulse: 0 to 7 */
+    uint8_t high;           /* pulse: 1 high, 0 low */
+    uint32_t min_width;     /* pulse, samples */
+    uint32_t max_width;     /* pulse, 0: no limit */
+    uint32_t width;         /* glitch: 2 to SIMD_GLITCH_MAX */
+    uint64_t pre;           /* samples kept before a trigger */
+    uint64_t post;          /* samples kept from a trigger on, 1 at least */
+    uint64_t holdoff;       /* samples from a trigger to the next one, 1 at least */
+} sdb_trig_cond_t;
+
+/* Trigger at sample pos */
+typedef void (*sdb_trig_fn_t)(void *ctx, uint64_t pos);
+/* n samples kept from sample first on; an error stops sdb_trig_process() */
+typedef int (*sdb_trig_keep_fn_t)(void *ctx, uint64_t first, const uint8_t *samples, uint32_t n);
+
+typedef struct
+{
+    sdb_trig_cond_t c;
+    sdb_trig_fn_t on_trigger;
+    sdb_trig_keep_fn_t keep;
+    void *ctx;
+    int scalar;             /* scalar searches, for the benchmarks */
+
+    uint64_t nb_samples;    /* processed */
+    uint8_t last;           /* last sample processed */
+    uint8_t hist[SIMD_GLITCH_MAX];  /* last samples processed, for the glitches */
+    int64_t pulse_start;    /* start of the pulse going on, -1: none */
+    uint64_t next;          /* first sample of the next trigger (holdoff) */
+    uint64_t kept;          /* samples up to there given to keep or skipped */
+    uint64_t win_end;       /* end of the window open, kept once closed */
+    uint8_t *ring;          /* last pre samples processed, sample x at x % pre */
+
+    uint64_t triggers;
+    uint64_t kept_samples;
+} sdb_trig_t;
+
+/* Returns 0, -EINVAL or -ENOMEM; on_trigger and keep can be NULL */
+int sdb_trig_init(sdb_trig_t *t, const sdb_trig_cond_t *c, sdb_trig_fn_t on_trigger,
+                  sdb_trig_keep_fn_t keep, void *ctx);
+void sdb_trig_free(sdb_trig_t *t);
+
+/* Samples following the ones already processed, returns 0 or the error of keep */
+int sdb_trig_process(sdb_trig_t *t, const uint8_t *samples, uint32_t n);
+
+/* Condition of a spec, see above. Returns 0 or -EINVAL */
+int sdb_trig_parse(sdb_trig_cond_t *c, const char *spec);
+
+#endif /* SDB_TRIGGER_H */
@@ -0,0 +1,265 @@
+/*
+ * alloc_check.c
+ * The libmetal pools of the harness, and their checks.
+ *
+ * metal_allocate_memory() takes its blocks from metal_alloc_pools[] as on
+ * the CM4: a pool per type of object the middleware allocates, sized for
+ * the runs of vring_sim and for the checks below.
+ *
+ * The checks cover the choice of the pool, the fallback to a larger one,
+ * the failures and the alignment. Then rproc_virtio_create_vdev() and
+ * rproc_virtio_remove_vdev() run in cycles, master and slave, as
+ * MX_OPENAMP_Init() and OPENAMP_DeInit() do on each start: every cycle
+ * must take the same blocks and give all of them back. A create that
+ * runs out of virtqueues midway must give back what it took. The checks
+ * stop at the first failure.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <metal/alloc.h>
+#include <metal/io.h>
+#include <openamp/remoteproc.h>
+#include <openamp/remoteproc_virtio.h>
+
+#include "alloc_check.h"
+
+#define NUM_DESCS       16      /* as NUM_BUFFS of vring_sim */
+#define SWEEP_DESCS     128     /* as SWEEP_BUFFS of vring_sim */
+#define RING_ALIGN      16
+#define RING_SIZE       0x1000
+#define NB_POOLS        (sizeof(metal_alloc_pools) / sizeof(metal_alloc_pools[0]))
+#define VQ_SIZE(extra)  (sizeof(struct virtqueue) + (extra) * sizeof(struct vq_desc_extra))
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("check failed line %d: %s\n", __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+/* A master and a slave vdev at once, the 4 virtqueues of vring_sim */
+METAL_ALLOC_POOL_MEM(rpvdev_mem, sizeof(struct remoteproc_virtio), 2);
+METAL_ALLOC_POOL_MEM(vrings_info_mem, 2 * sizeof(struct virtio_vring_info), 2);
+METAL_ALLOC_POOL_MEM(vq_mem, VQ_SIZE(NUM_DESCS), 4);
+METAL_ALLOC_POOL_MEM(vq_slave_mem, VQ_SIZE(0), 2);
+/* The larger virtqueues of "vring_sim sweep" */
+METAL_ALLOC_POOL_MEM(vq_sweep_mem, VQ_SIZE(SWEEP_DESCS), 4);
+
+struct metal_alloc_pool metal_alloc_pools[] = {
+    METAL_ALLOC_POOL("rpvdev", rpvdev_mem),
+    METAL_ALLOC_POOL("vrings_info", vrings_info_mem),
+    METAL_ALLOC_POOL("virtqueue", vq_mem),
+    METAL_ALLOC_POOL("virtqueue slave", vq_slave_mem),
+    METAL_ALLOC_POOL("virtqueue sweep", vq_sweep_mem),
+};
+const unsigned int metal_alloc_pools_num = NB_POOLS;
+
+static struct {
+    struct fw_rsc_vdev vdev;
+    struct fw_rsc_vdev_vring vring[2];
+} rsc;
+static uint8_t rings[2][2][RING_SIZE] __attribute__((aligned(4096)));
+static struct metal_io_region rings_io;
+static metal_phys_addr_t rings_phys = 0;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned int pools_used(void)
+{
+    unsigned int i, used = 0;
+
+    for (i = 0; i < NB_POOLS; i++)
+        used += metal_alloc_pools[i].used;
+
+    return used;
+}
+
+static int notify(void *priv, uint32_t id)
+{
+    (void)priv;
+    (void)id;
+    return 0;
+}
+
+static struct virtio_device *create_vdev(unsigned int role)
+{
+    struct virtio_device *vdev;
+    unsigned int i;
+    uint8_t (*r)[RING_SIZE] = rings[role == VIRTIO_DEV_MASTER ? 0 : 1];
+
+    vdev = rproc_virtio_create_vdev(role, 0, &rsc.vdev, NULL, NULL, notify, NULL);
+    if (!vdev)
+        return NULL;
+    for (i = 0; i < 2; i++)
+        if (rproc_virtio_init_vring(vdev, i, i, r[i], &rings_io, NUM_DESCS, RING_ALIGN)) {
+            rproc_virtio_remove_vdev(vdev);
+            return NULL;
+        }
+
+    return vdev;
+}
+
+static int run_checks(uint32_t cycles)
+{
+    struct metal_alloc_pool *rpvdev = &metal_alloc_pools[0];
+    struct metal_alloc_pool *vq = &metal_alloc_pools[2];
+    struct virtio_device *m, *s, *m0 = NULL, *s0 = NULL;
+    void *b[16], *first;
+    unsigned int i, n, used;
+    uint32_t c;
+
+    /* The pool of the type, 8 byte aligned, the same block again */
+    first = metal_allocate_memory(sizeof(struct remoteproc_virtio));
+    CHECK(first == (void *)rpvdev_mem && rpvdev->used == 1);
+    metal_free_memory(first);
+    b[0] = metal_allocate_memory(1);
+    CHECK(((uintptr_t)b[0] & 7) == 0);
+    metal_free_memory(b[0]);
+    CHECK(metal_allocate_memory(sizeof(struct remoteproc_virtio)) == first);
+    metal_free_memory(first);
+    metal_free_memory(NULL);
+
+    /* A larger pool when the own one is empty, then a failure of the own one */
+    for (n = 0; n < 16; n++) {
+        b[n] = metal_allocate_memory(VQ_SIZE(NUM_DESCS));
+        if (!b[n])
+            break;
+    }
+    for (i = 0, used = 0; i < NB_POOLS; i++)
+        if (metal_alloc_pools[i].size >= VQ_SIZE(NUM_DESCS))
+            used += metal_alloc_pools[i].count;
+    CHECK(n == used && vq->used == vq->count && vq->fails == 1);
+    while (n--)
+        metal_free_memory(b[n]);
+    CHECK(pools_used() == 0);
+    CHECK(metal_allocate_memory(1 << 20) == NULL);
+
+    /* Create and destroy */
+    memset(&rsc, 0, sizeof(rsc));
+    rsc.vdev.num_of_vrings = 2;
+    for (i = 0; i < 2; i++) {
+        rsc.vring[i].align = RING_ALIGN;
+        rsc.vring[i].num = NUM_DESCS;
+    }
+    metal_io_init(&rings_io, rings, &rings_phys, sizeof(rings), (unsigned int)-1, 0, NULL);
+    for (c = 0; c < cycles; c++) {
+        m = create_vdev(VIRTIO_DEV_MASTER);
+        s = create_vdev(VIRTIO_DEV_SLAVE);
+        CHECK(m && s);
+        if (!c) {
+            m0 = m;
+            s0 = s;
+        }
+        CHECK(m == m0 && s == s0);
+        CHECK(pools_used() == 2 + 2 + 4);
+        rproc_virtio_remove_vdev(s);
+        rproc_virtio_remove_vdev(m);
+        CHECK(pools_used() == 0);
+    }
+    for (i = 0; i < NB_POOLS; i++)
+        CHECK(metal_alloc_pools[i].used == 0 &&
+              metal_alloc_pools[i].high_water <= metal_alloc_pools[i].count);
+
+    /* Out of virtqueues after the first one: nothing kept */
+    for (n = 0; n < 16; n++) {
+        b[n] = metal_allocate_memory(VQ_SIZE(NUM_DESCS));
+        if (!b[n])
+            break;
+    }
+    CHECK(n > 0);
+    metal_free_memory(b[--n]);
+    used = pools_used();
+    CHECK(create_vdev(VIRTIO_DEV_MASTER) == NULL && pools_used() == used);
+    while (n--)
+        metal_free_memory(b[n]);
+    CHECK(pools_used() == 0);
+
+    return 0;
+}
+
+static void bench(void)
+{
+    uint32_t i, loops = 10000000;
+    void *p;
+    double t, tm;
+
+    t = now_ns();
+    for (i = 0; i < loops; i++) {
+        p = metal_allocate_memory(VQ_SIZE(NUM_DESCS));
+        metal_free_memory(p);
+    }
+    t = (now_ns() - t) / loops;
+
+    tm = now_ns();
+    for (i = 0; i < loops; i++) {
+        p = malloc(VQ_SIZE(NUM_DESCS));
+        __asm__ volatile ("" : : "r" (p) : "memory");
+        free(p);
+    }
+    tm = (now_ns() - tm) / loops;
+
+    printf("allocate+free %zu bytes: %.1f ns, malloc+free: %.1f ns\n",
+           VQ_SIZE(NUM_DESCS), t, tm);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage : \n");
+    printf("%s alloc [-c <cycles>]\n", prog);
+    printf("  -c: create/destroy cycles (default 100000)\n");
+}
+
+int alloc_check_main(int argc, char **argv)
+{
+    uint32_t cycles = 100000;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            cycles = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!cycles) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (run_checks(cycles))
+        return 1;
+    printf("checks passed, %u create/destroy cycles\n", cycles);
+    alloc_print_pools();
+    bench();
+
+    return 0;
+}
+
+unsigned int alloc_print_pools(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < NB_POOLS; i++)
+        printf("metal pool %s: %u/%u blocks of %u bytes, high water %u, %u failed\n",
+               metal_alloc_pools[i].name, metal_alloc_pools[i].used,
+               metal_alloc_pools[i].count, metal_alloc_pools[i].size,
+               metal_alloc_pools[i].high_water, metal_alloc_pools[i].fails);
+
+    return pools_used();
+}
@@ -0,0 +1,13 @@
+/*
+ * alloc_check.h
+ * The libmetal pools of the harness and their checks, see alloc_check.c.
+ */
+
+#ifndef ALLOC_CHECK_H
+#define ALLOC_CHECK_H
+
+int alloc_check_main(int argc, char **argv);
+/* Returns the blocks in use */
+unsigned int alloc_print_pools(void);
+
+#endif /* ALLOC_CHECK_H */
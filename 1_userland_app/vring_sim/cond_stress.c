@@ -0,0 +1,314 @@
+/*
+ * cond_stress.c
+ * Checks and stress test of the libmetal condition, irq and sleep
+ * primitives of the generic system, on the pthread backend of
+ * metal_host.c.
+ *
+ * The checks cover the nesting of sys_irq_save_disable(), the errors of
+ * metal_condition_wait() and metal_sleep_usec(), and stop at the first
+ * failure.
+ *
+ * The stress test runs waiter threads on one condition and mutex, as the
+ * main loop of the CM4 would, and a producer that stands for an interrupt
+ * handler: it bumps a counter and signals from interrupt context. A
+ * handler can not wait for the mutex: when a waiter holds it, the handler
+ * tries again on the next interrupt. Another handler thread only enters
+ * and leaves, which wakes the pollers for nothing. The producer waits for
+ * each waiter to see each value; a waiter that has not seen it after a
+ * second is a lost wakeup, and the next signal frees it.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <metal/sys.h>
+#include <metal/condition.h>
+#include <metal/sleep.h>
+
+#include "metal_host.h"
+#include "cond_stress.h"
+
+#define MAX_WAITERS     8
+#define LOST_NS         1000000000.0
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("check failed line %d: %s\n", __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+typedef struct
+{
+    pthread_t tid;
+    uint64_t seen;
+    atomic_uint_fast64_t ack;
+    uint64_t waits;
+    double cpu_ns;
+    atomic_int done;
+} waiter_t;
+
+static struct metal_condition cv = METAL_CONDITION_INIT;
+static METAL_MUTEX_DEFINE(m);
+static uint64_t produced;       /* under m */
+static int stop;                /* under m */
+static atomic_int noise_stop;
+static waiter_t waiters[MAX_WAITERS];
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void spin_ns(double ns)
+{
+    double end = now_ns() + ns;
+
+    while (now_ns() < end)
+        ;
+}
+
+static int run_checks(void)
+{
+    struct metal_condition c = METAL_CONDITION_INIT;
+    METAL_MUTEX_DEFINE(m1);
+    unsigned int f1, f2, f3;
+    double t;
+    int usec;
+
+    /* The saved state nests as PRIMASK does */
+    f1 = sys_irq_save_disable();
+    f2 = sys_irq_save_disable();
+    CHECK(f1 == 0 && f2 == 1);
+    sys_irq_restore_enable(f2);
+    f3 = sys_irq_save_disable();
+    CHECK(f3 == 1);
+    sys_irq_restore_enable(f3);
+    sys_irq_restore_enable(f1);
+    f1 = sys_irq_save_disable();
+    CHECK(f1 == 0);
+    sys_irq_restore_enable(f1);
+
+    /* The mutex must be held */
+    CHECK(metal_condition_wait(NULL, &m1) == -EINVAL);
+    CHECK(metal_condition_wait(&c, NULL) == -EINVAL);
+    CHECK(metal_condition_wait(&c, &m1) == -EINVAL);
+    CHECK(c.m == NULL);
+
+    /* A signal only bumps the value the waiters compare */
+    CHECK(metal_condition_signal(&c) == 0 && atomic_load(&c.v) == 1);
+
+    for (usec = 100; usec <= 10000; usec *= 10) {
+        t = now_ns();
+        CHECK(metal_sleep_usec(usec) == 0);
+        t = now_ns() - t;
+        CHECK(t >= usec * 1000.0);
+        printf("metal_sleep_usec(%d): %.0f us\n", usec, t / 1000);
+    }
+
+    return 0;
+}
+
+static void *waiter_thread(void *arg)
+{
+    waiter_t *w = arg;
+
+    metal_mutex_acquire(&m);
+    while (!stop) {
+        if (produced == w->seen) {
+            metal_condition_wait(&cv, &m);
+            w->waits++;
+            continue;
+        }
+        w->seen = produced;
+        atomic_store(&w->ack, w->seen);
+    }
+    metal_mutex_release(&m);
+    w->cpu_ns = cpu_ns();
+    atomic_store(&w->done, 1);
+
+    return NULL;
+}
+
+static void *noise_thread(void *arg)
+{
+    unsigned int flags;
+
+    (void)arg;
+    while (!atomic_load(&noise_stop)) {
+        flags = metal_host_irq_enter();
+        metal_host_irq_exit(flags);
+        usleep(50);
+    }
+
+    return NULL;
+}
+
+/* One interrupt of the producer, returns 0 when the mutex was busy */
+static int handler(int end)
+{
+    unsigned int flags = metal_host_irq_enter();
+    int done = metal_mutex_try_acquire(&m);
+
+    if (done) {
+        if (end)
+            stop = 1;
+        else
+            produced++;
+        metal_condition_signal(&cv);
+        metal_mutex_release(&m);
+    }
+    metal_host_irq_exit(flags);
+
+    return done;
+}
+
+static int run_stress(uint32_t signals, int nb_waiters)
+{
+    METAL_MUTEX_DEFINE(m2);
+    pthread_t noise;
+    uint64_t retries = 0, lost = 0, waits = 0, polls;
+    double t, t0, lat, lat_sum = 0, lat_max = 0, wall, cpu = 0;
+    uint32_t i;
+    int k;
+
+    memset(waiters, 0, sizeof(waiters));
+    polls = metal_host_polls();
+    for (k = 0; k < nb_waiters; k++)
+        pthread_create(&waiters[k].tid, NULL, waiter_thread, &waiters[k]);
+    pthread_create(&noise, NULL, noise_thread, NULL);
+
+    wall = now_ns();
+    for (i = 1; i <= signals; i++) {
+        /* Moves the signal around the check of the waiters */
+        spin_ns(rnd() % 20000);
+        while (!handler(0)) {
+            retries++;
+            sched_yield();
+        }
+
+        t0 = now_ns();
+        lat = 0;
+        for (k = 0; k < nb_waiters; k++) {
+            while (atomic_load(&waiters[k].ack) < i) {
+                t = now_ns() - t0;
+                if (t > LOST_NS) {
+                    lost++;
+                    break;
+                }
+                sched_yield();
+            }
+            lat = now_ns() - t0;
+        }
+        lat_sum += lat;
+        if (lat > lat_max)
+            lat_max = lat;
+    }
+    wall = now_ns() - wall;
+
+    while (!handler(1))
+        sched_yield();
+    t0 = now_ns();
+    for (k = 0; k < nb_waiters; k++) {
+        while (!atomic_load(&waiters[k].done) && now_ns() - t0 < LOST_NS)
+            sched_yield();
+        if (!atomic_load(&waiters[k].done)) {
+            /* Never woken up by the stop, left behind */
+            lost++;
+            continue;
+        }
+        pthread_join(waiters[k].tid, NULL);
+        waits += waiters[k].waits;
+        cpu += waiters[k].cpu_ns;
+    }
+    atomic_store(&noise_stop, 1);
+    pthread_join(noise, NULL);
+    polls = metal_host_polls() - polls;
+
+    printf("%7d %8u %8llu %8llu %10.2f %10.2f %10.1f %10.1f %9.1f%%\n",
+           nb_waiters, signals, (unsigned long long)lost, (unsigned long long)retries,
+           (double)waits / signals / nb_waiters, waits ? (double)polls / waits : 0.0,
+           lat_sum / signals / 1000, lat_max / 1000,
+           100.0 * cpu / wall / nb_waiters);
+
+    /* The condition is attached to the mutex of the waiters */
+    if (lost)
+        return 1;
+    metal_mutex_acquire(&m2);
+    CHECK(cv.m == &m);
+    CHECK(metal_condition_wait(&cv, &m2) == -EINVAL);
+    metal_mutex_release(&m2);
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage : \n");
+    printf("%s cond [-n <signals>] [-w <waiters>]\n", prog);
+    printf("  -n: signals of the producer (default 20000)\n");
+    printf("  -w: waiter threads (default 2, max %d)\n", MAX_WAITERS);
+}
+
+int cond_stress_main(int argc, char **argv)
+{
+    uint32_t signals = 20000;
+    int nb_waiters = 2;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "n:w:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            signals = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            nb_waiters = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!signals || nb_waiters < 1 || nb_waiters > MAX_WAITERS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (run_checks())
+        return 1;
+    printf("checks passed\n");
+
+    printf("waiters  signals     lost  retries   wait/sig   poll/wait  lat us avg  lat us max  waiter cpu\n");
+    if (run_stress(signals, nb_waiters)) {
+        printf("lost wakeups\n");
+        return 1;
+    }
+
+    return 0;
+}
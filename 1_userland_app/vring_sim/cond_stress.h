@@ -0,0 +1,12 @@
+/*
+ * cond_stress.h
+ * Checks and stress test of the libmetal condition, irq and sleep
+ * primitives, see cond_stress.c.
+ */
+
+#ifndef COND_STRESS_H
+#define COND_STRESS_H
+
+int cond_stress_main(int argc, char **argv);
+
+#endif /* COND_STRESS_H */
@@ -0,0 +1,126 @@
+/*
+ * metal_host.c
+ * The libmetal system layer of the target (cortexm/sys.c) backed by
+ * pthreads, to run the middleware on the host.
+ *
+ * The core is a lock: a thread holds it while its interrupts are disabled
+ * (PRIMASK), and a thread that stands for an interrupt handler holds it
+ * between metal_host_irq_enter() and metal_host_irq_exit(), so a handler
+ * never runs inside a critical section.
+ *
+ * Each thread has an event register. metal_generic_default_wake() (SEV)
+ * sets the registers of all the threads, and so does a handler entry, as
+ * an interrupt becoming pending does with SEVONPEND.
+ * metal_generic_default_poll() (WFE) clears the register of the caller,
+ * or waits for it with the lock released, so that the handlers can run.
+ *
+ * The caches and the I/O mappings are no-ops, as on the CM4.
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <metal/sys.h>
+#include <metal/io.h>
+
+#include "metal_host.h"
+
+struct metal_state _metal;
+
+static pthread_mutex_t core_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t core_event = PTHREAD_COND_INITIALIZER;
+static uint64_t events;                 /* under core_lock */
+static __thread uint64_t events_seen;   /* the event register: events_seen != events */
+static __thread int masked;             /* PRIMASK */
+static atomic_uint_fast64_t polls;
+
+unsigned int sys_irq_save_disable(void)
+{
+    if (masked)
+        return 1;
+    pthread_mutex_lock(&core_lock);
+    masked = 1;
+    return 0;
+}
+
+void sys_irq_restore_enable(unsigned int flags)
+{
+    if (!flags && masked) {
+        masked = 0;
+        pthread_mutex_unlock(&core_lock);
+    }
+}
+
+/* Under core_lock */
+static void send_event(void)
+{
+    events++;
+    pthread_cond_broadcast(&core_event);
+}
+
+void metal_generic_default_poll(void)
+{
+    unsigned int flags = sys_irq_save_disable();
+
+    atomic_fetch_add(&polls, 1);
+    while (events_seen == events)
+        pthread_cond_wait(&core_event, &core_lock);
+    events_seen = events;
+    sys_irq_restore_enable(flags);
+}
+
+void metal_generic_default_wake(void)
+{
+    unsigned int flags = sys_irq_save_disable();
+
+    send_event();
+    sys_irq_restore_enable(flags);
+}
+
+int metal_generic_default_sleep_usec(unsigned int usec)
+{
+    struct timespec ts = { usec / 1000000, (usec % 1000000) * 1000 };
+
+    while (nanosleep(&ts, &ts) && errno == EINTR)
+        ;
+
+    return 0;
+}
+
+unsigned int metal_host_irq_enter(void)
+{
+    unsigned int flags = sys_irq_save_disable();
+
+    send_event();
+    return flags;
+}
+
+void metal_host_irq_exit(unsigned int flags)
+{
+    sys_irq_restore_enable(flags);
+}
+
+uint64_t metal_host_polls(void)
+{
+    return atomic_load(&polls);
+}
+
+void metal_machine_cache_invalidate(void *addr, unsigned int len)
+{
+    (void)addr;
+    (void)len;
+}
+
+void metal_machine_cache_flush(void *addr, unsigned int len)
+{
+    (void)addr;
+    (void)len;
+}
+
+void metal_sys_io_mem_map(struct metal_io_region *io)
+{
+    (void)io;
+}
@@ -0,0 +1,18 @@
+/*
+ * metal_host.h
+ * The libmetal system layer of the target on the host, see metal_host.c.
+ */
+
+#ifndef METAL_HOST_H
+#define METAL_HOST_H
+
+#include <stdint.h>
+
+/* Around the body of a thread that stands for an interrupt handler */
+unsigned int metal_host_irq_enter(void);
+void metal_host_irq_exit(unsigned int flags);
+
+/* Calls of metal_generic_default_poll() so far */
+uint64_t metal_host_polls(void);
+
+#endif /* METAL_HOST_H */
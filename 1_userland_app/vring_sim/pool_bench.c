@@ -0,0 +1,225 @@
+/*
+ * pool_bench.c
+ * Checks and benchmark of the rpmsg_virtio shared memory pool.
+ *
+ * The checks exercise the size classes, the free lists, the buffers
+ * above the largest class, rpmsg_virtio_shm_pool_reserve() and the
+ * statistics, and stop at the first failure.
+ *
+ * The benchmark runs a random workload on a pool of the size of the
+ * RAM2_ipc_shm region: a set of live buffers, each step gives one back
+ * and takes another: mostly vring buffers, some of other sizes and a few
+ * large-message buffers.
+ * It prints the cost of a get + put and the fragmentation, with and
+ * without large buffers reserved up front, and how many steps the former
+ * bump allocator (no free) lasts on the same workload.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <openamp/rpmsg_virtio.h>
+
+#include "pool_bench.h"
+
+#define IPC_SHM_SIZE    0x8000      /* RAM2_ipc_shm */
+#define MAX_LIVE        256
+#define LARGE_SIZE      8192
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("check failed line %d: %s\n", __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+static uint8_t mem[4 * IPC_SHM_SIZE] __attribute__((aligned(64)));
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int run_checks(void)
+{
+    struct rpmsg_virtio_shm_pool pool;
+    struct rpmsg_virtio_shm_pool_stats *st = &pool.stats;
+    void *a, *b, *c, *l1, *l2, *r[4];
+    int i;
+
+    /* Whole words, the memory never handed out shrinks from the start */
+    rpmsg_virtio_init_shm_pool(&pool, mem, IPC_SHM_SIZE + 3);
+    CHECK(pool.size == IPC_SHM_SIZE && pool.avail == IPC_SHM_SIZE);
+
+    /* Rounded to the class */
+    a = rpmsg_virtio_shm_pool_get_buffer(&pool, 100);
+    CHECK(a == mem && st->used == 128 && st->requested == 100);
+    b = rpmsg_virtio_shm_pool_get_buffer(&pool, RPMSG_BUFFER_SIZE);
+    CHECK(b == mem + 128 && st->used == 128 + RPMSG_BUFFER_SIZE);
+
+    /* A buffer given back is reused by its class only */
+    rpmsg_virtio_shm_pool_put_buffer(&pool, a, 100);
+    CHECK(st->cached == 128 && st->nfree[1] == 1 && st->used == RPMSG_BUFFER_SIZE);
+    c = rpmsg_virtio_shm_pool_get_buffer(&pool, 200);
+    CHECK(c != a && st->reuses == 0);
+    c = rpmsg_virtio_shm_pool_get_buffer(&pool, 65);
+    CHECK(c == a && st->reuses == 1 && st->cached == 0 && st->nfree[1] == 0);
+
+    /* Above the classes: header, first fit without split */
+    l1 = rpmsg_virtio_shm_pool_get_buffer(&pool, 20000);
+    CHECK(l1 && ((uintptr_t)l1 & (sizeof(void *) - 1)) == 0);
+    rpmsg_virtio_shm_pool_put_buffer(&pool, l1, 20000);
+    CHECK(st->nfree[RPMSG_SHM_POOL_CLASSES] == 1);
+    l2 = rpmsg_virtio_shm_pool_get_buffer(&pool, 17000);
+    CHECK(l2 == l1 && st->nfree[RPMSG_SHM_POOL_CLASSES] == 0);
+    CHECK(rpmsg_virtio_shm_pool_get_buffer(&pool, 17000) == NULL && st->fails == 1);
+    rpmsg_virtio_shm_pool_put_buffer(&pool, l2, 17000);
+    CHECK(st->requested == 200 + 65 + RPMSG_BUFFER_SIZE);
+
+    /* Reserved buffers go to the free list and serve the next gets */
+    rpmsg_virtio_init_shm_pool(&pool, mem, sizeof(mem));
+    CHECK(rpmsg_virtio_shm_pool_reserve(&pool, 4096, 3) == 3);
+    CHECK(st->cached == 3 * 4096 && st->nfree[6] == 3 && st->used == 0);
+    for (i = 0; i < 4; i++)
+        r[i] = rpmsg_virtio_shm_pool_get_buffer(&pool, 3000 + i);
+    CHECK(st->reuses == 3 && st->cached == 0 && r[3] == mem + 3 * 4096);
+    for (i = 0; i < 4; i++)
+        rpmsg_virtio_shm_pool_put_buffer(&pool, r[i], 3000 + i);
+    CHECK(st->used == 0 && st->requested == 0 && st->cached == 4 * 4096);
+    CHECK(st->high_water == 4 * 4096 && st->gets == 4 && st->puts == 4);
+    CHECK(rpmsg_virtio_shm_pool_reserve(&pool, 1 << 20, 1) == RPMSG_ERR_NO_MEM);
+
+    return 0;
+}
+
+/* Buffer sizes: mostly vring buffers, some larger ones of any size */
+static size_t random_size(void)
+{
+    uint32_t p = rnd() % 100;
+
+    if (p < 80)
+        return RPMSG_BUFFER_SIZE;
+    if (p < 97)
+        return 64 + rnd() % (4 * RPMSG_BUFFER_SIZE);
+    return LARGE_SIZE;
+}
+
+static void run_bench(uint32_t steps, uint32_t live, uint32_t reserved)
+{
+    struct rpmsg_virtio_shm_pool pool;
+    struct rpmsg_virtio_shm_pool_stats *st = &pool.stats;
+    static void *bufs[MAX_LIVE];
+    static size_t sizes[MAX_LIVE];
+    size_t avail, bump_size;
+    uint32_t i, k, bump_steps, large_fails = 0;
+    double t;
+
+    /* The former allocator: carve, never free */
+    seed = 1;
+    avail = IPC_SHM_SIZE;
+    for (bump_steps = 0; bump_steps < steps; bump_steps++) {
+        bump_size = random_size();
+        if (avail < bump_size)
+            break;
+        avail -= bump_size;
+    }
+
+    seed = 1;
+    rpmsg_virtio_init_shm_pool(&pool, mem, IPC_SHM_SIZE);
+    rpmsg_virtio_shm_pool_reserve(&pool, LARGE_SIZE, reserved);
+    memset(bufs, 0, sizeof(bufs));
+    t = now_ns();
+    for (i = 0; i < steps; i++) {
+        k = rnd() % live;
+        rpmsg_virtio_shm_pool_put_buffer(&pool, bufs[k], sizes[k]);
+        sizes[k] = random_size();
+        bufs[k] = rpmsg_virtio_shm_pool_get_buffer(&pool, sizes[k]);
+        if (!bufs[k] && sizes[k] == LARGE_SIZE)
+            large_fails++;
+    }
+    t = (now_ns() - t) / steps;
+
+    printf("%5u %8u %10u %8.1f %8lu %8u %7.1f%% %7.1f%% %7.1f%% %9zu %10u\n",
+           live, reserved, steps, t, st->fails, large_fails,
+           st->used ? 100.0 * (st->used - st->requested) / st->used : 0.0,
+           100.0 * st->cached / pool.size, 100.0 * pool.avail / pool.size,
+           st->high_water, bump_steps);
+}
+
+static double bench_get_put(size_t size)
+{
+    struct rpmsg_virtio_shm_pool pool;
+    uint32_t i, loops = 10000000;
+    void *b;
+    double t;
+
+    rpmsg_virtio_init_shm_pool(&pool, mem, sizeof(mem));
+    t = now_ns();
+    for (i = 0; i < loops; i++) {
+        b = rpmsg_virtio_shm_pool_get_buffer(&pool, size);
+        rpmsg_virtio_shm_pool_put_buffer(&pool, b, size);
+    }
+    return (now_ns() - t) / loops;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage : \n");
+    printf("%s pool [-s <steps>]\n", prog);
+    printf("  -s: steps of the random workload (default 1000000)\n");
+}
+
+int pool_bench_main(int argc, char **argv)
+{
+    static const uint32_t lives[] = { 8, 16, 32, 64 };
+    uint32_t steps = 1000000;
+    unsigned int i;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "s:h")) != -1) {
+        switch (opt) {
+        case 's':
+            steps = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!steps) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (run_checks())
+        return 1;
+    printf("checks passed\n");
+
+    printf("get+put %d bytes: %.1f ns, large 6000 bytes: %.1f ns\n",
+           RPMSG_BUFFER_SIZE, bench_get_put(RPMSG_BUFFER_SIZE), bench_get_put(6000));
+    printf("random workload on %d KB, %d classes from %d bytes: 80%% of %d bytes, 17%% of 64 to %d, 3%% of %d\n",
+           IPC_SHM_SIZE >> 10, RPMSG_SHM_POOL_CLASSES, RPMSG_SHM_POOL_MIN_SIZE,
+           RPMSG_BUFFER_SIZE, 4 * RPMSG_BUFFER_SIZE, LARGE_SIZE);
+    printf(" live reserved      steps  ns/step    fails    large rounding   cached    never high water bump steps\n");
+    for (i = 0; i < sizeof(lives) / sizeof(lives[0]); i++) {
+        run_bench(steps, lives[i], 0);
+        run_bench(steps, lives[i], 2);
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+/*
+ * pool_bench.h
+ * Checks and benchmark of the rpmsg_virtio shared memory pool, see
+ * pool_bench.c.
+ */
+
+#ifndef POOL_BENCH_H
+#define POOL_BENCH_H
+
+int pool_bench_main(int argc, char **argv);
+
+#endif /* POOL_BENCH_H */
@@ -0,0 +1,459 @@
+/*
+ * vring_sim.c
+ * Host harness of the OpenAMP vrings: kicks per message with and without
+ * VIRTIO_RING_F_EVENT_IDX.
+ *
+ * The virtqueue and rpmsg code of the exchange_large_buf middleware runs
+ * here twice, as the master (Linux) and as the remote (CM4), over the
+ * same ring memory. A kick of one side latches an interrupt of the other,
+ * as the IPCC does between the cores; the harness delivers the latched
+ * interrupts after a message with some probability (the peer runs while
+ * the sender goes on) and at the end of each burst.
+ *
+ * Each run sends bursts of messages master to remote, remote to master or
+ * as an echo by the remote, and prints the kicks of both sides per
+ * message. Messages left in a ring with no interrupt pending at the end
+ * are lost wakeups. All the runs share one buffer pool: the master gives
+ * its buffers back when it is deinitialized.
+ *
+ * "vring_sim pool" checks and benchmarks the buffer pool, see
+ * pool_bench.c. "vring_sim cond" checks and stress tests the libmetal
+ * condition, irq and sleep primitives, see cond_stress.c. The libmetal
+ * system layer of the target is in metal_host.c, its static pools in
+ * alloc_check.c: "vring_sim alloc" checks them.
+ *
+ * "vring_sim sweep" measures the throughput for the numbers and sizes of
+ * buffers the CM4 projects can be built with (VRING_NUM_BUFFS,
+ * RPMSG_BUFFER_SIZE): the master allocates them with
+ * rpmsg_init_vdev_with_config() and the remote reads their size from the
+ * descriptors, as on the target. Each point sends full buffers one way, a
+ * message never spans two buffers (RPMSG_HDR_Transmit() refuses them).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <metal/sys.h>
+#include <metal/io.h>
+#include <openamp/rpmsg_virtio.h>
+
+#include "pool_bench.h"
+#include "cond_stress.h"
+#include "alloc_check.h"
+
+#define NUM_BUFFS   16
+#define BUF_SIZE    512
+#define RING_ALIGN  16
+#define RING_SIZE   0x1000
+#define SHM_SIZE    (2 * RING_SIZE + 2 * NUM_BUFFS * BUF_SIZE)
+#define SWEEP_BUFFS 128         /* fits RING_SIZE */
+#define SWEEP_SIZE  4096
+#define SWEEP_SHM   (2 * RING_SIZE + 2 * SWEEP_BUFFS * SWEEP_SIZE)
+#define EPT_MASTER  0x20
+#define EPT_REMOTE  0x21
+
+enum {
+    DIR_M2R = 0,
+    DIR_R2M,
+    DIR_ECHO,
+};
+
+static const char *dir_names[] = { "m2r", "r2m", "echo" };
+
+typedef struct side
+{
+    struct virtio_device vdev;
+    struct virtio_vring_info vrings[2];
+    struct rpmsg_virtio_device rvdev;
+    struct rpmsg_endpoint ept;
+    struct side *peer;
+    int irq[2];             /* interrupt latched per vring */
+    int echo;
+    uint64_t kicks;
+    uint64_t received;
+    uint64_t dropped;       /* echo without a free buffer */
+    uint64_t stalls;        /* send without a free buffer */
+} side_t;
+
+static side_t master, remote;
+static uint8_t shm[SWEEP_SHM] __attribute__((aligned(4096)));
+static struct metal_io_region shm_io;
+static metal_phys_addr_t shm_phys = 0;
+static struct rpmsg_virtio_shm_pool shpool;
+static uint8_t vdev_status;
+static uint32_t vdev_features;
+static uint32_t seed = 1;
+static int run_pct = 25;
+static unsigned int num_buffs = NUM_BUFFS;
+static struct rpmsg_virtio_config buf_config = {
+    .h2r_buf_size = BUF_SIZE,
+    .r2h_buf_size = BUF_SIZE,
+};
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+static uint8_t sim_get_status(struct virtio_device *vdev)
+{
+    (void)vdev;
+    return vdev_status;
+}
+
+static void sim_set_status(struct virtio_device *vdev, uint8_t status)
+{
+    (void)vdev;
+    vdev_status = status;
+}
+
+static uint32_t sim_get_features(struct virtio_device *vdev)
+{
+    (void)vdev;
+    return vdev_features;
+}
+
+static void sim_set_features(struct virtio_device *vdev, uint32_t features)
+{
+    (void)vdev;
+    (void)features;
+}
+
+static void sim_notify(struct virtqueue *vq)
+{
+    side_t *s = metal_container_of(vq->vq_dev, side_t, vdev);
+
+    s->kicks++;
+    s->peer->irq[vq->vq_queue_index] = 1;
+}
+
+static const struct virtio_dispatch sim_dispatch = {
+    .get_status = sim_get_status,
+    .set_status = sim_set_status,
+    .get_features = sim_get_features,
+    .set_features = sim_set_features,
+    .notify = sim_notify,
+};
+
+static int sim_ept_cb(struct rpmsg_endpoint *ept, void *data, size_t len,
+                      uint32_t src, void *priv)
+{
+    side_t *s = priv;
+
+    (void)src;
+    s->received++;
+    if (s->echo && rpmsg_trysend(ept, data, len) < 0)
+        s->dropped++;
+
+    return RPMSG_SUCCESS;
+}
+
+/* Runs the latched interrupts of both sides until none is left */
+static int run_irqs(void)
+{
+    side_t *sides[2] = { &remote, &master };
+    int i, n, count = 0;
+
+    do {
+        n = 0;
+        for (i = 0; i < 4; i++) {
+            side_t *s = sides[i / 2];
+
+            if (s->irq[i % 2]) {
+                s->irq[i % 2] = 0;
+                virtqueue_notification(s->vrings[i % 2].vq);
+                n++;
+            }
+        }
+        count += n;
+    } while (n);
+
+    return count;
+}
+
+static int side_init(side_t *s, side_t *peer, unsigned int role)
+{
+    int i, ret;
+
+    memset(s, 0, sizeof(*s));
+    s->peer = peer;
+    s->vdev.role = role;
+    s->vdev.func = &sim_dispatch;
+    s->vdev.vrings_num = 2;
+    s->vdev.vrings_info = s->vrings;
+    for (i = 0; i < 2; i++) {
+        s->vrings[i].vq = virtqueue_allocate(num_buffs);
+        if (!s->vrings[i].vq)
+            return -1;
+        s->vrings[i].io = &shm_io;
+        s->vrings[i].notifyid = i;
+        s->vrings[i].info.vaddr = shm + i * RING_SIZE;
+        s->vrings[i].info.align = RING_ALIGN;
+        s->vrings[i].info.num_descs = num_buffs;
+    }
+
+    ret = rpmsg_init_vdev_with_config(&s->rvdev, &s->vdev, NULL, &shm_io,
+                                      role == VIRTIO_DEV_MASTER ? &shpool : NULL,
+                                      &buf_config);
+    if (!ret)
+        ret = rpmsg_create_ept(&s->ept, &s->rvdev.rdev, "vring_sim",
+                               role == VIRTIO_DEV_MASTER ? EPT_MASTER : EPT_REMOTE,
+                               role == VIRTIO_DEV_MASTER ? EPT_REMOTE : EPT_MASTER,
+                               sim_ept_cb, NULL);
+    s->ept.priv = s;
+
+    return ret;
+}
+
+static void side_deinit(side_t *s)
+{
+    int i;
+
+    rpmsg_deinit_vdev(&s->rvdev);
+    for (i = 0; i < 2; i++)
+        metal_free_memory(s->vrings[i].vq);
+}
+
+static void send_one(side_t *s, const void *data, int len)
+{
+    while (rpmsg_trysend(&s->ept, data, len) < 0) {
+        /* The sender waits for the peer to give buffers back */
+        s->stalls++;
+        if (!run_irqs())
+            break;
+    }
+}
+
+static int run(int dir, int burst, uint32_t features, uint32_t msgs)
+{
+    side_t *tx = dir == DIR_R2M ? &remote : &master;
+    side_t *rx = dir == DIR_R2M ? &master : &remote;
+    uint64_t expected, got, lost;
+    uint32_t i;
+
+    /* The buffers hold the free lists of the pool */
+    memset(shm, 0, 2 * RING_SIZE);
+    vdev_status = 0;
+    vdev_features = features;
+    seed = 1;
+
+    if (side_init(&master, &remote, VIRTIO_DEV_MASTER) ||
+        side_init(&remote, &master, VIRTIO_DEV_SLAVE)) {
+        fprintf(stderr, "init failed\n");
+        return -1;
+    }
+    remote.echo = dir == DIR_ECHO;
+
+    for (i = 0; i < msgs; i++) {
+        send_one(tx, &i, sizeof(i));
+        if ((i + 1) % burst == 0 || (int)(rnd() % 100) < run_pct)
+            run_irqs();
+    }
+    run_irqs();
+
+    got = rx->received;
+    expected = msgs;
+    if (dir == DIR_ECHO) {
+        got = master.received;
+        expected = remote.received - remote.dropped;
+    }
+    lost = expected - got;
+
+    printf("%-8s %-5s %5d %8u %10.3f %10.3f %10.3f %8llu %8llu %8llu\n",
+           features & VIRTIO_RING_F_EVENT_IDX ? "eventidx" : "legacy",
+           dir_names[dir], burst, msgs,
+           (double)master.kicks / msgs, (double)remote.kicks / msgs,
+           (double)(master.kicks + remote.kicks) / msgs,
+           (unsigned long long)lost,
+           (unsigned long long)(tx->stalls),
+           (unsigned long long)remote.dropped);
+
+    side_deinit(&remote);
+    side_deinit(&master);
+
+    return lost ? 1 : 0;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Full buffers master to remote, returns the payload bytes per message */
+static int sweep_point(uint32_t msgs, double *ns)
+{
+    static uint8_t payload[SWEEP_SIZE];
+    uint32_t i;
+    int len;
+    double t;
+
+    memset(shm, 0, 2 * RING_SIZE);
+    rpmsg_virtio_init_shm_pool(&shpool, shm + 2 * RING_SIZE,
+                               2 * num_buffs * buf_config.h2r_buf_size);
+    vdev_status = 0;
+    vdev_features = (1 << VIRTIO_RPMSG_F_NS) | VIRTIO_RING_F_EVENT_IDX;
+    seed = 1;
+
+    if (side_init(&master, &remote, VIRTIO_DEV_MASTER) ||
+        side_init(&remote, &master, VIRTIO_DEV_SLAVE)) {
+        fprintf(stderr, "init failed\n");
+        return -1;
+    }
+
+    len = rpmsg_virtio_get_buffer_size(&master.rvdev.rdev);
+    if (len <= 0 || len != rpmsg_virtio_get_buffer_size(&remote.rvdev.rdev)) {
+        fprintf(stderr, "buffer sizes differ: %d %d\n", len,
+                rpmsg_virtio_get_buffer_size(&remote.rvdev.rdev));
+        return -1;
+    }
+
+    t = now_ns();
+    for (i = 0; i < msgs; i++) {
+        memcpy(payload, &i, sizeof(i));
+        send_one(&master, payload, len);
+        if ((int)(rnd() % 100) < run_pct)
+            run_irqs();
+    }
+    run_irqs();
+    *ns = now_ns() - t;
+
+    if (remote.received != msgs) {
+        fprintf(stderr, "%llu messages received of %u\n",
+                (unsigned long long)remote.received, msgs);
+        len = -1;
+    }
+
+    side_deinit(&remote);
+    side_deinit(&master);
+
+    return len;
+}
+
+static int sweep_main(int argc, char **argv)
+{
+    static const unsigned int counts[] = { 4, 8, 16, 32, 64, 128 };
+    static const unsigned int sizes[] = { 128, 256, 512, 1024, 2048, 4096 };
+    uint32_t msgs = 100000;
+    unsigned int c, z;
+    int opt, len;
+    double ns;
+
+    while ((opt = getopt(argc, argv, "n:p:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            msgs = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            run_pct = atoi(optarg);
+            break;
+        default:
+            printf("Usage : %s [-n <messages>] [-p <run %%>]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!msgs)
+        return 1;
+
+    metal_io_init(&shm_io, shm, &shm_phys, sizeof(shm), (unsigned int)-1, 0, NULL);
+
+    printf("master to remote, full buffers, peer runs after %d%% of the messages\n",
+           run_pct);
+    printf("buffs  size  payload   shm KB     Mmsg/s       MB/s   kick/msg   stalls\n");
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+            num_buffs = counts[c];
+            buf_config.h2r_buf_size = sizes[z];
+            buf_config.r2h_buf_size = sizes[z];
+
+            len = sweep_point(msgs, &ns);
+            if (len < 0)
+                return 1;
+
+            printf("%5u %5u %8d %8u %10.3f %10.1f %10.3f %8llu\n",
+                   counts[c], sizes[z], len,
+                   2 * counts[c] * sizes[z] / 1024,
+                   msgs * 1e3 / ns, (double)msgs * len * 1e3 / ns,
+                   (double)(master.kicks + remote.kicks) / msgs,
+                   (unsigned long long)master.stalls);
+        }
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage : \n");
+    printf("%s [-n <messages>] [-p <run %%>]\n", prog);
+    printf("%s pool [-s <steps>]\n", prog);
+    printf("%s cond [-n <signals>] [-w <waiters>]\n", prog);
+    printf("%s alloc [-c <cycles>]\n", prog);
+    printf("%s sweep [-n <messages>] [-p <run %%>]\n", prog);
+    printf("  -n: messages per run (default 10000)\n");
+    printf("  -p: chance that the peer runs after a message, %% (default 25)\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const int bursts[] = { 1, 4, 16 };
+    struct rpmsg_virtio_shm_pool_stats *st = &shpool.stats;
+    uint32_t msgs = 10000;
+    int opt, dir, b, f, bad = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "pool"))
+        return pool_bench_main(argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "cond"))
+        return cond_stress_main(argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "alloc"))
+        return alloc_check_main(argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "sweep"))
+        return sweep_main(argc - 1, argv + 1);
+
+    while ((opt = getopt(argc, argv, "n:p:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            msgs = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            run_pct = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!msgs) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    metal_io_init(&shm_io, shm, &shm_phys, sizeof(shm), (unsigned int)-1, 0, NULL);
+    rpmsg_virtio_init_shm_pool(&shpool, shm + 2 * RING_SIZE, SHM_SIZE - 2 * RING_SIZE);
+
+    printf("%d buffers of %d bytes, peer runs after %d%% of the messages\n",
+           NUM_BUFFS, BUF_SIZE, run_pct);
+    printf("mode     dir   burst     msgs  M kick/msg R kick/msg   kick/msg     lost   stalls  dropped\n");
+    for (dir = DIR_M2R; dir <= DIR_ECHO; dir++)
+        for (b = 0; b < 3; b++)
+            for (f = 0; f < 2; f++)
+                bad |= run(dir, bursts[b],
+                           (1 << VIRTIO_RPMSG_F_NS) | (f ? VIRTIO_RING_F_EVENT_IDX : 0),
+                           msgs);
+
+    printf("pool: %zu bytes carved of %zu, high water %zu, %zu in use after the runs\n",
+           shpool.size - shpool.avail, shpool.size, st->high_water, st->used);
+    if (alloc_print_pools() || st->used)
+        bad = 1;
+    if (bad)
+        printf("lost wakeups or buffers\n");
+
+    return bad;
+}
@@ -23,7 +23,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-
+#include <stdio.h>
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -43,6 +43,16 @@ enum {
 	TRANSFER_COMPLETE,
 	TRANSFER_ERROR
 };
+
+/* Binary trace event ids, keep in sync with 1_userland_app/cm4_trace */
+enum {
+	EVT_UART0_RX = 1,	/* size */
+	EVT_UART1_RX,		/* size */
+	EVT_SPI_DMA_START,
+	EVT_SPI_DMA_CPLT,	/* buffer count */
+	EVT_UART0_TX,		/* size, status */
+	EVT_SPI_DMA_ERROR,
+};
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -113,7 +123,8 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  /* unbuffered: newlib would allocate the stdout buffer on the heap */
+  setvbuf(stdout, NULL, _IONBF, 0);
   /* USER CODE END Init */
 
   if(IS_ENGINEERING_BOOT_MODE())
@@ -130,10 +141,12 @@ int main(void)
   }
 
   /* USER CODE BEGIN SysInit */
+  log_evt_init();
   log_info("Cortex-M4 boot successful with STM32Cube FW version: v%ld.%ld.%ld \r\n",
                                               ((HAL_GetHalVersion() >> 24) & 0x000000FF),
                                               ((HAL_GetHalVersion() >> 16) & 0x000000FF),
                                               ((HAL_GetHalVersion() >> 8) & 0x000000FF));
+  OPENAMP_pools_report();
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -177,14 +190,12 @@ int main(void)
     OPENAMP_check_for_message();
     if (VirtUart0RxMsg) {
       VirtUart0RxMsg = RESET;
-      log_info("CM4: Receive message from ttyRPMSG0\n");
+      log_evt1(EVT_UART0_RX, VirtUart0ChannelRxSize);
 
 #if 1 //debug only
       while(1) {
     	  res = VIRT_UART_Transmit(&huart0, (uint8_t *)VirtUart0ChannelBuffRx, MAX_BUFFER_SIZE);
-    	  if (VIRT_UART_OK != res) {
-    		  log_info("CM4: DEBUG VIRT_UART_Transmit() error\n");
-    	  }
+    	  log_evt2(EVT_UART0_TX, MAX_BUFFER_SIZE, res);
       }
 #else
       if (VirtUart0ChannelBuffRx[0] == 'S' && VirtUart0ChannelBuffRx[1] == 'T') {
@@ -195,7 +206,7 @@ int main(void)
 
     if (VirtUart1RxMsg) {
       VirtUart1RxMsg = RESET;
-      log_info("CM4: Receive message from ttyRPMSG1\n");
+      log_evt1(EVT_UART1_RX, VirtUart1ChannelRxSize);
 
       if (VirtUart1ChannelBuffRx[0] == 'S' && VirtUart1ChannelBuffRx[1] == 'T') {
     	  wTransferState = TRANSFER_IDLE;
@@ -204,16 +215,16 @@ int main(void)
 
     switch(wTransferState) {
     case TRANSFER_IDLE:
-    	log_info("CM4: Start SPI DMA\n");
+    	log_evt0(EVT_SPI_DMA_START);
     	wTransferState = TRANSFER_WAIT;
 		if(HAL_SPI_TransmitReceive_DMA(&hspi4, (uint8_t*)aTxBuffer, (uint8_t *)aRxBuffer, SAMPLING_BUFFER_SIZE) != HAL_OK) {
-			log_info("CM4: HAL_SPI_TransmitReceive_DMA() error\n");
+			log_evt0(EVT_SPI_DMA_ERROR);
 			/* Transfer error in transmission process */
 			Error_Handler();
 		}
 		break;
     case TRANSFER_COMPLETE:
-    	log_info("CM4: Transmit buffer to A7 by ttyRPMSG0\n");
+    	log_evt1(EVT_SPI_DMA_CPLT, bBufferCnt);
     	wBufferVal = 'a' + bBufferCnt;
     	wBufferVal |= (wBufferVal << 8);
     	wBufferVal |= (wBufferVal << 16);
@@ -224,8 +235,9 @@ int main(void)
     	memcpy(VirtUart0ChannelBuffTx, aTxBuffer, SAMPLING_BUFFER_SIZE);
     	memcpy(VirtUart0ChannelBuffTx + SAMPLING_BUFFER_SIZE, aRxBuffer, SAMPLING_BUFFER_SIZE);
 
-    	if(VIRT_UART_OK != VIRT_UART_Transmit(&huart0, (uint8_t *)VirtUart0ChannelBuffTx, MAX_BUFFER_SIZE)) {
-    		log_info("CM4: VIRT_UART_Transmit() error\n");
+    	res = VIRT_UART_Transmit(&huart0, (uint8_t *)VirtUart0ChannelBuffTx, MAX_BUFFER_SIZE);
+    	log_evt2(EVT_UART0_TX, MAX_BUFFER_SIZE, res);
+    	if(VIRT_UART_OK != res) {
     		Error_Handler();
     	}
     	wTransferState = TRANSFER_WAIT;
@@ -463,8 +475,6 @@ static void MX_GPIO_Init(void)
 void VIRT_UART0_RxCpltCallback(VIRT_UART_HandleTypeDef *huart)
 {
 
-    log_info("Msg received on VIRTUAL UART0 channel:  %s \n\r", (char *) huart->pRxBuffPtr);
-
     /* copy received msg in a variable to sent it back to master processor in main infinite loop*/
     VirtUart0ChannelRxSize = huart->RxXferSize < MAX_BUFFER_SIZE? huart->RxXferSize : MAX_BUFFER_SIZE-1;
     memcpy(VirtUart0ChannelBuffRx, huart->pRxBuffPtr, VirtUart0ChannelRxSize);
@@ -474,8 +484,6 @@ void VIRT_UART0_RxCpltCallback(VIRT_UART_HandleTypeDef *huart)
 void VIRT_UART1_RxCpltCallback(VIRT_UART_HandleTypeDef *huart)
 {
 
-    log_info("Msg received on VIRTUAL UART1 channel:  %s \n\r", (char *) huart->pRxBuffPtr);
-
     /* copy received msg in a variable to sent it back to master processor in main infinite loop*/
     VirtUart1ChannelRxSize = huart->RxXferSize < MAX_BUFFER_SIZE? huart->RxXferSize : MAX_BUFFER_SIZE-1;
     memcpy(VirtUart1ChannelBuffRx, huart->pRxBuffPtr, VirtUart1ChannelRxSize);
@@ -166,7 +166,7 @@ int MAILBOX_Notify(void *priv, uint32_t id)
     OPENAMP_log_dbg("Send msg on ch_1\r\n");
   }
   else if (id == VRING1_ID) {
-    /* Note: the OpenAMP framework never notifies this */
+    /* Rx buffers returned, only when the master waits for them */
     channel = IPCC_CHANNEL_2;
     OPENAMP_log_dbg("Send 'buff free' on ch_2\r\n");
   }
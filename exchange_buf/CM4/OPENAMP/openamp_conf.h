@@ -162,17 +162,62 @@ extern int __OPENAMP_region_end__[];    /* defined by linker script */
 #define VRING_TX_ADDRESS        -1        /* allocated by Master processor: CA7 */
 #define VRING_BUFF_ADDRESS      -1        /* allocated by Master processor: CA7 */
 #define VRING_ALIGNMENT         16        /* fixed to match with linux constraint */
+#ifndef VRING_NUM_BUFFS
 #define VRING_NUM_BUFFS         16		  /* number of rpmsg buffer */
+#endif
 #else
 
 #define VRING_RX_ADDRESS     0x10040000             /* allocated by Master processor: CA7 */
 #define VRING_TX_ADDRESS     0x10040400             /* allocated by Master processor: CA7 */
 #define VRING_BUFF_ADDRESS   0x10040800             /* allocated by Master processor: CA7 */
 #define VRING_ALIGNMENT      16         /* fixed to match with 4k page alignment requested by linux  */
+#ifndef VRING_NUM_BUFFS
 #define VRING_NUM_BUFFS      16             /* number of rpmsg buffer */
 #endif
+#endif
+
+/*
+ * Size of the reserved-memory regions declared for the vdev in the Linux
+ * device tree (vdev0vring0, vdev0vring1 and vdev0buffer). The master
+ * allocates 2 * VRING_NUM_BUFFS buffers of RPMSG_BUFFER_SIZE bytes in
+ * vdev0buffer, so increasing VRING_NUM_BUFFS or RPMSG_BUFFER_SIZE requires
+ * the device tree regions to be enlarged accordingly.
+ */
+#ifndef VRING_REGION_SIZE
+#define VRING_REGION_SIZE        0x1000    /* vdev0vring0 / vdev0vring1 size */
+#endif
+#ifndef VRING_BUFF_REGION_SIZE
+#define VRING_BUFF_REGION_SIZE   0x4000    /* vdev0buffer size */
+#endif
+
+/*
+ * The vring depth and the buffer size are fixed at build time, nothing is
+ * negotiated: the Linux master (virtio_rpmsg_bus) takes the depth from
+ * the resource table but always uses 512-byte buffers. RPMSG_BUFFER_SIZE
+ * must match it, define RPMSG_BUFFER_SIZE_OVERRIDE only with a kernel
+ * built for the same size.
+ */
+#define LINUX_RPMSG_BUFFER_SIZE  512       /* MAX_RPMSG_BUF_SIZE of virtio_rpmsg_bus */
+#if defined(RPMSG_BUFFER_SIZE) && (RPMSG_BUFFER_SIZE != LINUX_RPMSG_BUFFER_SIZE) && \
+    !defined(RPMSG_BUFFER_SIZE_OVERRIDE)
+#error "RPMSG_BUFFER_SIZE differs from the buffers of the Linux master"
+#endif
+
+/* Same computation as vring_size(), usable in preprocessor checks */
+#define VRING_SIZE(num, align)  ((((num) * 16 + 6 + (num) * 2 + (align) - 1) & ~((align) - 1)) + \
+                                 6 + (num) * 8)
+
+/*
+ * Offer VIRTIO_RING_F_EVENT_IDX to the master: each side then interrupts
+ * the other only when the peer has consumed all it was told about, not
+ * once per message. 0 goes back to a notification per message.
+ */
+#ifndef RPMSG_EVENT_IDX
+#define RPMSG_EVENT_IDX          1
+#endif
+
 /* Fixed parameter */
-#define NUM_RESOURCE_ENTRIES 2
+#define NUM_RESOURCE_ENTRIES 3
 #define VRING_COUNT          2
 #define VDEV_ID              0xFF
 #define VRING0_ID            0              /* VRING0 ID (master to remote) fixed to 0 for linux compatibility*/
@@ -69,6 +69,57 @@ __weak void log_buff(int ch)
 	system_log_buf[offset++ + 1] = '\0';
 }
 
+log_evt_ring_t system_evt_ring = {
+	.magic = SYSTEM_EVT_MAGIC,
+	.rec_size = sizeof(log_evt_rec_t),
+	.nb_rec = SYSTEM_EVT_NB_REC,
+	.head = 0,
+};
+
+/**
+  * @brief  Start the DWT cycle counter used to timestamp the events
+  * @retval None
+  */
+void log_evt_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+  * @brief  Write a binary event in the event ring
+  * @note   Lock-free, can be called from both thread and interrupt context:
+  *         the slot is reserved with LDREX/STREX and the record sequence is
+  *         written last so that the reader can drop records being written.
+  * @param  id event id
+  * @param  nargs number of valid arguments (0 to 4)
+  * @retval None
+  */
+void log_evt(uint16_t id, uint16_t nargs, uint32_t a0, uint32_t a1,
+             uint32_t a2, uint32_t a3)
+{
+	log_evt_rec_t *rec;
+	uint32_t seq;
+
+	do {
+		seq = __LDREXW(&system_evt_ring.head);
+	} while (__STREXW(seq + 1, &system_evt_ring.head));
+
+	rec = &system_evt_ring.rec[seq & (SYSTEM_EVT_NB_REC - 1)];
+	rec->seq = ~seq;
+	__DMB();
+	rec->ts = DWT->CYCCNT;
+	rec->id = id;
+	rec->nargs = nargs;
+	rec->args[0] = a0;
+	rec->args[1] = a1;
+	rec->args[2] = a2;
+	rec->args[3] = a3;
+	__DMB();
+	rec->seq = seq;
+}
+
 #endif
 
 #if defined ( __CC_ARM) || (__ARMCC_VERSION) && (__ARMCC_VERSION >= 6010050)
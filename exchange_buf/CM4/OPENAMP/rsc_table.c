@@ -71,7 +71,11 @@
  #define CONST
 #endif
 
-#define RPMSG_IPU_C0_FEATURES       1
+#if RPMSG_EVENT_IDX
+#define RPMSG_IPU_C0_FEATURES       ((1 << VIRTIO_RPMSG_F_NS) | VIRTIO_RING_F_EVENT_IDX)
+#else
+#define RPMSG_IPU_C0_FEATURES       (1 << VIRTIO_RPMSG_F_NS)
+#endif
 #define VRING_COUNT         		2
 
 /* VirtIO rpmsg device id */
@@ -79,6 +83,7 @@
 
 #if defined (__LOG_TRACE_IO_)
 extern char system_log_buf[];
+extern log_evt_ring_t system_evt_ring;
 #endif
 
 #if defined(__GNUC__)
@@ -98,7 +103,7 @@ __root CONST struct shared_resource_table resource_table @ ".resource_table" = {
 #if defined(__ICCARM__) || defined (__CC_ARM) || defined (LINUX_RPROC_MASTER)
 	.version = 1,
 #if defined (__LOG_TRACE_IO_)
-	.num = 2,
+	.num = 3,
 #else
 	.num = 1,
 #endif
@@ -106,6 +111,7 @@ __root CONST struct shared_resource_table resource_table @ ".resource_table" = {
 	.offset = {
 		offsetof(struct shared_resource_table, vdev),
 		offsetof(struct shared_resource_table, cm_trace),
+		offsetof(struct shared_resource_table, cm_evt),
 	},
 
 	/* Virtio device entry */
@@ -123,6 +129,10 @@ __root CONST struct shared_resource_table resource_table @ ".resource_table" = {
 		RSC_TRACE,
 		(uint32_t)system_log_buf, SYSTEM_TRACE_BUF_SZ, 0, "cm4_log",
 	},
+	.cm_evt = {
+		RSC_TRACE,
+		(uint32_t)&system_evt_ring, sizeof(system_evt_ring), 0, "cm4_evt",
+	},
 #endif
 } ;
 #endif
@@ -39,6 +39,7 @@ struct shared_resource_table {
 	struct fw_rsc_vdev_vring vring0;
 	struct fw_rsc_vdev_vring vring1;
 		struct fw_rsc_trace cm_trace;
+		struct fw_rsc_trace cm_evt;
 };
 
 /* USER CODE END ET */
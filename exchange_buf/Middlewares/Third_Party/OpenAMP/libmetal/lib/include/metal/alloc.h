@@ -19,6 +19,7 @@ extern "C" {
 /** \defgroup Memory Allocation Interfaces
  *  @{ */
 
+#ifndef METAL_ALLOC_POOLS
 /**
  * @brief      allocate requested memory size
  *             return a pointer to the allocated memory
@@ -34,6 +35,7 @@ static inline void *metal_allocate_memory(unsigned int size);
  * @param[in]  ptr       pointer to memory
  */
 static inline void metal_free_memory(void *ptr);
+#endif
 
 #include <metal/system/generic/alloc.h>
 
@@ -40,15 +40,39 @@ struct metal_state {
 	struct metal_common_state common;
 };
 
+/*
+ * Event and sleep primitives of the machine, see cortexm/sys.c. They are
+ * weak there: an application or a host build can provide its own.
+ */
+
+/**
+ * @brief wait for an event: metal_generic_default_wake() or an interrupt
+ *        becoming pending, also with the interrupts disabled. It may
+ *        return early, the caller checks its condition again.
+ */
+void metal_generic_default_poll(void);
+
+/**
+ * @brief wake up the contexts waiting in metal_generic_default_poll()
+ */
+void metal_generic_default_wake(void);
+
+/**
+ * @brief wait for at least usec microseconds
+ * @return 0
+ */
+int metal_generic_default_sleep_usec(unsigned int usec);
+
 #ifdef METAL_INTERNAL
 
 /**
- * @brief restore interrupts to state before disable_global_interrupt()
+ * @brief restore interrupts to state before sys_irq_save_disable()
  */
 void sys_irq_restore_enable(unsigned int flags);
 
 /**
  * @brief disable all interrupts
+ * @return previous state for sys_irq_restore_enable(), the pairs nest
  */
 unsigned int sys_irq_save_disable(void);
 
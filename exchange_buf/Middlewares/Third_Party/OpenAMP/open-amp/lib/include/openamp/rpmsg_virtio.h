@@ -26,23 +26,97 @@ extern "C" {
 #define RPMSG_BUFFER_SIZE	(512)
 #endif
 
+/* Size classes of the shared buffers pool: RPMSG_SHM_POOL_MIN_SIZE << n */
+#ifndef RPMSG_SHM_POOL_MIN_SIZE
+#define RPMSG_SHM_POOL_MIN_SIZE	(64)
+#endif
+#ifndef RPMSG_SHM_POOL_CLASSES
+#define RPMSG_SHM_POOL_CLASSES	(8)
+#endif
+
 /* The feature bitmap for virtio rpmsg */
 #define VIRTIO_RPMSG_F_NS 0 /* RP supports name service notifications */
 
 struct rpmsg_virtio_shm_pool;
+struct rpmsg_shm_large;
+
+/**
+ * struct rpmsg_virtio_shm_pool_stats - usage of the shared memory pool
+ * @used: bytes handed out, rounded up to their class
+ * @requested: bytes asked for by the users of those: used - requested is
+ *	       lost to the rounding
+ * @cached: bytes given back, waiting in the free lists of their class
+ * @high_water: maximum of used
+ * @gets: buffers handed out
+ * @puts: buffers given back
+ * @reuses: gets served from a free list
+ * @splits: gets served by splitting a free buffer of a larger class
+ * @fails: gets that found no memory
+ * @nfree: buffers in the free list of each class, the last entry for the
+ *	   buffers above the classes
+ */
+struct rpmsg_virtio_shm_pool_stats {
+	size_t used;
+	size_t requested;
+	size_t cached;
+	size_t high_water;
+	unsigned long gets;
+	unsigned long puts;
+	unsigned long reuses;
+	unsigned long splits;
+	unsigned long fails;
+	unsigned int nfree[RPMSG_SHM_POOL_CLASSES + 1];
+};
+
 /**
  * struct rpmsg_virtio_shm_pool - shared memory pool used for rpmsg buffers
- * @get_buffer: function to get buffer from the pool
  * @base: base address of the memory pool
- * @avail: available memory size
+ * @avail: memory never handed out yet, at the end of the pool
  * @size: total pool size
+ * @free: buffers given back, per size class
+ * @free_large: buffers above the largest class given back
+ * @reserved: buffers of each class added by rpmsg_virtio_shm_pool_reserve,
+ *	      never split
+ * @stats: usage and fragmentation statistics
+ *
+ * A buffer is rounded up to its size class and carved from the end of
+ * the memory never handed out the first time; once given back it waits
+ * in the free list of its class for the next buffer of the same class.
+ * When nothing is left to carve, a free buffer of a larger class is split,
+ * unless it was reserved. Free buffers are not merged back.
+ * Buffers above the largest class keep their size in a header and are
+ * reused first fit, without splitting.
  */
 struct rpmsg_virtio_shm_pool {
 	void *base;
 	size_t avail;
 	size_t size;
+	void *free[RPMSG_SHM_POOL_CLASSES];
+	struct rpmsg_shm_large *free_large;
+	unsigned int reserved[RPMSG_SHM_POOL_CLASSES];
+	struct rpmsg_virtio_shm_pool_stats stats;
+};
+
+/**
+ * struct rpmsg_virtio_config - configuration of the rpmsg virtio device
+ * @h2r_buf_size: size of the buffers used to send data from host to remote
+ * @r2h_buf_size: size of the buffers used to send data from remote to host
+ *
+ * Only used when the local side is the RPMsg master, as the master allocates
+ * the buffers. On the remote side the size is given by the virtqueue
+ * descriptors filled by the master.
+ */
+struct rpmsg_virtio_config {
+	uint32_t h2r_buf_size;
+	uint32_t r2h_buf_size;
 };
 
+#define RPMSG_VIRTIO_DEFAULT_CONFIG			\
+	(&(const struct rpmsg_virtio_config) {		\
+		.h2r_buf_size = RPMSG_BUFFER_SIZE,	\
+		.r2h_buf_size = RPMSG_BUFFER_SIZE,	\
+	})
+
 /**
  * struct rpmsg_virtio_device - representation of a rpmsg device based on virtio
  * @rdev: rpmsg device, first property in the struct
@@ -51,10 +125,12 @@ struct rpmsg_virtio_shm_pool {
  * @svq: pointer to send virtqueue
  * @shbuf_io: pointer to the shared buffer I/O region
  * @shpool: pointer to the shared buffers pool
+ * @config: buffer sizes used by the master side
  * @endpoints: list of endpoints.
  */
 struct rpmsg_virtio_device {
 	struct rpmsg_device rdev;
+	struct rpmsg_virtio_config config;
 	struct virtio_device *vdev;
 	struct virtqueue *rvq;
 	struct virtqueue *svq;
@@ -133,6 +209,30 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 		    struct metal_io_region *shm_io,
 		    struct rpmsg_virtio_shm_pool *shpool);
 
+/**
+ * rpmsg_init_vdev_with_config - initialize rpmsg virtio device with config
+ *
+ * Same as rpmsg_init_vdev() but the size of the shared buffers allocated by
+ * the master side is taken from @config instead of RPMSG_BUFFER_SIZE.
+ *
+ * @param rvdev  - pointer to the rpmsg virtio device
+ * @param vdev   - pointer to the virtio device
+ * @param ns_bind_cb  - callback handler for name service announcement without
+ *                      local endpoints waiting to bind.
+ * @param shm_io - pointer to the share memory I/O region.
+ * @param shpool - pointer to shared memory pool. rpmsg_virtio_init_shm_pool has
+ *                 to be called first to fill this structure.
+ * @param config - pointer to the buffer size configuration
+ *
+ * @return - status of function execution
+ */
+int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
+				struct virtio_device *vdev,
+				rpmsg_ns_bind_cb ns_bind_cb,
+				struct metal_io_region *shm_io,
+				struct rpmsg_virtio_shm_pool *shpool,
+				const struct rpmsg_virtio_config *config);
+
 /**
  * rpmsg_deinit_vdev - deinitialize rpmsg virtio device
  *
@@ -155,6 +255,45 @@ void rpmsg_deinit_vdev(struct rpmsg_virtio_device *rvdev);
 void rpmsg_virtio_init_shm_pool(struct rpmsg_virtio_shm_pool *shpool,
 				void *shbuf, size_t size);
 
+/**
+ * rpmsg_virtio_shm_pool_get_buffer - get a buffer from the shared pool
+ *
+ * Only used on the master side, which allocates the buffers.
+ *
+ * @param shpool - pointer to the shared buffers pool structure
+ * @param size - buffer size
+ *
+ * @return - pointer to the buffer, NULL if the pool is exhausted
+ */
+void *rpmsg_virtio_shm_pool_get_buffer(struct rpmsg_virtio_shm_pool *shpool,
+				       size_t size);
+
+/**
+ * rpmsg_virtio_shm_pool_put_buffer - give a buffer back to the shared pool
+ *
+ * @param shpool - pointer to the shared buffers pool structure
+ * @param buffer - buffer from rpmsg_virtio_shm_pool_get_buffer
+ * @param size - size it was asked with
+ */
+void rpmsg_virtio_shm_pool_put_buffer(struct rpmsg_virtio_shm_pool *shpool,
+				      void *buffer, size_t size);
+
+/**
+ * rpmsg_virtio_shm_pool_reserve - add buffers to the shared pool
+ *
+ * Carves count buffers of size now and keeps them in the free list of
+ * their class, typically large-message buffers before the rest of the
+ * pool is used up by small ones. Can be called at any time.
+ *
+ * @param shpool - pointer to the shared buffers pool structure
+ * @param size - buffer size
+ * @param count - number of buffers
+ *
+ * @return - number of buffers added, RPMSG_ERR_NO_MEM if not all of them
+ */
+int rpmsg_virtio_shm_pool_reserve(struct rpmsg_virtio_shm_pool *shpool,
+				  size_t size, unsigned int count);
+
 /**
  * rpmsg_virtio_get_rpmsg_device - get RPMsg device from RPMsg virtio device
  *
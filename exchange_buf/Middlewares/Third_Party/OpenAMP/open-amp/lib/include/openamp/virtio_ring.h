@@ -105,6 +105,10 @@ struct vring {
  */
 #define vring_used_event(vr)	((vr)->avail->ring[(vr)->num])
 #define vring_avail_event(vr)	((vr)->used->ring[(vr)->num].id & 0xFFFF)
+/* avail_event is 16 bits, the used ring stops right after it */
+#define vring_set_avail_event(vr, v) \
+	(*(uint16_t *)((uint8_t *)(vr)->used->ring + \
+		       (vr)->num * sizeof(struct vring_used_elem)) = (uint16_t)(v))
 
 static inline int vring_size(unsigned int num, unsigned long align)
 {
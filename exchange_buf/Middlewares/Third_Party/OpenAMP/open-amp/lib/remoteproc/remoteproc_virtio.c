@@ -96,9 +96,14 @@ static uint32_t rproc_virtio_get_features(struct virtio_device *vdev)
 	rpvdev = metal_container_of(vdev, struct remoteproc_virtio, vdev);
 	vdev_rsc = rpvdev->vdev_rsc;
 	io = rpvdev->vdev_rsc_io;
-	/* TODO: shall we get features based on the role ? */
 	features = metal_io_read32(io,
 			metal_io_virt_to_offset(io, &vdev_rsc->dfeatures));
+#ifndef VIRTIO_MASTER_ONLY
+	/* The slave uses the ones the master acknowledged */
+	if (vdev->role == VIRTIO_DEV_SLAVE)
+		features &= metal_io_read32(io,
+			metal_io_virt_to_offset(io, &vdev_rsc->gfeatures));
+#endif
 
 	return features;
 }
@@ -198,7 +203,7 @@ rproc_virtio_create_vdev(unsigned int role, unsigned int notifyid,
 	if (!vrings_info)
 		goto err0;
 	memset(rpvdev, 0, sizeof(*rpvdev));
-	memset(vrings_info, 0, sizeof(*vrings_info));
+	memset(vrings_info, 0, sizeof(*vrings_info) * num_vrings);
 	vdev = &rpvdev->vdev;
 
 	for (i = 0; i < num_vrings; i++) {
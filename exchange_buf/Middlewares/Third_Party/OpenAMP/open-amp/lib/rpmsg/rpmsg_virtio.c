@@ -25,23 +25,202 @@
 #define RPMSG_TICKS_PER_INTERVAL                10
 
 #define WORD_SIZE	sizeof(unsigned long)
-#define WORD_ALIGN(a)	((((a) & (WORD_SIZE - 1)) != 0) ? \
-			(((a) & (~(WORD_SIZE - 1))) + WORD_SIZE) : (a))
 
 #ifndef VIRTIO_SLAVE_ONLY
+/* Header of the buffers above the largest class, size includes it */
+struct rpmsg_shm_large {
+	struct rpmsg_shm_large *next;
+	size_t size;
+};
+
+/* Size class of a buffer, RPMSG_SHM_POOL_CLASSES above the largest one */
+static unsigned int rpmsg_shm_class(size_t size)
+{
+	size_t csize = RPMSG_SHM_POOL_MIN_SIZE;
+	unsigned int c = 0;
+
+	while (c < RPMSG_SHM_POOL_CLASSES && csize < size) {
+		csize <<= 1;
+		c++;
+	}
+
+	return c;
+}
+
+/* Bytes taken by a buffer of size in class c */
+static size_t rpmsg_shm_class_size(unsigned int c, size_t size)
+{
+	if (c < RPMSG_SHM_POOL_CLASSES)
+		return (size_t)RPMSG_SHM_POOL_MIN_SIZE << c;
+
+	return sizeof(struct rpmsg_shm_large) +
+	       ((size + RPMSG_SHM_POOL_MIN_SIZE - 1) &
+		~(size_t)(RPMSG_SHM_POOL_MIN_SIZE - 1));
+}
+
+/* Carves a new buffer from the memory never handed out */
+static void *rpmsg_shm_carve(struct rpmsg_virtio_shm_pool *shpool,
+			     unsigned int c, size_t csize)
+{
+	struct rpmsg_shm_large *l;
+	void *buffer;
+
+	if (shpool->avail < csize)
+		return NULL;
+	buffer = (char *)shpool->base + shpool->size - shpool->avail;
+	shpool->avail -= csize;
+
+	if (c < RPMSG_SHM_POOL_CLASSES)
+		return buffer;
+	l = buffer;
+	l->size = csize;
+
+	return l + 1;
+}
+
+/*
+ * Once the memory never handed out is used up, a free buffer of a larger
+ * class is split: one piece is returned, the others go to the free list
+ * of class c.
+ */
+static void *rpmsg_shm_split(struct rpmsg_virtio_shm_pool *shpool,
+			     unsigned int c)
+{
+	struct rpmsg_virtio_shm_pool_stats *st = &shpool->stats;
+	size_t csize = (size_t)RPMSG_SHM_POOL_MIN_SIZE << c;
+	unsigned int j, n;
+	char *buffer;
+
+	/* Reserved buffers are kept whole */
+	for (j = c + 1; j < RPMSG_SHM_POOL_CLASSES; j++)
+		if (st->nfree[j] > shpool->reserved[j])
+			break;
+	if (j >= RPMSG_SHM_POOL_CLASSES)
+		return NULL;
+
+	buffer = shpool->free[j];
+	shpool->free[j] = *(void **)buffer;
+	st->nfree[j]--;
+	st->cached -= csize;
+	for (n = 1; n < 1U << (j - c); n++) {
+		*(void **)(buffer + n * csize) = shpool->free[c];
+		shpool->free[c] = buffer + n * csize;
+		st->nfree[c]++;
+	}
+
+	return buffer;
+}
+
+/* Puts a buffer in its free list, csize bytes of class c */
+static void rpmsg_shm_free(struct rpmsg_virtio_shm_pool *shpool,
+			   unsigned int c, void *buffer, size_t csize)
+{
+	struct rpmsg_shm_large *l;
+
+	if (c < RPMSG_SHM_POOL_CLASSES) {
+		*(void **)buffer = shpool->free[c];
+		shpool->free[c] = buffer;
+	} else {
+		l = (struct rpmsg_shm_large *)buffer - 1;
+		l->next = shpool->free_large;
+		shpool->free_large = l;
+	}
+	shpool->stats.cached += csize;
+	shpool->stats.nfree[c]++;
+}
+
 metal_weak void *
 rpmsg_virtio_shm_pool_get_buffer(struct rpmsg_virtio_shm_pool *shpool,
 				 size_t size)
 {
-	void *buffer;
+	struct rpmsg_virtio_shm_pool_stats *st = &shpool->stats;
+	unsigned int c = rpmsg_shm_class(size);
+	size_t csize = rpmsg_shm_class_size(c, size);
+	struct rpmsg_shm_large **pp, *l;
+	void *buffer = NULL;
 
-	if (shpool->avail < size)
-		return NULL;
-	buffer =  (void *)((char *)shpool->base + shpool->size - shpool->avail);
-	shpool->avail -= size;
+	if (c < RPMSG_SHM_POOL_CLASSES) {
+		buffer = shpool->free[c];
+		if (buffer)
+			shpool->free[c] = *(void **)buffer;
+	} else {
+		/* First fit, a larger buffer is not split */
+		for (pp = &shpool->free_large; (l = *pp); pp = &l->next) {
+			if (l->size >= csize) {
+				*pp = l->next;
+				csize = l->size;
+				buffer = l + 1;
+				break;
+			}
+		}
+	}
+
+	if (buffer) {
+		st->reuses++;
+		st->cached -= csize;
+		st->nfree[c]--;
+	} else {
+		buffer = rpmsg_shm_carve(shpool, c, csize);
+		if (!buffer && c < RPMSG_SHM_POOL_CLASSES) {
+			buffer = rpmsg_shm_split(shpool, c);
+			if (buffer)
+				st->splits++;
+		}
+		if (!buffer) {
+			st->fails++;
+			return NULL;
+		}
+	}
+
+	st->gets++;
+	st->used += csize;
+	st->requested += size;
+	if (st->used > st->high_water)
+		st->high_water = st->used;
 
 	return buffer;
 }
+
+void rpmsg_virtio_shm_pool_put_buffer(struct rpmsg_virtio_shm_pool *shpool,
+				      void *buffer, size_t size)
+{
+	struct rpmsg_virtio_shm_pool_stats *st = &shpool->stats;
+	unsigned int c = rpmsg_shm_class(size);
+	size_t csize;
+
+	if (!buffer)
+		return;
+
+	if (c < RPMSG_SHM_POOL_CLASSES)
+		csize = rpmsg_shm_class_size(c, size);
+	else
+		csize = ((struct rpmsg_shm_large *)buffer - 1)->size;
+
+	rpmsg_shm_free(shpool, c, buffer, csize);
+	st->puts++;
+	st->used -= csize;
+	st->requested -= size;
+}
+
+int rpmsg_virtio_shm_pool_reserve(struct rpmsg_virtio_shm_pool *shpool,
+				  size_t size, unsigned int count)
+{
+	unsigned int c = rpmsg_shm_class(size);
+	size_t csize = rpmsg_shm_class_size(c, size);
+	unsigned int i;
+	void *buffer;
+
+	for (i = 0; i < count; i++) {
+		buffer = rpmsg_shm_carve(shpool, c, csize);
+		if (!buffer)
+			return RPMSG_ERR_NO_MEM;
+		rpmsg_shm_free(shpool, c, buffer, csize);
+		if (c < RPMSG_SHM_POOL_CLASSES)
+			shpool->reserved[c]++;
+	}
+
+	return (int)count;
+}
 #endif /*!VIRTIO_SLAVE_ONLY*/
 
 void rpmsg_virtio_init_shm_pool(struct rpmsg_virtio_shm_pool *shpool,
@@ -49,10 +228,38 @@ void rpmsg_virtio_init_shm_pool(struct rpmsg_virtio_shm_pool *shpool,
 {
 	if (!shpool)
 		return;
+	memset(shpool, 0, sizeof(*shpool));
+	/* Whole words only, the buffers stay aligned */
 	shpool->base = shb;
-	shpool->size = WORD_ALIGN(size);
-	shpool->avail = WORD_ALIGN(size);
+	shpool->size = size & ~(WORD_SIZE - 1);
+	shpool->avail = shpool->size;
+}
+
+#ifndef VIRTIO_SLAVE_ONLY
+/**
+ * rpmsg_virtio_release_buffers
+ *
+ * Gives the buffers of a virtqueue back to the pool: the ones posted to
+ * the remote and the ones it returned that were not taken again.
+ *
+ * @param shpool - pointer to the shared buffers pool
+ * @param vq     - virtqueue
+ * @param size   - size of its buffers
+ */
+static void rpmsg_virtio_release_buffers(struct rpmsg_virtio_shm_pool *shpool,
+					 struct virtqueue *vq, size_t size)
+{
+	uint16_t i;
+
+	for (i = 0; i < vq->vq_nentries; i++) {
+		if (vq->vq_descx[i].cookie) {
+			rpmsg_virtio_shm_pool_put_buffer(shpool,
+						vq->vq_descx[i].cookie, size);
+			vq->vq_descx[i].cookie = NULL;
+		}
+	}
 }
+#endif /*!VIRTIO_SLAVE_ONLY*/
 
 /**
  * rpmsg_virtio_return_buffer
@@ -151,8 +358,8 @@ static void *rpmsg_virtio_get_tx_buffer(struct rpmsg_virtio_device *rvdev,
 		data = virtqueue_get_buffer(rvdev->svq, (uint32_t *)len, idx);
 		if (data == NULL) {
 			data = rpmsg_virtio_shm_pool_get_buffer(rvdev->shpool,
-							RPMSG_BUFFER_SIZE);
-			*len = RPMSG_BUFFER_SIZE;
+						rvdev->config.h2r_buf_size);
+			*len = rvdev->config.h2r_buf_size;
 		}
 	}
 #endif /*!VIRTIO_SLAVE_ONLY*/
@@ -258,7 +465,8 @@ static int _rpmsg_virtio_get_buffer_size(struct rpmsg_virtio_device *rvdev)
 		 * If device role is Remote then buffers are provided by us
 		 * (RPMSG Master), so just provide the macro.
 		 */
-		length = RPMSG_BUFFER_SIZE - sizeof(struct rpmsg_hdr);
+		length = (int)rvdev->config.h2r_buf_size -
+			 sizeof(struct rpmsg_hdr);
 	}
 #endif /*!VIRTIO_SLAVE_ONLY*/
 
@@ -401,6 +609,7 @@ static void rpmsg_virtio_rx_callback(struct virtqueue *vq)
 	unsigned long len;
 	unsigned short idx;
 	int status;
+	int returned = 0;
 
 	metal_mutex_acquire(&rdev->lock);
 
@@ -436,11 +645,19 @@ static void rpmsg_virtio_rx_callback(struct virtqueue *vq)
 
 		/* Return used buffers. */
 		rpmsg_virtio_return_buffer(rvdev, rp_hdr, len, idx);
+		returned++;
 
 		rp_hdr = (struct rpmsg_hdr *)
 			 rpmsg_virtio_get_rx_buffer(rvdev, &len, &idx);
 		metal_mutex_release(&rdev->lock);
 	}
+
+	/* Once per batch: the peer may be waiting for free buffers */
+	if (returned) {
+		metal_mutex_acquire(&rdev->lock);
+		virtqueue_kick(rvdev->rvq);
+		metal_mutex_release(&rdev->lock);
+	}
 }
 
 /**
@@ -542,6 +759,17 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 		    rpmsg_ns_bind_cb ns_bind_cb,
 		    struct metal_io_region *shm_io,
 		    struct rpmsg_virtio_shm_pool *shpool)
+{
+	return rpmsg_init_vdev_with_config(rvdev, vdev, ns_bind_cb, shm_io,
+					   shpool, RPMSG_VIRTIO_DEFAULT_CONFIG);
+}
+
+int rpmsg_init_vdev_with_config(struct rpmsg_virtio_device *rvdev,
+				struct virtio_device *vdev,
+				rpmsg_ns_bind_cb ns_bind_cb,
+				struct metal_io_region *shm_io,
+				struct rpmsg_virtio_shm_pool *shpool,
+				const struct rpmsg_virtio_config *config)
 {
 	struct rpmsg_device *rdev;
 	const char *vq_names[RPMSG_NUM_VRINGS];
@@ -560,6 +788,10 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 	rdev->ops.send_offchannel_raw = rpmsg_virtio_send_offchannel_raw;
 	role = rpmsg_virtio_get_role(rvdev);
 
+	if (!config)
+		return RPMSG_ERR_PARAM;
+	rvdev->config = *config;
+
 #ifndef VIRTIO_SLAVE_ONLY
 	if (role == RPMSG_MASTER) {
 		/*
@@ -601,6 +833,9 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 	}
 #endif /*!VIRTIO_MASTER_ONLY*/
 
+	/* The virtqueues need the features to know if event-idx is used */
+	vdev->features = rpmsg_virtio_get_features(rvdev);
+
 	/* Create virtqueues for remote device */
 	status = rpmsg_virtio_create_virtqueues(rvdev, 0, RPMSG_NUM_VRINGS,
 						vq_names, callback);
@@ -621,11 +856,11 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 		unsigned int idx;
 		void *buffer;
 
-		vqbuf.len = RPMSG_BUFFER_SIZE;
+		vqbuf.len = rvdev->config.r2h_buf_size;
 		for (idx = 0; idx < rvdev->rvq->vq_nentries; idx++) {
 			/* Initialize TX virtqueue buffers for remote device */
 			buffer = rpmsg_virtio_shm_pool_get_buffer(shpool,
-							RPMSG_BUFFER_SIZE);
+						rvdev->config.r2h_buf_size);
 
 			if (!buffer) {
 				return RPMSG_ERR_NO_BUFF;
@@ -636,7 +871,7 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 			metal_io_block_set(shm_io,
 					   metal_io_virt_to_offset(shm_io,
 								   buffer),
-					   0x00, RPMSG_BUFFER_SIZE);
+					   0x00, rvdev->config.r2h_buf_size);
 			status =
 				virtqueue_add_buffer(rvdev->rvq, &vqbuf, 0, 1,
 						     buffer);
@@ -651,7 +886,13 @@ int rpmsg_init_vdev(struct rpmsg_virtio_device *rvdev,
 	/* Initialize channels and endpoints list */
 	metal_list_init(&rdev->endpoints);
 
-	dev_features = rpmsg_virtio_get_features(rvdev);
+	/*
+	 * Nothing is pending: the master sends nothing before the name
+	 * service announcement of the remote.
+	 */
+	(void)virtqueue_enable_cb(rvdev->rvq);
+
+	dev_features = vdev->features;
 
 	/*
 	 * Create name service announcement endpoint if device supports name
@@ -685,6 +926,16 @@ void rpmsg_deinit_vdev(struct rpmsg_virtio_device *rvdev)
 		rpmsg_destroy_ept(ept);
 	}
 
+#ifndef VIRTIO_SLAVE_ONLY
+	/* The buffers can be used again by the next rpmsg_init_vdev() */
+	if (rpmsg_virtio_get_role(rvdev) == RPMSG_MASTER && rvdev->rvq) {
+		rpmsg_virtio_release_buffers(rvdev->shpool, rvdev->rvq,
+					     rvdev->config.r2h_buf_size);
+		rpmsg_virtio_release_buffers(rvdev->shpool, rvdev->svq,
+					     rvdev->config.h2r_buf_size);
+	}
+#endif /*!VIRTIO_SLAVE_ONLY*/
+
 	rvdev->rvq = 0;
 	rvdev->svq = 0;
 
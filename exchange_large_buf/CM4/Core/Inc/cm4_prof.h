@@ -0,0 +1,102 @@
+/**
+  ******************************************************************************
+  * @file    cm4_prof.h
+  * @brief   Cycle counter probes for the CM4 hot paths.
+  ******************************************************************************
+  * Each probe measures the DWT cycles spent between PROF_START() and
+  * PROF_STOP() and keeps count/min/max/sum and a log2 histogram in
+  * prof_stats. The block is exported in the resource table as the
+  * "cm4_prof" trace entry so that Linux can read it live (cm4_trace -p).
+  *
+  * The probes compile away when __PROF_CYCLES_ is not defined.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CM4_PROF_H
+#define __CM4_PROF_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/*
+ * The cycle source can be replaced, e.g. to run PROF_Update() on a host.
+ * PROF_CYCLES_INIT() only enables the DWT counter, it does not reset it:
+ * log_evt_init() of openamp_log.c starts it from 0 for the event log and
+ * the probes and SDB timestamps share it.
+ */
+#ifndef PROF_GET_CYCLES
+#include "stm32mp1xx.h"
+#define PROF_GET_CYCLES()   (DWT->CYCCNT)
+#define PROF_CYCLES_INIT()  do { CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; \
+                                 DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; } while (0)
+#endif
+
+/* Exported constants --------------------------------------------------------*/
+#define PROF_MAGIC        0x464f5250  /* "PROF" */
+#define PROF_NB_BINS      24          /* bin n counts durations in [2^(n-1), 2^n) */
+#define PROF_NAME_LEN     16
+
+/* Exported structures --------------------------------------------------------*/
+/* Probe ids, names are in cm4_prof.c (keep in sync with 1_userland_app/cm4_trace) */
+typedef enum
+{
+  PROF_MAILBOX_POLL,
+  PROF_RPMSG_RX,
+  PROF_SDB_EVENT,
+  PROF_SDB_FORMAT,
+  PROF_UART_TX,
+  PROF_SDB_TX,
+  PROF_DMA_IRQ,
+  PROF_NB
+} PROF_IdTypeDef;
+
+/* seq is odd while the probe is updated, the reader retries in that case */
+typedef struct
+{
+  volatile uint32_t seq;
+  char name[PROF_NAME_LEN];
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t hist[PROF_NB_BINS];
+} PROF_ProbeTypeDef;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t probe_size;
+  uint32_t nb_probes;
+  uint32_t nb_bins;
+  uint32_t cpu_freq;
+  uint32_t reserved;
+  PROF_ProbeTypeDef probe[PROF_NB];
+} PROF_StatsTypeDef;
+
+extern PROF_StatsTypeDef prof_stats;
+
+/* Exported macros -----------------------------------------------------------*/
+#if defined (__PROF_CYCLES_)
+#define PROF_INIT()       PROF_Init(SystemCoreClock)
+#define PROF_START(id)    uint32_t prof_t0_##id = PROF_GET_CYCLES()
+#define PROF_STOP(id)     PROF_Update(&prof_stats.probe[id], PROF_GET_CYCLES() - prof_t0_##id)
+#else
+#define PROF_INIT()
+#define PROF_START(id)
+#define PROF_STOP(id)
+#endif
+
+/* Exported functions --------------------------------------------------------*/
+void PROF_Init(uint32_t cpu_freq);
+void PROF_Update(PROF_ProbeTypeDef *probe, uint32_t cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CM4_PROF_H */
@@ -45,6 +45,25 @@
    uint32_t physSize;
  }RPMSG_HDR_DdrBuffTypeDef;
 
+/*
+ * Header of each fragment of a message longer than one rpmsg buffer, the
+ * rpmsg_sdb driver reassembles them (rpmsg_sdb_frag.h, same layout). The
+ * shorter messages are sent as they are.
+ */
+#define RPMSG_HDR_FRAG_MAGIC  0xA5U       /*!< first byte of a fragment          */
+#define RPMSG_HDR_FRAG_LAST   0x01U       /*!< flags of the last fragment        */
+#define RPMSG_HDR_FRAG_MAX    256U        /*!< fragments of one message          */
+
+ typedef struct __RPMSG_HDR_FragTypeDef
+ {
+   uint8_t  magic;                     /*!< RPMSG_HDR_FRAG_MAGIC                        */
+   uint8_t  id;                        /*!< of the message, same in all its fragments   */
+   uint8_t  index;                     /*!< of the fragment in the message, from 0      */
+   uint8_t  flags;                     /*!< RPMSG_HDR_FRAG_LAST                         */
+   uint16_t total;                     /*!< length of the whole message                 */
+   uint16_t reserved;
+ }RPMSG_HDR_FragTypeDef;
+
 typedef enum
 {
     RPMSG_HDR_OK       = 0x00U,
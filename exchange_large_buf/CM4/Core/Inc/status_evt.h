@@ -0,0 +1,92 @@
+/**
+  ******************************************************************************
+  * @file    status_evt.h
+  * @brief   Binary status events sent to Linux over the virtual UART.
+  ******************************************************************************
+  * The application posts compact event records instead of formatting
+  * strings. Records below the current verbosity are dropped at post time,
+  * unless posted with STS_FORCE (answers to Linux requests), the others
+  * are queued and drained in batches from the main loop when the data
+  * path is idle.
+  *
+  * Codes and record layout must be kept in sync with
+  * 1_userland_app/rpmsg_sdb_app.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STATUS_EVT_H
+#define __STATUS_EVT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* The queue is also fed from IRQ handlers; the lock can be replaced, e.g.
+ * to run the queue on a host */
+#ifndef STS_LOCK
+#include "stm32mp1xx.h"
+#define STS_LOCK(key)     do { (key) = __get_PRIMASK(); __disable_irq(); } while (0)
+#define STS_UNLOCK(key)   __set_PRIMASK(key)
+#endif
+
+/* Exported constants --------------------------------------------------------*/
+#define STS_SYNC          0xA5
+#define STS_QUEUE_SIZE    32          /* must be a power of 2 */
+#define STS_FORCE         0x80        /* or'ed to the level: queued whatever the verbosity */
+
+/* Exported structures --------------------------------------------------------*/
+typedef enum
+{
+  STS_LVL_NONE  = 0,
+  STS_LVL_ERROR = 1,
+  STS_LVL_WARN  = 2,
+  STS_LVL_INFO  = 3,
+  STS_LVL_DEBUG = 4,
+} STS_LevelTypeDef;
+
+typedef enum
+{
+  STS_EVT_DROPPED = 1,        /* arg0: number of events lost              */
+  STS_EVT_BOOT,               /* arg0: HAL version                        */
+  STS_EVT_VERBOSITY,          /* arg0: new level                          */
+  STS_EVT_UART_RX,            /* arg0: size, arg1: first byte             */
+  STS_EVT_SDB_RX,             /* arg0: size, arg1: first byte             */
+  STS_EVT_START,              /*                                          */
+  STS_EVT_START_ERROR,        /* arg0: HDR status                         */
+  STS_EVT_EXIT,               /*                                          */
+  STS_EVT_BAD_COMMAND,        /* arg0: command                            */
+  STS_EVT_SDB_BUFFER,         /* arg0: index, arg1: phys addr, arg2: size */
+  STS_EVT_SDB_BAD_COMMAND,    /* arg0: command                            */
+  STS_EVT_SDB_BAD_INDEX,      /* arg0: index, arg1: awaited index         */
+  STS_EVT_SDB_BAD_TAG,        /* arg0: tag, arg1: expected tag            */
+  STS_EVT_SDB_BAD_DIGIT,      /* arg0: digit, arg1: offset                */
+  STS_EVT_DMA_START_ERROR,    /*                                          */
+  STS_EVT_DMA_XFER_ERROR,     /* arg0: DMA error code                     */
+  STS_EVT_SDB_RX_OVERFLOW,    /* arg0: first byte, arg1: size             */
+} STS_CodeTypeDef;
+
+typedef struct
+{
+  uint8_t  sync;
+  uint8_t  level;
+  uint16_t code;
+  uint32_t arg[3];
+} STS_EventTypeDef;
+
+/* Exported functions --------------------------------------------------------*/
+void STS_Init(uint8_t level);
+void STS_SetLevel(uint8_t level);
+uint8_t STS_GetLevel(void);
+int STS_Post(uint8_t level, uint16_t code, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+int STS_Peek(STS_EventTypeDef *evt, int max);
+void STS_Consume(int nb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STATUS_EVT_H */
@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    cm4_prof.c
+  * @brief   Cycle counter probes for the CM4 hot paths.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "cm4_prof.h"
+
+#if defined (__PROF_CYCLES_)
+
+/* Private variables ---------------------------------------------------------*/
+static const char * const prof_names[PROF_NB] = {
+  [PROF_MAILBOX_POLL] = "mailbox_poll",
+  [PROF_RPMSG_RX]     = "rpmsg_rx",
+  [PROF_SDB_EVENT]    = "sdb_event",
+  [PROF_SDB_FORMAT]   = "sdb_format",
+  [PROF_UART_TX]      = "uart_tx",
+  [PROF_SDB_TX]       = "sdb_tx",
+  [PROF_DMA_IRQ]      = "dma_irq",
+};
+
+PROF_StatsTypeDef prof_stats;
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Reset the statistics, the cycle counter is enabled by PROF_CYCLES_INIT()
+  * @param  cpu_freq: frequency of the cycle counter in Hz
+  * @retval None
+  */
+void PROF_Init(uint32_t cpu_freq)
+{
+  int i;
+
+  memset(&prof_stats, 0, sizeof(prof_stats));
+  for (i = 0; i < PROF_NB; i++) {
+    strncpy(prof_stats.probe[i].name, prof_names[i], PROF_NAME_LEN - 1);
+    prof_stats.probe[i].min = UINT32_MAX;
+  }
+  prof_stats.probe_size = sizeof(PROF_ProbeTypeDef);
+  prof_stats.nb_probes = PROF_NB;
+  prof_stats.nb_bins = PROF_NB_BINS;
+  prof_stats.cpu_freq = cpu_freq;
+
+  /* Published last: the reader ignores the block until then */
+  __sync_synchronize();
+  prof_stats.magic = PROF_MAGIC;
+}
+
+/**
+  * @brief  Account one measurement of a probe
+  * @note   A probe must only be updated from one context (thread or given IRQ)
+  * @param  probe: probe to update
+  * @param  cycles: measured duration
+  * @retval None
+  */
+void PROF_Update(PROF_ProbeTypeDef *probe, uint32_t cycles)
+{
+  uint32_t bin = cycles ? 32 - __builtin_clz(cycles) : 0;
+
+  if (bin >= PROF_NB_BINS)
+    bin = PROF_NB_BINS - 1;
+
+  probe->seq++;
+  __sync_synchronize();
+
+  probe->count++;
+  probe->sum += cycles;
+  if (cycles < probe->min)
+    probe->min = cycles;
+  if (cycles > probe->max)
+    probe->max = cycles;
+  probe->hist[bin]++;
+
+  __sync_synchronize();
+  probe->seq++;
+}
+
+#endif /* __PROF_CYCLES_ */
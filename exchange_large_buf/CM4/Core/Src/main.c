@@ -23,8 +23,11 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include <stdio.h>
 #include "virt_uart.h"
 #include "rpmsg_hdr.h"
+#include "cm4_prof.h"
+#include "status_evt.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -55,6 +58,13 @@ typedef enum
 #define SAMP_DDR_BUFFER_CNT (1)
 
 #define COPRO_SYNC_SHUTDOWN_CHANNEL  IPCC_CHANNEL_3
+
+#define STATUS_BATCH_MAX ((RPMSG_BUFFER_SIZE - 16) / sizeof(STS_EventTypeDef))
+
+#define SDB_RX_QUEUE_SIZE (8)     /* power of 2 */
+#define SDB_RX_MSG_SIZE (32)
+
+#define HDR_START_DELAY_MS (1000) /* from the START command to the DMA */
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -72,16 +82,23 @@ RPMSG_HDR_HandleTypeDef hsdb0;
 VIRT_UART_HandleTypeDef huart0;
 
 __IO FlagStatus VirtUart0RxMsg = RESET;
-__IO FlagStatus SDB0RxMsg = RESET;
 
 volatile HDR_StatusTypeDef fHDRStatus = HDRSTATUS_INIT;
+static uint32_t mStartTick = 0;
 
-char mUartBuffTx[512];
+STS_EventTypeDef mStatusBuffTx[STATUS_BATCH_MAX];
 uint8_t VirtUart0ChannelBuffRx[100];
 uint16_t VirtUart0ChannelRxSize = 0;
-uint8_t SDB0ChannelBuffRx[100];
-uint16_t SDB0ChannelRxSize = 0;
+/*
+ * SDB messages but the pings, queued by SDB0_RxCpltCallback(): several of
+ * them can come in one OPENAMP_check_for_message() pass. The callback runs
+ * from the main loop too, no lock is needed.
+ */
+uint8_t SDB0ChannelBuffRx[SDB_RX_QUEUE_SIZE][SDB_RX_MSG_SIZE];
+uint8_t SDB0RxHead = 0;
+uint8_t SDB0RxTail = 0;
 char mSdbBuffTx[512];
+char mSdbPingTx[32];
 
 volatile static HDR_DdrBuffTypeDef mArrayDdrBuff[SAMP_DDR_BUFFER_CNT];
 volatile uint8_t mArrayDdrBuffIndex = 0;
@@ -89,6 +106,12 @@ volatile uint8_t mArrayDdrBuffCount = 0;
 
 volatile uint8_t mArraySramBuff[SAMP_SRAM_PACKET_SIZE];
 volatile uint8_t mArraySramVal = 0;
+
+/* CM4 clock of the SDB completion timestamps, see CM4_ClockUpdate() */
+volatile uint32_t mDdrDoneCycles = 0;
+volatile uint32_t mSdbRxCycles = 0;
+static uint64_t mCm4Cycles = 0;
+static uint32_t mCm4LastCycles = 0;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -110,114 +133,148 @@ void VIRT_UART0_RxCpltCallback(VIRT_UART_HandleTypeDef *huart)
     VirtUart0ChannelRxSize = huart->RxXferSize < 100? huart->RxXferSize : 99;
     memcpy(VirtUart0ChannelBuffRx, huart->pRxBuffPtr, VirtUart0ChannelRxSize);
     VirtUart0ChannelBuffRx[VirtUart0ChannelRxSize] = 0;   // insure end of String
-    sprintf(mUartBuffTx, "CM4 : VIRT_UART0_RxCpltCallback: %s\n", VirtUart0ChannelBuffRx);
-    VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    STS_Post(STS_LVL_DEBUG, STS_EVT_UART_RX, VirtUart0ChannelRxSize, VirtUart0ChannelBuffRx[0], 0);
     VirtUart0RxMsg = SET;
 }
 
+/*
+ * Extend the 32-bit cycle counter to 64 bits. Called from the main loop,
+ * which runs much more often than the counter wraps (20s at 209MHz).
+ */
+static void CM4_ClockUpdate(void)
+{
+    uint32_t now = PROF_GET_CYCLES();
+
+    mCm4Cycles += (uint32_t)(now - mCm4LastCycles);
+    mCm4LastCycles = now;
+}
+
+/* Time in us since boot of a cycle counter sample taken less than 2^32 cycles ago */
+static uint32_t CM4_CyclesToUs(uint32_t cycles)
+{
+    CM4_ClockUpdate();
+    return (uint32_t)((mCm4Cycles - (uint32_t)(mCm4LastCycles - cycles)) / (SystemCoreClock / 1000000));
+}
+
+// clock ping of the driver: Pxxxxxxxx => PxxxxxxxxRyyyyyyyyTzzzzzzzz, receive and answer in us
+static void SDB0_AnswerPing(const uint8_t *msg, uint16_t size)
+{
+    uint32_t rxUs = CM4_CyclesToUs(mSdbRxCycles);
+
+    sprintf(mSdbPingTx, "%.*sR%08lxT%08lx", size < 9 ? size : 9, (const char*)msg,
+            (unsigned long)rxUs, (unsigned long)CM4_CyclesToUs(PROF_GET_CYCLES()));
+    RPMSG_HDR_Transmit(&hsdb0, (uint8_t*)mSdbPingTx, strlen(mSdbPingTx));
+}
+
 void SDB0_RxCpltCallback(RPMSG_HDR_HandleTypeDef *huart)
 {
-    // copy received msg in a buffer
-    SDB0ChannelRxSize = huart->RxXferSize < 100? huart->RxXferSize : 99;
-    memcpy(SDB0ChannelBuffRx, huart->pRxBuffPtr, SDB0ChannelRxSize);
-    SDB0ChannelBuffRx[SDB0ChannelRxSize] = 0;   // insure end of String
-    sprintf(mUartBuffTx, "CM4 : SDB0_RxCpltCallback: %s\n", SDB0ChannelBuffRx);
-    VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
-    SDB0RxMsg = SET;
+    uint16_t size = huart->RxXferSize < SDB_RX_MSG_SIZE ? huart->RxXferSize : SDB_RX_MSG_SIZE - 1;
+    uint8_t first = size ? huart->pRxBuffPtr[0] : 0;
+    uint8_t *msg;
+
+    mSdbRxCycles = PROF_GET_CYCLES();
+    STS_Post(STS_LVL_DEBUG, STS_EVT_SDB_RX, size, first, 0);
+
+    // pings answered at once, a registration of the same pass cannot hide them
+    if (first == 'P') {
+        PROF_START(PROF_SDB_EVENT);
+        SDB0_AnswerPing(huart->pRxBuffPtr, size);
+        PROF_STOP(PROF_SDB_EVENT);
+        return;
+    }
+
+    // copy received msg in the queue
+    if ((uint8_t)(SDB0RxHead - SDB0RxTail) == SDB_RX_QUEUE_SIZE) {
+        STS_Post(STS_LVL_ERROR, STS_EVT_SDB_RX_OVERFLOW, first, size, 0);
+        return;
+    }
+    msg = SDB0ChannelBuffRx[SDB0RxHead % SDB_RX_QUEUE_SIZE];
+    memcpy(msg, huart->pRxBuffPtr, size);
+    msg[size] = 0;   // insure end of String
+    SDB0RxHead++;
 }
 
 static void TransferCompleteDDR(DMA_HandleTypeDef *DmaHandle)
 {
+	mDdrDoneCycles = PROF_GET_CYCLES();
 	fHDRStatus = HDRSTATUS_DONE;
 }
 
 static void TransferErrorDDR(DMA_HandleTypeDef *DmaHandle)
 {
-    sprintf(mUartBuffTx, "CM4 : DMA DDR TransferError CB !!!\n");
-    VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    STS_Post(STS_LVL_ERROR, STS_EVT_DMA_XFER_ERROR, HAL_DMA_GetError(DmaHandle), 0, 0);
 }
 
 void treatRxCommand() {
 	switch(VirtUart0ChannelBuffRx[0]) {
 		case 'S':
 			if (fHDRStatus == HDRSTATUS_IDLE) {
+				mStartTick = HAL_GetTick();
 				fHDRStatus = HDRSTATUS_START;
-
-				sprintf(mUartBuffTx, "CM4 : START command !!!\n");
-				VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+				STS_Post(STS_LVL_INFO, STS_EVT_START, 0, 0, 0);
 			}
 			else {
-				sprintf(mUartBuffTx, "CM4 : START with error status:%d !!!\n", fHDRStatus);
-				VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+				STS_Post(STS_LVL_ERROR, STS_EVT_START_ERROR, fHDRStatus, 0, 0);
 			}
 			break;
 		case 'E':
 			fHDRStatus = HDRSTATUS_ABORT;
-			sprintf(mUartBuffTx, "CM4 : EXIT command !!!\n");
-			VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+			STS_Post(STS_LVL_INFO, STS_EVT_EXIT, 0, 0, 0);
 			break;
 		case 'R':
-			sprintf(mUartBuffTx, "CM4 : boot successful with STM32Cube FW version: v%ld.%ld.%ld \n",
-					((HAL_GetHalVersion() >> 24) & 0x000000FF),
-					((HAL_GetHalVersion() >> 16) & 0x000000FF),
-					((HAL_GetHalVersion() >> 8) & 0x000000FF));
-			VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+			/* answers to Linux requests are always sent */
+			STS_Post(STS_LVL_INFO | STS_FORCE, STS_EVT_BOOT, HAL_GetHalVersion(), 0, 0);
+			break;
+		case 'V':
+			// example command: V3 => verbosity up to STS_LVL_INFO
+			if (VirtUart0ChannelBuffRx[1] >= '0' && VirtUart0ChannelBuffRx[1] <= '0' + STS_LVL_DEBUG) {
+				STS_SetLevel(VirtUart0ChannelBuffRx[1] - '0');
+			}
+			STS_Post(STS_LVL_INFO | STS_FORCE, STS_EVT_VERBOSITY, STS_GetLevel(), 0, 0);
 			break;
 		default:
-			sprintf(mUartBuffTx, "CM4 : Error command:%c instead of: S\n",
-					VirtUart0ChannelBuffRx[0]);
-			VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+			STS_Post(STS_LVL_ERROR, STS_EVT_BAD_COMMAND, VirtUart0ChannelBuffRx[0], 0, 0);
 			break;
 	}
 }
 
-void treatSDBEvent() {
+void treatSDBEvent(const uint8_t *msg) {
     // example command: B0AxxxxxxxxLyyyyyyyy => Buff0 @:xx..x Length:yy..y
-    if (SDB0ChannelBuffRx[0] != 'B') {
-        sprintf(mUartBuffTx, "CM4 : treatSDBEvent ERROR wrong buffer command:%c\n", SDB0ChannelBuffRx[0]);
-        VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    if (msg[0] != 'B') {
+        STS_Post(STS_LVL_ERROR, STS_EVT_SDB_BAD_COMMAND, msg[0], 0, 0);
     }
-    if (!((SDB0ChannelBuffRx[1] >= '0' && SDB0ChannelBuffRx[1] <= '3'))) {
-        sprintf(mUartBuffTx, "CM4 : treatSDBEvent ERROR wrong buffer index:%c\n", SDB0ChannelBuffRx[1]);
-        VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    if (!((msg[1] >= '0' && msg[1] <= '3'))) {
+        STS_Post(STS_LVL_ERROR, STS_EVT_SDB_BAD_INDEX, msg[1], mArrayDdrBuffCount, 0);
         return;
     }
-    if (mArrayDdrBuffCount != (SDB0ChannelBuffRx[1] - '0')) {
-        sprintf(mUartBuffTx, "CM4 : treatSDBEvent ERROR wrong buffer received index:%c awaited index:%d\n",
-                SDB0ChannelBuffRx[1], mArrayDdrBuffCount);
-        VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    if (mArrayDdrBuffCount != (msg[1] - '0')) {
+        STS_Post(STS_LVL_ERROR, STS_EVT_SDB_BAD_INDEX, msg[1], mArrayDdrBuffCount, 0);
         return;
     }
-    if (SDB0ChannelBuffRx[2] != 'A') {
-        sprintf(mUartBuffTx, "CM4 : treatSDBEvent ERROR wrong buffer address tag:%c instead of:A\n", SDB0ChannelBuffRx[1]);
-        VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    if (msg[2] != 'A') {
+        STS_Post(STS_LVL_ERROR, STS_EVT_SDB_BAD_TAG, msg[2], 'A', 0);
         return ;
     }
-    if (SDB0ChannelBuffRx[11] != 'L') {
-        sprintf(mUartBuffTx, "CM4 : treatSDBEvent ERROR wrong buffer length tag:%c instead of:L\n", SDB0ChannelBuffRx[11]);
-        VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    if (msg[11] != 'L') {
+        STS_Post(STS_LVL_ERROR, STS_EVT_SDB_BAD_TAG, msg[11], 'L', 0);
         return ;
     }
     for (int i=0; i<8; i++) {
-        if (!((SDB0ChannelBuffRx[3+i] >= '0' && SDB0ChannelBuffRx[3+i] <= '9') || (SDB0ChannelBuffRx[3+i] >= 'a' && SDB0ChannelBuffRx[3+i] <= 'f'))) {
-            sprintf(mUartBuffTx, "CM4 : treatSDBEvent ERROR wrong address digit:%c at offset:%d\n", SDB0ChannelBuffRx[3+i], 3+i);
-            VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+        if (!((msg[3+i] >= '0' && msg[3+i] <= '9') || (msg[3+i] >= 'a' && msg[3+i] <= 'f'))) {
+            STS_Post(STS_LVL_ERROR, STS_EVT_SDB_BAD_DIGIT, msg[3+i], 3+i, 0);
             return ;
         }
-        if (!((SDB0ChannelBuffRx[12+i] >= '0' && SDB0ChannelBuffRx[12+i] <= '9') || (SDB0ChannelBuffRx[12+i] >= 'a' && SDB0ChannelBuffRx[12+i] <= 'f'))) {
-            sprintf(mUartBuffTx, "CM4 : treatSDBEvent ERROR wrong length digit:%c at offset:%d\n", SDB0ChannelBuffRx[12+i], 12+i);
-            VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+        if (!((msg[12+i] >= '0' && msg[12+i] <= '9') || (msg[12+i] >= 'a' && msg[12+i] <= 'f'))) {
+            STS_Post(STS_LVL_ERROR, STS_EVT_SDB_BAD_DIGIT, msg[12+i], 12+i, 0);
             return ;
         }
     }
     // save DDR buff @ and size
-    mArrayDdrBuff[mArrayDdrBuffCount].physAddr = (uint32_t)strtoll((char*)&SDB0ChannelBuffRx[3], NULL, 16);
-    mArrayDdrBuff[mArrayDdrBuffCount].physSize = (uint32_t)strtoll((char*)&SDB0ChannelBuffRx[12], NULL, 16);
-    sprintf(mUartBuffTx, "CM4 : treatSDBEvent OK physAddr=0x%lx physSize=%ld mArrayDdrBuffCount=%d\n",
-            mArrayDdrBuff[mArrayDdrBuffCount].physAddr,
-            mArrayDdrBuff[mArrayDdrBuffCount].physSize,
-            mArrayDdrBuffCount);
-    VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+    mArrayDdrBuff[mArrayDdrBuffCount].physAddr = (uint32_t)strtoll((const char*)&msg[3], NULL, 16);
+    mArrayDdrBuff[mArrayDdrBuffCount].physSize = (uint32_t)strtoll((const char*)&msg[12], NULL, 16);
+    STS_Post(STS_LVL_INFO, STS_EVT_SDB_BUFFER, mArrayDdrBuffCount,
+             mArrayDdrBuff[mArrayDdrBuffCount].physAddr,
+             mArrayDdrBuff[mArrayDdrBuffCount].physSize);
 
     mArrayDdrBuffCount++;
     if (mArrayDdrBuffCount == SAMP_DDR_BUFFER_CNT) {
@@ -225,28 +282,64 @@ void treatSDBEvent() {
     }
 }
 
+/*
+ * Send the queued status events, batched in one rpmsg buffer, when the data
+ * path has nothing to do. Nothing is sent before Linux has written to the
+ * virtual UART (the endpoint has no destination yet) or if no rpmsg buffer
+ * is free: the events stay queued for the next loop.
+ */
+static void StatusDrain(void)
+{
+    int nb, max;
+
+    if (fHDRStatus == HDRSTATUS_DONE ||
+        (fHDRStatus == HDRSTATUS_START && HAL_GetTick() - mStartTick >= HDR_START_DELAY_MS))
+        return;
+    if (!is_rpmsg_ept_ready(&huart0.ept))
+        return;
+
+    max = OPENAMP_get_buffer_size() / sizeof(STS_EventTypeDef);
+    if (max > STATUS_BATCH_MAX)
+        max = STATUS_BATCH_MAX;
+
+    nb = STS_Peek(mStatusBuffTx, max);
+    if (!nb)
+        return;
+
+    PROF_START(PROF_UART_TX);
+    if (rpmsg_trysend(&huart0.ept, mStatusBuffTx, nb * sizeof(STS_EventTypeDef)) > 0)
+        STS_Consume(nb);
+    PROF_STOP(PROF_UART_TX);
+}
+
 void LAStateMachine(void) {
+    CM4_ClockUpdate();
     OPENAMP_check_for_message();
     if (VirtUart0RxMsg) {
       VirtUart0RxMsg = RESET;
       treatRxCommand();
     }
 
-    if (SDB0RxMsg) {
-        SDB0RxMsg = RESET;
-        treatSDBEvent();
+    while (SDB0RxTail != SDB0RxHead) {
+        PROF_START(PROF_SDB_EVENT);
+        treatSDBEvent(SDB0ChannelBuffRx[SDB0RxTail % SDB_RX_QUEUE_SIZE]);
+        PROF_STOP(PROF_SDB_EVENT);
+        SDB0RxTail++;
     }
 
+    StatusDrain();
+
     switch(fHDRStatus) {
 		case HDRSTATUS_INIT:
 			break;
 		case HDRSTATUS_IDLE:
 			break;
 		case HDRSTATUS_START:
+			// no HAL_Delay(): the loop goes on answering the pings of the driver
+			if (HAL_GetTick() - mStartTick < HDR_START_DELAY_MS)
+				break;
 			fHDRStatus = HDRSTATUS_WAIT;
 
-			HAL_Delay(1000);
-
 			__ISB();
 			__DSB();
 
@@ -263,8 +356,7 @@ void LAStateMachine(void) {
 					mArrayDdrBuff[mArrayDdrBuffIndex].physAddr,
 					SAMP_DDR_BUFFER_SIZE) != HAL_OK) {
 				/* Transfer Error */
-				sprintf(mUartBuffTx, "CM4 : HAL_DMA_Start_IT() error !!!\n");
-				VIRT_UART_Transmit(&huart0, (uint8_t*)mUartBuffTx, strlen(mUartBuffTx));
+				STS_Post(STS_LVL_ERROR, STS_EVT_DMA_START_ERROR, 0, 0, 0);
 
 				fHDRStatus = HDRSTATUS_ABORT;
 			}
@@ -274,9 +366,14 @@ void LAStateMachine(void) {
 		case HDRSTATUS_DONE:
 			fHDRStatus = HDRSTATUS_IDLE;
 
-			// time to change DDR buffer and send MSG to Linux
-			sprintf(mSdbBuffTx, "B%dL%08x", mArrayDdrBuffIndex, SAMP_DDR_BUFFER_SIZE);
+			// time to change DDR buffer and send MSG to Linux, T: end of the DMA in us
+			PROF_START(PROF_SDB_FORMAT);
+			sprintf(mSdbBuffTx, "B%dL%08xT%08lx", mArrayDdrBuffIndex, SAMP_DDR_BUFFER_SIZE,
+			        (unsigned long)CM4_CyclesToUs(mDdrDoneCycles));
+			PROF_STOP(PROF_SDB_FORMAT);
+			PROF_START(PROF_SDB_TX);
 			RPMSG_HDR_Transmit(&hsdb0, (uint8_t*)mSdbBuffTx, strlen(mSdbBuffTx));
+			PROF_STOP(PROF_SDB_TX);
 
 			mArrayDdrBuffIndex++;
 			if (mArrayDdrBuffIndex == mArrayDdrBuffCount) {
@@ -304,7 +401,9 @@ void CoproSync_ShutdownCb(IPCC_HandleTypeDef * hipcc, uint32_t ChannelIndex, IPC
 
 void DMA2_Stream1_IRQHandler(void)
 {
+  PROF_START(PROF_DMA_IRQ);
   HAL_DMA_IRQHandler(&hdma_memtomem_dma2_stream1);
+  PROF_STOP(PROF_DMA_IRQ);
 }
 /* USER CODE END 0 */
 
@@ -324,7 +423,8 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  /* unbuffered: newlib would allocate the stdout buffer on the heap */
+  setvbuf(stdout, NULL, _IONBF, 0);
   /* USER CODE END Init */
 
   if(IS_ENGINEERING_BOOT_MODE())
@@ -341,7 +441,12 @@ int main(void)
   }
 
   /* USER CODE BEGIN SysInit */
-
+  log_evt_init();
+  /* the cycle counter also times the probes and the SDB completions */
+  PROF_CYCLES_INIT();
+  PROF_INIT();
+  STS_Init(STS_LVL_WARN);
+  OPENAMP_pools_report();
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
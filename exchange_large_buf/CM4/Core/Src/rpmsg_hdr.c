@@ -54,6 +54,8 @@
 /* Private variables ---------------------------------------------------------*/
 static RPMSG_HDR_DdrBuffTypeDef mArrayDdrBuff[MAX_DDR_BUFF];  // static array to save DdrBuff @ and size
 static uint8_t mArrayDdrBuffCount;
+static uint8_t mFragBuff[RPMSG_BUFFER_SIZE];  // fragment being sent, header then payload
+static uint8_t mFragId;
 
 static int RPMSG_HDR_read_cb(struct rpmsg_endpoint *ept, void *data,
 			    size_t len, uint32_t src, void *priv)
@@ -118,14 +120,45 @@ RPMSG_HDR_StatusTypeDef RPMSG_HDR_RegisterCallback(RPMSG_HDR_HandleTypeDef *hdr,
 
 RPMSG_HDR_StatusTypeDef RPMSG_HDR_Transmit(RPMSG_HDR_HandleTypeDef *hdr, uint8_t *pData, uint16_t Size)
 {
+	RPMSG_HDR_FragTypeDef *frag = (RPMSG_HDR_FragTypeDef *)mFragBuff;
+	int max = OPENAMP_get_buffer_size();
+	uint32_t chunk, count, index;
 	int res;
 
-	if (Size > (RPMSG_BUFFER_SIZE-16))
+	/* One buffer, and not taken for a fragment by the driver: sent as it is */
+	if (Size <= max && (Size == 0 || pData[0] != RPMSG_HDR_FRAG_MAGIC)) {
+		res = OPENAMP_send(&hdr->ept, pData, Size);
+		if (res <0) {
+			return RPMSG_HDR_ERROR;
+		}
+		return RPMSG_HDR_OK;
+	}
+
+	/* Otherwise in fragments, each one with its header in front */
+	if (max > (int)sizeof(mFragBuff))
+	  max = sizeof(mFragBuff);
+	if (max <= (int)sizeof(*frag))
+	  return RPMSG_HDR_ERROR;
+	chunk = max - sizeof(*frag);
+	count = (Size + chunk - 1) / chunk;
+	if (count > RPMSG_HDR_FRAG_MAX)
 	  return RPMSG_HDR_ERROR;
 
-	res = OPENAMP_send(&hdr->ept, pData, Size);
-	if (res <0) {
-		return RPMSG_HDR_ERROR;
+	frag->magic = RPMSG_HDR_FRAG_MAGIC;
+	frag->id = mFragId++;
+	frag->total = Size;
+	frag->reserved = 0;
+	for (index = 0; index < count; index++) {
+		uint32_t len = (index == count - 1) ? Size - index * chunk : chunk;
+
+		frag->index = index;
+		frag->flags = (index == count - 1) ? RPMSG_HDR_FRAG_LAST : 0;
+		memcpy(mFragBuff + sizeof(*frag), pData + index * chunk, len);
+		/* the driver drops the whole message if a fragment is missing */
+		res = OPENAMP_send(&hdr->ept, mFragBuff, sizeof(*frag) + len);
+		if (res <0) {
+			return RPMSG_HDR_ERROR;
+		}
 	}
 
 	return RPMSG_HDR_OK;
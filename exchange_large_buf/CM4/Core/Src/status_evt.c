@@ -0,0 +1,130 @@
+/**
+  ******************************************************************************
+  * @file    status_evt.c
+  * @brief   Binary status events sent to Linux over the virtual UART.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "status_evt.h"
+
+/* Private variables ---------------------------------------------------------*/
+static STS_EventTypeDef sts_queue[STS_QUEUE_SIZE];
+static volatile uint32_t sts_head;     /* written by the producers */
+static volatile uint32_t sts_tail;     /* written by the consumer  */
+static volatile uint32_t sts_dropped;
+static uint32_t sts_dropped_peeked;    /* drop count reported by the last peek */
+static volatile uint8_t sts_level = STS_LVL_WARN;
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Empty the queue and set the verbosity
+  * @param  level: highest level that is queued
+  * @retval None
+  */
+void STS_Init(uint8_t level)
+{
+  sts_head = 0;
+  sts_tail = 0;
+  sts_dropped = 0;
+  sts_dropped_peeked = 0;
+  sts_level = level;
+}
+
+void STS_SetLevel(uint8_t level)
+{
+  sts_level = level;
+}
+
+uint8_t STS_GetLevel(void)
+{
+  return sts_level;
+}
+
+/**
+  * @brief  Queue an event if its level is enabled
+  * @note   Can be called from thread and IRQ context
+  * @param  level: level of the record, or'ed with STS_FORCE to skip the
+  *         verbosity filter
+  * @retval 1 if queued, 0 if filtered out, -1 if the queue is full
+  */
+int STS_Post(uint8_t level, uint16_t code, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+{
+  STS_EventTypeDef *evt;
+  uint8_t force = level & STS_FORCE;
+  uint32_t key;
+
+  level &= ~STS_FORCE;
+  if (level == STS_LVL_NONE || (!force && level > sts_level))
+    return 0;
+
+  STS_LOCK(key);
+  if (sts_head - sts_tail >= STS_QUEUE_SIZE) {
+    sts_dropped++;
+    STS_UNLOCK(key);
+    return -1;
+  }
+  evt = &sts_queue[sts_head & (STS_QUEUE_SIZE - 1)];
+  evt->sync = STS_SYNC;
+  evt->level = level;
+  evt->code = code;
+  evt->arg[0] = arg0;
+  evt->arg[1] = arg1;
+  evt->arg[2] = arg2;
+  sts_head++;
+  STS_UNLOCK(key);
+
+  return 1;
+}
+
+/**
+  * @brief  Copy the oldest queued events without removing them
+  * @note   Only one consumer is supported. Lost events are reported first
+  *         with a STS_EVT_DROPPED record.
+  * @param  evt: destination array
+  * @param  max: size of the array
+  * @retval number of events copied
+  */
+int STS_Peek(STS_EventTypeDef *evt, int max)
+{
+  uint32_t tail = sts_tail, head = sts_head;
+  int nb = 0;
+
+  sts_dropped_peeked = 0;
+  if (max > 0 && sts_dropped) {
+    sts_dropped_peeked = sts_dropped;
+    evt[nb].sync = STS_SYNC;
+    evt[nb].level = STS_LVL_WARN;
+    evt[nb].code = STS_EVT_DROPPED;
+    evt[nb].arg[0] = sts_dropped_peeked;
+    evt[nb].arg[1] = 0;
+    evt[nb].arg[2] = 0;
+    nb++;
+  }
+
+  for (; nb < max && tail != head; nb++, tail++)
+    evt[nb] = sts_queue[tail & (STS_QUEUE_SIZE - 1)];
+
+  return nb;
+}
+
+/**
+  * @brief  Remove events returned by STS_Peek() once they are sent
+  * @param  nb: value returned by STS_Peek()
+  * @retval None
+  */
+void STS_Consume(int nb)
+{
+  uint32_t key;
+
+  if (nb > 0 && sts_dropped_peeked) {
+    /* the producers may have dropped more since the peek, keep those */
+    STS_LOCK(key);
+    sts_dropped -= sts_dropped_peeked;
+    STS_UNLOCK(key);
+    sts_dropped_peeked = 0;
+    nb--;
+  }
+  sts_tail += nb;
+}
@@ -34,6 +34,7 @@
 #include "openamp/open_amp.h"
 #include "stm32mp1xx_hal.h"
 #include "openamp_conf.h"
+#include "cm4_prof.h"
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN Define */
@@ -107,7 +108,7 @@ int MAILBOX_Poll(struct virtio_device *vdev)
   int ret = -1;
 
    /* USER CODE BEGIN PRE_MAILBOX_POLL */
-
+  PROF_START(PROF_MAILBOX_POLL);
    /* USER CODE END  PRE_MAILBOX_POLL */
 
   if (msg_received_ch1 == RX_BUF_FREE) {
@@ -130,7 +131,9 @@ int MAILBOX_Poll(struct virtio_device *vdev)
    /* USER CODE END  MSG_CHANNEL2 */
 
     OPENAMP_log_dbg("Running virt1 (ch_2 new msg)\r\n");
+    PROF_START(PROF_RPMSG_RX);
     rproc_virtio_notified(vdev, VRING1_ID);
+    PROF_STOP(PROF_RPMSG_RX);
     msg_received_ch2 = RX_NO_MSG;
 
     /* The OpenAMP framework does not notify for free buf: do it here */
@@ -140,7 +143,10 @@ int MAILBOX_Poll(struct virtio_device *vdev)
   }
 
   /* USER CODE BEGIN POST_MAILBOX_POLL */
-
+  /* idle polls are not accounted */
+  if (ret == 0) {
+    PROF_STOP(PROF_MAILBOX_POLL);
+  }
   /* USER CODE END  POST_MAILBOX_POLL */
 
   return ret;
@@ -166,7 +172,7 @@ int MAILBOX_Notify(void *priv, uint32_t id)
     OPENAMP_log_dbg("Send msg on ch_1\r\n");
   }
   else if (id == VRING1_ID) {
-    /* Note: the OpenAMP framework never notifies this */
+    /* Rx buffers returned, only when the master waits for them */
     channel = IPCC_CHANNEL_2;
     OPENAMP_log_dbg("Send 'buff free' on ch_2\r\n");
   }
@@ -24,7 +24,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-
+#include <stddef.h>
 /* USER CODE END Includes */
 
 /* Private define ------------------------------------------------------------*/
@@ -34,6 +34,18 @@
 
 #define SHM_DEVICE_NAME         "STM32_SHM"
 
+#if (VRING_NUM_BUFFS == 0) || (VRING_NUM_BUFFS & (VRING_NUM_BUFFS - 1))
+#error "VRING_NUM_BUFFS must be a power of 2"
+#endif
+
+#if VRING_SIZE(VRING_NUM_BUFFS, VRING_ALIGNMENT) > VRING_REGION_SIZE
+#error "VRING_NUM_BUFFS does not fit in the vring region"
+#endif
+
+#if (2 * VRING_NUM_BUFFS * RPMSG_BUFFER_SIZE) > VRING_BUFF_REGION_SIZE
+#error "VRING_NUM_BUFFS * RPMSG_BUFFER_SIZE does not fit in the vdev buffer region"
+#endif
+
 /* Private macro -------------------------------------------------------------*/
 /* USER CODE BEGIN PM */
 
@@ -51,6 +63,7 @@ static struct rpmsg_virtio_shm_pool shpool;
 static struct rpmsg_virtio_device rvdev;
 
 static metal_phys_addr_t shm_physmap;
+static int rpmsg_payload_size = RPMSG_BUFFER_SIZE - 16; /* minus rpmsg header */
 
 struct metal_device shm_device = {
   .name = SHM_DEVICE_NAME,
@@ -64,11 +77,61 @@ struct metal_device shm_device = {
   .irq_info = NULL
 };
 
+#ifdef METAL_ALLOC_POOLS
+/*
+ * What OpenAMP allocates with metal_allocate_memory(), a pool per type:
+ * the remoteproc vdev, its vring info array and a virtqueue per vring,
+ * with a descriptor list on the master side only.
+ */
+#ifdef VIRTIO_SLAVE_ONLY
+#define VQ_DESC_EXTRA           0
+#else
+#define VQ_DESC_EXTRA           VRING_NUM_BUFFS
+#endif
+
+METAL_ALLOC_POOL_MEM(rpvdev_mem, sizeof(struct remoteproc_virtio), 1);
+METAL_ALLOC_POOL_MEM(vrings_info_mem, VRING_COUNT * sizeof(struct virtio_vring_info), 1);
+METAL_ALLOC_POOL_MEM(vq_mem, sizeof(struct virtqueue) +
+                     VQ_DESC_EXTRA * sizeof(struct vq_desc_extra), VRING_COUNT);
+
+struct metal_alloc_pool metal_alloc_pools[] = {
+  METAL_ALLOC_POOL("rpvdev", rpvdev_mem),
+  METAL_ALLOC_POOL("vrings_info", vrings_info_mem),
+  METAL_ALLOC_POOL("virtqueue", vq_mem),
+};
+const unsigned int metal_alloc_pools_num =
+  sizeof(metal_alloc_pools) / sizeof(metal_alloc_pools[0]);
+#endif /* METAL_ALLOC_POOLS */
+
 /* Private functions ---------------------------------------------------------*/
 /* USER CODE BEGIN PFP */
 
 /* USER CODE END PFP */
 
+/* Check that a vring allocated by the master lies in the shared memory */
+static int OPENAMP_check_vring(struct fw_rsc_vdev_vring *vring_rsc)
+{
+  metal_phys_addr_t start = (metal_phys_addr_t)vring_rsc->da;
+  size_t size;
+
+  if ((vring_rsc->num == 0) || (vring_rsc->num & (vring_rsc->num - 1)))
+  {
+    return -1;
+  }
+
+  size = vring_size(vring_rsc->num, vring_rsc->align);
+  if ((size > VRING_REGION_SIZE) ||
+      (start < SHM_START_ADDRESS) ||
+      (start + size > SHM_START_ADDRESS + SHM_SIZE))
+  {
+    OPENAMP_log_err("vring @0x%lx (%d x %d) out of shared memory\n",
+                    (unsigned long)start, (int)vring_rsc->num, (int)size);
+    return -1;
+  }
+
+  return 0;
+}
+
 static int OPENAMP_shmem_init(int RPMsgRole)
 {
   int status = 0;
@@ -172,6 +235,11 @@ int MX_OPENAMP_Init(int RPMsgRole, rpmsg_ns_bind_cb ns_bind_cb)
 
   /* USER CODE END POST_VIRTIO_INIT */
   vring_rsc = &rsc_table->vring0;
+  status = OPENAMP_check_vring(vring_rsc);
+  if (status != 0)
+  {
+    return status;
+  }
   status = rproc_virtio_init_vring(vdev, 0, vring_rsc->notifyid,
                                    (void *)vring_rsc->da, shm_io,
                                    vring_rsc->num, vring_rsc->align);
@@ -184,6 +252,11 @@ int MX_OPENAMP_Init(int RPMsgRole, rpmsg_ns_bind_cb ns_bind_cb)
 
   /* USER CODE END POST_VRING0_INIT */
   vring_rsc = &rsc_table->vring1;
+  status = OPENAMP_check_vring(vring_rsc);
+  if (status != 0)
+  {
+    return status;
+  }
   status = rproc_virtio_init_vring(vdev, 1, vring_rsc->notifyid,
                                    (void *)vring_rsc->da, shm_io,
                                    vring_rsc->num, vring_rsc->align);
@@ -209,12 +282,15 @@ int MX_OPENAMP_Init(int RPMsgRole, rpmsg_ns_bind_cb ns_bind_cb)
 
 void OPENAMP_DeInit()
 {
+  struct virtio_device *vdev = rvdev.vdev;
 
   /* USER CODE BEGIN PRE_OPENAMP_DEINIT */
 
   /* USER CODE END PRE_OPENAMP_DEINIT */
 
   rpmsg_deinit_vdev(&rvdev);
+  /* the next MX_OPENAMP_Init() takes the same blocks again */
+  rproc_virtio_remove_vdev(vdev);
 
   metal_finish();
 
@@ -223,6 +299,25 @@ void OPENAMP_DeInit()
   /* USER CODE END POST_OPENAMP_DEINIT */
 }
 
+void OPENAMP_pools_report(void)
+{
+  extern uint8_t _end;
+  extern void *_sbrk(ptrdiff_t incr);
+#ifdef METAL_ALLOC_POOLS
+  unsigned int i;
+
+  for (i = 0; i < metal_alloc_pools_num; i++)
+  {
+    OPENAMP_log_info("metal pool %s: %u/%u blocks of %u bytes, high water %u, %u failed\n",
+                     metal_alloc_pools[i].name, metal_alloc_pools[i].used,
+                     metal_alloc_pools[i].count, metal_alloc_pools[i].size,
+                     metal_alloc_pools[i].high_water, metal_alloc_pools[i].fails);
+  }
+#endif /* METAL_ALLOC_POOLS */
+  OPENAMP_log_info("heap: %u bytes\n",
+                   (unsigned int)((uint8_t *)_sbrk(0) - &_end));
+}
+
 void OPENAMP_init_ept(struct rpmsg_endpoint *ept)
 {
   /* USER CODE BEGIN PRE_EP_INIT */
@@ -254,6 +349,23 @@ int OPENAMP_create_endpoint(struct rpmsg_endpoint *ept, const char *name,
   return ret;
 }
 
+int OPENAMP_get_buffer_size(void)
+{
+  int size = rpmsg_virtio_get_buffer_size(&rvdev.rdev);
+
+  /*
+   * The size is read from the next available descriptor, which is 0 when all
+   * the buffers are in use: keep the last value seen as the master provides
+   * buffers of the same size.
+   */
+  if (size > 0)
+  {
+    rpmsg_payload_size = size;
+  }
+
+  return rpmsg_payload_size;
+}
+
 void OPENAMP_check_for_message(void)
 {
   /* USER CODE BEGIN MSG_CHECK */
@@ -66,6 +66,9 @@ int MX_OPENAMP_Init(int RPMsgRole, rpmsg_ns_bind_cb ns_bind_cb);
 /* Deinitialize the openamp framework*/
 void OPENAMP_DeInit(void);
 
+/* Log the libmetal pools and the heap in use */
+void OPENAMP_pools_report(void);
+
 /* Initialize the endpoint struct*/
 void OPENAMP_init_ept(struct rpmsg_endpoint *ept);
 
@@ -74,6 +77,9 @@ int OPENAMP_create_endpoint(struct rpmsg_endpoint *ept, const char *name,
                             uint32_t dest, rpmsg_ept_cb cb,
                             rpmsg_ns_unbind_cb unbind_cb);
 
+/* Get the payload size of the rpmsg buffers provided by the master */
+int OPENAMP_get_buffer_size(void);
+
 /* Check for new rpmsg reception */
 void OPENAMP_check_for_message(void);
 
@@ -51,6 +51,8 @@
   */
 #if defined (__LOG_TRACE_IO_)
 #define SYSTEM_TRACE_BUF_SZ 2048
+#define SYSTEM_EVT_NB_REC   64          /* must be a power of 2 */
+#define SYSTEM_EVT_MAGIC    0x45564d34  /* "4MVE" */
 #endif
 
 #define LOGQUIET 0
@@ -72,6 +74,28 @@
   */
 #if defined (__LOG_TRACE_IO_)
 extern char system_log_buf[SYSTEM_TRACE_BUF_SZ]; /*!< buffer for debug traces */
+
+/* Binary event record, formatted on Linux side by the cm4_trace tool */
+typedef struct
+{
+  volatile uint32_t seq;       /*!< index of the record, written last */
+  uint32_t ts;                 /*!< DWT cycle counter when logged */
+  uint16_t id;                 /*!< event id */
+  uint16_t nargs;              /*!< number of valid args */
+  uint32_t args[4];
+} log_evt_rec_t;
+
+/* Event ring published in the resource table as "cm4_evt" trace */
+typedef struct
+{
+  uint32_t magic;              /*!< SYSTEM_EVT_MAGIC */
+  uint32_t rec_size;           /*!< sizeof(log_evt_rec_t) */
+  uint32_t nb_rec;             /*!< SYSTEM_EVT_NB_REC */
+  volatile uint32_t head;      /*!< number of records ever written */
+  log_evt_rec_t rec[SYSTEM_EVT_NB_REC];
+} log_evt_ring_t;
+
+extern log_evt_ring_t system_evt_ring; /*!< ring for binary events */
 #endif /* __LOG_TRACE_IO_ */
 /**
   * @}
@@ -107,6 +131,22 @@ extern char system_log_buf[SYSTEM_TRACE_BUF_SZ]; /*!< buffer for debug traces */
 #define log_warn(fmt, ...)
 #define log_err(fmt, ...)
 #endif /* __LOG_TRACE_IO_ */
+
+/* Binary events: a few stores instead of a printf, meant for the hot path */
+#if defined (__LOG_TRACE_IO_)
+#define log_evt0(id)                 log_evt((id), 0, 0, 0, 0, 0)
+#define log_evt1(id, a)              log_evt((id), 1, (a), 0, 0, 0)
+#define log_evt2(id, a, b)           log_evt((id), 2, (a), (b), 0, 0)
+#define log_evt3(id, a, b, c)        log_evt((id), 3, (a), (b), (c), 0)
+#define log_evt4(id, a, b, c, d)     log_evt((id), 4, (a), (b), (c), (d))
+#else
+#define log_evt_init()
+#define log_evt0(id)
+#define log_evt1(id, a)
+#define log_evt2(id, a, b)
+#define log_evt3(id, a, b, c)
+#define log_evt4(id, a, b, c, d)
+#endif /* __LOG_TRACE_IO_ */
 /**
   * @}
   */
@@ -114,6 +154,11 @@ extern char system_log_buf[SYSTEM_TRACE_BUF_SZ]; /*!< buffer for debug traces */
 /** @addtogroup STM32MP1xx_Log_Exported_Functions
   * @{
   */
+#if defined (__LOG_TRACE_IO_)
+void log_evt_init(void);
+void log_evt(uint16_t id, uint16_t nargs, uint32_t a0, uint32_t a1,
+             uint32_t a2, uint32_t a3);
+#endif /* __LOG_TRACE_IO_ */
 
 /**
   * @}
@@ -38,6 +38,7 @@
 #endif
 #include "rsc_table.h"
 #include "openamp/open_amp.h"
+#include "cm4_prof.h"
 
 /**
   * @}
@@ -71,14 +72,30 @@
  #define CONST
 #endif
 
-#define RPMSG_IPU_C0_FEATURES       1
+#if RPMSG_EVENT_IDX
+#define RPMSG_IPU_C0_FEATURES       ((1 << VIRTIO_RPMSG_F_NS) | VIRTIO_RING_F_EVENT_IDX)
+#else
+#define RPMSG_IPU_C0_FEATURES       (1 << VIRTIO_RPMSG_F_NS)
+#endif
 #define VRING_COUNT         		2
 
 /* VirtIO rpmsg device id */
 #define VIRTIO_ID_RPMSG_            7
 
+#if defined (__LOG_TRACE_IO_)
+#define RSC_NUM_LOG                 2
+#else
+#define RSC_NUM_LOG                 0
+#endif
+#if defined (__PROF_CYCLES_)
+#define RSC_NUM_PROF                1
+#else
+#define RSC_NUM_PROF                0
+#endif
+
 #if defined (__LOG_TRACE_IO_)
 extern char system_log_buf[];
+extern log_evt_ring_t system_evt_ring;
 #endif
 
 #if defined(__GNUC__)
@@ -97,15 +114,17 @@ __root CONST struct shared_resource_table resource_table @ ".resource_table" = {
 
 #if defined(__ICCARM__) || defined (__CC_ARM) || defined (LINUX_RPROC_MASTER)
 	.version = 1,
-#if defined (__LOG_TRACE_IO_)
-	.num = 2,
-#else
-	.num = 1,
-#endif
+	.num = 1 + RSC_NUM_LOG + RSC_NUM_PROF,
 	.reserved = {0, 0},
 	.offset = {
 		offsetof(struct shared_resource_table, vdev),
+#if defined (__LOG_TRACE_IO_)
 		offsetof(struct shared_resource_table, cm_trace),
+		offsetof(struct shared_resource_table, cm_evt),
+#endif
+#if defined (__PROF_CYCLES_)
+		offsetof(struct shared_resource_table, cm_prof),
+#endif
 	},
 
 	/* Virtio device entry */
@@ -123,6 +142,16 @@ __root CONST struct shared_resource_table resource_table @ ".resource_table" = {
 		RSC_TRACE,
 		(uint32_t)system_log_buf, SYSTEM_TRACE_BUF_SZ, 0, "cm4_log",
 	},
+	.cm_evt = {
+		RSC_TRACE,
+		(uint32_t)&system_evt_ring, sizeof(system_evt_ring), 0, "cm4_evt",
+	},
+#endif
+#if defined (__PROF_CYCLES_)
+	.cm_prof = {
+		RSC_TRACE,
+		(uint32_t)&prof_stats, sizeof(prof_stats), 0, "cm4_prof",
+	},
 #endif
 } ;
 #endif
@@ -39,6 +39,8 @@ struct shared_resource_table {
 	struct fw_rsc_vdev_vring vring0;
 	struct fw_rsc_vdev_vring vring1;
 		struct fw_rsc_trace cm_trace;
+		struct fw_rsc_trace cm_evt;
+		struct fw_rsc_trace cm_prof;
 };
 
 /* USER CODE END ET */
@@ -22,6 +22,44 @@
 extern "C" {
 #endif
 
+#ifdef METAL_ALLOC_POOLS
+
+/**
+ * Pool of blocks of one size. With METAL_ALLOC_POOLS the application
+ * defines metal_alloc_pools[], a pool per type of object, and
+ * metal_allocate_memory() takes a block of the smallest pool that fits,
+ * or of a larger one when it is empty: no heap, and the same blocks on
+ * each start. See generic/generic_alloc.c.
+ */
+struct metal_alloc_pool {
+	const char *name;
+	unsigned int size;		/**< bytes per block */
+	unsigned int count;		/**< blocks */
+	void *mem;			/**< count blocks */
+	unsigned int carved;		/**< blocks handed out at least once */
+	void *free;			/**< blocks given back */
+	unsigned int used;		/**< blocks in use */
+	unsigned int high_water;	/**< most blocks in use */
+	unsigned int fails;		/**< requests of its size left unserved */
+};
+
+/** Storage of a pool: count blocks of size bytes, 8 byte aligned. */
+#define METAL_ALLOC_POOL_MEM(var, size, count) \
+	static unsigned long long var[count][((size) + 7) / 8]
+
+/** Entry of metal_alloc_pools[] for the storage var. */
+#define METAL_ALLOC_POOL(name, var) \
+	{ (name), sizeof((var)[0]), sizeof(var) / sizeof((var)[0]), (var), \
+	  0, NULL, 0, 0, 0 }
+
+extern struct metal_alloc_pool metal_alloc_pools[];
+extern const unsigned int metal_alloc_pools_num;
+
+void *metal_allocate_memory(unsigned int size);
+void metal_free_memory(void *ptr);
+
+#else
+
 static inline void *metal_allocate_memory(unsigned int size)
 {
 	return (malloc(size));
@@ -32,6 +70,8 @@ static inline void metal_free_memory(void *ptr)
 	free(ptr);
 }
 
+#endif /* METAL_ALLOC_POOLS */
+
 #ifdef __cplusplus
 }
 #endif
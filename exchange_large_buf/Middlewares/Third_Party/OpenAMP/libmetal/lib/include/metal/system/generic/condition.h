@@ -23,6 +23,7 @@
 #include <stdint.h>
 #include <limits.h>
 #include <metal/errno.h>
+#include <metal/sys.h>
 
 
 
@@ -56,6 +57,7 @@ static inline int metal_condition_signal(struct metal_condition *cv)
 
 	/** wake up waiters if there are any. */
 	atomic_fetch_add(&cv->v, 1);
+	metal_generic_default_wake();
 	return 0;
 }
 
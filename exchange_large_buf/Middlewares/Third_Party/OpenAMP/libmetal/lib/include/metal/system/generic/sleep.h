@@ -16,7 +16,7 @@
 #ifndef __METAL_GENERIC_SLEEP__H__
 #define __METAL_GENERIC_SLEEP__H__
 
-#include <metal/utilities.h>
+#include <metal/sys.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,9 +24,7 @@ extern "C" {
 
 static inline int __metal_sleep_usec(unsigned int usec)
 {
-	metal_unused(usec);
-	/* Fix me */
-	return 0;
+	return metal_generic_default_sleep_usec(usec);
 }
 
 /** @} */
@@ -10,14 +10,11 @@
  */
 
 #include <metal/condition.h>
-#include <metal/irq.h>
-
-extern void metal_generic_default_poll(void);
+#include <metal/sys.h>
 
 int metal_condition_wait(struct metal_condition *cv,
 			 metal_mutex_t *m)
 {
-	metal_mutex_t *tmpm = 0;
 	int v;
 	unsigned int flags;
 
@@ -25,23 +22,33 @@ int metal_condition_wait(struct metal_condition *cv,
 	if (!cv || !m || !metal_mutex_is_acquired(m))
 		return -EINVAL;
 
-	if (!atomic_compare_exchange_strong(&cv->m->v, &tmpm->v, m->v)) {
-		if (m != tmpm)
-			return -EINVAL;
+	/* Attached to the mutex of the first waiter, the others must share it */
+	flags = sys_irq_save_disable();
+	if (!cv->m)
+		cv->m = m;
+	if (cv->m != m) {
+		sys_irq_restore_enable(flags);
+		return -EINVAL;
 	}
+	sys_irq_restore_enable(flags);
 
 	v = atomic_load(&cv->v);
 
 	/* Release the mutex first. */
 	metal_mutex_release(m);
 	do {
-		flags = metal_irq_save_disable();
+		/*
+		 * Checked and waited for with the interrupts disabled: a signal
+		 * from a handler after the check still ends the poll, the
+		 * handler runs once they are enabled again.
+		 */
+		flags = sys_irq_save_disable();
 		if (atomic_load(&cv->v) != v) {
-			metal_irq_restore_enable(flags);
+			sys_irq_restore_enable(flags);
 			break;
 		}
 		metal_generic_default_poll();
-		metal_irq_restore_enable(flags);
+		sys_irq_restore_enable(flags);
 	} while(1);
 	/* Acquire the mutex again. */
 	metal_mutex_acquire(m);
@@ -34,16 +34,37 @@
  */
 
 
+#include <stdint.h>
+
 #include "metal/io.h"
 #include "metal/sys.h"
 
+/* ARMv7-M system control space */
+#define SCB_SCR			(*(volatile uint32_t *)0xE000ED10UL)
+#define SCB_SCR_SEVONPEND	(1UL << 4)
+#define SYST_CSR		(*(volatile uint32_t *)0xE000E010UL)
+#define SYST_CSR_RUNNING	(7UL)	/* ENABLE | TICKINT | CLKSOURCE core */
+#define SYST_RVR		(*(volatile uint32_t *)0xE000E014UL)
+#define DEMCR			(*(volatile uint32_t *)0xE000EDFCUL)
+#define DEMCR_TRCENA		(1UL << 24)
+#define DWT_CTRL		(*(volatile uint32_t *)0xE0001000UL)
+#define DWT_CTRL_CYCCNTENA	(1UL << 0)
+#define DWT_CYCCNT		(*(volatile uint32_t *)0xE0001004UL)
+
+/* CMSIS core clock, see SystemCoreClockUpdate() */
+extern uint32_t SystemCoreClock;
+
 void sys_irq_restore_enable(unsigned int flags)
 {
+	__asm volatile ("msr primask, %0" : : "r" (flags) : "memory");
 }
 
 unsigned int sys_irq_save_disable(void)
 {
-  return 0;
+	unsigned int flags;
+
+	__asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (flags) : : "memory");
+	return flags;
 }
 
 void metal_machine_cache_flush(void *addr, unsigned int len)
@@ -60,9 +81,56 @@ void metal_machine_cache_invalidate(void *addr, unsigned int len)
 
 /**
  * @brief poll function until some event happens
+ *
+ * WFE with SEVONPEND: an interrupt becoming pending wakes the core even
+ * when PRIMASK masks it, so metal_condition_wait() can check and wait
+ * with the interrupts disabled.
  */
 void __attribute__((weak)) metal_generic_default_poll(void)
 {
+	SCB_SCR |= SCB_SCR_SEVONPEND;
+	__asm volatile ("dsb\n\twfe" : : : "memory");
+}
+
+/**
+ * @brief wake up the pollers: SEV sets the event register
+ */
+void __attribute__((weak)) metal_generic_default_wake(void)
+{
+	__asm volatile ("dsb\n\tsev" : : : "memory");
+}
+
+/**
+ * @brief wait for usec microseconds on the DWT cycle counter
+ *
+ * The elapsed cycles are summed, so waits longer than a CYCCNT wrap are
+ * right too. While more than a SysTick period is left and the tick
+ * interrupt can run, the core sleeps in WFE: the next tick wakes it.
+ */
+int __attribute__((weak)) metal_generic_default_sleep_usec(unsigned int usec)
+{
+	uint64_t cycles = (uint64_t)usec * (SystemCoreClock / 1000000U);
+	uint64_t elapsed = 0;
+	uint32_t last, now, primask;
+	int ticking;
+
+	if (!(DWT_CTRL & DWT_CTRL_CYCCNTENA)) {
+		DEMCR |= DEMCR_TRCENA;
+		DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	}
+	__asm volatile ("mrs %0, primask" : "=r" (primask));
+	ticking = !primask && (SYST_CSR & SYST_CSR_RUNNING) == SYST_CSR_RUNNING;
+
+	last = DWT_CYCCNT;
+	while (elapsed < cycles) {
+		if (ticking && cycles - elapsed > (uint64_t)SYST_RVR + 1)
+			__asm volatile ("wfe" : : : "memory");
+		now = DWT_CYCCNT;
+		elapsed += now - last;
+		last = now;
+	}
+
+	return 0;
 }
 
 void *metal_machine_io_mem_map(void *va, metal_phys_addr_t pa,
@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * @file	generic/generic_alloc.c
+ * @brief	Static pools behind metal_allocate_memory().
+ */
+
+#include <metal/alloc.h>
+#include <metal/assert.h>
+#include <metal/sys.h>
+
+#ifdef METAL_ALLOC_POOLS
+
+static struct metal_alloc_pool *metal_alloc_pool_of(void *ptr)
+{
+	struct metal_alloc_pool *pool;
+	unsigned int i;
+
+	for (i = 0; i < metal_alloc_pools_num; i++) {
+		pool = &metal_alloc_pools[i];
+		if ((char *)ptr >= (char *)pool->mem &&
+		    (char *)ptr < (char *)pool->mem + pool->size * pool->count)
+			return pool;
+	}
+
+	return NULL;
+}
+
+void *metal_allocate_memory(unsigned int size)
+{
+	struct metal_alloc_pool *pool, *fit = NULL, *best = NULL;
+	void *block = NULL;
+	unsigned int i, flags;
+
+	flags = sys_irq_save_disable();
+	for (i = 0; i < metal_alloc_pools_num; i++) {
+		pool = &metal_alloc_pools[i];
+		if (pool->size < size)
+			continue;
+		/* The pool of the object type: the smallest that fits */
+		if (!fit || pool->size < fit->size)
+			fit = pool;
+		/* A larger one when it is empty */
+		if ((pool->free || pool->carved < pool->count) &&
+		    (!best || pool->size < best->size))
+			best = pool;
+	}
+
+	if (best) {
+		if (best->free) {
+			block = best->free;
+			best->free = *(void **)block;
+		} else {
+			block = (char *)best->mem + best->carved++ * best->size;
+		}
+		if (++best->used > best->high_water)
+			best->high_water = best->used;
+	} else if (fit) {
+		fit->fails++;
+	}
+	sys_irq_restore_enable(flags);
+
+	return block;
+}
+
+void metal_free_memory(void *ptr)
+{
+	struct metal_alloc_pool *pool;
+	unsigned int flags;
+
+	if (!ptr)
+		return;
+	pool = metal_alloc_pool_of(ptr);
+	metal_assert(pool && ((char *)ptr - (char *)pool->mem) % pool->size == 0);
+	if (!pool)
+		return;
+
+	flags = sys_irq_save_disable();
+	*(void **)ptr = pool->free;
+	pool->free = ptr;
+	pool->used--;
+	sys_irq_restore_enable(flags);
+}
+
+#endif /* METAL_ALLOC_POOLS */
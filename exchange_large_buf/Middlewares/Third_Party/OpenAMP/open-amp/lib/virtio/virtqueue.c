@@ -7,6 +7,7 @@
 
 #include <string.h>
 #include <openamp/virtqueue.h>
+#include <openamp/virtio.h>
 #include <metal/atomic.h>
 #include <metal/log.h>
 #include <metal/alloc.h>
@@ -21,6 +22,21 @@ static void vq_ring_free_chain(struct virtqueue *, uint16_t);
 static int vq_ring_must_notify_host(struct virtqueue *vq);
 static void vq_ring_notify_host(struct virtqueue *vq);
 static int virtqueue_nused(struct virtqueue *vq);
+static int virtqueue_navail(struct virtqueue *vq);
+static int vq_ring_event_rearm(struct virtqueue *vq);
+
+/*
+ * The driver (master) adds to the avail ring and takes from the used ring,
+ * the device (slave) does the opposite: the notification fields a side
+ * writes and reads depend on its role.
+ */
+#if defined(VIRTIO_SLAVE_ONLY)
+#define VQ_IS_DEVICE(vq)	1
+#elif defined(VIRTIO_MASTER_ONLY)
+#define VQ_IS_DEVICE(vq)	0
+#else
+#define VQ_IS_DEVICE(vq)	((vq)->vq_dev->role == VIRTIO_DEV_SLAVE)
+#endif
 
 /* Default implementation of P2V based on libmetal */
 static inline void *virtqueue_phys_to_virt(struct virtqueue *vq,
@@ -77,6 +93,8 @@ int virtqueue_create(struct virtio_device *virt_dev, unsigned short id,
 		vq->vq_free_cnt = vq->vq_nentries;
 		vq->callback = callback;
 		vq->notify = notify;
+		if (virt_dev->features & VIRTIO_RING_F_EVENT_IDX)
+			vq->vq_flags |= VIRTQUEUE_FLAG_EVENT_IDX;
 
 		/* Initialize vring control block in virtqueue. */
 		vq_ring_init(vq, (void *)ring->vaddr, ring->align);
@@ -173,7 +191,10 @@ void *virtqueue_get_buffer(struct virtqueue *vq, uint32_t *len, uint16_t *idx)
 	void *cookie;
 	uint16_t used_idx, desc_idx;
 
-	if (!vq || vq->vq_used_cons_idx == vq->vq_ring.used->idx)
+	if (!vq)
+		return (NULL);
+	if (vq->vq_used_cons_idx == vq->vq_ring.used->idx &&
+	    !vq_ring_event_rearm(vq))
 		return (NULL);
 
 	VQUEUE_BUSY(vq);
@@ -240,7 +261,8 @@ void *virtqueue_get_available_buffer(struct virtqueue *vq, uint16_t *avail_idx,
 	void *buffer;
 
 	atomic_thread_fence(memory_order_seq_cst);
-	if (vq->vq_available_idx == vq->vq_ring.avail->idx) {
+	if (vq->vq_available_idx == vq->vq_ring.avail->idx &&
+	    !vq_ring_event_rearm(vq)) {
 		return NULL;
 	}
 
@@ -287,6 +309,9 @@ int virtqueue_add_consumed_buffer(struct virtqueue *vq, uint16_t head_idx,
 
 	vq->vq_ring.used->idx++;
 
+	/* Keep pending count until virtqueue_kick(). */
+	vq->vq_queued_cnt++;
+
 	VQUEUE_IDLE(vq);
 
 	return VQUEUE_SUCCESS;
@@ -314,9 +339,18 @@ void virtqueue_disable_cb(struct virtqueue *vq)
 {
 	VQUEUE_BUSY(vq);
 
+	vq->vq_flags |= VIRTQUEUE_FLAG_NO_CB;
 	if (vq->vq_flags & VIRTQUEUE_FLAG_EVENT_IDX) {
-		vring_used_event(&vq->vq_ring) =
-		    vq->vq_used_cons_idx - vq->vq_nentries - 1;
+		/* An index the peer cannot reach without a full ring */
+		if (VQ_IS_DEVICE(vq))
+			vring_set_avail_event(&vq->vq_ring,
+					      vq->vq_available_idx -
+					      vq->vq_nentries - 1);
+		else
+			vring_used_event(&vq->vq_ring) =
+			    vq->vq_used_cons_idx - vq->vq_nentries - 1;
+	} else if (VQ_IS_DEVICE(vq)) {
+		vq->vq_ring.used->flags |= VRING_USED_F_NO_NOTIFY;
 	} else {
 		vq->vq_ring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
 	}
@@ -533,12 +567,23 @@ static void vq_ring_update_avail(struct virtqueue *vq, uint16_t desc_idx)
  */
 static int vq_ring_enable_interrupt(struct virtqueue *vq, uint16_t ndesc)
 {
+	int pending;
+
+	vq->vq_flags &= ~VIRTQUEUE_FLAG_NO_CB;
+
 	/*
 	 * Enable interrupts, making sure we get the latest index of
 	 * what's already been consumed.
 	 */
 	if (vq->vq_flags & VIRTQUEUE_FLAG_EVENT_IDX) {
-		vring_used_event(&vq->vq_ring) = vq->vq_used_cons_idx + ndesc;
+		if (VQ_IS_DEVICE(vq))
+			vring_set_avail_event(&vq->vq_ring,
+					      vq->vq_available_idx + ndesc);
+		else
+			vring_used_event(&vq->vq_ring) =
+			    vq->vq_used_cons_idx + ndesc;
+	} else if (VQ_IS_DEVICE(vq)) {
+		vq->vq_ring.used->flags &= ~VRING_USED_F_NO_NOTIFY;
 	} else {
 		vq->vq_ring.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
 	}
@@ -550,13 +595,32 @@ static int vq_ring_enable_interrupt(struct virtqueue *vq, uint16_t ndesc)
 	 * since we last checked. Let our caller know so it processes the new
 	 * entries.
 	 */
-	if (virtqueue_nused(vq) > ndesc) {
+	pending = VQ_IS_DEVICE(vq) ? virtqueue_navail(vq) : virtqueue_nused(vq);
+	if (pending > ndesc) {
 		return 1;
 	}
 
 	return 0;
 }
 
+/**
+ *
+ * vq_ring_event_rearm
+ *
+ * With event indexes the peer interrupts once when it crosses the index
+ * we published. A consumer that emptied the ring moves it to where it
+ * stopped, so the next entry interrupts again, and returns 1 if an entry
+ * came in the meantime.
+ */
+static int vq_ring_event_rearm(struct virtqueue *vq)
+{
+	if ((vq->vq_flags & (VIRTQUEUE_FLAG_EVENT_IDX | VIRTQUEUE_FLAG_NO_CB))
+	    != VIRTQUEUE_FLAG_EVENT_IDX)
+		return 0;
+
+	return vq_ring_enable_interrupt(vq, 0);
+}
+
 /**
  *
  * virtqueue_interrupt
@@ -579,13 +643,22 @@ static int vq_ring_must_notify_host(struct virtqueue *vq)
 	uint16_t new_idx, prev_idx, event_idx;
 
 	if (vq->vq_flags & VIRTQUEUE_FLAG_EVENT_IDX) {
-		new_idx = vq->vq_ring.avail->idx;
+		if (VQ_IS_DEVICE(vq)) {
+			new_idx = vq->vq_ring.used->idx;
+			event_idx = vring_used_event(&vq->vq_ring);
+		} else {
+			new_idx = vq->vq_ring.avail->idx;
+			event_idx = vring_avail_event(&vq->vq_ring);
+		}
 		prev_idx = new_idx - vq->vq_queued_cnt;
-		event_idx = vring_avail_event(&vq->vq_ring);
 
 		return (vring_need_event(event_idx, new_idx, prev_idx) != 0);
 	}
 
+	if (VQ_IS_DEVICE(vq))
+		return ((vq->vq_ring.avail->flags &
+			 VRING_AVAIL_F_NO_INTERRUPT) == 0);
+
 	return ((vq->vq_ring.used->flags & VRING_USED_F_NO_NOTIFY) == 0);
 }
 
@@ -616,3 +689,20 @@ static int virtqueue_nused(struct virtqueue *vq)
 
 	return nused;
 }
+
+/**
+ *
+ * virtqueue_navail
+ *
+ */
+static int virtqueue_navail(struct virtqueue *vq)
+{
+	uint16_t avail_idx, navail;
+
+	avail_idx = vq->vq_ring.avail->idx;
+
+	navail = (uint16_t)(avail_idx - vq->vq_available_idx);
+	VQASSERT(vq, navail <= vq->vq_nentries, "avail more than available");
+
+	return navail;
+}
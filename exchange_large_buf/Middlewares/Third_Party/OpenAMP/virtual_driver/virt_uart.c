@@ -116,7 +116,7 @@ VIRT_UART_StatusTypeDef VIRT_UART_Transmit(VIRT_UART_HandleTypeDef *huart, uint8
 {
 	int res;
 
-	if (Size > (RPMSG_BUFFER_SIZE-16))
+	if (Size > OPENAMP_get_buffer_size())
 	  return VIRT_UART_ERROR;
 
 	res = OPENAMP_send(&huart->ept, pData, Size);